@@ -166,6 +166,8 @@ static PSPPROXYIOIF g_ProxyIoIf =
     cmToolProxyIoIfInBufPeek,
     /** pfnInBufRead */
     cmToolProxyIoIfInBufRead,
+    /** pfnLogMsgBatch */
+    NULL
 };
 
 
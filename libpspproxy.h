@@ -84,6 +84,323 @@ typedef PSPPROXYADDR *PPSPPROXYADDR;
 typedef const PSPPROXYADDR *PCPSPPROXYADDR;
 
 
+/**
+ * Log message descriptor used for batched log message delivery.
+ */
+typedef struct PSPPROXYLOGMSG
+{
+    /** The CCD ID the message originated from. */
+    uint32_t                    idCcd;
+    /** Target timestamp in milliseconds of the PDU which started the message. */
+    uint32_t                    tsMillies;
+    /** Length of the message in characters, excluding the terminator. */
+    size_t                      cchMsg;
+    /** The zero terminated message. */
+    const char                  *pszMsg;
+} PSPPROXYLOGMSG;
+/** Pointer to a log message descriptor. */
+typedef PSPPROXYLOGMSG *PPSPPROXYLOGMSG;
+/** Pointer to a const log message descriptor. */
+typedef const PSPPROXYLOGMSG *PCPSPPROXYLOGMSG;
+
+
+/**
+ * IRQ/FIRQ state change event.
+ */
+typedef struct PSPPROXYIRQEVT
+{
+    /** The CCD ID the state change happened on. */
+    uint32_t                    idCcd;
+    /** Target timestamp in milliseconds of the notification. */
+    uint32_t                    tsMillies;
+    /** Flag whether an IRQ is pending. */
+    bool                        fIrq;
+    /** Flag whether a FIRQ is pending. */
+    bool                        fFirq;
+} PSPPROXYIRQEVT;
+/** Pointer to an IRQ event. */
+typedef PSPPROXYIRQEVT *PPSPPROXYIRQEVT;
+/** Pointer to a const IRQ event. */
+typedef const PSPPROXYIRQEVT *PCPSPPROXYIRQEVT;
+
+
+/**
+ * IRQ event callback.
+ *
+ * @returns nothing.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pvUser                  Opaque user data passed during registration.
+ * @param   pIrqEvt                 The IRQ event, only valid during the callback.
+ */
+typedef void (*PFNPSPPROXYIRQEVT) (PSPPROXYCTX hCtx, void *pvUser, PCPSPPROXYIRQEVT pIrqEvt);
+
+
+/**
+ * Request types the statistics and timeouts are kept for.
+ */
+typedef enum PSPPROXYREQ
+{
+    /** Connect request. */
+    PSPPROXYREQ_CONNECT = 0,
+    /** PSP SMN read. */
+    PSPPROXYREQ_PSP_SMN_READ,
+    /** PSP SMN write. */
+    PSPPROXYREQ_PSP_SMN_WRITE,
+    /** PSP SRAM read. */
+    PSPPROXYREQ_PSP_MEM_READ,
+    /** PSP SRAM write. */
+    PSPPROXYREQ_PSP_MEM_WRITE,
+    /** PSP MMIO read. */
+    PSPPROXYREQ_PSP_MMIO_READ,
+    /** PSP MMIO write. */
+    PSPPROXYREQ_PSP_MMIO_WRITE,
+    /** x86 memory read from the PSP. */
+    PSPPROXYREQ_PSP_X86_MEM_READ,
+    /** x86 memory write from the PSP. */
+    PSPPROXYREQ_PSP_X86_MEM_WRITE,
+    /** x86 MMIO read from the PSP. */
+    PSPPROXYREQ_PSP_X86_MMIO_READ,
+    /** x86 MMIO write from the PSP. */
+    PSPPROXYREQ_PSP_X86_MMIO_WRITE,
+    /** Generic data transfer. */
+    PSPPROXYREQ_PSP_DATA_XFER,
+    /** Co-processor register read. */
+    PSPPROXYREQ_COPROC_READ,
+    /** Co-processor register write. */
+    PSPPROXYREQ_COPROC_WRITE,
+    /** Code module load. */
+    PSPPROXYREQ_LOAD_CODE_MOD,
+    /** Code module execution. */
+    PSPPROXYREQ_EXEC_CODE_MOD,
+    /** Input buffer write. */
+    PSPPROXYREQ_INPUT_BUF_WRITE,
+    /** Branch to a given address. */
+    PSPPROXYREQ_BRANCH_TO,
+    /** Number of request types. */
+    PSPPROXYREQ_COUNT,
+    /** 32bit hack. */
+    PSPPROXYREQ_32BIT_HACK = 0x7fffffff
+} PSPPROXYREQ;
+
+
+/**
+ * Number of buckets in a latency histogram.
+ *
+ * Buckets 0 to 15 count the exact values 0 to 15ns, after that every power of two range is split
+ * into 8 equally sized buckets (so the relative error is at most 12.5%) up to 2^37ns (~137s).
+ * Larger values are counted in the last bucket.
+ */
+#define PSPPROXY_STATS_HIST_BUCKETS             280
+
+
+/**
+ * Latency histogram.
+ */
+typedef struct PSPPROXYSTATSHIST
+{
+    /** Number of samples per bucket. */
+    uint64_t                    acSamples[PSPPROXY_STATS_HIST_BUCKETS];
+} PSPPROXYSTATSHIST;
+/** Pointer to a latency histogram. */
+typedef PSPPROXYSTATSHIST *PPSPPROXYSTATSHIST;
+/** Pointer to a const latency histogram. */
+typedef const PSPPROXYSTATSHIST *PCPSPPROXYSTATSHIST;
+
+
+/**
+ * PDU counters.
+ */
+typedef struct PSPPROXYSTATSPDUS
+{
+    /** Number of PDUs. */
+    uint64_t                    cPdus;
+    /** Number of bytes including header, padding and footer. */
+    uint64_t                    cbPdus;
+} PSPPROXYSTATSPDUS;
+
+
+/**
+ * Per request type statistics.
+ */
+typedef struct PSPPROXYSTATSREQ
+{
+    /** Request PDUs sent. */
+    PSPPROXYSTATSPDUS           Sent;
+    /** Response PDUs received. */
+    PSPPROXYSTATSPDUS           Recv;
+    /** Number of requests the target completed with an error status. */
+    uint64_t                    cErrors;
+    /** Number of requests which timed out waiting for the response. */
+    uint64_t                    cTimeouts;
+    /** Sum of all round trip times in nanoseconds. */
+    uint64_t                    cNsTotal;
+    /** Maximum round trip time in nanoseconds. */
+    uint64_t                    cNsMax;
+    /** Sum of the host side times until the requests were handed to the provider completely in nanoseconds. */
+    uint64_t                    cNsHostTxTotal;
+    /** Sum of the forward delay excess in milliseconds, see PSPPROXYREQTIMING::cMsFwdExcess. */
+    uint64_t                    cMsFwdExcessTotal;
+    /** Round trip time histogram. */
+    PSPPROXYSTATSHIST           HistNs;
+} PSPPROXYSTATSREQ;
+/** Pointer to per request type statistics. */
+typedef PSPPROXYSTATSREQ *PPSPPROXYSTATSREQ;
+/** Pointer to const per request type statistics. */
+typedef const PSPPROXYSTATSREQ *PCPSPPROXYSTATSREQ;
+
+
+/**
+ * Context statistics, rather large (~40KiB) so better not put it onto the stack.
+ */
+typedef struct PSPPROXYSTATS
+{
+    /** All PDUs sent. */
+    PSPPROXYSTATSPDUS           Sent;
+    /** All valid PDUs received. */
+    PSPPROXYSTATSPDUS           Recv;
+    /** Beacon notifications received. */
+    PSPPROXYSTATSPDUS           NotBeacon;
+    /** Log message notifications received. */
+    PSPPROXYSTATSPDUS           NotLogMsg;
+    /** Output buffer notifications received. */
+    PSPPROXYSTATSPDUS           NotOutBuf;
+    /** Code module execution finished notifications received. */
+    PSPPROXYSTATSPDUS           NotCodeModExecFinished;
+    /** IRQ notifications received. */
+    PSPPROXYSTATSPDUS           NotIrq;
+    /** Number of PDUs discarded because of an invalid header. */
+    uint64_t                    cHdrErrors;
+    /** Number of PDUs discarded because of a checksum or footer mismatch. */
+    uint64_t                    cChkSumErrors;
+    /** Number of bytes skipped while searching for the start of a PDU. */
+    uint64_t                    cbResyncSkipped;
+    /** Number of log message bytes dropped. */
+    uint64_t                    cbLogMsgDropped;
+    /** Number of IRQ events dropped. */
+    uint64_t                    cIrqEvtsDropped;
+    /** Number of requests which timed out. */
+    uint64_t                    cTimeouts;
+    /** Number of requests which were interrupted. */
+    uint64_t                    cInterrupts;
+    /** Number of late responses to timed out or interrupted requests which were discarded. */
+    uint64_t                    cLateRespsDropped;
+    /** Number of target resets detected while connected. */
+    uint64_t                    cTargetResets;
+    /** Number of sessions resumed successfully after a target reset. */
+    uint64_t                    cSessionsResumed;
+    /** Number of idempotent requests issued again after the session was resumed. */
+    uint64_t                    cReqsReplayed;
+    /** Number of provider poll calls. */
+    uint64_t                    cProvPolls;
+    /** Number of provider peek calls. */
+    uint64_t                    cProvPeeks;
+    /** Number of provider read calls. */
+    uint64_t                    cProvReads;
+    /** Number of provider write calls. */
+    uint64_t                    cProvWrites;
+    /** Number of system calls done by the provider, UINT64_MAX if the provider doesn't keep track. */
+    uint64_t                    cProvSyscalls;
+    /** Number of times the provider checked the remote side for new data, UINT64_MAX if the transport
+     * signals new data on its own. Relative to Recv.cbPdus this gives the polls per received byte. */
+    uint64_t                    cProvRemotePolls;
+    /** Minimum forward delay observed since connecting (target timestamp of a response minus the host timestamp
+     * of the request) in milliseconds, includes the unknown offset between both clocks. INT32_MAX if unknown.
+     * Not affected by resetting the statistics. */
+    int32_t                     i32MsFwdMin;
+    /** Minimum reverse delay observed since connecting (host receive time minus the target timestamp of
+     * a PDU) in milliseconds, includes the negated clock offset. The sum with i32MsFwdMin is an estimate of
+     * the best case link round trip time without any target processing. INT32_MAX if unknown.
+     * Not affected by resetting the statistics. */
+    int32_t                     i32MsRevMin;
+    /** Per request type statistics, indexed by PSPPROXYREQ. */
+    PSPPROXYSTATSREQ            aReqs[PSPPROXYREQ_COUNT];
+} PSPPROXYSTATS;
+/** Pointer to context statistics. */
+typedef PSPPROXYSTATS *PPSPPROXYSTATS;
+/** Pointer to const context statistics. */
+typedef const PSPPROXYSTATS *PCPSPPROXYSTATS;
+
+
+/**
+ * Timing information of a single request.
+ */
+typedef struct PSPPROXYREQTIMING
+{
+    /** The request type. */
+    PSPPROXYREQ                 enmReq;
+    /** Host timestamp in milliseconds put into the request PDU header (monotonic clock). */
+    uint32_t                    tsHostMillies;
+    /** Target timestamp in milliseconds from the response PDU header. */
+    uint32_t                    tsTargetMillies;
+    /** Forward delay beyond the minimum observed so far in milliseconds, an estimate for the target
+     * processing time plus any queuing on the way to the target. */
+    uint32_t                    cMsFwdExcess;
+    /** Monotonic host time in nanoseconds the request was started. */
+    uint64_t                    tsHostStartNs;
+    /** Host side time until the request was handed to the provider completely in nanoseconds. */
+    uint64_t                    cNsHostTx;
+    /** Round trip time in nanoseconds, from the start of the request until the response was received. */
+    uint64_t                    cNsRtt;
+} PSPPROXYREQTIMING;
+/** Pointer to request timing information. */
+typedef PSPPROXYREQTIMING *PPSPPROXYREQTIMING;
+
+
+/** @name Context capabilities.
+ * @{ */
+/** Connected to a stub, the code module, coprocessor, IRQ and address transfer APIs are available. */
+#define PSPPROXY_CAPS_F_STUB                    BIT(0)
+/** The provider accesses PSP memory, MMIO and SMN directly instead of going through a stub. */
+#define PSPPROXY_CAPS_F_PSP_NATIVE              BIT(1)
+/** PSPProxyCtxPspSvcCall() is available. */
+#define PSPPROXY_CAPS_F_PSP_SVC_CALL            BIT(2)
+/** SMN accesses initiated from the x86 side are available. */
+#define PSPPROXY_CAPS_F_X86_SMN                 BIT(3)
+/** R0 memory can be allocated, read and written. */
+#define PSPPROXY_CAPS_F_X86_MEM                 BIT(4)
+/** x86 physical memory can be accessed from the host directly. */
+#define PSPPROXY_CAPS_F_X86_PHYS_MEM            BIT(5)
+/** The PSP emulation interface is available. */
+#define PSPPROXY_CAPS_F_EMU                     BIT(6)
+/** Waits can be cancelled with PSPProxyCtxInterrupt(). */
+#define PSPPROXY_CAPS_F_INTERRUPT               BIT(7)
+/** A PDU is handed to the transport in one operation even if it is scattered over several buffers. */
+#define PSPPROXY_CAPS_F_WRITEV                  BIT(8)
+/** The provider counts its system calls, see PSPPROXYSTATS::cProvSyscalls. */
+#define PSPPROXY_CAPS_F_PROV_STATS              BIT(9)
+/** The transport moves data through shared memory without copies through the kernel. */
+#define PSPPROXY_CAPS_F_ZERO_COPY               BIT(16)
+/** The transport I/O is done asynchronously by the kernel. */
+#define PSPPROXY_CAPS_F_ASYNC                   BIT(17)
+/** The transport combines several low level operations into a single round trip. */
+#define PSPPROXY_CAPS_F_BATCHING                BIT(18)
+/** The PSP is simulated in process, there is no real hardware behind the context. */
+#define PSPPROXY_CAPS_F_SIMULATED               BIT(19)
+/** Mask of the capabilities describing properties of the transport itself. */
+#define PSPPROXY_CAPS_F_TRANSPORT_MASK          UINT32_C(0xffff0000)
+/** @} */
+
+
+/**
+ * Context capabilities.
+ */
+typedef struct PSPPROXYCAPS
+{
+    /** PSPPROXY_CAPS_F_XXX flags. */
+    uint32_t                    fCaps;
+    /** Maximum PDU size the stub accepts in bytes, 0 without a stub. */
+    uint32_t                    cbPduMax;
+    /** Number of sockets in the system as reported by the stub, 0 if unknown. */
+    uint32_t                    cSysSockets;
+    /** Number of CCDs per socket as reported by the stub, 0 if unknown. */
+    uint32_t                    cCcdsPerSocket;
+    /** The provider ID, the scheme of the device URI. */
+    const char                  *pszProvId;
+} PSPPROXYCAPS;
+/** Pointer to context capabilities. */
+typedef PSPPROXYCAPS *PPSPPROXYCAPS;
+
+
 /**
  * I/O interface callback table.
  */
@@ -134,6 +451,17 @@ typedef struct PSPPROXYIOIF
      */
     int (*pfnInBufRead) (PSPPROXYCTX hCtx, void *pvUser, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead);
 
+    /**
+     * Batched log message received callback, optional. Takes precedence over pfnLogMsg if set.
+     *
+     * @returns nothing.
+     * @param   hCtx                    The PSP proxy context handle.
+     * @param   pvUser                  Opaque user data passed during creation.
+     * @param   paMsgs                  Array of complete log lines received, only valid during the callback.
+     * @param   cMsgs                   Number of entries in the array.
+     */
+    void (*pfnLogMsgBatch) (PSPPROXYCTX hCtx, void *pvUser, PCPSPPROXYLOGMSG paMsgs, uint32_t cMsgs);
+
 } PSPPROXYIOIF;
 /** Pointer to an I/O interface callback table. */
 typedef PSPPROXYIOIF *PPSPPROXYIOIF;
@@ -155,6 +483,18 @@ typedef const PSPPROXYIOIF *PCPSPPROXYIOIF;
 #define PSPPROXY_CTX_ADDR_XFER_F_OP_MASK_VALID (0x7)
 
 
+/**
+ * Loads a provider plugin from the given shared object.
+ *
+ * @returns Status code.
+ * @param   pszPath                 Path of the plugin.
+ *
+ * @note Plugins are loaded automatically when a device URI has an unknown scheme, this is only needed
+ *       for plugins outside of the search path. See PSPPROXYPROVPLUGIN in psp-proxy-provider.h for
+ *       the plugin interface.
+ */
+int PSPProxyProvPluginLoad(const char *pszPath);
+
 /**
  * Creates a new PSP proxy context for the given device.
  *
@@ -197,6 +537,138 @@ int PSPProxyCtxPspCcdSet(PSPPROXYCTX hCtx, uint32_t idCcd);
  */
 int PSPProxyCtxQueryLastReqRc(PSPPROXYCTX hCtx, PSPSTS *pReqRcLast);
 
+/**
+ * Sets the size of the log message line assembly buffer, which is also the maximum length of a
+ * single log line handed to the callbacks. Longer lines are truncated and the remainder is counted as dropped.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   cbLogMsgBuf             Size of the line assembly buffer in bytes.
+ */
+int PSPProxyCtxLogMsgBufSizeSet(PSPPROXYCTX hCtx, size_t cbLogMsgBuf);
+
+/**
+ * Queries the number of log message bytes which were dropped so far because they didn't fit into the
+ * line assembly buffer.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pcbDropped              Where to store the number of bytes dropped.
+ */
+int PSPProxyCtxLogMsgQueryDropped(PSPPROXYCTX hCtx, uint64_t *pcbDropped);
+
+/**
+ * Queries the statistics collected since the context was created or the statistics were reset.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pStats                  Where to store the statistics.
+ */
+int PSPProxyCtxQueryStats(PSPPROXYCTX hCtx, PPSPPROXYSTATS pStats);
+
+/**
+ * Queries the capabilities of the given context.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pCaps                   Where to store the capabilities.
+ *
+ * @note This combines what the provider implements with what the stub reported when connecting, so callers
+ *       can select the best path up front instead of trying operations until one doesn't fail.
+ */
+int PSPProxyCtxQueryCaps(PSPPROXYCTX hCtx, PPSPPROXYCAPS pCaps);
+
+/**
+ * Queries the timing information of the last request which received a response.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pTiming                 Where to store the timing information.
+ */
+int PSPProxyCtxQueryLastReqTiming(PSPPROXYCTX hCtx, PPSPPROXYREQTIMING pTiming);
+
+/**
+ * Interrupts the request currently waiting for a response, making it return STS_ERR_PSP_PROXY_INTERRUPTED.
+ * A late response to the interrupted request is discarded when it arrives. This is the only API which may be
+ * called from a different thread than the one using the context.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ *
+ * @note The interrupt is latched, if no request is waiting at the time the next wait for a response is interrupted.
+ */
+int PSPProxyCtxInterrupt(PSPPROXYCTX hCtx);
+
+/**
+ * Sets the timeout for the given request type, the default is 10 seconds.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   enmReq                  The request type, PSPPROXYREQ_COUNT to set the timeout for all request types.
+ * @param   cMillies                The timeout in milliseconds, must not be 0.
+ *
+ * @note The timeout covers the whole request from sending it until the response was received, notifications
+ *       received in the meantime don't extend it.
+ */
+int PSPProxyCtxReqTimeoutSet(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t cMillies);
+
+/**
+ * Queries the timeout currently in effect for the given request type, which is lower than the configured one
+ * if adaptive timeouts are enabled and enough round trip time samples were collected.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   enmReq                  The request type.
+ * @param   pcMillies               Where to store the timeout in milliseconds.
+ */
+int PSPProxyCtxReqTimeoutQuery(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t *pcMillies);
+
+/**
+ * Enables adaptive request timeouts derived from the measured round trip times of each request type
+ * (smoothed RTT plus four times its variation), allowing a dead link to be detected quickly.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   cMilliesMin             Lower bound for the adaptive timeouts in milliseconds, 0 disables adaptive timeouts.
+ *
+ * @note The timeouts configured with PSPProxyCtxReqTimeoutSet() serve as upper bound. The estimate is per request type
+ *       and doesn't account for the transfer size, so the lower bound should leave room for the largest transfers done.
+ */
+int PSPProxyCtxReqTimeoutAdaptiveSet(PSPPROXYCTX hCtx, uint32_t cMilliesMin);
+
+/**
+ * Enables or disables resuming the session automatically when the target resets, enabled by default.
+ *
+ * A reset is detected by a beacon arriving while connected. The beacon is replied to right away with a new connect
+ * request and the session continues if the target reports the same parameters (maximum PDU size, scratch space
+ * and topology). A pending plain memory read or write is issued again, any other pending request fails with
+ * STS_ERR_PSP_PROXY_TARGET_RESET. When disabled, or if resuming fails, the context has to be recreated.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   fAutoResume             Flag whether to resume the session automatically.
+ *
+ * @note Anything set up on the target (loaded code modules, register state) is gone after a reset.
+ */
+int PSPProxyCtxAutoResumeSet(PSPPROXYCTX hCtx, bool fAutoResume);
+
+/**
+ * Resets the statistics of the given context.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ */
+int PSPProxyCtxResetStats(PSPPROXYCTX hCtx);
+
+/**
+ * Returns the value at the given percentile of a latency histogram.
+ *
+ * @returns Upper bound of the bucket the percentile falls into in nanoseconds, 0 if the histogram is empty.
+ * @param   pHist                   The histogram.
+ * @param   dPercentile             The percentile to return (0.0 - 100.0).
+ */
+uint64_t PSPProxyStatsHistPercentileNs(PCPSPPROXYSTATSHIST pHist, double dPercentile);
+
 /**
  * Reads the register at the given SMN address.
  *
@@ -382,6 +854,38 @@ int PSPProxyCtxPspSvcCall(PSPPROXYCTX hCtx, uint32_t idxSyscall, uint32_t u32R0,
  */
 int PSPProxyCtxPspWaitForIrq(PSPPROXYCTX hCtx, uint32_t *pidCcd, bool *pfIrq, bool *pfFirq, uint32_t cWaitMs);
 
+/**
+ * Registers a callback for IRQ events received while processing other requests. Events delivered through the
+ * callback are not queued for PSPProxyCtxPspWaitForIrq().
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pfnIrqEvt               The callback to register, NULL to go back to queueing events.
+ * @param   pvUser                  Opaque user data to pass to the callback.
+ */
+int PSPProxyCtxIrqEvtCallbackSet(PSPPROXYCTX hCtx, PFNPSPPROXYIRQEVT pfnIrqEvt, void *pvUser);
+
+/**
+ * Returns an eventfd which becomes readable when IRQ events are queued for PSPProxyCtxPspWaitForIrq().
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   piFd                    Where to store the file descriptor, owned by the context.
+ *
+ * @note Events are only received while the context processes PDUs (any request or
+ *       PSPProxyCtxPspWaitForIrq()), the fd does not signal target activity otherwise.
+ */
+int PSPProxyCtxIrqEvtQueryFd(PSPPROXYCTX hCtx, int *piFd);
+
+/**
+ * Queries the number of IRQ events dropped so far because the event queue was full.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   pcEvtsDropped           Where to store the number of events dropped.
+ */
+int PSPProxyCtxIrqEvtQueryDropped(PSPPROXYCTX hCtx, uint64_t *pcEvtsDropped);
+
 /**
  * Reads the register at the given SMN address, the access is initiated from the x86 core and not the PSP.
  *
@@ -426,6 +930,21 @@ int PSPProxyCtxX86MemAlloc(PSPPROXYCTX hCtx, uint32_t cbMem, R0PTR *pR0KernVirtu
  */
 int PSPProxyCtxX86MemFree(PSPPROXYCTX hCtx, R0PTR R0KernVirtual);
 
+/**
+ * Sets the size of the regions the R0 memory pool allocates from the provider.
+ *
+ * @returns Status code.
+ * @param   hCtx                    The PSP proxy context handle.
+ * @param   cbRegion                Size of a region in bytes, 0 disables pooling for new allocations.
+ *
+ * @note Pooling is disabled by default. When enabled allocations up to 64KiB are carved from regions of
+ *       this size (a large page, 2MiB, is a good choice) and recycled by size class when freed, instead of
+ *       going to the provider every time. Blocks are naturally aligned by their physical address and
+ *       zeroed when handed out again. The regions are only returned to the provider when the context is
+ *       destroyed.
+ */
+int PSPProxyCtxX86MemPoolRegionSizeSet(PSPPROXYCTX hCtx, size_t cbRegion);
+
 /**
  * Copies memory from a given R0 virtual address to a supplied userspace buffer.
  *
@@ -531,7 +1050,7 @@ int PSPProxyCtxCodeModLoad(PSPPROXYCTX hCtx, const void *pvCm, size_t cbCm);
  * @param   u32Arg3                 Argument 3.
  * @param   pu32CmdRet              Where to store the return value of the code module when it returns.
  * @param   cMillies                How long to wait for the code module to finish exeucting until a timeout
- *                                  error is returned.
+ *                                  error is returned, UINT32_MAX to wait indefinitely.
  */
 int PSPProxyCtxCodeModExec(PSPPROXYCTX hCtx, uint32_t u32Arg0, uint32_t u32Arg1, uint32_t u32Arg2, uint32_t u32Arg3,
                            uint32_t *pu32CmRet, uint32_t cMillies);
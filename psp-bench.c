@@ -0,0 +1,929 @@
+/** @file
+ * psp-bench - Latency and throughput benchmark for the PSP proxy library
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "libpspproxy.h"
+
+
+/** Default number of measured iterations per workload. */
+#define PSP_BENCH_ITERATIONS_DEFAULT    1000
+/** Default number of warmup iterations per workload. */
+#define PSP_BENCH_WARMUP_DEFAULT        10
+/** Default transfer size for the bulk workloads. */
+#define PSP_BENCH_BULK_SZ_DEFAULT       4096
+/** Number of workloads available. */
+#define PSP_BENCH_WORKLOADS             10
+
+
+/** Pointer to the benchmark state. */
+typedef struct PSPBENCH *PPSPBENCH;
+
+
+/**
+ * A single workload.
+ */
+typedef struct PSPBENCHWORKLOAD
+{
+    /** Name of the workload as given on the command line. */
+    const char                      *pszName;
+    /** Description. */
+    const char                      *pszDesc;
+    /**
+     * Checks whether the workload can run with the given configuration and prepares it.
+     *
+     * @returns Status code, > 0 if the workload is skipped.
+     * @param   pThis               The benchmark state.
+     * @param   ppszWhy             Where to store the reason for skipping the workload.
+     */
+    int                             (*pfnPrepare) (PPSPBENCH pThis, const char **ppszWhy);
+    /**
+     * Executes a single operation of the workload.
+     *
+     * @returns Status code.
+     * @param   pThis               The benchmark state.
+     */
+    int                             (*pfnOp) (PPSPBENCH pThis);
+    /**
+     * Returns the number of payload bytes transferred by a single operation.
+     *
+     * @returns Number of bytes.
+     * @param   pThis               The benchmark state.
+     */
+    size_t                          (*pfnOpBytes) (PPSPBENCH pThis);
+} PSPBENCHWORKLOAD;
+/** Pointer to a const workload. */
+typedef const PSPBENCHWORKLOAD *PCPSPBENCHWORKLOAD;
+
+
+/**
+ * Results of a single workload.
+ */
+typedef struct PSPBENCHRESULT
+{
+    /** The workload. */
+    PCPSPBENCHWORKLOAD              pWorkload;
+    /** Status code of the run, 0 on success. */
+    int                             rc;
+    /** Reason for skipping the workload if rc is > 0. */
+    const char                      *pszSkipped;
+    /** Number of operations measured. */
+    uint32_t                        cOps;
+    /** Payload bytes per operation. */
+    size_t                          cbOp;
+    /** Total time for all operations. */
+    uint64_t                        cNsTotal;
+    /** Minimum latency. */
+    uint64_t                        cNsMin;
+    /** Maximum latency. */
+    uint64_t                        cNsMax;
+    /** Median latency. */
+    uint64_t                        cNsP50;
+    /** 99th percentile latency. */
+    uint64_t                        cNsP99;
+    /** 99.9th percentile latency. */
+    uint64_t                        cNsP999;
+    /** Number of system calls during the measurement, UINT64_MAX if not available. */
+    uint64_t                        cSyscalls;
+} PSPBENCHRESULT;
+/** Pointer to a workload result. */
+typedef PSPBENCHRESULT *PPSPBENCHRESULT;
+
+
+/**
+ * The benchmark state.
+ */
+typedef struct PSPBENCH
+{
+    /** The proxy context. */
+    PSPPROXYCTX                     hCtx;
+    /** The device URI. */
+    const char                      *pszDevice;
+    /** Number of measured iterations per workload. */
+    uint32_t                        cIterations;
+    /** Number of warmup iterations per workload. */
+    uint32_t                        cWarmup;
+    /** Transfer size of the bulk workloads. */
+    size_t                          cbBulk;
+    /** Bulk transfer buffer. */
+    uint8_t                         *pbBulk;
+    /** Flag whether the PSP MMIO address is set. */
+    bool                            fPspMmioAddr;
+    /** PSP MMIO address to access. */
+    PSPADDR                         PspAddrMmio;
+    /** Flag whether the SMN address is set. */
+    bool                            fSmnAddr;
+    /** SMN address to access. */
+    SMNADDR                         SmnAddr;
+    /** Flag whether the x86 address is set. */
+    bool                            fX86Addr;
+    /** x86 physical address to access. */
+    X86PADDR                        PhysX86Addr;
+    /** SRAM scratch space address used for the bulk SRAM workloads, 0 if not allocated. */
+    PSPADDR                         PspAddrScratch;
+    /** The code module file for the code module workloads. */
+    const char                      *pszCm;
+    /** The code module loaded into memory. */
+    void                            *pvCm;
+    /** Size of the code module in bytes. */
+    size_t                          cbCm;
+    /** Flag whether the code module was loaded onto the PSP for the exec workload. */
+    bool                            fCmLoaded;
+    /** Value read or written by the small access workloads. */
+    uint32_t                        u32Val;
+    /** The perf event descriptor counting system calls, -1 if not available. */
+    int                             iFdPerfSyscalls;
+    /** Latency samples of the current workload. */
+    uint64_t                        *pacNsSamples;
+    /** The workloads selected. */
+    PCPSPBENCHWORKLOAD              apWorkloads[PSP_BENCH_WORKLOADS];
+    /** Number of workloads selected. */
+    uint32_t                        cWorkloads;
+    /** The results for each workload. */
+    PSPBENCHRESULT                  aResults[PSP_BENCH_WORKLOADS];
+} PSPBENCH;
+
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ */
+static uint64_t pspBenchTimeNs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Loads the given file into memory.
+ *
+ * @returns Status code.
+ * @param   pszFilename         The filename to load.
+ * @param   ppv                 Where to store the memory buffer pointer on success.
+ * @param   pcb                 Where to store the size of the loaded file on success.
+ */
+static int pspBenchLoadFromFile(const char *pszFilename, void **ppv, size_t *pcb)
+{
+    int rc = 0;
+    FILE *pFile = fopen(pszFilename, "rb");
+    if (pFile)
+    {
+        rc = fseek(pFile, 0, SEEK_END);
+        if (!rc)
+        {
+            long cbFile = ftell(pFile);
+            if (cbFile > 0)
+            {
+                rewind(pFile);
+
+                void *pv = malloc(cbFile);
+                if (pv)
+                {
+                    if (fread(pv, cbFile, 1, pFile) == 1)
+                    {
+                        *ppv = pv;
+                        *pcb = cbFile;
+                        fclose(pFile);
+                        return 0;
+                    }
+
+                    free(pv);
+                }
+            }
+        }
+
+        rc = -1;
+        fclose(pFile);
+    }
+    else
+        rc = errno;
+
+    return rc;
+}
+
+
+/**
+ * Opens a perf event counting the system calls entered by this thread.
+ *
+ * @returns The perf event descriptor or -1 if counting system calls is not possible
+ *          (missing tracefs or insufficient privileges).
+ */
+static int pspBenchPerfSyscallsOpen(void)
+{
+    static const char *s_apszPaths[] =
+    {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+    };
+    unsigned long long idTp = 0;
+    bool fFound = false;
+
+    for (uint32_t i = 0; i < sizeof(s_apszPaths) / sizeof(s_apszPaths[0]) && !fFound; i++)
+    {
+        FILE *pFile = fopen(s_apszPaths[i], "r");
+        if (pFile)
+        {
+            fFound = fscanf(pFile, "%llu", &idTp) == 1;
+            fclose(pFile);
+        }
+    }
+
+    if (!fFound)
+        return -1;
+
+    struct perf_event_attr Attr;
+    memset(&Attr, 0, sizeof(Attr));
+    Attr.type           = PERF_TYPE_TRACEPOINT;
+    Attr.size           = sizeof(Attr);
+    Attr.config         = idTp;
+    Attr.disabled       = 1;
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv     = 1;
+    return (int)syscall(__NR_perf_event_open, &Attr, 0 /*pid*/, -1 /*cpu*/, -1 /*group_fd*/, 0 /*flags*/);
+}
+
+
+/**
+ * Small PSP MMIO read.
+ */
+static int pspBenchMmioRead(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspMmioRead(pThis->hCtx, pThis->PspAddrMmio, sizeof(pThis->u32Val), &pThis->u32Val);
+}
+
+
+/**
+ * Small PSP MMIO write.
+ */
+static int pspBenchMmioWrite(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspMmioWrite(pThis->hCtx, pThis->PspAddrMmio, sizeof(pThis->u32Val), &pThis->u32Val);
+}
+
+
+/**
+ * Small SMN read.
+ */
+static int pspBenchSmnRead(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspSmnRead(pThis->hCtx, 0 /*idCcdTgt*/, pThis->SmnAddr, sizeof(pThis->u32Val), &pThis->u32Val);
+}
+
+
+/**
+ * Small SMN write.
+ */
+static int pspBenchSmnWrite(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspSmnWrite(pThis->hCtx, 0 /*idCcdTgt*/, pThis->SmnAddr, sizeof(pThis->u32Val), &pThis->u32Val);
+}
+
+
+/**
+ * Bulk SRAM read.
+ */
+static int pspBenchSramRead(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspMemRead(pThis->hCtx, pThis->PspAddrScratch, pThis->pbBulk, pThis->cbBulk);
+}
+
+
+/**
+ * Bulk SRAM write.
+ */
+static int pspBenchSramWrite(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspMemWrite(pThis->hCtx, pThis->PspAddrScratch, pThis->pbBulk, pThis->cbBulk);
+}
+
+
+/**
+ * Bulk x86 memory read.
+ */
+static int pspBenchX86Read(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspX86MemRead(pThis->hCtx, pThis->PhysX86Addr, pThis->pbBulk, pThis->cbBulk);
+}
+
+
+/**
+ * Bulk x86 memory write.
+ */
+static int pspBenchX86Write(PPSPBENCH pThis)
+{
+    return PSPProxyCtxPspX86MemWrite(pThis->hCtx, pThis->PhysX86Addr, pThis->pbBulk, pThis->cbBulk);
+}
+
+
+/**
+ * Code module load.
+ */
+static int pspBenchCmLoad(PPSPBENCH pThis)
+{
+    return PSPProxyCtxCodeModLoad(pThis->hCtx, pThis->pvCm, pThis->cbCm);
+}
+
+
+/**
+ * Code module execution round trip.
+ */
+static int pspBenchCmExec(PPSPBENCH pThis)
+{
+    uint32_t u32CmRet = 0;
+    return PSPProxyCtxCodeModExec(pThis->hCtx, 0 /*u32Arg0*/, 0 /*u32Arg1*/, 0 /*u32Arg2*/, 0 /*u32Arg3*/, &u32CmRet, 10 * 1000);
+}
+
+
+static size_t pspBenchOpBytesSmall(PPSPBENCH pThis)
+{
+    return sizeof(pThis->u32Val);
+}
+
+
+static size_t pspBenchOpBytesBulk(PPSPBENCH pThis)
+{
+    return pThis->cbBulk;
+}
+
+
+static size_t pspBenchOpBytesCm(PPSPBENCH pThis)
+{
+    return pThis->cbCm;
+}
+
+
+static size_t pspBenchOpBytesNone(PPSPBENCH pThis)
+{
+    return 0;
+}
+
+
+static int pspBenchPrepareMmio(PPSPBENCH pThis, const char **ppszWhy)
+{
+    *ppszWhy = "needs --mmio-addr";
+    return pThis->fPspMmioAddr ? 0 : 1;
+}
+
+
+static int pspBenchPrepareSmn(PPSPBENCH pThis, const char **ppszWhy)
+{
+    *ppszWhy = "needs --smn-addr";
+    return pThis->fSmnAddr ? 0 : 1;
+}
+
+
+static int pspBenchPrepareX86(PPSPBENCH pThis, const char **ppszWhy)
+{
+    *ppszWhy = "needs --x86-addr";
+    return pThis->fX86Addr ? 0 : 1;
+}
+
+
+static int pspBenchPrepareSram(PPSPBENCH pThis, const char **ppszWhy)
+{
+    if (pThis->PspAddrScratch)
+        return 0;
+
+    /* The bulk SRAM workloads operate on scratch space so they never clobber anything the stub uses. */
+    int rc = PSPProxyCtxScratchSpaceAlloc(pThis->hCtx, pThis->cbBulk, &pThis->PspAddrScratch);
+    if (rc)
+    {
+        *ppszWhy = "not enough scratch space for the transfer size";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static int pspBenchPrepareCmLoad(PPSPBENCH pThis, const char **ppszWhy)
+{
+    *ppszWhy = "needs --cm";
+    return pThis->pvCm ? 0 : 1;
+}
+
+
+static int pspBenchPrepareCmExec(PPSPBENCH pThis, const char **ppszWhy)
+{
+    *ppszWhy = "needs --cm";
+    if (!pThis->pvCm)
+        return 1;
+
+    if (!pThis->fCmLoaded)
+    {
+        int rc = pspBenchCmLoad(pThis);
+        if (rc)
+            return rc;
+        pThis->fCmLoaded = true;
+    }
+
+    return 0;
+}
+
+
+/**
+ * The available workloads.
+ */
+static const PSPBENCHWORKLOAD g_aWorkloads[PSP_BENCH_WORKLOADS] =
+{
+    { "mmio-read",  "32bit PSP MMIO read",                    pspBenchPrepareMmio,   pspBenchMmioRead,  pspBenchOpBytesSmall },
+    { "mmio-write", "32bit PSP MMIO write",                   pspBenchPrepareMmio,   pspBenchMmioWrite, pspBenchOpBytesSmall },
+    { "smn-read",   "32bit SMN read",                         pspBenchPrepareSmn,    pspBenchSmnRead,   pspBenchOpBytesSmall },
+    { "smn-write",  "32bit SMN write",                        pspBenchPrepareSmn,    pspBenchSmnWrite,  pspBenchOpBytesSmall },
+    { "sram-read",  "Bulk SRAM read from scratch space",      pspBenchPrepareSram,   pspBenchSramRead,  pspBenchOpBytesBulk  },
+    { "sram-write", "Bulk SRAM write to scratch space",       pspBenchPrepareSram,   pspBenchSramWrite, pspBenchOpBytesBulk  },
+    { "x86-read",   "Bulk x86 memory read",                   pspBenchPrepareX86,    pspBenchX86Read,   pspBenchOpBytesBulk  },
+    { "x86-write",  "Bulk x86 memory write",                  pspBenchPrepareX86,    pspBenchX86Write,  pspBenchOpBytesBulk  },
+    { "cm-load",    "Code module load",                       pspBenchPrepareCmLoad, pspBenchCmLoad,    pspBenchOpBytesCm    },
+    { "cm-exec",    "Code module execution round trip",       pspBenchPrepareCmExec, pspBenchCmExec,    pspBenchOpBytesNone  }
+};
+
+
+/**
+ * Comparison callback for sorting the latency samples.
+ */
+static int pspBenchSampleCmp(const void *pv1, const void *pv2)
+{
+    uint64_t u64Val1 = *(const uint64_t *)pv1;
+    uint64_t u64Val2 = *(const uint64_t *)pv2;
+
+    return u64Val1 < u64Val2 ? -1 : u64Val1 > u64Val2 ? 1 : 0;
+}
+
+
+/**
+ * Returns the given percentile from the sorted sample array (nearest rank).
+ *
+ * @returns Sample value.
+ * @param   pacNsSamples        The sorted samples.
+ * @param   cSamples            Number of samples.
+ * @param   uPermille           The percentile in 1/1000 (or rather 1/10 percent).
+ */
+static uint64_t pspBenchPercentile(const uint64_t *pacNsSamples, uint32_t cSamples, uint32_t uPermille)
+{
+    uint64_t idx = ((uint64_t)cSamples * uPermille + 999) / 1000;
+
+    return pacNsSamples[idx ? idx - 1 : 0];
+}
+
+
+/**
+ * Runs a single workload.
+ *
+ * @returns Status code.
+ * @param   pThis               The benchmark state.
+ * @param   pWorkload           The workload to run.
+ * @param   pResult             Where to store the results.
+ */
+static int pspBenchWorkloadRun(PPSPBENCH pThis, PCPSPBENCHWORKLOAD pWorkload, PPSPBENCHRESULT pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    pResult->pWorkload = pWorkload;
+    pResult->cSyscalls = UINT64_MAX;
+
+    int rc = pWorkload->pfnPrepare(pThis, &pResult->pszSkipped);
+    if (rc)
+    {
+        pResult->rc = rc;
+        return rc > 0 ? 0 : rc;
+    }
+
+    pResult->cbOp = pWorkload->pfnOpBytes(pThis);
+    for (uint32_t i = 0; i < pThis->cWarmup && !rc; i++)
+        rc = pWorkload->pfnOp(pThis);
+
+    if (pThis->iFdPerfSyscalls != -1)
+    {
+        ioctl(pThis->iFdPerfSyscalls, PERF_EVENT_IOC_RESET, 0);
+        ioctl(pThis->iFdPerfSyscalls, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t tsStartNs = pspBenchTimeNs();
+    uint64_t tsLastNs = tsStartNs;
+    uint32_t cOps = 0;
+    while (   cOps < pThis->cIterations
+           && !rc)
+    {
+        rc = pWorkload->pfnOp(pThis);
+
+        uint64_t tsNs = pspBenchTimeNs();
+        pThis->pacNsSamples[cOps++] = tsNs - tsLastNs;
+        tsLastNs = tsNs;
+    }
+
+    if (pThis->iFdPerfSyscalls != -1)
+    {
+        uint64_t cSyscalls = 0;
+
+        ioctl(pThis->iFdPerfSyscalls, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(pThis->iFdPerfSyscalls, &cSyscalls, sizeof(cSyscalls)) == sizeof(cSyscalls))
+            pResult->cSyscalls = cSyscalls;
+    }
+
+    pResult->rc = rc;
+    if (rc)
+        return rc;
+
+    qsort(pThis->pacNsSamples, cOps, sizeof(pThis->pacNsSamples[0]), pspBenchSampleCmp);
+    pResult->cOps     = cOps;
+    pResult->cNsTotal = tsLastNs - tsStartNs;
+    pResult->cNsMin   = pThis->pacNsSamples[0];
+    pResult->cNsMax   = pThis->pacNsSamples[cOps - 1];
+    pResult->cNsP50   = pspBenchPercentile(pThis->pacNsSamples, cOps, 500);
+    pResult->cNsP99   = pspBenchPercentile(pThis->pacNsSamples, cOps, 990);
+    pResult->cNsP999  = pspBenchPercentile(pThis->pacNsSamples, cOps, 999);
+    return 0;
+}
+
+
+/**
+ * Returns the operations per second of the given result.
+ */
+static double pspBenchResultOpsPerSec(PPSPBENCHRESULT pResult)
+{
+    return pResult->cNsTotal ? (double)pResult->cOps * 1e9 / pResult->cNsTotal : 0.0;
+}
+
+
+/**
+ * Returns the throughput in MB/s of the given result.
+ */
+static double pspBenchResultMbPerSec(PPSPBENCHRESULT pResult)
+{
+    return pResult->cNsTotal ? (double)pResult->cOps * pResult->cbOp * 1e3 / pResult->cNsTotal : 0.0;
+}
+
+
+/**
+ * Prints the results as a human readable table.
+ *
+ * @returns nothing.
+ * @param   pThis               The benchmark state.
+ * @param   pOut                The stream to print to.
+ */
+static void pspBenchResultsPrintTable(PPSPBENCH pThis, FILE *pOut)
+{
+    fprintf(pOut, "Device: %s, %u iterations (%u warmup), bulk size %zu bytes\n\n",
+            pThis->pszDevice, pThis->cIterations, pThis->cWarmup, pThis->cbBulk);
+    fprintf(pOut, "%-12s %10s %10s %10s %10s %10s %12s %10s %12s\n",
+            "Workload", "min us", "p50 us", "p99 us", "p99.9 us", "max us", "ops/s", "MB/s", "syscalls/op");
+
+    for (uint32_t i = 0; i < pThis->cWorkloads; i++)
+    {
+        PPSPBENCHRESULT pResult = &pThis->aResults[i];
+
+        if (pResult->rc > 0)
+            fprintf(pOut, "%-12s skipped (%s)\n", pResult->pWorkload->pszName, pResult->pszSkipped);
+        else if (pResult->rc)
+            fprintf(pOut, "%-12s failed with %d\n", pResult->pWorkload->pszName, pResult->rc);
+        else
+        {
+            char szSyscalls[32];
+
+            if (pResult->cSyscalls != UINT64_MAX)
+                snprintf(&szSyscalls[0], sizeof(szSyscalls), "%.2f", (double)pResult->cSyscalls / pResult->cOps);
+            else
+                snprintf(&szSyscalls[0], sizeof(szSyscalls), "n/a");
+
+            fprintf(pOut, "%-12s %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f %10.3f %12s\n",
+                    pResult->pWorkload->pszName,
+                    pResult->cNsMin / 1e3, pResult->cNsP50 / 1e3, pResult->cNsP99 / 1e3,
+                    pResult->cNsP999 / 1e3, pResult->cNsMax / 1e3,
+                    pspBenchResultOpsPerSec(pResult), pspBenchResultMbPerSec(pResult), &szSyscalls[0]);
+        }
+    }
+}
+
+
+/**
+ * Prints the given string as a JSON string literal.
+ *
+ * @returns nothing.
+ * @param   pOut                The stream to print to.
+ * @param   psz                 The string to print.
+ */
+static void pspBenchJsonStrPrint(FILE *pOut, const char *psz)
+{
+    putc('"', pOut);
+    for (; *psz; psz++)
+    {
+        unsigned char ch = (unsigned char)*psz;
+
+        if (ch == '"' || ch == '\\')
+            fprintf(pOut, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(pOut, "\\u%04x", ch);
+        else
+            putc(ch, pOut);
+    }
+    putc('"', pOut);
+}
+
+
+/**
+ * Prints the results as JSON for automated regression tracking.
+ *
+ * @returns nothing.
+ * @param   pThis               The benchmark state.
+ * @param   pOut                The stream to print to.
+ */
+static void pspBenchResultsPrintJson(PPSPBENCH pThis, FILE *pOut)
+{
+    fprintf(pOut, "{\n  \"device\": ");
+    pspBenchJsonStrPrint(pOut, pThis->pszDevice);
+    fprintf(pOut, ",\n  \"iterations\": %u,\n  \"warmup\": %u,\n  \"bulk_size\": %zu,\n  \"results\": [",
+            pThis->cIterations, pThis->cWarmup, pThis->cbBulk);
+
+    for (uint32_t i = 0; i < pThis->cWorkloads; i++)
+    {
+        PPSPBENCHRESULT pResult = &pThis->aResults[i];
+
+        fprintf(pOut, "%s\n    { \"workload\": \"%s\", ", i ? "," : "", pResult->pWorkload->pszName);
+        if (pResult->rc > 0)
+        {
+            fprintf(pOut, "\"status\": \"skipped\", \"reason\": ");
+            pspBenchJsonStrPrint(pOut, pResult->pszSkipped);
+            fprintf(pOut, " }");
+        }
+        else if (pResult->rc)
+            fprintf(pOut, "\"status\": \"failed\", \"rc\": %d }", pResult->rc);
+        else
+        {
+            fprintf(pOut, "\"status\": \"ok\", \"ops\": %u, \"bytes_per_op\": %zu, \"total_ns\": %llu, "
+                          "\"min_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, "
+                          "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, \"syscalls_per_op\": ",
+                    pResult->cOps, pResult->cbOp, (unsigned long long)pResult->cNsTotal,
+                    (unsigned long long)pResult->cNsMin, (unsigned long long)pResult->cNsP50,
+                    (unsigned long long)pResult->cNsP99, (unsigned long long)pResult->cNsP999,
+                    (unsigned long long)pResult->cNsMax,
+                    pspBenchResultOpsPerSec(pResult), pspBenchResultMbPerSec(pResult));
+            if (pResult->cSyscalls != UINT64_MAX)
+                fprintf(pOut, "%.3f }", (double)pResult->cSyscalls / pResult->cOps);
+            else
+                fprintf(pOut, "null }");
+        }
+    }
+
+    fprintf(pOut, "\n  ]\n}\n");
+}
+
+
+/**
+ * Selects the workloads from the given comma separated list.
+ *
+ * @returns Status code.
+ * @param   pThis               The benchmark state.
+ * @param   pszList             The list of workload names, "all" selects every workload.
+ */
+static int pspBenchWorkloadsSelect(PPSPBENCH pThis, const char *pszList)
+{
+    pThis->cWorkloads = 0;
+    while (*pszList)
+    {
+        const char *pszSep = strchr(pszList, ',');
+        size_t cchName = pszSep ? (size_t)(pszSep - pszList) : strlen(pszList);
+        bool fFound = false;
+
+        for (uint32_t i = 0; i < PSP_BENCH_WORKLOADS; i++)
+        {
+            bool fAll = cchName == 3 && !strncmp(pszList, "all", 3);
+            if (   fAll
+                || (   strlen(g_aWorkloads[i].pszName) == cchName
+                    && !strncmp(g_aWorkloads[i].pszName, pszList, cchName)))
+            {
+                if (pThis->cWorkloads == PSP_BENCH_WORKLOADS)
+                    return -1;
+                pThis->apWorkloads[pThis->cWorkloads++] = &g_aWorkloads[i];
+                fFound = true;
+                if (!fAll)
+                    break;
+            }
+        }
+
+        if (!fFound)
+        {
+            fprintf(stderr, "Unknown workload \"%.*s\"\n", (int)cchName, pszList);
+            return -1;
+        }
+
+        pszList += cchName;
+        if (*pszList == ',')
+            pszList++;
+    }
+
+    return pThis->cWorkloads ? 0 : -1;
+}
+
+
+/**
+ * Prints the usage.
+ *
+ * @returns nothing.
+ * @param   pszArgv0            Program name.
+ */
+static void pspBenchUsage(const char *pszArgv0)
+{
+    printf("Usage: %s [options] <device>\n"
+           "\n"
+           "Options:\n"
+           "    -w, --workloads <list>   Comma separated list of workloads to run (default: all)\n"
+           "    -n, --iterations <n>     Number of measured operations per workload (default: %u)\n"
+           "        --warmup <n>         Number of warmup operations per workload (default: %u)\n"
+           "    -s, --size <bytes>       Transfer size of the bulk workloads (default: %u)\n"
+           "        --mmio-addr <addr>   PSP MMIO address for the mmio workloads\n"
+           "        --smn-addr <addr>    SMN address for the smn workloads\n"
+           "        --x86-addr <addr>    x86 physical address for the x86 workloads\n"
+           "        --cm <file>          Code module for the cm workloads\n"
+           "    -j, --json <file>        Write the results as JSON to the given file, - for stdout\n"
+           "    -h, --help               Show this help\n"
+           "\n"
+           "Workloads:\n",
+           pszArgv0, PSP_BENCH_ITERATIONS_DEFAULT, PSP_BENCH_WARMUP_DEFAULT, PSP_BENCH_BULK_SZ_DEFAULT);
+
+    for (uint32_t i = 0; i < PSP_BENCH_WORKLOADS; i++)
+        printf("    %-12s %s\n", g_aWorkloads[i].pszName, g_aWorkloads[i].pszDesc);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const struct option s_aOptions[] =
+    {
+        { "workloads",  required_argument, NULL, 'w' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "warmup",     required_argument, NULL, 'W' },
+        { "size",       required_argument, NULL, 's' },
+        { "mmio-addr",  required_argument, NULL, 'M' },
+        { "smn-addr",   required_argument, NULL, 'S' },
+        { "x86-addr",   required_argument, NULL, 'X' },
+        { "cm",         required_argument, NULL, 'c' },
+        { "json",       required_argument, NULL, 'j' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL,         0,                 NULL, 0   }
+    };
+    PSPBENCH This;
+    PPSPBENCH pThis = &This;
+    const char *pszJson = NULL;
+    int rc = 0;
+    int chOpt;
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->cIterations     = PSP_BENCH_ITERATIONS_DEFAULT;
+    pThis->cWarmup         = PSP_BENCH_WARMUP_DEFAULT;
+    pThis->cbBulk          = PSP_BENCH_BULK_SZ_DEFAULT;
+    pThis->iFdPerfSyscalls = -1;
+    pspBenchWorkloadsSelect(pThis, "all");
+
+    while ((chOpt = getopt_long(argc, argv, "w:n:s:j:h", &s_aOptions[0], NULL)) != -1)
+    {
+        switch (chOpt)
+        {
+            case 'w':
+                rc = pspBenchWorkloadsSelect(pThis, optarg);
+                break;
+            case 'n':
+                pThis->cIterations = strtoul(optarg, NULL, 0);
+                break;
+            case 'W':
+                pThis->cWarmup = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                pThis->cbBulk = strtoul(optarg, NULL, 0);
+                break;
+            case 'M':
+                pThis->PspAddrMmio  = strtoul(optarg, NULL, 0);
+                pThis->fPspMmioAddr = true;
+                break;
+            case 'S':
+                pThis->SmnAddr  = strtoul(optarg, NULL, 0);
+                pThis->fSmnAddr = true;
+                break;
+            case 'X':
+                pThis->PhysX86Addr = strtoull(optarg, NULL, 0);
+                pThis->fX86Addr    = true;
+                break;
+            case 'c':
+                pThis->pszCm = optarg;
+                break;
+            case 'j':
+                pszJson = optarg;
+                break;
+            case 'h':
+                pspBenchUsage(argv[0]);
+                return 0;
+            default:
+                rc = -1;
+                break;
+        }
+
+        if (rc)
+            break;
+    }
+
+    if (   rc
+        || optind != argc - 1
+        || !pThis->cIterations
+        || !pThis->cbBulk
+        || pThis->cbBulk > UINT32_MAX)
+    {
+        pspBenchUsage(argv[0]);
+        return 1;
+    }
+
+    pThis->pszDevice = argv[optind];
+    if (pThis->pszCm)
+    {
+        rc = pspBenchLoadFromFile(pThis->pszCm, &pThis->pvCm, &pThis->cbCm);
+        if (rc)
+        {
+            fprintf(stderr, "Loading the code module \"%s\" failed with %d\n", pThis->pszCm, rc);
+            return 1;
+        }
+    }
+
+    pThis->pbBulk       = (uint8_t *)calloc(1, pThis->cbBulk);
+    pThis->pacNsSamples = (uint64_t *)calloc(pThis->cIterations, sizeof(*pThis->pacNsSamples));
+    if (   pThis->pbBulk
+        && pThis->pacNsSamples)
+    {
+        rc = PSPProxyCtxCreate(&pThis->hCtx, pThis->pszDevice, NULL /*pIoIf*/, NULL /*pvUser*/);
+        if (!rc)
+        {
+            pThis->iFdPerfSyscalls = pspBenchPerfSyscallsOpen();
+
+            for (uint32_t i = 0; i < pThis->cWorkloads; i++)
+            {
+                int rc2 = pspBenchWorkloadRun(pThis, pThis->apWorkloads[i], &pThis->aResults[i]);
+                if (rc2 && !rc)
+                    rc = rc2;
+            }
+
+            if (pThis->PspAddrScratch)
+                PSPProxyCtxScratchSpaceFree(pThis->hCtx, pThis->PspAddrScratch, pThis->cbBulk);
+            if (pThis->iFdPerfSyscalls != -1)
+                close(pThis->iFdPerfSyscalls);
+            PSPProxyCtxDestroy(pThis->hCtx);
+
+            if (!pszJson || strcmp(pszJson, "-"))
+                pspBenchResultsPrintTable(pThis, stdout);
+
+            if (pszJson)
+            {
+                FILE *pOut = strcmp(pszJson, "-") ? fopen(pszJson, "w") : stdout;
+                if (pOut)
+                {
+                    pspBenchResultsPrintJson(pThis, pOut);
+                    if (pOut != stdout)
+                        fclose(pOut);
+                }
+                else
+                {
+                    fprintf(stderr, "Opening \"%s\" for writing failed with %d\n", pszJson, errno);
+                    rc = errno;
+                }
+            }
+        }
+        else
+            fprintf(stderr, "Opening device \"%s\" failed with %d\n", pThis->pszDevice, rc);
+    }
+    else
+        rc = -1;
+
+    free(pThis->pacNsSamples);
+    free(pThis->pbBulk);
+    free(pThis->pvCm);
+    return rc ? 1 : 0;
+}
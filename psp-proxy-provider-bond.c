@@ -0,0 +1,982 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - bonding of multiple transport links
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The provider stripes a single stub session across several links to the same stub, device schema
+ * looks like bond://[rr|load,][window=<ms>,]<device>,<device>[,...], for example
+ * bond://serial:///dev/ttyUSB0:3000000:8:n:1,serial:///dev/ttyUSB1:3000000:8:n:1.
+ * A new link starts at every comma followed by a provider schema, links which contain such a comma
+ * themselves (stacked providers like uring) have to be put into parentheses.
+ *     - Every packet written is a complete PDU and goes out as a whole over one link, either
+ *       round robin (rr, default) or over the link with the least amount of data queued in the
+ *       kernel (load, links without a descriptor are skipped for the decision).
+ *     - The PDUs received on each link are reassembled and held back until they are in sequence
+ *       according to the PDU counter in the header. Beacons and the connect response restart the
+ *       sequence. If a PDU is still missing after the reorder window the gap is skipped and the PDU
+ *       layer deals with it.
+ * The stub has to process the requests in PDU counter order and may answer on any link, the
+ * simulator models this with links sharing one stub (sim://stub=<id>,...).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+#include <common/cdefs.h>
+#include <common/types.h>
+#include <common/status.h>
+#include <psp-stub/psp-serial-stub.h>
+
+#include "psp-proxy-provider.h"
+
+
+/** Maximum number of links in a bond. */
+#define PSP_BOND_LINKS_MAX              8
+/** Maximum size of a PDU in bytes. */
+#define PSP_BOND_PDU_MAX                _4K
+/** Size of the per link reassembly buffer. */
+#define PSP_BOND_LINK_RX_BUF_SZ         (2 * PSP_BOND_PDU_MAX)
+/** Default reorder window in milliseconds. */
+#define PSP_BOND_REORDER_WINDOW_MS_DEF  100
+/** Time slice for polling links without a descriptor in milliseconds. */
+#define PSP_BOND_POLL_SLICE_MS          1
+
+
+/**
+ * How the outgoing PDUs are distributed over the links.
+ */
+typedef enum PSPBONDSCHED
+{
+    /** Invalid scheduler. */
+    PSPBONDSCHED_INVALID = 0,
+    /** Round robin. */
+    PSPBONDSCHED_ROUND_ROBIN,
+    /** Link with the least amount of data queued. */
+    PSPBONDSCHED_LOAD,
+    /** 32bit hack. */
+    PSPBONDSCHED_32BIT_HACK = 0x7fffffff
+} PSPBONDSCHED;
+
+
+/**
+ * A received PDU.
+ */
+typedef struct PSPBONDPDU
+{
+    /** Next PDU in the list. */
+    struct PSPBONDPDU               *pNext;
+    /** The PDU counter from the header. */
+    uint32_t                        u32Seq;
+    /** Size of the PDU in bytes. */
+    size_t                          cbPdu;
+    /** Number of bytes already read. */
+    size_t                          offRead;
+    /** The PDU data, variable in size. */
+    uint8_t                         abPdu[1];
+} PSPBONDPDU;
+/** Pointer to a received PDU. */
+typedef PSPBONDPDU *PPSPBONDPDU;
+
+
+/**
+ * A single link of the bond.
+ */
+typedef struct PSPBONDLINK
+{
+    /** The provider of the link. */
+    PCPSPPROXYPROV                  pProv;
+    /** The provider context. */
+    PSPPROXYPROVCTX                 hProvCtx;
+    /** The descriptor of the link, -1 if the provider doesn't expose one. */
+    int                             iFd;
+    /** Number of bytes in the reassembly buffer. */
+    size_t                          cbRx;
+    /** The reassembly buffer. */
+    uint8_t                         abRx[PSP_BOND_LINK_RX_BUF_SZ];
+} PSPBONDLINK;
+/** Pointer to a link. */
+typedef PSPBONDLINK *PPSPBONDLINK;
+
+
+/**
+ * Internal PSP proxy provider context.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** Number of links. */
+    uint32_t                        cLinks;
+    /** The links. */
+    PPSPBONDLINK                    apLinks[PSP_BOND_LINKS_MAX];
+    /** The scheduler used for sending. */
+    PSPBONDSCHED                    enmSched;
+    /** The next link to send on for round robin. */
+    uint32_t                        idxLinkNext;
+    /** The link the last PDU was sent on. */
+    uint32_t                        idxLinkLast;
+    /** Flag whether all links expose a descriptor. */
+    bool                            fAllFds;
+    /** The reorder window in nanoseconds. */
+    uint64_t                        cNsReorder;
+    /** Flag whether the next sequence number is known. */
+    bool                            fSeqValid;
+    /** The next PDU counter to deliver. */
+    uint32_t                        u32SeqNext;
+    /** PDUs received out of sequence, in order of arrival. */
+    PPSPBONDPDU                     pHeldHead;
+    /** Point in time the oldest gap was noticed, 0 if there is none. */
+    uint64_t                        tsGapNs;
+    /** Head of the PDUs ready to be read. */
+    PPSPBONDPDU                     pOutHead;
+    /** Tail of the PDUs ready to be read. */
+    PPSPBONDPDU                     pOutTail;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ */
+static uint64_t pspBondTimeNs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Returns whether the given string starts with a provider schema.
+ *
+ * @returns Flag whether a schema starts here.
+ * @param   psz                     The string to check.
+ */
+static bool pspBondIsSchema(const char *psz)
+{
+    const char *pszStart = psz;
+
+    while (   (*psz >= 'a' && *psz <= 'z')
+           || (*psz >= '0' && *psz <= '9'))
+        psz++;
+
+    return psz != pszStart && !strncmp(psz, "://", 3);
+}
+
+
+/**
+ * Splits off the next link device from the given configuration.
+ *
+ * @returns Status code.
+ * @param   pszDevice               The remaining configuration, starting with a link.
+ * @param   ppszLink                Where to store the duplicated link device on success, free with free().
+ * @param   ppszNext                Where to store the pointer to the rest of the configuration.
+ */
+static int pspBondLinkSplit(const char *pszDevice, char **ppszLink, const char **ppszNext)
+{
+    const char *pszEnd = NULL;
+    const char *pszNext = NULL;
+
+    if (*pszDevice == '(')
+    {
+        uint32_t cNested = 1;
+
+        pszDevice++;
+        pszEnd = pszDevice;
+        while (*pszEnd && cNested)
+        {
+            if (*pszEnd == '(')
+                cNested++;
+            else if (*pszEnd == ')')
+                cNested--;
+            pszEnd++;
+        }
+
+        if (cNested)
+            return -1;
+        pszNext = pszEnd--; /* Exclude the closing parenthesis. */
+        if (*pszNext == ',')
+            pszNext++;
+        else if (*pszNext != '\0')
+            return -1;
+    }
+    else
+    {
+        pszEnd = pszDevice;
+        while (   *pszEnd
+               && (   *pszEnd != ','
+                   || !(pspBondIsSchema(pszEnd + 1) || pszEnd[1] == '(')))
+            pszEnd++;
+
+        pszNext = *pszEnd ? pszEnd + 1 : pszEnd;
+    }
+
+    if (pszEnd == pszDevice)
+        return -1;
+
+    *ppszLink = strndup(pszDevice, pszEnd - pszDevice);
+    *ppszNext = pszNext;
+    return *ppszLink ? 0 : -1;
+}
+
+
+/**
+ * Creates a new link from the given device.
+ *
+ * @returns Status code.
+ * @param   ppLink                  Where to store the link on success.
+ * @param   pszDevice               The device of the link.
+ */
+static int pspBondLinkCreate(PPSPBONDLINK *ppLink, const char *pszDevice)
+{
+    const char *pszDevRem = NULL;
+    PCPSPPROXYPROV pProv = pspProxyProvFind(pszDevice, &pszDevRem);
+    if (   !pProv
+        || !pProv->pfnCtxRead) /* Native providers have no byte stream to stripe over. */
+        return -1;
+
+    PPSPBONDLINK pLink = (PPSPBONDLINK)calloc(1, sizeof(*pLink));
+    if (!pLink)
+        return -1;
+
+    pLink->pProv    = pProv;
+    pLink->iFd      = -1;
+    pLink->cbRx     = 0;
+    pLink->hProvCtx = (PSPPROXYPROVCTX)calloc(1, pProv->cbCtx);
+    if (pLink->hProvCtx)
+    {
+        int rc = pProv->pfnCtxInit(pLink->hProvCtx, pszDevRem);
+        if (!rc)
+        {
+            if (   pProv->pfnCtxQueryFd
+                && pProv->pfnCtxQueryFd(pLink->hProvCtx, &pLink->iFd))
+                pLink->iFd = -1;
+
+            *ppLink = pLink;
+            return 0;
+        }
+
+        free(pLink->hProvCtx);
+    }
+
+    free(pLink);
+    return -1;
+}
+
+
+/**
+ * Destroys the given link.
+ *
+ * @returns nothing.
+ * @param   pLink                   The link to destroy.
+ */
+static void pspBondLinkDestroy(PPSPBONDLINK pLink)
+{
+    pLink->pProv->pfnCtxDestroy(pLink->hProvCtx);
+    free(pLink->hProvCtx);
+    free(pLink);
+}
+
+
+/**
+ * Frees all PDUs in the given list.
+ *
+ * @returns nothing.
+ * @param   pPdu                    The head of the list.
+ */
+static void pspBondPduListFree(PPSPBONDPDU pPdu)
+{
+    while (pPdu)
+    {
+        PPSPBONDPDU pNext = pPdu->pNext;
+        free(pPdu);
+        pPdu = pNext;
+    }
+}
+
+
+/**
+ * Returns whether the given PDU restarts the sequence.
+ *
+ * @returns Flag whether the PDU restarts the sequence.
+ * @param   pPdu                    The PDU to check.
+ */
+static bool pspBondPduIsSeqStart(PPSPBONDPDU pPdu)
+{
+    PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pPdu->abPdu[0];
+
+    return    pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_NOTIFICATION_BEACON
+           || pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_RESPONSE_CONNECT;
+}
+
+
+/**
+ * Queues the given PDU for reading and advances the sequence.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   pPdu                    The PDU to deliver, must be unlinked.
+ */
+static void pspBondPduDeliver(PPSPPROXYPROVCTXINT pThis, PPSPBONDPDU pPdu)
+{
+    pThis->fSeqValid  = true;
+    pThis->u32SeqNext = pPdu->u32Seq + 1;
+    pThis->tsGapNs    = 0;
+
+    pPdu->pNext = NULL;
+    if (pThis->pOutTail)
+        pThis->pOutTail->pNext = pPdu;
+    else
+        pThis->pOutHead = pPdu;
+    pThis->pOutTail = pPdu;
+}
+
+
+/**
+ * Moves all held PDUs which are in sequence to the read queue.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   tsNs                    The current point in time.
+ */
+static void pspBondReorder(PPSPPROXYPROVCTXINT pThis, uint64_t tsNs)
+{
+    while (pThis->pHeldHead)
+    {
+        PPSPBONDPDU *ppPdu = &pThis->pHeldHead;
+        PPSPBONDPDU *ppPduFound = NULL;
+
+        while (*ppPdu)
+        {
+            PPSPBONDPDU pPdu = *ppPdu;
+            int32_t i32Dist = (int32_t)(pPdu->u32Seq - pThis->u32SeqNext);
+
+            if (   !pThis->fSeqValid
+                || !i32Dist
+                || pspBondPduIsSeqStart(pPdu))
+            {
+                ppPduFound = ppPdu;
+                break;
+            }
+            else if (i32Dist < 0)
+            {
+                /* Duplicate or too late after skipping a gap, drop it. */
+                *ppPdu = pPdu->pNext;
+                free(pPdu);
+                continue;
+            }
+            else if (   !ppPduFound
+                     || i32Dist < (int32_t)((*ppPduFound)->u32Seq - pThis->u32SeqNext))
+                ppPduFound = ppPdu;
+
+            ppPdu = &pPdu->pNext;
+        }
+
+        if (!ppPduFound)
+            break;
+
+        PPSPBONDPDU pPdu = *ppPduFound;
+        if (   pThis->fSeqValid
+            && pPdu->u32Seq != pThis->u32SeqNext
+            && !pspBondPduIsSeqStart(pPdu))
+        {
+            /* Wait for the missing PDU until the reorder window closes. */
+            if (!pThis->tsGapNs)
+                pThis->tsGapNs = tsNs;
+            if (tsNs - pThis->tsGapNs < pThis->cNsReorder)
+                break;
+        }
+
+        *ppPduFound = pPdu->pNext;
+        pspBondPduDeliver(pThis, pPdu);
+    }
+
+    if (!pThis->pHeldHead)
+        pThis->tsGapNs = 0;
+}
+
+
+/**
+ * Extracts all complete PDUs from the reassembly buffer of the given link.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ * @param   pLink                   The link.
+ */
+static int pspBondLinkRxParse(PPSPPROXYPROVCTXINT pThis, PPSPBONDLINK pLink)
+{
+    while (pLink->cbRx >= sizeof(uint32_t))
+    {
+        PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pLink->abRx[0];
+        size_t cbDrop = 0;
+
+        if (pHdr->u32Magic != PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC)
+            cbDrop = 1; /* Resync. */
+        else if (pLink->cbRx < sizeof(*pHdr))
+            break;
+        else if (pHdr->u.Fields.cbPdu > PSP_BOND_PDU_MAX - sizeof(PSPSERIALPDUHDR) - sizeof(PSPSERIALPDUFOOTER))
+            cbDrop = 1;
+        else
+        {
+            size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~(size_t)7) - pHdr->u.Fields.cbPdu;
+            size_t cbPdu = sizeof(*pHdr) + pHdr->u.Fields.cbPdu + cbPad + sizeof(PSPSERIALPDUFOOTER);
+            if (pLink->cbRx < cbPdu)
+                break;
+
+            /* A corrupted PDU would mess up the sequence, so check it here already. */
+            uint32_t uChkSum = 0;
+            for (uint32_t i = 0; i < sizeof(pHdr->u.ab); i++)
+                uChkSum += pHdr->u.ab[i];
+            const uint8_t *pbPayload = (const uint8_t *)(pHdr + 1);
+            for (size_t i = 0; i < pHdr->u.Fields.cbPdu + cbPad; i++)
+                uChkSum += pbPayload[i];
+
+            PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)(pbPayload + pHdr->u.Fields.cbPdu + cbPad);
+            if (   uChkSum + pFooter->u32ChkSum == 0
+                && pFooter->u32Magic == PSP_SERIAL_PSP_2_EXT_PDU_END_MAGIC)
+            {
+                PPSPBONDPDU pPdu = (PPSPBONDPDU)malloc(sizeof(*pPdu) + cbPdu);
+                if (!pPdu)
+                    return -1;
+
+                pPdu->u32Seq  = pHdr->u.Fields.cPdus;
+                pPdu->cbPdu   = cbPdu;
+                pPdu->offRead = 0;
+                memcpy(&pPdu->abPdu[0], pHdr, cbPdu);
+
+                /* Append to keep the order of arrival. */
+                PPSPBONDPDU *ppTail = &pThis->pHeldHead;
+                while (*ppTail)
+                    ppTail = &(*ppTail)->pNext;
+                pPdu->pNext = NULL;
+                *ppTail     = pPdu;
+                cbDrop = cbPdu;
+            }
+            else
+                cbDrop = 1;
+        }
+
+        memmove(&pLink->abRx[0], &pLink->abRx[cbDrop], pLink->cbRx - cbDrop);
+        pLink->cbRx -= cbDrop;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Reads everything available from all links without blocking and reorders the received PDUs.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ */
+static int pspBondRxPump(PPSPPROXYPROVCTXINT pThis)
+{
+    for (uint32_t i = 0; i < pThis->cLinks; i++)
+    {
+        PPSPBONDLINK pLink = pThis->apLinks[i];
+        size_t cbAvail = pLink->pProv->pfnCtxPeek(pLink->hProvCtx);
+
+        while (cbAvail)
+        {
+            size_t cbThisRead = 0;
+            int rc = pLink->pProv->pfnCtxRead(pLink->hProvCtx, &pLink->abRx[pLink->cbRx],
+                                              MIN(cbAvail, sizeof(pLink->abRx) - pLink->cbRx), &cbThisRead);
+            if (rc)
+                return rc;
+            if (!cbThisRead)
+                break;
+
+            pLink->cbRx += cbThisRead;
+            rc = pspBondLinkRxParse(pThis, pLink);
+            if (rc)
+                return rc;
+
+            cbAvail = pLink->pProv->pfnCtxPeek(pLink->hProvCtx);
+        }
+    }
+
+    pspBondReorder(pThis, pspBondTimeNs());
+    return 0;
+}
+
+
+/**
+ * Returns the number of bytes ready to be read.
+ *
+ * @returns Number of bytes.
+ * @param   pThis                   The provider context.
+ */
+static size_t pspBondRxAvail(PPSPPROXYPROVCTXINT pThis)
+{
+    size_t cbAvail = 0;
+
+    for (PPSPBONDPDU pPdu = pThis->pOutHead; pPdu; pPdu = pPdu->pNext)
+        cbAvail += pPdu->cbPdu - pPdu->offRead;
+
+    return cbAvail;
+}
+
+
+/**
+ * Consumes a pending interrupt.
+ *
+ * @returns Flag whether the provider was interrupted.
+ * @param   pThis                   The provider context.
+ */
+static bool pspBondIntrConsume(PPSPPROXYPROVCTXINT pThis)
+{
+    uint64_t uCnt = 0;
+
+    return read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt)) == sizeof(uCnt);
+}
+
+
+/**
+ * Selects the link to send the next PDU on.
+ *
+ * @returns Pointer to the link.
+ * @param   pThis                   The provider context.
+ */
+static PPSPBONDLINK pspBondLinkSelect(PPSPPROXYPROVCTXINT pThis)
+{
+    uint32_t idxLink = pThis->idxLinkNext;
+
+    if (pThis->enmSched == PSPBONDSCHED_LOAD)
+    {
+        /* Ties are resolved in round robin order, so idle links get used evenly. */
+        int cbQueuedMin = INT32_MAX;
+
+        for (uint32_t i = 0; i < pThis->cLinks; i++)
+        {
+            uint32_t idxCur = (pThis->idxLinkNext + i) % pThis->cLinks;
+            PPSPBONDLINK pLink = pThis->apLinks[idxCur];
+            int cbQueued = 0;
+
+            if (   pLink->iFd > -1
+                && !ioctl(pLink->iFd, TIOCOUTQ, &cbQueued)
+                && cbQueued < cbQueuedMin)
+            {
+                cbQueuedMin = cbQueued;
+                idxLink     = idxCur;
+            }
+        }
+    }
+
+    pThis->idxLinkLast = idxLink;
+    pThis->idxLinkNext = (idxLink + 1) % pThis->cLinks;
+    return pThis->apLinks[idxLink];
+}
+
+
+/**
+ * Parses the options preceding the links.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ * @param   ppszDevice              The configuration, updated to point to the first link on success.
+ */
+static int pspBondCfgParse(PPSPPROXYPROVCTXINT pThis, const char **ppszDevice)
+{
+    const char *pszDevice = *ppszDevice;
+
+    pThis->enmSched   = PSPBONDSCHED_ROUND_ROBIN;
+    pThis->cNsReorder = PSP_BOND_REORDER_WINDOW_MS_DEF * 1000000ULL;
+
+    while (   *pszDevice != '('
+           && !pspBondIsSchema(pszDevice))
+    {
+        if (!strncmp(pszDevice, "rr,", sizeof("rr,") - 1))
+            pThis->enmSched = PSPBONDSCHED_ROUND_ROBIN;
+        else if (!strncmp(pszDevice, "load,", sizeof("load,") - 1))
+            pThis->enmSched = PSPBONDSCHED_LOAD;
+        else if (!strncmp(pszDevice, "window=", sizeof("window=") - 1))
+        {
+            char *pszEnd = NULL;
+
+            errno = 0;
+            unsigned long cMillies = strtoul(pszDevice + sizeof("window=") - 1, &pszEnd, 10);
+            if (   errno
+                || *pszEnd != ',')
+                return -1;
+
+            pThis->cNsReorder = (uint64_t)cMillies * 1000000ULL;
+        }
+        else
+            return -1;
+
+        pszDevice = strchr(pszDevice, ',') + 1;
+    }
+
+    *ppszDevice = pszDevice;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int bondProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pThis->cLinks      = 0;
+    pThis->idxLinkNext = 0;
+    pThis->idxLinkLast = 0;
+    pThis->fSeqValid   = false;
+    pThis->pHeldHead   = NULL;
+    pThis->pOutHead    = NULL;
+    pThis->pOutTail    = NULL;
+    pThis->tsGapNs     = 0;
+    pThis->iFdEvtIntr  = -1;
+
+    int rc = pspBondCfgParse(pThis, &pszDevice);
+    while (   !rc
+           && *pszDevice)
+    {
+        char *pszLink = NULL;
+
+        if (pThis->cLinks == PSP_BOND_LINKS_MAX)
+        {
+            rc = -1;
+            break;
+        }
+
+        rc = pspBondLinkSplit(pszDevice, &pszLink, &pszDevice);
+        if (!rc)
+        {
+            rc = pspBondLinkCreate(&pThis->apLinks[pThis->cLinks], pszLink);
+            if (!rc)
+                pThis->cLinks++;
+            free(pszLink);
+        }
+    }
+
+    if (   !rc
+        && pThis->cLinks)
+    {
+        pThis->fAllFds = true;
+        for (uint32_t i = 0; i < pThis->cLinks; i++)
+            if (pThis->apLinks[i]->iFd == -1)
+                pThis->fAllFds = false;
+
+        pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (pThis->iFdEvtIntr > -1)
+            return 0;
+    }
+
+    for (uint32_t i = 0; i < pThis->cLinks; i++)
+        pspBondLinkDestroy(pThis->apLinks[i]);
+    pThis->cLinks = 0;
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void bondProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    for (uint32_t i = 0; i < pThis->cLinks; i++)
+        pspBondLinkDestroy(pThis->apLinks[i]);
+    pspBondPduListFree(pThis->pHeldHead);
+    pspBondPduListFree(pThis->pOutHead);
+    close(pThis->iFdEvtIntr);
+
+    pThis->cLinks     = 0;
+    pThis->pHeldHead  = NULL;
+    pThis->pOutHead   = NULL;
+    pThis->pOutTail   = NULL;
+    pThis->iFdEvtIntr = -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t bondProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (   !pThis->pOutHead
+        && pspBondRxPump(pThis))
+        return 0;
+
+    return pspBondRxAvail(pThis);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int bondProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint8_t *pbDst = (uint8_t *)pvDst;
+    size_t cbReadTotal = 0;
+
+    *pcbRead = 0;
+    if (!pThis->pOutHead)
+    {
+        int rc = pspBondRxPump(pThis);
+        if (rc)
+            return rc;
+    }
+
+    while (   cbRead
+           && pThis->pOutHead)
+    {
+        PPSPBONDPDU pPdu = pThis->pOutHead;
+        size_t cbThisRead = MIN(cbRead, pPdu->cbPdu - pPdu->offRead);
+
+        memcpy(pbDst, &pPdu->abPdu[pPdu->offRead], cbThisRead);
+        pbDst         += cbThisRead;
+        cbRead        -= cbThisRead;
+        cbReadTotal   += cbThisRead;
+        pPdu->offRead += cbThisRead;
+
+        if (pPdu->offRead == pPdu->cbPdu)
+        {
+            pThis->pOutHead = pPdu->pNext;
+            if (!pThis->pOutHead)
+                pThis->pOutTail = NULL;
+            free(pPdu);
+        }
+    }
+
+    *pcbRead = cbReadTotal;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int bondProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPBONDLINK pLink = pspBondLinkSelect(pThis);
+
+    if (pLink->pProv->pfnCtxWriteV)
+        return pLink->pProv->pfnCtxWriteV(pLink->hProvCtx, paIov, cIov);
+
+    int rc = 0;
+    for (unsigned i = 0; i < cIov && !rc; i++)
+        rc = pLink->pProv->pfnCtxWrite(pLink->hProvCtx, paIov[i].iov_base, paIov[i].iov_len);
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int bondProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    struct iovec Iov;
+
+    /* The packet has to be a complete PDU as it mustn't get split across links. */
+    Iov.iov_base = (void *)pvPkt;
+    Iov.iov_len  = cbPkt;
+    return bondProvCtxWriteV(hProvCtx, &Iov, 1);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int bondProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t tsDeadlineNs = pspBondTimeNs() + (uint64_t)cMillies * 1000000ULL;
+
+    for (;;)
+    {
+        int rc = pspBondRxPump(pThis);
+        if (rc)
+            return rc;
+        if (pThis->pOutHead)
+            return 0;
+
+        uint64_t tsNs = pspBondTimeNs();
+        if (tsNs >= tsDeadlineNs)
+            return STS_ERR_PSP_PROXY_TIMEOUT;
+
+        /* Wake up in time to skip a gap. */
+        uint64_t tsWakeupNs = tsDeadlineNs;
+        if (pThis->tsGapNs)
+            tsWakeupNs = MIN(tsWakeupNs, pThis->tsGapNs + pThis->cNsReorder);
+
+        if (pThis->fAllFds)
+        {
+            struct pollfd aPollFds[PSP_BOND_LINKS_MAX + 1];
+            uint64_t cNsWait = tsWakeupNs > tsNs ? tsWakeupNs - tsNs : 0;
+            struct timespec Ts;
+
+            for (uint32_t i = 0; i < pThis->cLinks; i++)
+            {
+                aPollFds[i].fd      = pThis->apLinks[i]->iFd;
+                aPollFds[i].events  = POLLIN;
+                aPollFds[i].revents = 0;
+            }
+            aPollFds[pThis->cLinks].fd      = pThis->iFdEvtIntr;
+            aPollFds[pThis->cLinks].events  = POLLIN;
+            aPollFds[pThis->cLinks].revents = 0;
+
+            Ts.tv_sec  = cNsWait / 1000000000ULL;
+            Ts.tv_nsec = cNsWait % 1000000000ULL;
+            if (   ppoll(&aPollFds[0], pThis->cLinks + 1, &Ts, NULL) == -1
+                && errno != EINTR)
+                return -1;
+        }
+        else
+        {
+            /*
+             * Not every link can be waited for at once, so give each one a short time slice,
+             * starting with the one the last request went out on as the response likely comes back there.
+             */
+            for (uint32_t i = 0; i < pThis->cLinks; i++)
+            {
+                PPSPBONDLINK pLink = pThis->apLinks[(pThis->idxLinkLast + i) % pThis->cLinks];
+
+                rc = pLink->pProv->pfnCtxPoll(pLink->hProvCtx, PSP_BOND_POLL_SLICE_MS);
+                if (!rc)
+                    break;
+                if (rc != STS_ERR_PSP_PROXY_TIMEOUT)
+                    return rc;
+            }
+        }
+
+        if (pspBondIntrConsume(pThis))
+            return STS_ERR_PSP_PROXY_INTERRUPTED;
+    }
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int bondProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * Provider registration structure.
+ */
+const PSPPROXYPROV g_PspProxyProvBond =
+{
+    /** pszId */
+    "bond",
+    /** pszDesc */
+    "Stripes the session across multiple links to the same stub, device schema looks like "
+    "bond://[rr|load,][window=<reorder window in ms>,]<device>,<device>[,...]",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    0,
+    /** pfnCtxInit */
+    bondProvCtxInit,
+    /** pfnCtxDestroy */
+    bondProvCtxDestroy,
+    /** pfnCtxPeek */
+    bondProvCtxPeek,
+    /** pfnCtxRead */
+    bondProvCtxRead,
+    /** pfnCtxWrite */
+    bondProvCtxWrite,
+    /** pfnCtxPoll */
+    bondProvCtxPoll,
+    /** pfnCtxInterrupt */
+    bondProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    NULL,
+    /** pfnCtxWriteV */
+    bondProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    NULL
+};
@@ -20,25 +20,29 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 
 #include <common/cdefs.h>
+#include <common/status.h>
 
 #include "psp-proxy-provider.h"
-#include "psp-stub-pdu.h"
 
 
 /**
@@ -58,6 +62,10 @@ typedef struct REQHDR
 
 /** Magic identifying the request. */
 #define REQHDR_MAGIC 0xebadc0de
+/** Read command. */
+#define REQHDR_CMD_READ  0
+/** Write command. */
+#define REQHDR_CMD_WRITE 1
 
 
 /**
@@ -97,6 +105,36 @@ typedef struct SPIMSGCHANHDR
 #define SPI_MSG_CHAN_HDR_OFF   0xaab000
 /** THe magic vaue to identify the message channel header (J. R. R. Tolkien). */
 #define SPI_MSG_CHAN_HDR_MAGIC 0x18920103
+/** Size of each ring buffer. */
+#define SPI_MSG_CHAN_RING_SZ   _4K
+
+
+/** Maximum number of flash commands sent in one go. */
+#define EM100_FLASH_CMDS_MAX   4
+/** Default interval between two checks of the message channel right after traffic in microseconds. */
+#define EM100_POLL_MIN_US_DEF  50
+/** Default upper bound for the interval between two checks of the message channel in microseconds. */
+#define EM100_POLL_MAX_US_DEF  10000
+/** How long a write waits for the PSP to free up space in the message channel before giving up in microseconds. */
+#define EM100_TX_STALL_TIMEOUT_US 5000000
+
+
+/**
+ * A flash command queued for sending.
+ */
+typedef struct EM100FLASHCMD
+{
+    /** The command ID (REQHDR_CMD_XXX). */
+    uint32_t                        u32Cmd;
+    /** Start address to access. */
+    uint32_t                        u32AddrStart;
+    /** The buffer to read into or write from. */
+    void                            *pvBuf;
+    /** Number of bytes to transfer. */
+    uint32_t                        cbXfer;
+} EM100FLASHCMD;
+/** Pointer to a flash command. */
+typedef EM100FLASHCMD *PEM100FLASHCMD;
 
 
 /**
@@ -106,10 +144,32 @@ typedef struct PSPPROXYPROVCTXINT
 {
     /** The socket descriptor for the connection to the em100 network server. */
     int                             iFdCon;
-    /** The PDU context. */
-    PSPSTUBPDUCTX                   hPduCtx;
-    /** The message channel header constantly updated. */
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+    /** Poll interval right after traffic in microseconds. */
+    uint32_t                        cUsPollMin;
+    /** Maximum poll interval in microseconds. */
+    uint32_t                        cUsPollMax;
+    /** The current poll interval in microseconds, doubles with every check coming up empty. */
+    uint32_t                        cUsPoll;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** Number of times the message channel was checked for new data. */
+    uint64_t                        cRemotePolls;
+    /**
+     * Our view of the message channel header. The head of the EXT -> PSP ring and the tail of
+     * the PSP -> EXT ring are owned by us, the other two counters get only refreshed when
+     * the ring looks full or empty respectively.
+     */
     SPIMSGCHANHDR                   MsgChanHdr;
+    /** Offset of the first unconsumed byte in the receive buffer. */
+    size_t                          offRx;
+    /** Number of valid bytes in the receive buffer. */
+    size_t                          cbRx;
+    /** The receive buffer, the PSP -> EXT ring gets drained into it. */
+    uint8_t                         abRx[SPI_MSG_CHAN_RING_SZ];
+    /** Staging buffer for gathering the fragments of a packet. */
+    uint8_t                         abTx[SPI_MSG_CHAN_RING_SZ];
 } PSPPROXYPROVCTXINT;
 /** Pointer to an internal PSP proxy context. */
 typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
@@ -117,87 +177,157 @@ typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
 
 
 /**
- * Reads from the given SPI flash address.
+ * Sends the given buffers completely.
  *
  * @returns Status code.
  * @param   pThis                   The EM100 provider instance.
- * @param   u32SpiAddrStart         The flash address to start reading from.
- * @param   pvBuf                   Where to store the read data.
- * @param   cbRead                  How many bytes to read.
+ * @param   paIov                   The buffers to send, modified.
+ * @param   cIov                    Number of buffers.
  */
-static int em100TcpSpiFlashRead(PPSPPROXYPROVCTXINT pThis, uint32_t u32AddrStart, void *pvBuf, size_t cbRead)
+static int em100TcpSendV(PPSPPROXYPROVCTXINT pThis, struct iovec *paIov, unsigned cIov)
 {
-    int rc = 0;
-    REQHDR Req;
-
-    Req.u32Magic     = 0xebadc0de;
-    Req.u32Cmd       = 0;
-    Req.u32AddrStart = u32AddrStart;
-    Req.cbXfer       = cbRead;
-    ssize_t cbXfer = send(pThis->iFdCon, &Req, sizeof(Req), 0);
-    if (cbXfer == sizeof(Req))
+    struct msghdr Msg;
+
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov    = paIov;
+    Msg.msg_iovlen = cIov;
+
+    while (Msg.msg_iovlen)
     {
-        /* Wait for the status code. */
-        int32_t rcReq = 0;
-        cbXfer = recv(pThis->iFdCon, &rcReq, sizeof(rcReq), 0);
-        if (   cbXfer == sizeof(rcReq)
-            && rcReq == 0)
+        ssize_t cbRet = sendmsg(pThis->iFdCon, &Msg, MSG_NOSIGNAL);
+        pThis->cSyscalls++;
+        if (cbRet == -1)
         {
-            cbXfer = recv(pThis->iFdCon, pvBuf, cbRead, 0);
-            if (cbXfer != cbRead)
-                rc = -1;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        size_t cbLeft = cbRet;
+        while (   Msg.msg_iovlen
+               && cbLeft >= Msg.msg_iov->iov_len)
+        {
+            cbLeft -= Msg.msg_iov->iov_len;
+            Msg.msg_iov++;
+            Msg.msg_iovlen--;
+        }
+
+        if (cbLeft)
+        {
+            Msg.msg_iov->iov_base = (uint8_t *)Msg.msg_iov->iov_base + cbLeft;
+            Msg.msg_iov->iov_len -= cbLeft;
         }
-        else
-            rc = -1;
     }
-    else
-        rc = -1;
 
-    return rc;
+    return 0;
 }
 
 
 /**
- * Writes to the given SPI flash address.
+ * Receives exactly the given amount of bytes.
  *
  * @returns Status code.
  * @param   pThis                   The EM100 provider instance.
- * @param   u32SpiAddrStart         The flash address to start writing to.
- * @param   pvBuf                   The data to write.
- * @param   cbWrite                 How many bytes to write.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRecv                  Number of bytes to receive.
  */
-static int em100TcpSpiFlashWrite(PPSPPROXYPROVCTXINT pThis, uint32_t u32AddrStart, const void *pvBuf, size_t cbWrite)
+static int em100TcpRecvAll(PPSPPROXYPROVCTXINT pThis, void *pvBuf, size_t cbRecv)
 {
-    int rc = 0;
-    REQHDR Req;
-
-    Req.u32Magic     = 0xebadc0de;
-    Req.u32Cmd       = 1;
-    Req.u32AddrStart = u32AddrStart;
-    Req.cbXfer       = cbWrite;
-    ssize_t cbXfer = send(pThis->iFdCon, &Req, sizeof(Req), 0);
-    if (cbXfer == sizeof(Req))
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+
+    while (cbRecv)
+    {
+        ssize_t cbRet = recv(pThis->iFdCon, pbBuf, cbRecv, MSG_WAITALL);
+        pThis->cSyscalls++;
+        if (cbRet > 0)
+        {
+            pbBuf  += cbRet;
+            cbRecv -= cbRet;
+        }
+        else if (   cbRet == 0
+                 || errno != EINTR)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Executes the given flash commands, all requests are sent out in one go and the replies
+ * are collected afterwards, so the whole batch costs a single round trip to the emulator.
+ *
+ * @returns Status code.
+ * @param   pThis                   The EM100 provider instance.
+ * @param   paCmds                  The commands to execute in order.
+ * @param   cCmds                   Number of commands.
+ */
+static int em100TcpSpiFlashCmdsExec(PPSPPROXYPROVCTXINT pThis, PEM100FLASHCMD paCmds, uint32_t cCmds)
+{
+    REQHDR aReqs[EM100_FLASH_CMDS_MAX];
+    struct iovec aIov[2 * EM100_FLASH_CMDS_MAX];
+    unsigned cIov = 0;
+
+    if (cCmds > EM100_FLASH_CMDS_MAX)
+        return -1;
+
+    for (uint32_t i = 0; i < cCmds; i++)
     {
-        cbXfer = send(pThis->iFdCon, pvBuf, cbWrite, 0);
-        if (cbXfer == cbWrite)
+        aReqs[i].u32Magic     = REQHDR_MAGIC;
+        aReqs[i].u32Cmd       = paCmds[i].u32Cmd;
+        aReqs[i].u32AddrStart = paCmds[i].u32AddrStart;
+        aReqs[i].cbXfer       = paCmds[i].cbXfer;
+
+        aIov[cIov].iov_base = &aReqs[i];
+        aIov[cIov].iov_len  = sizeof(aReqs[i]);
+        cIov++;
+        if (paCmds[i].u32Cmd == REQHDR_CMD_WRITE)
         {
-            /* Wait for the status code. */
-            int32_t rcReq = 0;
-            cbXfer = recv(pThis->iFdCon, &rcReq, sizeof(rcReq), 0);
-            if (   cbXfer != sizeof(rcReq)
-                || rcReq != 0)
+            aIov[cIov].iov_base = paCmds[i].pvBuf;
+            aIov[cIov].iov_len  = paCmds[i].cbXfer;
+            cIov++;
+        }
+    }
+
+    int rc = em100TcpSendV(pThis, &aIov[0], cIov);
+    for (uint32_t i = 0; i < cCmds && !rc; i++)
+    {
+        /* Wait for the status code, read data follows only on success. */
+        int32_t rcReq = 0;
+        rc = em100TcpRecvAll(pThis, &rcReq, sizeof(rcReq));
+        if (!rc)
+        {
+            if (rcReq != 0)
                 rc = -1;
+            else if (paCmds[i].u32Cmd == REQHDR_CMD_READ)
+                rc = em100TcpRecvAll(pThis, paCmds[i].pvBuf, paCmds[i].cbXfer);
         }
-        else
-            rc = -1;
     }
-    else
-        rc = -1;
 
     return rc;
 }
 
 
+/**
+ * Initializes a flash command.
+ *
+ * @returns nothing.
+ * @param   pCmd                    The command to initialize.
+ * @param   u32Cmd                  The command ID.
+ * @param   u32AddrStart            The flash address to access.
+ * @param   pvBuf                   The buffer to read into or write from.
+ * @param   cbXfer                  Number of bytes to transfer.
+ */
+static void em100TcpSpiFlashCmdInit(PEM100FLASHCMD pCmd, uint32_t u32Cmd, uint32_t u32AddrStart, void *pvBuf,
+                                    size_t cbXfer)
+{
+    pCmd->u32Cmd       = u32Cmd;
+    pCmd->u32AddrStart = u32AddrStart;
+    pCmd->pvBuf        = pvBuf;
+    pCmd->cbXfer       = (uint32_t)cbXfer;
+}
+
+
 /**
  * Init the SPI message buffer structures.
  *
@@ -206,45 +336,54 @@ static int em100TcpSpiFlashWrite(PPSPPROXYPROVCTXINT pThis, uint32_t u32AddrStar
  */
 static int em100TcpSpiMsgBufferInit(PPSPPROXYPROVCTXINT pThis)
 {
+    EM100FLASHCMD Cmd;
+
     pThis->MsgChanHdr.u32Magic      = SPI_MSG_CHAN_HDR_MAGIC;
     pThis->MsgChanHdr.offExt2PspBuf = sizeof(SPIMSGCHANHDR);
-    pThis->MsgChanHdr.offPsp2ExtBuf = sizeof(SPIMSGCHANHDR) + _4K;
-    pThis->MsgChanHdr.Ext2PspRingBuf.cbRingBuf = _4K;
+    pThis->MsgChanHdr.offPsp2ExtBuf = sizeof(SPIMSGCHANHDR) + SPI_MSG_CHAN_RING_SZ;
+    pThis->MsgChanHdr.Ext2PspRingBuf.cbRingBuf = SPI_MSG_CHAN_RING_SZ;
     pThis->MsgChanHdr.Ext2PspRingBuf.offHead   = 0;
     pThis->MsgChanHdr.Ext2PspRingBuf.offTail   = 0;
-    pThis->MsgChanHdr.Psp2ExtRingBuf.cbRingBuf = _4K;
+    pThis->MsgChanHdr.Psp2ExtRingBuf.cbRingBuf = SPI_MSG_CHAN_RING_SZ;
     pThis->MsgChanHdr.Psp2ExtRingBuf.offHead   = 0;
     pThis->MsgChanHdr.Psp2ExtRingBuf.offTail   = 0;
 
-    return em100TcpSpiFlashWrite(pThis, SPI_MSG_CHAN_HDR_OFF, &pThis->MsgChanHdr, sizeof(pThis->MsgChanHdr));
+    em100TcpSpiFlashCmdInit(&Cmd, REQHDR_CMD_WRITE, SPI_MSG_CHAN_HDR_OFF, &pThis->MsgChanHdr, sizeof(pThis->MsgChanHdr));
+    return em100TcpSpiFlashCmdsExec(pThis, &Cmd, 1);
 }
 
 
 /**
- * Updates our copy of the SPI message buffer header.
+ * Takes over the counters owned by the PSP from a freshly read message channel header.
  *
- * @returns Status code.
+ * @returns nothing.
  * @param   pThis                   The EM100 provider instance.
+ * @param   pHdr                    The header read from the flash.
  */
-static int em100TcpSpiMsgBufferHdrFetch(PPSPPROXYPROVCTXINT pThis)
+static void em100TcpSpiMsgBufferHdrUpdate(PPSPPROXYPROVCTXINT pThis, const SPIMSGCHANHDR *pHdr)
 {
-    return em100TcpSpiFlashRead(pThis, SPI_MSG_CHAN_HDR_OFF, &pThis->MsgChanHdr, sizeof(pThis->MsgChanHdr));
+    pThis->MsgChanHdr.Ext2PspRingBuf.offTail = pHdr->Ext2PspRingBuf.offTail % SPI_MSG_CHAN_RING_SZ;
+    pThis->MsgChanHdr.Psp2ExtRingBuf.offHead = pHdr->Psp2ExtRingBuf.offHead % SPI_MSG_CHAN_RING_SZ;
 }
 
 
 /**
- * Returns the amount of free bytes in the ring buffer.
+ * Updates our copy of the SPI message buffer header.
  *
- * @returns Number of bytes free in the ring buffer.
- * @param   pRingBuf                The ring buffer.
+ * @returns Status code.
+ * @param   pThis                   The EM100 provider instance.
  */
-static size_t em100TcpSpiMsgBufferGetFree(PSPIRINGBUF pRingBuf)
+static int em100TcpSpiMsgBufferHdrFetch(PPSPPROXYPROVCTXINT pThis)
 {
-    if (pRingBuf->offHead >= pRingBuf->offTail)
-        return pRingBuf->cbRingBuf - (pRingBuf->offHead - pRingBuf->offTail);
+    SPIMSGCHANHDR Hdr;
+    EM100FLASHCMD Cmd;
+
+    em100TcpSpiFlashCmdInit(&Cmd, REQHDR_CMD_READ, SPI_MSG_CHAN_HDR_OFF, &Hdr, sizeof(Hdr));
+    int rc = em100TcpSpiFlashCmdsExec(pThis, &Cmd, 1);
+    if (!rc)
+        em100TcpSpiMsgBufferHdrUpdate(pThis, &Hdr);
 
-    /* Wrap around. */
-    return pRingBuf->offTail - pRingBuf->offHead;
+    return rc;
 }
 
 
@@ -256,35 +395,21 @@ static size_t em100TcpSpiMsgBufferGetFree(PSPIRINGBUF pRingBuf)
  */
 static size_t em100TcpSpiMsgBufferGetUsed(PSPIRINGBUF pRingBuf)
 {
-    return pRingBuf->cbRingBuf - em100TcpSpiMsgBufferGetFree(pRingBuf);
+    return (pRingBuf->offHead + pRingBuf->cbRingBuf - pRingBuf->offTail) % pRingBuf->cbRingBuf;
 }
 
 
 /**
- * Returns the amount of bytes which can be written in one go, i.e. until the
- * buffer is full or a head pointer wraparound occurs.
+ * Returns the amount of free bytes in the ring buffer.
  *
- * @returns Number of bytes which can be written in one go.
+ * @returns Number of bytes free in the ring buffer.
  * @param   pRingBuf                The ring buffer.
- */
-static size_t em100TcpSpiMsgBufferGetWrite(PSPIRINGBUF pRingBuf)
-{
-    size_t cbFree = em100TcpSpiMsgBufferGetFree(pRingBuf);
-    return MIN(cbFree, pRingBuf->cbRingBuf - pRingBuf->offHead);
-}
-
-
-/**
- * Returns the amount of bytes which can be read in one go, i.e. until the
- * buffer is full or a tail pointer wraparound occurs.
  *
- * @returns Number of bytes which can be read in one go.
- * @param   pRingBuf                The ring buffer.
+ * @note One byte always stays unused, a completely filled ring would be indistinguishable from an empty one.
  */
-static size_t em100TcpSpiMsgBufferGetRead(PSPIRINGBUF pRingBuf)
+static size_t em100TcpSpiMsgBufferGetFree(PSPIRINGBUF pRingBuf)
 {
-    size_t cbUsed = em100TcpSpiMsgBufferGetUsed(pRingBuf);
-    return MIN(cbUsed, pRingBuf->cbRingBuf - pRingBuf->offTail);
+    return pRingBuf->cbRingBuf - 1 - em100TcpSpiMsgBufferGetUsed(pRingBuf);
 }
 
 
@@ -317,226 +442,260 @@ static void em100TcpSpiMsgBufferReadAdv(PSPIRINGBUF pRingBuf, size_t cbRead)
 
 
 /**
- * Writes into the SPI message buffer.
+ * Waits for the interrupt event or the given amount of time.
  *
  * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_INTERRUPTED if the provider was interrupted.
  * @param   pThis                   The EM100 provider instance.
- * @param   pvBuf                   The data to write.
- * @param   cbWrite                 Number of bytes to write.
+ * @param   cUs                     How long to wait in microseconds.
  */
-static int em100TcpSpiMsgBufferWrite(PPSPPROXYPROVCTXINT pThis, const void *pvBuf, size_t cbWrite)
+static int em100TcpWait(PPSPPROXYPROVCTXINT pThis, uint64_t cUs)
 {
-    int rc = 0;
-    uint8_t *pbBuf = (uint8_t *)pvBuf;
-    size_t cbWriteLeft = cbWrite;
+    struct pollfd PollFd;
+    struct timespec Ts;
 
-    do
+    Ts.tv_sec      = cUs / 1000000;
+    Ts.tv_nsec     = (cUs % 1000000) * 1000;
+    PollFd.fd      = pThis->iFdEvtIntr;
+    PollFd.events  = POLLIN;
+    PollFd.revents = 0;
+    int rcPsx = ppoll(&PollFd, 1, &Ts, NULL);
+    pThis->cSyscalls++;
+    if (rcPsx == 1)
     {
-        rc = em100TcpSpiMsgBufferHdrFetch(pThis);
-        if (!rc)
-        {
-            /* Check whether we have room to write the data into the ring buffer. */
-            size_t cbThisWrite = MIN(cbWriteLeft,
-                                     em100TcpSpiMsgBufferGetWrite(&pThis->MsgChanHdr.Ext2PspRingBuf));
-            if (cbThisWrite)
-            {
-                /* Write the data. */
-                size_t offSpiFlashWrite =   SPI_MSG_CHAN_HDR_OFF                       /* Static offset. */
-                                          + pThis->MsgChanHdr.offExt2PspBuf            /* Relative offset where the data area of the ring buffer starts. */
-                                          + pThis->MsgChanHdr.Ext2PspRingBuf.offHead;  /* Offset into the data area to write. */
-                rc = em100TcpSpiFlashWrite(pThis, offSpiFlashWrite, pbBuf, cbThisWrite);
-                if (!rc)
-                {
-                    pbBuf       += cbThisWrite;
-                    cbWriteLeft -= cbThisWrite;
-                    em100TcpSpiMsgBufferWriteAdv(&pThis->MsgChanHdr.Ext2PspRingBuf, cbThisWrite);
-                    /* Update the pointer in flash. */
-                    rc = em100TcpSpiFlashWrite(pThis, SPI_MSG_CHAN_HDR_OFF + offsetof(SPIMSGCHANHDR, Ext2PspRingBuf.offHead),
-                                               &pThis->MsgChanHdr.Ext2PspRingBuf.offHead,
-                                               sizeof(pThis->MsgChanHdr.Ext2PspRingBuf.offHead));
-                }
-            }
-        }
-    } while (   !rc
-             && cbWriteLeft);
+        /* Consume the interrupt. */
+        uint64_t uCnt = 0;
+        ssize_t cbRead = read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+        return cbRead == sizeof(uCnt) || errno == EAGAIN ? STS_ERR_PSP_PROXY_INTERRUPTED : -1;
+    }
 
-    return rc;
+    return rcPsx == -1 && errno != EINTR ? -1 : 0;
+}
+
+
+/**
+ * Returns the current monotonic time in microseconds.
+ *
+ * @returns Timestamp in microseconds.
+ */
+static uint64_t em100TcpTimeUs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000 + Ts.tv_nsec / 1000;
 }
 
 
 /**
- * Reads from the SPI message buffer.
+ * Writes into the SPI message buffer.
  *
  * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_TIMEOUT if the PSP didn't free up any space for too long.
+ * @retval  STS_ERR_PSP_PROXY_INTERRUPTED if interrupted while waiting for space.
  * @param   pThis                   The EM100 provider instance.
- * @param   pvBuf                   Where to store the read data.
- * @param   cbRead                  Number of bytes to read.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
  */
-static int em100TcpSpiMsgBufferRead(PPSPPROXYPROVCTXINT pThis, void *pvBuf, size_t cbRead)
+static int em100TcpSpiMsgBufferWrite(PPSPPROXYPROVCTXINT pThis, const void *pvBuf, size_t cbWrite)
 {
+    PSPIRINGBUF pRingBuf = &pThis->MsgChanHdr.Ext2PspRingBuf;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    uint64_t tsDeadlineUs = 0;
+    uint64_t cUsWait = pThis->cUsPollMin;
     int rc = 0;
-    uint8_t *pbBuf = (uint8_t *)pvBuf;
-    size_t cbReadLeft = cbRead;
 
-    do
+    while (   !rc
+           && cbWrite)
     {
-        rc = em100TcpSpiMsgBufferHdrFetch(pThis);
-        if (!rc)
+        /* The header is only fetched when the ring looks full, the PSP might have consumed data meanwhile. */
+        size_t cbFree = em100TcpSpiMsgBufferGetFree(pRingBuf);
+        if (cbFree < cbWrite)
         {
-            /* Check whether we have room to write the data into the ring buffer. */
-            size_t cbThisRead = MIN(cbReadLeft,
-                                    em100TcpSpiMsgBufferGetRead(&pThis->MsgChanHdr.Psp2ExtRingBuf));
-            if (cbThisRead)
+            rc = em100TcpSpiMsgBufferHdrFetch(pThis);
+            if (rc)
+                break;
+            cbFree = em100TcpSpiMsgBufferGetFree(pRingBuf);
+            if (!cbFree)
             {
-                /* Write the data. */
-                size_t offSpiFlashRead =   SPI_MSG_CHAN_HDR_OFF                       /* Static offset. */
-                                         + pThis->MsgChanHdr.offPsp2ExtBuf            /* Relative offset where the data area of the ring buffer starts. */
-                                         + pThis->MsgChanHdr.Psp2ExtRingBuf.offTail;  /* Offset into the data area to read. */
-                rc = em100TcpSpiFlashRead(pThis, offSpiFlashRead, pbBuf, cbThisRead);
-                if (!rc)
+                /* The ring is full, back off the same way as when polling for data but give up eventually. */
+                uint64_t tsUs = em100TcpTimeUs();
+                if (!tsDeadlineUs)
+                    tsDeadlineUs = tsUs + EM100_TX_STALL_TIMEOUT_US;
+                else if (tsUs >= tsDeadlineUs)
                 {
-                    pbBuf      += cbThisRead;
-                    cbReadLeft -= cbThisRead;
-                    em100TcpSpiMsgBufferReadAdv(&pThis->MsgChanHdr.Psp2ExtRingBuf, cbThisRead);
-                    /* Update the pointer in flash. */
-                    rc = em100TcpSpiFlashWrite(pThis, SPI_MSG_CHAN_HDR_OFF + offsetof(SPIMSGCHANHDR, Psp2ExtRingBuf.offTail),
-                                               &pThis->MsgChanHdr.Psp2ExtRingBuf.offTail,
-                                               sizeof(pThis->MsgChanHdr.Psp2ExtRingBuf.offTail));
+                    rc = STS_ERR_PSP_PROXY_TIMEOUT;
+                    break;
                 }
+
+                rc = em100TcpWait(pThis, MIN(cUsWait, tsDeadlineUs - tsUs));
+                cUsWait = MIN(2 * cUsWait, pThis->cUsPollMax);
+                continue;
             }
         }
-    } while (   !rc
-             && cbReadLeft);
 
+        /* Progress was made, a later stall gets the full timeout again. */
+        tsDeadlineUs = 0;
+        cUsWait      = pThis->cUsPollMin;
+
+        /*
+         * The data (split in two at the end of the ring) and the head pointer update go out together,
+         * the emulator processes the commands in order so the PSP never sees the pointer before the data.
+         */
+        EM100FLASHCMD aCmds[3];
+        uint32_t cCmds = 0;
+        size_t cbThisWrite = MIN(cbWrite, cbFree);
+        size_t cbLeft = cbThisWrite;
+        while (cbLeft)
+        {
+            size_t cbChunk = MIN(cbLeft, pRingBuf->cbRingBuf - pRingBuf->offHead);
+
+            em100TcpSpiFlashCmdInit(&aCmds[cCmds++], REQHDR_CMD_WRITE,
+                                    SPI_MSG_CHAN_HDR_OFF + pThis->MsgChanHdr.offExt2PspBuf + pRingBuf->offHead,
+                                    (void *)pbBuf, cbChunk);
+            em100TcpSpiMsgBufferWriteAdv(pRingBuf, cbChunk);
+            pbBuf  += cbChunk;
+            cbLeft -= cbChunk;
+        }
+
+        em100TcpSpiFlashCmdInit(&aCmds[cCmds++], REQHDR_CMD_WRITE,
+                                SPI_MSG_CHAN_HDR_OFF + offsetof(SPIMSGCHANHDR, Ext2PspRingBuf.offHead),
+                                &pRingBuf->offHead, sizeof(pRingBuf->offHead));
+        rc = em100TcpSpiFlashCmdsExec(pThis, &aCmds[0], cCmds);
+        cbWrite -= cbThisWrite;
+    }
+
+    /* A response is likely to follow soon. */
+    pThis->cUsPoll = pThis->cUsPollMin;
     return rc;
 }
 
 
 /**
- * Checks how many bytes are available for reading in the message buffer.
+ * Drains the SPI message buffer into the receive buffer.
  *
  * @returns Status code.
  * @param   pThis                   The EM100 provider instance.
- * @param   pcbAvail                Where to store the number of bytes available for reading on success.
- */
-static int em100TcpSpiMsgBufferPeek(PPSPPROXYPROVCTXINT pThis, size_t *pcbAvail)
-{
-    *pcbAvail = 0;
-
-    int rc = em100TcpSpiMsgBufferHdrFetch(pThis);
-    if (!rc)
-        *pcbAvail = em100TcpSpiMsgBufferGetUsed(&pThis->MsgChanHdr.Psp2ExtRingBuf);
-
-    return rc;
-}
-
-
-/**
- * @copydoc{PSPSTUBPDUIOIF,pfnPeek}
+ *
+ * @note Must only be called when the receive buffer is empty.
  */
-static size_t em100TcpProvPduIoIfPeek(PSPSTUBPDUCTX hPspStubPduCtx, void *pvUser)
+static int em100TcpSpiMsgBufferRxFill(PPSPPROXYPROVCTXINT pThis)
 {
-    (void)hPspStubPduCtx;
+    PSPIRINGBUF pRingBuf = &pThis->MsgChanHdr.Psp2ExtRingBuf;
 
-    PPSPPROXYPROVCTXINT pThis = (PPSPPROXYPROVCTXINT)pvUser;
-    size_t cbAvail = 0;
-    int rc = em100TcpSpiMsgBufferPeek(pThis, &cbAvail);
-    if (!rc)
-        return cbAvail;
+    pThis->offRx = 0;
+    pThis->cbRx  = 0;
 
-    return 0;
-}
+    /* The header is only fetched when the ring looks empty. */
+    size_t cbUsed = em100TcpSpiMsgBufferGetUsed(pRingBuf);
+    if (!cbUsed)
+    {
+        pThis->cRemotePolls++;
+        int rc = em100TcpSpiMsgBufferHdrFetch(pThis);
+        if (rc)
+            return rc;
+
+        cbUsed = em100TcpSpiMsgBufferGetUsed(pRingBuf);
+        if (!cbUsed)
+            return 0;
+    }
 
+    /*
+     * Read everything available (split in two at the end of the ring), release the space and
+     * fetch the header again in one go, which tells right away whether more data arrived meanwhile.
+     */
+    EM100FLASHCMD aCmds[4];
+    SPIMSGCHANHDR Hdr;
+    uint32_t cCmds = 0;
+    size_t cbLeft = cbUsed;
+    while (cbLeft)
+    {
+        size_t cbChunk = MIN(cbLeft, pRingBuf->cbRingBuf - pRingBuf->offTail);
 
-/**
- * @copydoc{PSPSTUBPDUIOIF,pfnRead}
- */
-static int em100TcpProvPduIoIfRead(PSPSTUBPDUCTX hPspStubPduCtx, void *pvUser, void *pvDst, size_t cbRead, size_t *pcbRead)
-{
-    (void)hPspStubPduCtx;
+        em100TcpSpiFlashCmdInit(&aCmds[cCmds++], REQHDR_CMD_READ,
+                                SPI_MSG_CHAN_HDR_OFF + pThis->MsgChanHdr.offPsp2ExtBuf + pRingBuf->offTail,
+                                &pThis->abRx[cbUsed - cbLeft], cbChunk);
+        em100TcpSpiMsgBufferReadAdv(pRingBuf, cbChunk);
+        cbLeft -= cbChunk;
+    }
 
-    PPSPPROXYPROVCTXINT pThis = (PPSPPROXYPROVCTXINT)pvUser;
-    int rc = em100TcpSpiMsgBufferRead(pThis, pvDst, cbRead);
+    em100TcpSpiFlashCmdInit(&aCmds[cCmds++], REQHDR_CMD_WRITE,
+                            SPI_MSG_CHAN_HDR_OFF + offsetof(SPIMSGCHANHDR, Psp2ExtRingBuf.offTail),
+                            &pRingBuf->offTail, sizeof(pRingBuf->offTail));
+    em100TcpSpiFlashCmdInit(&aCmds[cCmds++], REQHDR_CMD_READ, SPI_MSG_CHAN_HDR_OFF, &Hdr, sizeof(Hdr));
+    int rc = em100TcpSpiFlashCmdsExec(pThis, &aCmds[0], cCmds);
     if (!rc)
-        *pcbRead = cbRead;
+    {
+        em100TcpSpiMsgBufferHdrUpdate(pThis, &Hdr);
+        pThis->cbRx    = cbUsed;
+        pThis->cUsPoll = pThis->cUsPollMin;
+    }
 
     return rc;
 }
 
 
 /**
- * @copydoc{PSPSTUBPDUIOIF,pfnWrite}
+ * Parses the poll options preceding the server address.
+ *
+ * @returns Status code.
+ * @param   pThis                   The EM100 provider instance.
+ * @param   ppszDevice              The device configuration, updated to point to the server address on success.
  */
-static int em100TcpProvPduIoIfWrite(PSPSTUBPDUCTX hPspStubPduCtx, void *pvUser, const void *pvPkt, size_t cbPkt)
+static int em100TcpCfgParse(PPSPPROXYPROVCTXINT pThis, const char **ppszDevice)
 {
-    (void)hPspStubPduCtx;
-
-    PPSPPROXYPROVCTXINT pThis = (PPSPPROXYPROVCTXINT)pvUser;
-    return em100TcpSpiMsgBufferWrite(pThis, pvPkt, cbPkt);
-}
-
+    const char *pszDevice = *ppszDevice;
 
-/**
- * @copydoc{PSPSTUBPDUIOIF,pfnPoll}
- */
-static int em100TcpProvPduIoIfPoll(PSPSTUBPDUCTX hPspStubPduCtx, void *pvUser, uint32_t cMillies)
-{
-    (void)hPspStubPduCtx;
-    PPSPPROXYPROVCTXINT pThis = (PPSPPROXYPROVCTXINT)pvUser;
+    pThis->cUsPollMin = EM100_POLL_MIN_US_DEF;
+    pThis->cUsPollMax = EM100_POLL_MAX_US_DEF;
 
-    /* Do a peek until there is something available, inefficient but what choice do we have... */
-    int rc = 0;
-    size_t cbAvail = 0;
-    do
+    for (;;)
     {
-        /** @todo Maybe sleep for a short period if this turns out to be super inefficient. */
-        rc = em100TcpSpiMsgBufferPeek(pThis, &cbAvail);
-    } while (   !rc
-             && !cbAvail);
+        uint32_t *pcUs = NULL;
 
-    return rc;
-}
+        if (!strncmp(pszDevice, "poll-min=", sizeof("poll-min=") - 1))
+            pcUs = &pThis->cUsPollMin;
+        else if (!strncmp(pszDevice, "poll-max=", sizeof("poll-max=") - 1))
+            pcUs = &pThis->cUsPollMax;
+        else
+            break;
+
+        char *pszEnd = NULL;
+        errno = 0;
+        unsigned long cUs = strtoul(strchr(pszDevice, '=') + 1, &pszEnd, 10);
+        if (   errno
+            || *pszEnd != ','
+            || cUs > UINT32_MAX)
+            return -1;
+
+        *pcUs     = (uint32_t)cUs;
+        pszDevice = pszEnd + 1;
+    }
 
+    if (   !pThis->cUsPollMin
+        || pThis->cUsPollMin > pThis->cUsPollMax)
+        return -1;
 
-/**
- * @copydoc{PSPSTUBPDUIOIF,pfnInterrupt}
- */
-static int em100TcpProvPduIoIfInterrupt(PSPSTUBPDUCTX hPspStubPduCtx, void *pvUser)
-{
-    return -1; /** @todo */
+    pThis->cUsPoll = pThis->cUsPollMin;
+    *ppszDevice    = pszDevice;
+    return 0;
 }
 
 
-/**
- * I/O interface callback table.
- */
-static const PSPSTUBPDUIOIF g_PduIoIf =
-{
-    /** pfnPeek */
-    em100TcpProvPduIoIfPeek,
-    /** pfnRead */
-    em100TcpProvPduIoIfRead,
-    /** pfnWrite */
-    em100TcpProvPduIoIfWrite,
-    /** pfnPoll */
-    em100TcpProvPduIoIfPoll,
-    /** pfnInterrupt */
-    em100TcpProvPduIoIfInterrupt,
-    /** pfnLogMsg */
-    NULL
-};
-
-
 /**
  * @copydoc{PSPPROXYPROV,pfnCtxInit}
  */
-static int em100TcpProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice, PFNPSPPROXYLOGMSGRECV pfnLogMsg,
-                               void *pvUser)
+static int em100TcpProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
     int rc = 0;
     char szDev[256]; /* Should be plenty. */
 
+    pThis->cSyscalls    = 0;
+    pThis->cRemotePolls = 0;
+    if (em100TcpCfgParse(pThis, &pszDevice))
+        return -1;
+
     memset(&szDev[0], 0, sizeof(szDev));
     strncpy(&szDev[0], pszDevice, sizeof(szDev));
     if (szDev[sizeof(szDev) - 1] == '\0')
@@ -558,22 +717,23 @@ static int em100TcpProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice,
                 pThis->iFdCon = socket(AF_INET, SOCK_STREAM, 0);
                 if (pThis->iFdCon > -1)
                 {
-                    int rcPsx = connect(pThis->iFdCon,(struct sockaddr *)&SrvAddr,sizeof(SrvAddr));
+                    /* Disable nagle, the requests of a batch are sent in one go anyway. */
+                    int fNoDelay = 1;
+                    int rcPsx = setsockopt(pThis->iFdCon, IPPROTO_TCP, TCP_NODELAY, &fNoDelay, sizeof(int));
+                    if (!rcPsx)
+                        rcPsx = connect(pThis->iFdCon,(struct sockaddr *)&SrvAddr,sizeof(SrvAddr));
                     if (!rcPsx)
                     {
+                        pThis->offRx = 0;
+                        pThis->cbRx  = 0;
                         rc = em100TcpSpiMsgBufferInit(pThis);
                         if (!rc)
                         {
-                            /* Create the PDU context. */
-                            rc = pspStubPduCtxCreate(&pThis->hPduCtx, &g_PduIoIf, pThis);
-                            if (!rc)
-                            {
-                                rc = pspStubPduCtxConnect(pThis->hPduCtx, 10 * 1000);
-                                if (!rc)
-                                    return 0;
-
-                                pspStubPduCtxDestroy(pThis->hPduCtx);
-                            }
+                            pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                            if (pThis->iFdEvtIntr > -1)
+                                return 0;
+
+                            rc = -1;
                         }
                     }
                     else
@@ -604,120 +764,163 @@ static void em100TcpProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    pspStubPduCtxDestroy(pThis->hPduCtx);
     shutdown(pThis->iFdCon, SHUT_RDWR);
     close(pThis->iFdCon);
-    pThis->iFdCon = 0;
+    close(pThis->iFdEvtIntr);
+    pThis->iFdCon     = 0;
+    pThis->iFdEvtIntr = -1;
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxQueryInfo}
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
  */
-static int em100TcpProvCtxQueryInfo(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR *pPspAddrScratchStart, size_t *pcbScratch)
+static size_t em100TcpProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxQueryInfo(pThis->hPduCtx, idCcd, pPspAddrScratchStart, pcbScratch);
-}
 
+    if (   pThis->offRx == pThis->cbRx
+        && em100TcpSpiMsgBufferRxFill(pThis))
+        return 0;
 
-/**
- * @copydoc{PSPPROXYPROV,pfnCtxPspSmnRead}
- */
-static int em100TcpProvCtxPspSmnRead(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal)
-{
-    PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspSmnRead(pThis->hPduCtx, idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
+    return pThis->cbRx - pThis->offRx;
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspSmnWrite}
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
  */
-static int em100TcpProvCtxPspSmnWrite(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, const void *pvVal)
+static int em100TcpProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspSmnWrite(pThis->hPduCtx, idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
-}
 
+    *pcbRead = 0;
+    if (pThis->offRx == pThis->cbRx)
+    {
+        int rc = em100TcpSpiMsgBufferRxFill(pThis);
+        if (rc)
+            return rc;
+    }
 
-/**
- * @copydoc{PSPPROXYPROV,pfnCtxPspMemRead}
- */
-static int em100TcpProvCtxPspMemRead(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, void *pvBuf, uint32_t cbRead)
-{
-    PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspMemRead(pThis->hPduCtx, idCcd, uPspAddr, pvBuf, cbRead);
+    size_t cbThisRead = MIN(cbRead, pThis->cbRx - pThis->offRx);
+    memcpy(pvDst, &pThis->abRx[pThis->offRx], cbThisRead);
+    pThis->offRx += cbThisRead;
+    *pcbRead      = cbThisRead;
+    return 0;
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspMemWrite}
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
  */
-static int em100TcpProvCtxPspMemWrite(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, const void *pvBuf, uint32_t cbWrite)
+static int em100TcpProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspMemWrite(pThis->hPduCtx, idCcd, uPspAddr, pvBuf, cbWrite);
-}
+    size_t cbTx = 0;
+    int rc = 0;
 
+    /* Gather the fragments so a whole packet goes into the ring with a single batch. */
+    for (unsigned i = 0; i < cIov && !rc; i++)
+    {
+        const uint8_t *pbSrc = (const uint8_t *)paIov[i].iov_base;
+        size_t cbLeft = paIov[i].iov_len;
 
-/**
- * @copydoc{PSPPROXYPROV,pfnCtxPspMmioRead}
- */
-static int em100TcpProvCtxPspMmioRead(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, uint32_t cbVal, void *pvVal)
-{
-    PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspMmioRead(pThis->hPduCtx, idCcd, uPspAddr, pvVal, cbVal);
-}
+        while (   !rc
+               && cbLeft)
+        {
+            size_t cbThisCopy = MIN(cbLeft, sizeof(pThis->abTx) - cbTx);
 
+            memcpy(&pThis->abTx[cbTx], pbSrc, cbThisCopy);
+            cbTx   += cbThisCopy;
+            pbSrc  += cbThisCopy;
+            cbLeft -= cbThisCopy;
+            if (cbTx == sizeof(pThis->abTx))
+            {
+                rc = em100TcpSpiMsgBufferWrite(pThis, &pThis->abTx[0], cbTx);
+                cbTx = 0;
+            }
+        }
+    }
 
-/**
- * @copydoc{PSPPROXYPROV,pfnCtxPspMmioWrite}
- */
-static int em100TcpProvCtxPspMmioWrite(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, uint32_t cbVal, const void *pvVal)
-{
-    PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspMmioWrite(pThis->hPduCtx, idCcd, uPspAddr, pvVal, cbVal);
+    if (   !rc
+        && cbTx)
+        rc = em100TcpSpiMsgBufferWrite(pThis, &pThis->abTx[0], cbTx);
+
+    return rc;
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspX86MemRead}
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
  */
-static int em100TcpProvCtxPspX86MemRead(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, void *pvBuf, uint32_t cbRead)
+static int em100TcpProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspX86MemRead(pThis->hPduCtx, idCcd, PhysX86Addr, pvBuf, cbRead);
+
+    return em100TcpSpiMsgBufferWrite(pThis, pvPkt, cbPkt);
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspX86MemWrite}
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
  */
-static int em100TcpProvCtxPspX86MemWrite(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, const void *pvBuf, uint32_t cbWrite)
+static int em100TcpProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspX86MemWrite(pThis->hPduCtx, idCcd, PhysX86Addr, pvBuf, cbWrite);
+    uint64_t tsDeadlineUs = em100TcpTimeUs() + (uint64_t)cMillies * 1000;
+
+    /*
+     * There is no way to get notified about new data, so check the message channel periodically.
+     * Data is expected right after traffic, so the checks start tight and back off exponentially
+     * while nothing arrives to not saturate the emulator when idle.
+     */
+    for (;;)
+    {
+        if (pThis->offRx < pThis->cbRx)
+            return 0;
+
+        int rc = em100TcpSpiMsgBufferRxFill(pThis);
+        if (rc)
+            return rc;
+        if (pThis->cbRx)
+            return 0;
+
+        uint64_t tsUs = em100TcpTimeUs();
+        if (tsUs >= tsDeadlineUs)
+            return STS_ERR_PSP_PROXY_TIMEOUT;
+
+        rc = em100TcpWait(pThis, MIN(pThis->cUsPoll, tsDeadlineUs - tsUs));
+        if (rc)
+            return rc;
+
+        pThis->cUsPoll = MIN(2 * pThis->cUsPoll, pThis->cUsPollMax);
+    }
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspX86MmioRead}
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
  */
-static int em100TcpProvCtxPspX86MmioRead(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, uint32_t cbVal, void *pvVal)
+static int em100TcpProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspX86MmioRead(pThis->hPduCtx, idCcd, PhysX86Addr, pvVal, cbVal);
+    uint64_t uCnt = 1;
+
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
 }
 
 
 /**
- * @copydoc{PSPPROXYPROV,pfnCtxPspX86MmioWrite}
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
  */
-static int em100TcpProvCtxPspX86MmioWrite(PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, uint32_t cbVal, const void *pvVal)
+static int em100TcpProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    return pspStubPduCtxPspX86MmioWrite(pThis->hPduCtx, idCcd, PhysX86Addr, pvVal, cbVal);
+
+    pStats->cSyscalls    = pThis->cSyscalls;
+    pStats->cRemotePolls = pThis->cRemotePolls;
+    return 0;
 }
 
 
@@ -729,39 +932,26 @@ const PSPPROXYPROV g_PspProxyProvEm100Tcp =
     /** pszId */
     "em100tcp",
     /** pszDesc */
-    "PSP access through a SPI connection using a modified em100 tool device, schema looks like tcp://<hostname>:<port>",
+    "PSP access through a SPI connection using a modified em100 tool device, schema looks like "
+    "em100tcp://[poll-min=<us>,][poll-max=<us>,]<hostname>:<port>",
     /** cbCtx */
     sizeof(PSPPROXYPROVCTXINT),
     /** fFeatures */
-    0,
+    PSPPROXY_CAPS_F_BATCHING,
     /** pfnCtxInit */
     em100TcpProvCtxInit,
     /** pfnCtxDestroy */
     em100TcpProvCtxDestroy,
-    /** pfnCtxQueryInfo */
-    em100TcpProvCtxQueryInfo,
-    /** pfnCtxPspSmnRead */
-    em100TcpProvCtxPspSmnRead,
-    /** pfnCtxPspSmnWrite */
-    em100TcpProvCtxPspSmnWrite,
-    /** pfnCtxPspMemRead */
-    em100TcpProvCtxPspMemRead,
-    /** pfnCtxPspMemWrite */
-    em100TcpProvCtxPspMemWrite,
-    /** pfnCtxPspMmioRead */
-    em100TcpProvCtxPspMmioRead,
-    /** pfnCtxPspMmioWrite */
-    em100TcpProvCtxPspMmioWrite,
-    /** pfnCtxPspX86MemRead */
-    em100TcpProvCtxPspX86MemRead,
-    /** pfnCtxPspX86MemWrite */
-    em100TcpProvCtxPspX86MemWrite,
-    /** pfnCtxPspX86MmioRead */
-    em100TcpProvCtxPspX86MmioRead,
-    /** pfnCtxPspX86MmioWrite */
-    em100TcpProvCtxPspX86MmioWrite,
-    /** pfnCtxPspSvcCall */
-    NULL,
+    /** pfnCtxPeek */
+    em100TcpProvCtxPeek,
+    /** pfnCtxRead */
+    em100TcpProvCtxRead,
+    /** pfnCtxWrite */
+    em100TcpProvCtxWrite,
+    /** pfnCtxPoll */
+    em100TcpProvCtxPoll,
+    /** pfnCtxInterrupt */
+    em100TcpProvCtxInterrupt,
     /** pfnCtxX86SmnRead */
     NULL,
     /** pfnCtxX86SmnWrite */
@@ -781,6 +971,37 @@ const PSPPROXYPROV g_PspProxyProvEm100Tcp =
     /** pfnCtxEmuWaitForWork */
     NULL,
     /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    em100TcpProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    em100TcpProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
     NULL
 };
-
@@ -22,116 +22,92 @@
 
 #define _DEFAULT_SOURCE
 #include <errno.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <termios.h>
+/* termios2 for arbitrary baud rates, can't be mixed with the glibc termios.h. */
+#include <asm/termbits.h>
+#include <linux/serial.h>
 
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 
 #include <common/cdefs.h>
 #include <common/types.h>
+#include <psp-stub/psp-serial-stub.h>
 
 #include "psp-proxy-provider.h"
 
 
+/** Maximum number of baud rates to try when detecting the rate the stub runs at. */
+#define PSP_SERIAL_BAUDRATES_MAX        8
+/** How long to listen for a beacon from the stub at each baud rate in milliseconds. */
+#define PSP_SERIAL_AUTOBAUD_PROBE_MS    1500
+/** Latency timer value to set for FTDI adapters in milliseconds (the default is 16). */
+#define PSP_SERIAL_FTDI_LATENCY_TIMER   1
+/** Size of the userspace receive buffer. */
+#define PSP_SERIAL_RX_BUF_SZ            (16 * 1024)
+/** How long a write waits for the UART to drain some of the output buffer before giving up in milliseconds. */
+#define PSP_SERIAL_TX_STALL_TIMEOUT_MS  5000
+
+
 /**
  * Internal PSP proxy provider context.
  */
 typedef struct PSPPROXYPROVCTXINT
 {
-    /** The file descriptor of the device proxying our calls. */
+    /** The file descriptor of the device proxying our calls, always in non blocking mode. */
     int                             iFdDev;
-    /** Flag whether we are currently in blocking mode. */
-    bool                            fBlocking;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+    /** Offset of the first unconsumed byte in the receive buffer. */
+    size_t                          offRx;
+    /** Number of valid bytes in the receive buffer. */
+    size_t                          cbRx;
+    /** The receive buffer, peek and read are served from it. */
+    uint8_t                         abRx[PSP_SERIAL_RX_BUF_SZ];
 } PSPPROXYPROVCTXINT;
 /** Pointer to an internal PSP proxy context. */
 typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
 
 
 /**
- * Baud rate conversion descriptor.
- */
-typedef struct PSPPROXYSERIALBAUDRATECONV
-{
-    /** The baudrate. */
-    uint32_t                        u32BaudRate;
-    /** The termios API identifier. */
-    speed_t                         TermiosSpeed;
-} PSPPROXYSERIALBAUDRATECONV;
-/** Pointer to a baud rate conversion descriptor. */
-typedef PSPPROXYSERIALBAUDRATECONV *PPSPPROXYSERIALBAUDRATECONV;
-/** Pointer to a const baud rate conversion descriptor. */
-typedef const PSPPROXYSERIALBAUDRATECONV *PCPSPPROXYSERIALBAUDRATECONV;
-
-
-/** Baud rate conversion table. */
-static const PSPPROXYSERIALBAUDRATECONV g_aBaudRateConv[] =
-{
-    { 9600,   B9600   },
-    { 19200,  B19200  },
-    { 38400,  B38400  },
-    { 57600,  B57600  },
-    { 115200, B115200 }
-};
-
-
-
-/**
- * Ensures that the correct blocking mode is set.
+ * Fills the receive buffer with whatever the device has available.
  *
  * @returns Status code.
- * @param   pThis                   The serial providcer context.
- * @param   fBlocking               Flag whether to switch to blocking or non blocking mode.
+ * @param   pThis                   The provider context.
+ *
+ * @note Must only be called when the receive buffer is empty.
  */
-static int serialProvCtxEnsureBlockingMode(PPSPPROXYPROVCTXINT pThis, bool fBlocking)
+static int serialProvCtxRxFill(PPSPPROXYPROVCTXINT pThis)
 {
-    if (pThis->fBlocking == fBlocking)
-        return 0;
-
-    int rc = 0;
-    int fFcntl = fcntl(pThis->iFdDev, F_GETFL, 0);
-    if (fFcntl >= 0)
+    ssize_t cbRet = read(pThis->iFdDev, &pThis->abRx[0], sizeof(pThis->abRx));
+    pThis->cSyscalls++;
+    if (cbRet > 0)
     {
-        if (fBlocking)
-            fFcntl &= ~O_NONBLOCK;
-        else
-            fFcntl |= O_NONBLOCK;
-
-        int rcPsx = fcntl(pThis->iFdDev, F_SETFL, fFcntl);
-        if (rcPsx != -1)
-            pThis->fBlocking = fBlocking;
-        else
-            rc = -1;
+        pThis->offRx = 0;
+        pThis->cbRx  = cbRet;
+        return 0;
     }
-    else
-        rc = -1;
-
-    return rc;
-}
 
+    if (!cbRet)
+        return -1;
 
-/**
- * Converts the given baud rate to the termios speed.
- *
- * @returns Speed identifier or B0 if no matching one was found.
- * @param   u32Baudrate             The baudrate to convert.
- */
-static inline speed_t serialProvCtxBaudrateToTermiosSpeed(uint32_t u32Baudrate)
-{
-    for (uint32_t i = 0; i < ELEMENTS(g_aBaudRateConv); i++)
-    {
-        if (g_aBaudRateConv[i].u32BaudRate == u32Baudrate)
-            return g_aBaudRateConv[i].TermiosSpeed;
-    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
 
-    return B0;
+    return -1;
 }
 
 
@@ -142,13 +118,14 @@ static inline speed_t serialProvCtxBaudrateToTermiosSpeed(uint32_t u32Baudrate)
  * @param   pszDevice               The device string with the parameters.
  * @param   ppszDevice              Where to store the pointer to the device path to use on success.
  *                                  Must be freed with free().
- * @param   pu32Baudrate            Where to store the baud rate on success.
+ * @param   pau32Baudrates          Where to store the baud rates to try on success (PSP_SERIAL_BAUDRATES_MAX entries).
+ * @param   pcBaudrates             Where to store the number of baud rates on success.
  * @param   pcDataBits              Where to store the number of data bits.
  * @param   pchParity               Where to store the parity.
  * @param   pcStopBits              Where to store the number of stop bits.
  */
-static int serialProvCtxParseDevice(const char *pszDevice, char **ppszDevice, uint32_t *pu32Baudrate,
-                                    uint8_t *pcDataBits, char *pchParity, uint8_t *pcStopBits)
+static int serialProvCtxParseDevice(const char *pszDevice, char **ppszDevice, uint32_t *pau32Baudrates,
+                                    uint32_t *pcBaudrates, uint8_t *pcDataBits, char *pchParity, uint8_t *pcStopBits)
 {
     char szDevice[256]; /* Should be plenty. */
 
@@ -170,9 +147,28 @@ static int serialProvCtxParseDevice(const char *pszDevice, char **ppszDevice, ui
             *pszSep = '\0';
             pszSep++;
 
-            /* Baud rate. */
+            /* Baud rate(s), multiple ones are separated by / and tried in the given order. */
             errno = 0;
-            *pu32Baudrate = strtoul(pszStart, NULL, 10);
+            *pcBaudrates = 0;
+            for (;;)
+            {
+                char *pszEnd = NULL;
+                uint32_t u32Baudrate = strtoul(pszStart, &pszEnd, 10);
+                if (   errno
+                    || pszEnd == pszStart
+                    || !u32Baudrate
+                    || *pcBaudrates == PSP_SERIAL_BAUDRATES_MAX)
+                {
+                    errno = EINVAL;
+                    break;
+                }
+
+                pau32Baudrates[(*pcBaudrates)++] = u32Baudrate;
+                if (*pszEnd != '/')
+                    break;
+                pszStart = pszEnd + 1;
+            }
+
             if (!errno)
             {
                 pszStart = pszSep;
@@ -249,62 +245,69 @@ static int serialProvCtxSetTermiosCfg(PPSPPROXYPROVCTXINT pThis, uint32_t u32Bau
                                       uint8_t cDataBits, char chParity, uint8_t cStopBits)
 {
     int rc = 0;
-    speed_t Speed = serialProvCtxBaudrateToTermiosSpeed(u32Baudrate);
-    if (Speed != B0)
-    {
-        struct termios TermiosCfg;
+    struct termios2 TermiosCfg;
 
-        memset(&TermiosCfg, 0, sizeof(TermiosCfg));
-        cfsetispeed(&TermiosCfg, Speed);
-        cfsetospeed(&TermiosCfg, Speed);
-        TermiosCfg.c_cflag |= CREAD | CLOCAL;
+    /* BOTHER takes any rate the driver can do, the kernel maps the standard ones to Bxxx itself. */
+    memset(&TermiosCfg, 0, sizeof(TermiosCfg));
+    TermiosCfg.c_cflag  = BOTHER | CREAD | CLOCAL;
+    TermiosCfg.c_ispeed = u32Baudrate;
+    TermiosCfg.c_ospeed = u32Baudrate;
 
-        switch (cDataBits)
-        {
-            case 5:
-                TermiosCfg.c_cflag |= CS5;
-                break;
-            case 6:
-                TermiosCfg.c_cflag |= CS6;
-                break;
-            case 7:
-                TermiosCfg.c_cflag |= CS7;
-                break;
-            case 8:
-                TermiosCfg.c_cflag |= CS8;
-                break;
-            default:
-                return -1; /* Should not happen as the input is checked serialProvCtxParseDevice(). */
-        }
+    switch (cDataBits)
+    {
+        case 5:
+            TermiosCfg.c_cflag |= CS5;
+            break;
+        case 6:
+            TermiosCfg.c_cflag |= CS6;
+            break;
+        case 7:
+            TermiosCfg.c_cflag |= CS7;
+            break;
+        case 8:
+            TermiosCfg.c_cflag |= CS8;
+            break;
+        default:
+            return -1; /* Should not happen as the input is checked serialProvCtxParseDevice(). */
+    }
 
-        switch (chParity)
-        {
-            case 'n':
-                break;
-            case 'o':
-                TermiosCfg.c_cflag |= PARENB | PARODD;
-                break;
-            case 'e':
-                TermiosCfg.c_cflag |= PARENB;
-                break;
-            default:
-                return -1; /* Should not happen as the input is checked serialProvCtxParseDevice(). */
-        }
+    switch (chParity)
+    {
+        case 'n':
+            break;
+        case 'o':
+            TermiosCfg.c_cflag |= PARENB | PARODD;
+            break;
+        case 'e':
+            TermiosCfg.c_cflag |= PARENB;
+            break;
+        default:
+            return -1; /* Should not happen as the input is checked serialProvCtxParseDevice(). */
+    }
 
-        if (cStopBits == 2)
-            TermiosCfg.c_cflag |= CSTOPB;
+    if (cStopBits == 2)
+        TermiosCfg.c_cflag |= CSTOPB;
 
-        /* Set to raw input mode. */
-        TermiosCfg.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ECHOK | ISIG | IEXTEN);
-        TermiosCfg.c_cc[VMIN]  = 0;
-        TermiosCfg.c_cc[VTIME] = 0;
+    /*
+     * Raw input mode. Blocking reads return as soon as a single byte arrived, a larger VMIN
+     * would keep poll() from reporting the tail of a PDU shorter than that.
+     */
+    TermiosCfg.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ECHOK | ISIG | IEXTEN);
+    TermiosCfg.c_cc[VMIN]  = 1;
+    TermiosCfg.c_cc[VTIME] = 0;
 
-        /* Flush everything and set new config. */
-        int rcPsx = tcflush(pThis->iFdDev, TCIOFLUSH);
+    /* Flush everything and set new config. */
+    int rcPsx = ioctl(pThis->iFdDev, TCFLSH, TCIOFLUSH);
+    if (!rcPsx)
+    {
+        rcPsx = ioctl(pThis->iFdDev, TCSETS2, &TermiosCfg);
         if (!rcPsx)
         {
-            rcPsx = tcsetattr(pThis->iFdDev, TCSANOW, &TermiosCfg);
-            if (rcPsx)
+            /* Drivers silently round to what they support, way off means the rate is not possible. */
+            rcPsx = ioctl(pThis->iFdDev, TCGETS2, &TermiosCfg);
+            if (   rcPsx
+                || TermiosCfg.c_ospeed < u32Baudrate - u32Baudrate / 20
+                || TermiosCfg.c_ospeed > u32Baudrate + u32Baudrate / 20)
                 rc = -1;
         }
         else
@@ -317,6 +320,98 @@ static int serialProvCtxSetTermiosCfg(PPSPPROXYPROVCTXINT pThis, uint32_t u32Bau
 }
 
 
+/**
+ * Configures the device for low latency, this is best effort as not every driver supports it.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial provider context.
+ * @param   pszDevPath              The device path.
+ */
+static void serialProvCtxSetLowLatency(PPSPPROXYPROVCTXINT pThis, const char *pszDevPath)
+{
+    struct serial_struct SerialCfg;
+
+    /* Makes the driver push received data to the line discipline right away instead of deferring it. */
+    if (!ioctl(pThis->iFdDev, TIOCGSERIAL, &SerialCfg))
+    {
+        SerialCfg.flags |= ASYNC_LOW_LATENCY;
+        ioctl(pThis->iFdDev, TIOCSSERIAL, &SerialCfg);
+    }
+
+    /* FTDI adapters buffer received data for up to the latency timer (16ms by default) before sending it to the host. */
+    char szDevReal[PATH_MAX];
+    if (realpath(pszDevPath, &szDevReal[0]))
+    {
+        const char *pszName = strrchr(&szDevReal[0], '/');
+        char szPath[PATH_MAX];
+
+        int cchPath = snprintf(&szPath[0], sizeof(szPath), "/sys/class/tty/%s/device/latency_timer",
+                               pszName ? pszName + 1 : &szDevReal[0]);
+        int iFdSysfs = cchPath > 0 && (size_t)cchPath < sizeof(szPath) ? open(&szPath[0], O_WRONLY | O_CLOEXEC) : -1;
+        if (iFdSysfs > -1)
+        {
+            char szVal[16];
+            int cchVal = snprintf(&szVal[0], sizeof(szVal), "%u", PSP_SERIAL_FTDI_LATENCY_TIMER);
+            if (write(iFdSysfs, &szVal[0], cchVal) != cchVal)
+            { /* Not fatal, requires write permission to sysfs. */ }
+            close(iFdSysfs);
+        }
+    }
+}
+
+
+/**
+ * Listens for the start of a PDU from the stub, used to detect whether the baud rate matches.
+ *
+ * @returns Flag whether a PDU start magic was seen.
+ * @param   pThis                   The serial provider context.
+ * @param   cMillies                How long to listen.
+ *
+ * @note The stub sends beacons until somebody connects, the consumed partial beacon is skipped by
+ *       the PDU layer when it resyncs.
+ */
+static bool serialProvCtxProbeStub(PPSPPROXYPROVCTXINT pThis, uint32_t cMillies)
+{
+    struct timespec TsStart;
+    uint32_t u32Window = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &TsStart);
+    for (;;)
+    {
+        struct timespec TsNow;
+        struct pollfd PollFd;
+        uint8_t abBuf[64];
+
+        clock_gettime(CLOCK_MONOTONIC, &TsNow);
+        int64_t cMsElapsed = (TsNow.tv_sec - TsStart.tv_sec) * 1000 + (TsNow.tv_nsec - TsStart.tv_nsec) / 1000000;
+        if (cMsElapsed >= cMillies)
+            return false;
+
+        PollFd.fd      = pThis->iFdDev;
+        PollFd.events  = POLLIN;
+        PollFd.revents = 0;
+        int rcPsx = poll(&PollFd, 1, cMillies - cMsElapsed);
+        pThis->cSyscalls++;
+        if (rcPsx <= 0)
+            return false;
+
+        ssize_t cbRead = read(pThis->iFdDev, &abBuf[0], sizeof(abBuf));
+        pThis->cSyscalls++;
+        if (cbRead == -1 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (cbRead <= 0)
+            return false;
+
+        for (ssize_t i = 0; i < cbRead; i++)
+        {
+            u32Window = (u32Window >> 8) | ((uint32_t)abBuf[i] << 24);
+            if (u32Window == PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC)
+                return true;
+        }
+    }
+}
+
+
 /**
  * @copydoc{PSPPROXYPROV,pfnCtxInit}
  */
@@ -324,30 +419,57 @@ static int serialProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
     char *pszDevPath = NULL;
-    uint32_t u32Baudrate = 0;
+    uint32_t au32Baudrates[PSP_SERIAL_BAUDRATES_MAX];
+    uint32_t cBaudrates = 0;
     uint8_t cDataBits = 0;
     char chParity = '\0';
     uint8_t cStopBits = 0;
 
-    int rc = serialProvCtxParseDevice(pszDevice, &pszDevPath, &u32Baudrate,
+    int rc = serialProvCtxParseDevice(pszDevice, &pszDevPath, &au32Baudrates[0], &cBaudrates,
                                       &cDataBits, &chParity, &cStopBits);
     if (!rc)
     {
-        int iFd = open(pszDevPath, O_RDWR);
-
-        free(pszDevPath); /* Free device path in any case as it is not required anymore. */
+        int iFd = open(pszDevPath, O_RDWR | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
         if (iFd > 0)
         {
             pThis->iFdDev    = iFd;
-            pThis->fBlocking = true;
-            rc = serialProvCtxSetTermiosCfg(pThis, u32Baudrate, cDataBits, chParity, cStopBits);
+            pThis->cSyscalls = 0;
+            pThis->offRx     = 0;
+            pThis->cbRx      = 0;
+            serialProvCtxSetLowLatency(pThis, pszDevPath);
+
+            /*
+             * With multiple baud rates given the first one the stub is heard at wins, if it doesn't
+             * talk at all the last one is used.
+             */
+            rc = -1;
+            for (uint32_t i = 0; i < cBaudrates && rc; i++)
+            {
+                rc = serialProvCtxSetTermiosCfg(pThis, au32Baudrates[i], cDataBits, chParity, cStopBits);
+                if (   !rc
+                    && i < cBaudrates - 1
+                    && !serialProvCtxProbeStub(pThis, PSP_SERIAL_AUTOBAUD_PROBE_MS))
+                    rc = -1;
+            }
+
             if (!rc)
-                return rc;
+            {
+                pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (pThis->iFdEvtIntr > -1)
+                {
+                    free(pszDevPath);
+                    return rc;
+                }
+
+                rc = -1;
+            }
 
             close(iFd);
         }
         else
             rc = -1; /** @todo Error handling. */
+
+        free(pszDevPath);
     }
 
     return rc;
@@ -362,7 +484,9 @@ static void serialProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
     close(pThis->iFdDev);
-    pThis->iFdDev = 0;
+    close(pThis->iFdEvtIntr);
+    pThis->iFdDev     = 0;
+    pThis->iFdEvtIntr = -1;
 }
 
 
@@ -373,12 +497,12 @@ static size_t serialProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    int cbAvail = 0;
-    int rc = ioctl(pThis->iFdDev, FIONREAD, &cbAvail);
-    if (rc)
+    /* Reading right away instead of asking for the amount available saves a syscall on the following read. */
+    if (   pThis->offRx == pThis->cbRx
+        && serialProvCtxRxFill(pThis))
         return 0;
 
-    return cbAvail;
+    return pThis->cbRx - pThis->offRx;
 }
 
 
@@ -390,27 +514,90 @@ static int serialProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRea
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
     *pcbRead = 0;
-
-    if (serialProvCtxEnsureBlockingMode(pThis, false /*fBlocking*/) == -1)
-        return -1;
-
-    ssize_t cbRet = read(pThis->iFdDev, pvDst, cbRead);
-    if (cbRet > 0)
+    if (pThis->offRx == pThis->cbRx)
     {
-        *pcbRead = cbRead;
-        return 0;
+        int rc = serialProvCtxRxFill(pThis);
+        if (rc)
+            return rc;
     }
 
-    if (!cbRet)
+    size_t cbThisRead = MIN(cbRead, pThis->cbRx - pThis->offRx);
+    memcpy(pvDst, &pThis->abRx[pThis->offRx], cbThisRead);
+    pThis->offRx += cbThisRead;
+    *pcbRead      = cbThisRead;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int serialProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct iovec aIov[8];
+    struct iovec *pIov = &aIov[0];
+
+    if (cIov > ELEMENTS(aIov))
         return -1;
 
-    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    /* Local copy as partial writes require adjusting the buffers. */
+    memcpy(&aIov[0], paIov, cIov * sizeof(*paIov));
+    while (cIov)
     {
-        *pcbRead = 0;
-        return 0;
+        ssize_t cbRet = writev(pThis->iFdDev, pIov, cIov);
+        pThis->cSyscalls++;
+        if (cbRet == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+
+            /* The output buffer of the tty is full, wait until the UART drained some of it. */
+            struct pollfd aPollFds[2];
+            aPollFds[0].fd      = pThis->iFdDev;
+            aPollFds[0].events  = POLLOUT;
+            aPollFds[0].revents = 0;
+            aPollFds[1].fd      = pThis->iFdEvtIntr;
+            aPollFds[1].events  = POLLIN;
+            aPollFds[1].revents = 0;
+            int rcPsx = poll(&aPollFds[0], ELEMENTS(aPollFds), PSP_SERIAL_TX_STALL_TIMEOUT_MS);
+            pThis->cSyscalls++;
+            if (rcPsx == 0)
+                return STS_ERR_PSP_PROXY_TIMEOUT; /* The UART is wedged. */
+            if (rcPsx == -1 && errno != EINTR)
+                return -1;
+            if (aPollFds[1].revents)
+            {
+                /* Consume the interrupt. */
+                uint64_t uCnt = 0;
+                ssize_t cbRead = read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+                pThis->cSyscalls++;
+                return cbRead == sizeof(uCnt) || errno == EAGAIN ? STS_ERR_PSP_PROXY_INTERRUPTED : -1;
+            }
+            if (aPollFds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+                return -1;
+            continue;
+        }
+
+        size_t cbLeft = cbRet;
+        while (   cIov
+               && cbLeft >= pIov->iov_len)
+        {
+            cbLeft -= pIov->iov_len;
+            pIov++;
+            cIov--;
+        }
+
+        if (cbLeft)
+        {
+            pIov->iov_base = (uint8_t *)pIov->iov_base + cbLeft;
+            pIov->iov_len -= cbLeft;
+        }
     }
 
-    return -1;
+    return 0;
 }
 
 
@@ -419,16 +606,9 @@ static int serialProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRea
  */
 static int serialProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
 {
-    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct iovec Iov = { (void *)pvPkt, cbPkt };
 
-    if (serialProvCtxEnsureBlockingMode(pThis, true /*fBlocking*/) == -1)
-        return -1;
-
-    ssize_t cbRet = write(pThis->iFdDev, pvPkt, cbPkt);
-    if (cbRet == cbPkt)
-        return 0;
-
-    return -1;
+    return serialProvCtxWriteV(hProvCtx, &Iov, 1);
 }
 
 
@@ -438,20 +618,33 @@ static int serialProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_
 static int serialProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    struct pollfd PollFd;
+    struct pollfd aPollFds[2];
 
-    PollFd.fd      = pThis->iFdDev;
-    PollFd.events  = POLLIN | POLLHUP | POLLERR;
-    PollFd.revents = 0;
+    /* Data still buffered is available right away. */
+    if (pThis->offRx < pThis->cbRx)
+        return 0;
+
+    aPollFds[0].fd      = pThis->iFdDev;
+    aPollFds[0].events  = POLLIN | POLLHUP | POLLERR;
+    aPollFds[0].revents = 0;
+    aPollFds[1].fd      = pThis->iFdEvtIntr;
+    aPollFds[1].events  = POLLIN;
+    aPollFds[1].revents = 0;
 
     int rc = 0;
-    for (;;)
+    int rcPsx = poll(&aPollFds[0], ELEMENTS(aPollFds), cMillies);
+    pThis->cSyscalls++;
+    if (rcPsx == 0)
+        rc = STS_ERR_PSP_PROXY_TIMEOUT;
+    else if (rcPsx == -1)
+        rc = -1; /** @todo Better status codes for the individual errors. */
+    else if (aPollFds[1].revents)
     {
-        int rcPsx = poll(&PollFd, 1, cMillies);
-        if (rcPsx == 1)
-            break; /* Stop polling if the single descriptor has events. */
-        if (rcPsx == -1)
-            rc = -1; /** @todo Better status codes for the individual errors. */
+        /* Consume the interrupt. */
+        uint64_t uCnt = 0;
+        ssize_t cbRead = read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+        pThis->cSyscalls++;
+        rc = cbRead == sizeof(uCnt) || errno == EAGAIN ? STS_ERR_PSP_PROXY_INTERRUPTED : -1;
     }
 
     return rc;
@@ -463,7 +656,40 @@ static int serialProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
  */
 static int serialProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
 {
-    return -1; /** @todo */
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    /* Saturating the counter is fine, the poll is interrupted anyway. */
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int serialProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pStats->cSyscalls = pThis->cSyscalls;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryFd}
+ */
+static int serialProvCtxQueryFd(PSPPROXYPROVCTX hProvCtx, int *piFd)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Data already buffered would get lost when somebody else reads from the device. */
+    if (pThis->offRx < pThis->cbRx)
+        return -1;
+
+    *piFd = pThis->iFdDev;
+    return 0;
 }
 
 
@@ -513,6 +739,38 @@ const PSPPROXYPROV g_PspProxyProvSerial =
     /** pfnCtxEmuWaitForWork */
     NULL,
     /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    serialProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    serialProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    serialProvCtxQueryFd,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
     NULL
 };
 
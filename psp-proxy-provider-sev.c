@@ -32,12 +32,42 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <common/cdefs.h>
 
 #include "include/psp-sev.h"
 #include "include/ptedit_header.h" /* For the x86 physical mem read/write API */
 #include "psp-proxy-provider.h"
 
 
+/** Default number of pages in the physical memory window. */
+#define SEV_PHYS_WIN_PAGES_DEF          16
+/** Maximum number of pages in the physical memory window. */
+#define SEV_PHYS_WIN_PAGES_MAX          1024
+/** Marker for a window slot not mapping any physical page. */
+#define SEV_PHYS_PFN_NONE               (~(size_t)0)
+
+
+/**
+ * A page of the physical memory window.
+ */
+typedef struct SEVPHYSSLOT
+{
+    /** The page table entry for the page as resolved during setup. */
+    ptedit_entry_t                  VmEntry;
+    /** The original page table entry to restore when tearing the window down. */
+    size_t                          uPteOrig;
+    /** The physical page currently mapped, SEV_PHYS_PFN_NONE if none. */
+    size_t                          uPfnMapped;
+    /** Value of the LRU clock when the slot was last used. */
+    uint64_t                        uLruTick;
+} SEVPHYSSLOT;
+/** Pointer to a physical memory window slot. */
+typedef SEVPHYSSLOT *PSEVPHYSSLOT;
+
+
 /**
  * Internal PSP proxy provider context.
  */
@@ -45,12 +75,69 @@ typedef struct PSPPROXYPROVCTXINT
 {
     /** The file descriptor of the device proxying our calls. */
     int                             iFdDev;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** Flag whether the physical memory window is mapped as write back instead of uncached. */
+    bool                            fPhysWb;
+    /** Number of pages in the physical memory window. */
+    uint32_t                        cPhysPages;
+    /** The physical memory window, NULL if not set up yet. */
+    uint8_t                         *pbPhysWin;
+    /** The window slots, one per page. */
+    PSEVPHYSSLOT                    paPhysSlots;
+    /** Slot index for each page of the run currently being transferred. */
+    uint32_t                        *paidxPhysRun;
+    /** The memory type index applied to the window pages. */
+    int                             iPhysMt;
+    /** The LRU clock, advanced for every mapped run. */
+    uint64_t                        uPhysLruTick;
 } PSPPROXYPROVCTXINT;
 /** Pointer to an internal PSP proxy context. */
 typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
 
 
 
+/** Number of contexts using the page table editor, it has a single global device handle. */
+static uint32_t g_cPtEditRefs = 0;
+/** Serializes setting up and tearing down the page table editor. */
+static pthread_mutex_t g_PtEditMtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Retains a reference to the page table editor, initializing it for the first user.
+ *
+ * @returns Status code.
+ */
+static int sevPtEditRetain(void)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&g_PtEditMtx);
+    if (   !g_cPtEditRefs
+        && ptedit_init())
+        rc = -1;
+    else
+        g_cPtEditRefs++;
+    pthread_mutex_unlock(&g_PtEditMtx);
+
+    return rc;
+}
+
+
+/**
+ * Releases a reference to the page table editor, cleaning it up when the last user is gone.
+ *
+ * @returns nothing.
+ */
+static void sevPtEditRelease(void)
+{
+    pthread_mutex_lock(&g_PtEditMtx);
+    if (!--g_cPtEditRefs)
+        ptedit_cleanup();
+    pthread_mutex_unlock(&g_PtEditMtx);
+}
+
+
 /**
  * I/O control wrapper for the SEV device.
  *
@@ -68,6 +155,7 @@ static int sevProvCtxIoctl(PPSPPROXYPROVCTXINT pThis, uint32_t idCmd, void *pvAr
     Cmd.cmd  = idCmd;
     Cmd.data = (__u64)pvArgs;
 
+    pThis->cSyscalls++;
     int rc = ioctl(pThis->iFdDev, SEV_ISSUE_CMD, &Cmd);
     if (rc != -1)
     {
@@ -79,17 +167,269 @@ static int sevProvCtxIoctl(PPSPPROXYPROVCTXINT pThis, uint32_t idCmd, void *pvAr
 }
 
 
+/**
+ * Tears down the physical memory window, restoring the original page table entries.
+ *
+ * @returns nothing.
+ * @param   pThis                   The context instance.
+ */
+static void sevPhysWinTerm(PPSPPROXYPROVCTXINT pThis)
+{
+    for (uint32_t i = 0; i < pThis->cPhysPages; i++)
+    {
+        PSEVPHYSSLOT pSlot = &pThis->paPhysSlots[i];
+
+        if (   pSlot->VmEntry.pgd
+            && pSlot->VmEntry.pte != pSlot->uPteOrig)
+        {
+            pSlot->VmEntry.pte   = pSlot->uPteOrig;
+            pSlot->VmEntry.valid = PTEDIT_VALID_MASK_PTE;
+            ptedit_update(pThis->pbPhysWin + i * _4K, 0, &pSlot->VmEntry);
+        }
+    }
+
+    munmap(pThis->pbPhysWin, pThis->cPhysPages * _4K);
+    free(pThis->paPhysSlots);
+    free(pThis->paidxPhysRun);
+    pThis->pbPhysWin    = NULL;
+    pThis->paPhysSlots  = NULL;
+    pThis->paidxPhysRun = NULL;
+
+    sevPtEditRelease();
+}
+
+
+/**
+ * Sets up the physical memory window on first use.
+ *
+ * The window is a locked anonymous mapping whose page table entries get pointed to the physical pages
+ * being accessed. The mapping stays around for the lifetime of the context so repeated accesses to the
+ * same pages don't need any page table updates at all.
+ *
+ * @returns Status code.
+ * @param   pThis                   The context instance.
+ */
+static int sevPhysWinInit(PPSPPROXYPROVCTXINT pThis)
+{
+    if (sevPtEditRetain())
+        return -1;
+
+    /* Uncached is always safe, write back only when asked for as it is wrong for MMIO ranges. */
+    pThis->iPhysMt = ptedit_find_first_mt(PTEDIT_MT_UC);
+    if (pThis->fPhysWb)
+    {
+        int iMtWb = ptedit_find_first_mt(PTEDIT_MT_WB);
+        if (iMtWb != -1)
+            pThis->iPhysMt = iMtWb;
+    }
+
+    size_t cbWin = pThis->cPhysPages * _4K;
+    pThis->paPhysSlots  = (PSEVPHYSSLOT)calloc(pThis->cPhysPages, sizeof(*pThis->paPhysSlots));
+    pThis->paidxPhysRun = (uint32_t *)calloc(pThis->cPhysPages, sizeof(*pThis->paidxPhysRun));
+    pThis->pbPhysWin    = (uint8_t *)mmap(0, cbWin, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pThis->pbPhysWin == MAP_FAILED)
+        pThis->pbPhysWin = NULL;
+    if (   pThis->iPhysMt != -1
+        && pThis->paPhysSlots
+        && pThis->paidxPhysRun
+        && pThis->pbPhysWin)
+    {
+        /*
+         * Make sure the range is backed by memory which is neither swapped out nor shared with a child
+         * while the page table entries point elsewhere.
+         */
+        memset(pThis->pbPhysWin, 0, cbWin);
+        if (   !mlock(pThis->pbPhysWin, cbWin)
+            && !madvise(pThis->pbPhysWin, cbWin, MADV_DONTFORK))
+        {
+            uint32_t i;
+            for (i = 0; i < pThis->cPhysPages; i++)
+            {
+                PSEVPHYSSLOT pSlot = &pThis->paPhysSlots[i];
+
+                pSlot->VmEntry = ptedit_resolve(pThis->pbPhysWin + i * _4K, 0);
+                if (!pSlot->VmEntry.pgd)
+                    break;
+
+                pSlot->uPteOrig   = pSlot->VmEntry.pte;
+                pSlot->uPfnMapped = SEV_PHYS_PFN_NONE;
+                pSlot->uLruTick   = 0;
+            }
+
+            if (i == pThis->cPhysPages)
+            {
+                pThis->uPhysLruTick = 0;
+                return 0;
+            }
+        }
+    }
+
+    if (   pThis->paPhysSlots
+        && pThis->paidxPhysRun
+        && pThis->pbPhysWin)
+        sevPhysWinTerm(pThis);
+    else
+    {
+        if (pThis->pbPhysWin)
+            munmap(pThis->pbPhysWin, cbWin);
+        free(pThis->paPhysSlots);
+        free(pThis->paidxPhysRun);
+        pThis->pbPhysWin    = NULL;
+        pThis->paPhysSlots  = NULL;
+        pThis->paidxPhysRun = NULL;
+        sevPtEditRelease();
+    }
+    return -1;
+}
+
+
+/**
+ * Maps the given run of physical pages into the window, reusing slots already mapping a page.
+ *
+ * @returns nothing.
+ * @param   pThis                   The context instance.
+ * @param   uPfnFirst               The first physical page of the run.
+ * @param   cPages                  Number of pages in the run, at most the window size.
+ *
+ * @note The slot indices for the pages end up in paidxPhysRun.
+ */
+static void sevPhysWinMapRun(PPSPPROXYPROVCTXINT pThis, size_t uPfnFirst, uint32_t cPages)
+{
+    uint64_t uTick = ++pThis->uPhysLruTick;
+    bool fRemapped = false;
+
+    /* Pick up the pages which are still mapped first so they can't get evicted by the rest of the run. */
+    for (uint32_t i = 0; i < cPages; i++)
+    {
+        pThis->paidxPhysRun[i] = UINT32_MAX;
+        for (uint32_t idxSlot = 0; idxSlot < pThis->cPhysPages; idxSlot++)
+        {
+            if (pThis->paPhysSlots[idxSlot].uPfnMapped == uPfnFirst + i)
+            {
+                pThis->paPhysSlots[idxSlot].uLruTick = uTick;
+                pThis->paidxPhysRun[i] = idxSlot;
+                break;
+            }
+        }
+    }
+
+    /* Remap the least recently used slots for the remaining pages, one barrier for the whole run. */
+    for (uint32_t i = 0; i < cPages; i++)
+    {
+        if (pThis->paidxPhysRun[i] != UINT32_MAX)
+            continue;
+
+        uint32_t idxSlotLru = 0;
+        for (uint32_t idxSlot = 1; idxSlot < pThis->cPhysPages; idxSlot++)
+            if (pThis->paPhysSlots[idxSlot].uLruTick < pThis->paPhysSlots[idxSlotLru].uLruTick)
+                idxSlotLru = idxSlot;
+
+        PSEVPHYSSLOT pSlot = &pThis->paPhysSlots[idxSlotLru];
+        assert(pSlot->uLruTick != uTick);
+
+        pSlot->VmEntry.pte   = ptedit_set_pfn(pSlot->uPteOrig, uPfnFirst + i);
+        pSlot->VmEntry.pte   = ptedit_apply_mt(pSlot->VmEntry.pte, pThis->iPhysMt);
+        pSlot->VmEntry.valid = PTEDIT_VALID_MASK_PTE; /* Update only the PTE of the entry. */
+        ptedit_update(pThis->pbPhysWin + idxSlotLru * _4K, 0, &pSlot->VmEntry);
+        pSlot->uPfnMapped = uPfnFirst + i;
+        pSlot->uLruTick   = uTick;
+        pThis->paidxPhysRun[i] = idxSlotLru;
+        fRemapped = true;
+    }
+
+    if (fRemapped)
+        ptedit_full_serializing_barrier();
+}
+
+
+/**
+ * Transfers data between the given buffer and x86 physical memory through the window.
+ *
+ * @returns Status code.
+ * @param   pThis                   The context instance.
+ * @param   PhysX86Addr             The physical x86 address to access.
+ * @param   pvBuf                   The buffer to read into or write from.
+ * @param   cbXfer                  Number of bytes to transfer.
+ * @param   fWrite                  Flag whether this is a write to physical memory.
+ */
+static int sevPhysXfer(PPSPPROXYPROVCTXINT pThis, X86PADDR PhysX86Addr, void *pvBuf, uint32_t cbXfer, bool fWrite)
+{
+    if (   !pThis->pbPhysWin
+        && sevPhysWinInit(pThis))
+        return -1;
+
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    while (cbXfer)
+    {
+        size_t uPfnFirst = (size_t)(PhysX86Addr >> 12);
+        uint32_t offPage = (uint32_t)(PhysX86Addr & 0xfff);
+        uint32_t cPages  = (uint32_t)MIN(((uint64_t)offPage + cbXfer + _4K - 1) / _4K, pThis->cPhysPages);
+
+        sevPhysWinMapRun(pThis, uPfnFirst, cPages);
+        for (uint32_t i = 0; i < cPages && cbXfer; i++)
+        {
+            uint8_t *pbPage = pThis->pbPhysWin + pThis->paidxPhysRun[i] * _4K;
+            uint32_t cbThisXfer = MIN(cbXfer, _4K - offPage);
+
+            if (fWrite)
+                memcpy(pbPage + offPage, pbBuf, cbThisXfer);
+            else
+                memcpy(pbBuf, pbPage + offPage, cbThisXfer);
+
+            offPage      = 0; /* Page aligned after the first page. */
+            pbBuf       += cbThisXfer;
+            PhysX86Addr += cbThisXfer;
+            cbXfer      -= cbThisXfer;
+        }
+    }
+
+    return 0;
+}
+
+
 /**
  * @copydoc{PSPPROXYPROV,pfnCtxInit}
  */
-static int sevProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice, PFNPSPPROXYLOGMSGRECV pfnLogMsg,
-                          void *pvUser)
+static int sevProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
     int rc = 0;
 
-    int iFd = open(pszDevice, O_RDWR);
-    if (iFd > 0)
+    pThis->iFdDev     = -1;
+    pThis->fPhysWb    = false;
+    pThis->cPhysPages = SEV_PHYS_WIN_PAGES_DEF;
+    pThis->pbPhysWin  = NULL;
+    for (;;)
+    {
+        if (!strncmp(pszDevice, "phys-wb,", sizeof("phys-wb,") - 1))
+        {
+            pThis->fPhysWb = true;
+            pszDevice += sizeof("phys-wb,") - 1;
+        }
+        else if (!strncmp(pszDevice, "phys-window=", sizeof("phys-window=") - 1))
+        {
+            char *pszEnd = NULL;
+            errno = 0;
+            unsigned long cPages = strtoul(pszDevice + sizeof("phys-window=") - 1, &pszEnd, 10);
+            if (   errno
+                || *pszEnd != ','
+                || !cPages
+                || cPages > SEV_PHYS_WIN_PAGES_MAX)
+                return -1;
+
+            pThis->cPhysPages = (uint32_t)cPages;
+            pszDevice = pszEnd + 1;
+        }
+        else
+            break;
+    }
+
+    /* Allow sev:// as a shortcut for the default device. */
+    if (!*pszDevice)
+        pszDevice = "/dev/sev";
+
+    int iFd = open(pszDevice, O_RDWR | O_CLOEXEC);
+    if (iFd >= 0)
         pThis->iFdDev = iFd;
     else
         rc = -1; /** @todo Error handling. */
@@ -105,8 +445,10 @@ static void sevProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
+    if (pThis->pbPhysWin)
+        sevPhysWinTerm(pThis);
     close(pThis->iFdDev);
-    pThis->iFdDev = 0;
+    pThis->iFdDev = -1;
 }
 
 
@@ -406,8 +748,10 @@ static int sevProvCtxX86MemAlloc(PSPPROXYPROVCTX hProvCtx, uint32_t cbMem, R0PTR
     int rc = sevProvCtxIoctl(pThis, SEV_X86_MEM_ALLOC, &Req, NULL);
     if (!rc)
     {
-        *pR0KernVirtual = Req.addr_virtual;
-        *pPhysX86Addr = Req.addr_physical;
+        if (pR0KernVirtual)
+            *pR0KernVirtual = Req.addr_virtual;
+        if (pPhysX86Addr)
+            *pPhysX86Addr = Req.addr_physical;
     }
 
     return rc;
@@ -468,66 +812,9 @@ static int sevProvCtxX86MemWrite(PSPPROXYPROVCTX hProvCtx, R0PTR R0KernVirtualDs
  */
 static int sevProvCtxX86PhysMemRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, X86PADDR PhysX86AddrSrc, uint32_t cbRead)
 {
-    (void)hProvCtx; /* Not required here. */
-
-    int rc = ptedit_init();
-    if (rc)
-        return -1;
-
-    /* Map a page aligned anonymous region of memory we use as virtual address range for the physical address later on. */
-    void *pvVirt = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (pvVirt != MAP_FAILED)
-    {
-        memset(pvVirt, '0', 4096); /* Make sure the range is backed by memory. */
-
-        int uUcMt = ptedit_find_first_mt(PTEDIT_MT_UC);
-        if (uUcMt != -1)
-        {
-            /* Get the page table entry. */
-            ptedit_entry_t VmEntry = ptedit_resolve(pvVirt, 0);
-            if(VmEntry.pgd != 0)
-            {
-                uint8_t *pbDst = (uint8_t *)pvDst;
-                size_t uPhysPfn  = (size_t)(PhysX86AddrSrc >> 12);
-                uint32_t offPage = (uint32_t)(PhysX86AddrSrc & 0xfff);
-
-                size_t uPhysPfnOrig = ptedit_get_pfn(VmEntry.pte);
-
-                while (cbRead)
-                {
-                    size_t cbThisRead = cbRead <= 4096 ? cbRead : 4096;
-                    VmEntry.pte = ptedit_set_pfn(VmEntry.pte, uPhysPfn);
-                    VmEntry.pte = ptedit_apply_mt(VmEntry.pte, uUcMt);
-
-                    /* Update only the PTE of the entry. */
-                    VmEntry.valid = PTEDIT_VALID_MASK_PTE;
-                    ptedit_update(pvVirt, 0, &VmEntry);
-
-                    ptedit_full_serializing_barrier();
-
-                    memcpy(pbDst, (uint8_t *)pvVirt + offPage, cbThisRead);
-
-                    offPage = 0; /* Page aligned after the first page. */
-                    pbDst  += cbThisRead;
-                    cbRead -= cbThisRead;
-                }
-
-                /* Restore original pfn. */
-                ptedit_pte_set_pfn(pvVirt, 0, uPhysPfnOrig);
-            }
-            else
-                rc = -1;
-        }
-        else
-            rc = -1;
-
-        munmap(pvVirt, 4096);
-    }
-    else
-        rc = -1;
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    ptedit_cleanup();
-    return rc;
+    return sevPhysXfer(pThis, PhysX86AddrSrc, pvDst, cbRead, false /*fWrite*/);
 }
 
 
@@ -536,66 +823,9 @@ static int sevProvCtxX86PhysMemRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, X86PA
  */
 static int sevProvCtxX86PhysMemWrite(PSPPROXYPROVCTX hProvCtx, X86PADDR PhysX86AddrDst, const void *pvSrc, uint32_t cbWrite)
 {
-    (void)hProvCtx; /* Not required here. */
-
-    int rc = ptedit_init();
-    if (rc)
-        return -1;
-
-    /* Map a page aligned anonymous region of memory we use as virtual address range for the physical address later on. */
-    void *pvVirt = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (pvVirt != MAP_FAILED)
-    {
-        memset(pvVirt, '0', 4096); /* Make sure the range is backed by memory. */
-
-        int uUcMt = ptedit_find_first_mt(PTEDIT_MT_UC);
-        if (uUcMt != -1)
-        {
-            /* Get the page table entry. */
-            ptedit_entry_t VmEntry = ptedit_resolve(pvVirt, 0);
-            if(VmEntry.pgd != 0)
-            {
-                uint8_t *pbSrc = (uint8_t *)pvSrc;
-                size_t uPhysPfn  = (size_t)(PhysX86AddrDst >> 12);
-                uint32_t offPage = (uint32_t)(PhysX86AddrDst & 0xfff);
-
-                size_t uPhysPfnOrig = ptedit_get_pfn(VmEntry.pte);
-
-                while (cbWrite)
-                {
-                    size_t cbThisWrite = cbWrite <= 4096 ? cbWrite : 4096;
-                    VmEntry.pte = ptedit_set_pfn(VmEntry.pte, uPhysPfn);
-                    VmEntry.pte = ptedit_apply_mt(VmEntry.pte, uUcMt);
-
-                    /* Update only the PTE of the entry. */
-                    VmEntry.valid = PTEDIT_VALID_MASK_PTE;
-                    ptedit_update(pvVirt, 0, &VmEntry);
-
-                    ptedit_full_serializing_barrier();
-
-                    memcpy((uint8_t *)pvVirt + offPage, pbSrc, cbThisWrite);
-
-                    offPage = 0; /* Page aligned after the first page. */
-                    pbSrc   += cbThisWrite;
-                    cbWrite -= cbThisWrite;
-                }
-
-                /* Restore original pfn. */
-                ptedit_pte_set_pfn(pvVirt, 0, uPhysPfnOrig);
-            }
-            else
-                rc = -1;
-        }
-        else
-            rc = -1;
-
-        munmap(pvVirt, 4096);
-    }
-    else
-        rc = -1;
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    ptedit_cleanup();
-    return rc;
+    return sevPhysXfer(pThis, PhysX86AddrDst, (void *)pvSrc, cbWrite, true /*fWrite*/);
 }
 
 
@@ -635,6 +865,18 @@ static int sevProvCtxEmuSetResult(PSPPROXYPROVCTX hProvCtx, uint32_t uResult)
 }
 
 
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int sevProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pStats->cSyscalls = pThis->cSyscalls;
+    return 0;
+}
+
+
 /**
  * Provider registration structure.
  */
@@ -652,6 +894,42 @@ const PSPPROXYPROV g_PspProxyProvSev =
     sevProvCtxInit,
     /** pfnCtxDestroy */
     sevProvCtxDestroy,
+    /** pfnCtxPeek */
+    NULL,
+    /** pfnCtxRead */
+    NULL,
+    /** pfnCtxWrite */
+    NULL,
+    /** pfnCtxPoll */
+    NULL,
+    /** pfnCtxInterrupt */
+    NULL,
+    /** pfnCtxX86SmnRead */
+    sevProvCtxX86SmnRead,
+    /** pfnCtxX86SmnWrite */
+    sevProvCtxX86SmnWrite,
+    /** pfnCtxX86MemAlloc */
+    sevProvCtxX86MemAlloc,
+    /** pfnCtxX86MemFree */
+    sevProvCtxX86MemFree,
+    /** pfnCtxX86MemRead */
+    sevProvCtxX86MemRead,
+    /** pfnCtxX86MemWrite */
+    sevProvCtxX86MemWrite,
+    /** pfnCtxX86PhysMemRead */
+    sevProvCtxX86PhysMemRead,
+    /** pfnCtxX86PhysMemWrite */
+    sevProvCtxX86PhysMemWrite,
+    /** pfnCtxEmuWaitForWork */
+    sevProvCtxEmuWaitForWork,
+    /** pfnCtxEmuSetResult */
+    sevProvCtxEmuSetResult,
+    /** pfnCtxQueryStats */
+    sevProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    NULL,
+    /** pfnCtxQueryFd */
+    NULL,
     /** pfnCtxQueryInfo */
     sevProvCtxQueryInfo,
     /** pfnCtxPspSmnRead */
@@ -676,25 +954,6 @@ const PSPPROXYPROV g_PspProxyProvSev =
     sevProvCtxPspX86MmioWrite,
     /** pfnCtxPspSvcCall */
     sevProvCtxPspSvcCall,
-    /** pfnCtxX86SmnRead */
-    sevProvCtxX86SmnRead,
-    /** pfnCtxX86SmnWrite */
-    sevProvCtxX86SmnWrite,
-    /** pfnCtxX86MemAlloc */
-    sevProvCtxX86MemAlloc,
-    /** pfnCtxX86MemFree */
-    sevProvCtxX86MemFree,
-    /** pfnCtxX86MemRead */
-    sevProvCtxX86MemRead,
-    /** pfnCtxX86MemWrite */
-    sevProvCtxX86MemWrite,
-    /** pfnCtxX86PhysMemRead */
-    sevProvCtxX86PhysMemRead,
-    /** pfnCtxX86PhysMemWrite */
-    sevProvCtxX86PhysMemWrite,
-    /** pfnCtxEmuWaitForWork */
-    sevProvCtxEmuWaitForWork,
-    /** pfnCtxEmuSetResult */
-    sevProvCtxEmuSetResult
+    /** pfnCtxQueryCaps */
+    NULL
 };
-
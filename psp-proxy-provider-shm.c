@@ -0,0 +1,642 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - shared memory rings for co-located stubs.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Device schema looks like shm://[spin=<us>,]<name>|/<path>|fd=<descriptor>:
+ *     - <name> is a POSIX shared memory object (living in /dev/shm), /<path> any file which can be mapped
+ *       shared and fd=<descriptor> an inherited memfd.
+ *     - spin=<us> is the maximum time to busy wait for a response before blocking on the futex.
+ * The region is created by the stub side, see psp-shm.h for the layout and the wakeup protocol.
+ *
+ * Waiting for data busy waits first and only blocks in the kernel if nothing arrived in time. The spin
+ * budget adapts to the observed response time: when blocking was necessary it is set to twice the time
+ * the response took (up to the configured maximum), so short requests end up never entering the kernel
+ * while long running ones don't burn the CPU.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <common/cdefs.h>
+#include <common/types.h>
+#include <common/status.h>
+
+#include "psp-proxy-provider.h"
+#include "psp-shm.h"
+
+
+/** Default maximum spin time before blocking in nanoseconds. */
+#define PSP_SHM_SPIN_NS_MAX_DEF         (50 * 1000)
+/** Minimum spin time before blocking in nanoseconds. */
+#define PSP_SHM_SPIN_NS_MIN             (1 * 1000)
+/** How long to wait for space in the ring when writing before giving up, in milliseconds. */
+#define PSP_SHM_WRITE_TIMEOUT_MS        10000
+
+
+/**
+ * Internal PSP proxy provider context.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** The descriptor of the shared memory object. */
+    int                             iFdShm;
+    /** The shared memory region header. */
+    PPSPSHMHDR                      pHdr;
+    /** Size of the mapping. */
+    size_t                          cbMap;
+    /** The ring we produce. */
+    PPSPSHMRING                     pRingTx;
+    /** The data area of the ring we produce. */
+    uint8_t                         *pbTx;
+    /** Size of the ring we produce, as validated during init (the peer can change the shared copy). */
+    uint32_t                        cbRingTx;
+    /** The ring we consume. */
+    PPSPSHMRING                     pRingRx;
+    /** The data area of the ring we consume. */
+    uint8_t                         *pbRx;
+    /** Size of the ring we consume, as validated during init. */
+    uint32_t                        cbRingRx;
+    /** Flag whether the peer published a head offset which doesn't fit the ring we consume. */
+    bool                            fRxCorrupt;
+    /** Maximum spin time in nanoseconds. */
+    uint64_t                        cNsSpinMax;
+    /** Current spin time in nanoseconds. */
+    uint64_t                        cNsSpin;
+    /** Flag whether the poll got interrupted. */
+    volatile uint32_t               fIntr;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t pspShmTimeNs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000 + Ts.tv_nsec;
+}
+
+
+/**
+ * Tells the CPU we are busy waiting.
+ */
+static inline void pspShmCpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+
+/**
+ * Waits on the given shared futex word as long as it has the given value.
+ *
+ * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_TIMEOUT if the timeout elapsed.
+ * @param   pThis                   The provider context.
+ * @param   pu32                    The futex word.
+ * @param   u32Val                  The value to wait on.
+ * @param   cNsTimeout              How long to wait at most.
+ */
+static int pspShmFutexWait(PPSPPROXYPROVCTXINT pThis, volatile uint32_t *pu32, uint32_t u32Val, uint64_t cNsTimeout)
+{
+    struct timespec Ts;
+
+    Ts.tv_sec  = cNsTimeout / 1000000000;
+    Ts.tv_nsec = cNsTimeout % 1000000000;
+    long rcSys = syscall(SYS_futex, pu32, FUTEX_WAIT, u32Val, &Ts, NULL, 0);
+    pThis->cSyscalls++;
+    if (!rcSys || errno == EAGAIN || errno == EINTR)
+        return 0;
+    if (errno == ETIMEDOUT)
+        return STS_ERR_PSP_PROXY_TIMEOUT;
+
+    return -1;
+}
+
+
+/**
+ * Bumps the given sequence counter and wakes up the other side if it is blocked on it.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   pu32Seq                 The sequence counter.
+ * @param   pfWaiter                The waiter flag.
+ */
+static void pspShmSignal(PPSPPROXYPROVCTXINT pThis, volatile uint32_t *pu32Seq, volatile uint32_t *pfWaiter)
+{
+    __atomic_fetch_add(pu32Seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(pfWaiter, __ATOMIC_SEQ_CST))
+    {
+        syscall(SYS_futex, pu32Seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        pThis->cSyscalls++;
+    }
+}
+
+
+/**
+ * Sets a new spin time, clamped to the allowed range.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   cNsSpin                 The new spin time in nanoseconds.
+ */
+static inline void pspShmSpinAdjust(PPSPPROXYPROVCTXINT pThis, uint64_t cNsSpin)
+{
+    pThis->cNsSpin = MIN(MAX(cNsSpin, PSP_SHM_SPIN_NS_MIN), pThis->cNsSpinMax);
+}
+
+
+/**
+ * Returns the number of bytes available for reading.
+ *
+ * @returns Number of bytes available.
+ * @param   pThis                   The provider context.
+ */
+static inline uint32_t pspShmRxAvail(PPSPPROXYPROVCTXINT pThis)
+{
+    uint32_t cbAvail = __atomic_load_n(&pThis->pRingRx->offHead, __ATOMIC_ACQUIRE) - pThis->pRingRx->offTail;
+
+    /* The head comes from the peer, never read beyond what the ring can hold. */
+    if (cbAvail > pThis->cbRingRx)
+    {
+        pThis->fRxCorrupt = true;
+        return 0;
+    }
+
+    return cbAvail;
+}
+
+
+/**
+ * Returns the number of bytes free for writing.
+ *
+ * @returns Number of bytes free.
+ * @param   pThis                   The provider context.
+ */
+static inline uint32_t pspShmTxFree(PPSPPROXYPROVCTXINT pThis)
+{
+    return pThis->cbRingTx - (pThis->pRingTx->offHead - __atomic_load_n(&pThis->pRingTx->offTail, __ATOMIC_ACQUIRE));
+}
+
+
+/**
+ * Checks whether the given ring header is sane.
+ *
+ * @returns Flag whether the ring is usable.
+ * @param   pRing                   The ring header.
+ * @param   cbRegion                Size of the region.
+ */
+static bool pspShmRingIsValid(PPSPSHMRING pRing, size_t cbRegion)
+{
+    return    pRing->cbRing
+           && !(pRing->cbRing & (pRing->cbRing - 1))
+           && pRing->offData >= sizeof(PSPSHMHDR)
+           && (uint64_t)pRing->offData + pRing->cbRing <= cbRegion
+           && pRing->offHead - pRing->offTail <= pRing->cbRing;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int shmProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct stat StatShm;
+
+    /* Spinning on a single CPU only keeps the stub from running. */
+    pThis->cNsSpinMax = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? PSP_SHM_SPIN_NS_MAX_DEF : 0;
+    if (!strncmp(pszDevice, "spin=", sizeof("spin=") - 1))
+    {
+        char *pszEnd = NULL;
+        pThis->cNsSpinMax = strtoul(pszDevice + sizeof("spin=") - 1, &pszEnd, 10) * 1000;
+        if (!pszEnd || *pszEnd != ',')
+            return -1;
+        pszDevice = pszEnd + 1;
+    }
+    pThis->cNsSpin = pThis->cNsSpinMax;
+
+    if (!strncmp(pszDevice, "fd=", sizeof("fd=") - 1))
+    {
+        char *pszEnd = NULL;
+        long iFd = strtol(pszDevice + sizeof("fd=") - 1, &pszEnd, 10);
+        if (!pszEnd || *pszEnd != '\0' || iFd < 0 || iFd > INT_MAX)
+            return -1;
+        pThis->iFdShm = (int)iFd;
+    }
+    else
+    {
+        char szPath[256];
+
+        /* This is what shm_open() does, saves pulling in librt on older systems. */
+        if (*pszDevice == '/')
+            snprintf(&szPath[0], sizeof(szPath), "%s", pszDevice);
+        else
+            snprintf(&szPath[0], sizeof(szPath), "/dev/shm/%s", pszDevice);
+        pThis->iFdShm = open(&szPath[0], O_RDWR | O_CLOEXEC);
+        if (pThis->iFdShm == -1)
+            return -1;
+    }
+
+    if (   !fstat(pThis->iFdShm, &StatShm)
+        && (size_t)StatShm.st_size >= sizeof(PSPSHMHDR))
+    {
+        pThis->cbMap = StatShm.st_size;
+        pThis->pHdr  = (PPSPSHMHDR)mmap(NULL, pThis->cbMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        pThis->iFdShm, 0);
+        if (pThis->pHdr != MAP_FAILED)
+        {
+            PPSPSHMHDR pHdr = pThis->pHdr;
+
+            if (   __atomic_load_n(&pHdr->u32Magic, __ATOMIC_ACQUIRE) == PSP_SHM_MAGIC
+                && pHdr->u32Version == PSP_SHM_VERSION
+                && pHdr->cbRegion <= pThis->cbMap
+                && pspShmRingIsValid(&pHdr->Ext2Psp, pHdr->cbRegion)
+                && pspShmRingIsValid(&pHdr->Psp2Ext, pHdr->cbRegion))
+            {
+                pThis->pRingTx = &pHdr->Ext2Psp;
+                pThis->pbTx       = (uint8_t *)pHdr + pHdr->Ext2Psp.offData;
+                pThis->cbRingTx   = pHdr->Ext2Psp.cbRing;
+                pThis->pRingRx    = &pHdr->Psp2Ext;
+                pThis->pbRx       = (uint8_t *)pHdr + pHdr->Psp2Ext.offData;
+                pThis->cbRingRx   = pHdr->Psp2Ext.cbRing;
+                pThis->fRxCorrupt = false;
+                pThis->fIntr      = 0;
+                __atomic_and_fetch(&pHdr->fFlags, ~PSP_SHM_F_EXT_CLOSED, __ATOMIC_SEQ_CST);
+                return 0;
+            }
+
+            munmap(pThis->pHdr, pThis->cbMap);
+            pThis->pHdr = NULL;
+        }
+    }
+
+    close(pThis->iFdShm);
+    pThis->iFdShm = -1;
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void shmProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Let the stub side know we are gone. */
+    __atomic_or_fetch(&pThis->pHdr->fFlags, PSP_SHM_F_EXT_CLOSED, __ATOMIC_SEQ_CST);
+    pspShmSignal(pThis, &pThis->pRingTx->u32DataSeq, &pThis->pRingTx->fDataWaiter);
+
+    munmap(pThis->pHdr, pThis->cbMap);
+    close(pThis->iFdShm);
+    pThis->pHdr   = NULL;
+    pThis->iFdShm = -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t shmProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    return pspShmRxAvail(pThis);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int shmProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSHMRING pRing = pThis->pRingRx;
+    uint32_t offTail = pRing->offTail;
+    uint32_t cbThisRead = MIN(cbRead, pspShmRxAvail(pThis));
+
+    *pcbRead = 0;
+    if (pThis->fRxCorrupt)
+        return -1;
+    if (!cbThisRead)
+        return 0;
+
+    uint32_t offRing = offTail & (pThis->cbRingRx - 1);
+    uint32_t cbChunk = MIN(cbThisRead, pThis->cbRingRx - offRing);
+    memcpy(pvDst, &pThis->pbRx[offRing], cbChunk);
+    if (cbChunk < cbThisRead)
+        memcpy((uint8_t *)pvDst + cbChunk, &pThis->pbRx[0], cbThisRead - cbChunk);
+
+    __atomic_store_n(&pRing->offTail, offTail + cbThisRead, __ATOMIC_RELEASE);
+    pspShmSignal(pThis, &pRing->u32SpaceSeq, &pRing->fSpaceWaiter);
+    *pcbRead = cbThisRead;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int shmProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSHMRING pRing = pThis->pRingTx;
+    size_t cbTotal = 0;
+
+    for (unsigned i = 0; i < cIov; i++)
+        cbTotal += paIov[i].iov_len;
+    if (cbTotal > pThis->cbRingTx)
+        return -1;
+
+    /* The stub normally keeps up, only block when the ring is really full. */
+    if (pspShmTxFree(pThis) < cbTotal)
+    {
+        uint64_t tsDeadline = pspShmTimeNs() + PSP_SHM_WRITE_TIMEOUT_MS * 1000000ULL;
+        for (;;)
+        {
+            __atomic_store_n(&pRing->fSpaceWaiter, 1, __ATOMIC_SEQ_CST);
+            uint32_t u32Seq = __atomic_load_n(&pRing->u32SpaceSeq, __ATOMIC_SEQ_CST);
+            if (pspShmTxFree(pThis) >= cbTotal)
+                break;
+            if (pThis->pHdr->fFlags & PSP_SHM_F_PSP_CLOSED)
+            {
+                __atomic_store_n(&pRing->fSpaceWaiter, 0, __ATOMIC_SEQ_CST);
+                return -1;
+            }
+
+            uint64_t tsNow = pspShmTimeNs();
+            if (tsNow >= tsDeadline)
+            {
+                __atomic_store_n(&pRing->fSpaceWaiter, 0, __ATOMIC_SEQ_CST);
+                return -1;
+            }
+
+            int rc = pspShmFutexWait(pThis, &pRing->u32SpaceSeq, u32Seq, tsDeadline - tsNow);
+            if (rc && rc != STS_ERR_PSP_PROXY_TIMEOUT)
+            {
+                __atomic_store_n(&pRing->fSpaceWaiter, 0, __ATOMIC_SEQ_CST);
+                return rc;
+            }
+        }
+        __atomic_store_n(&pRing->fSpaceWaiter, 0, __ATOMIC_SEQ_CST);
+    }
+
+    /* Copy all fragments and publish the packet at once so the stub never sees a partial PDU. */
+    uint32_t offHead = pRing->offHead;
+    for (unsigned i = 0; i < cIov; i++)
+    {
+        const uint8_t *pbSrc = (const uint8_t *)paIov[i].iov_base;
+        size_t cbLeft = paIov[i].iov_len;
+
+        while (cbLeft)
+        {
+            uint32_t offRing = offHead & (pThis->cbRingTx - 1);
+            uint32_t cbChunk = MIN(cbLeft, pThis->cbRingTx - offRing);
+
+            memcpy(&pThis->pbTx[offRing], pbSrc, cbChunk);
+            pbSrc   += cbChunk;
+            cbLeft  -= cbChunk;
+            offHead += cbChunk;
+        }
+    }
+
+    __atomic_store_n(&pRing->offHead, offHead, __ATOMIC_RELEASE);
+    pspShmSignal(pThis, &pRing->u32DataSeq, &pRing->fDataWaiter);
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int shmProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    struct iovec Iov = { (void *)pvPkt, cbPkt };
+
+    return shmProvCtxWriteV(hProvCtx, &Iov, 1);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int shmProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSHMRING pRing = pThis->pRingRx;
+
+    if (pspShmRxAvail(pThis))
+        return 0;
+    if (pThis->fRxCorrupt)
+        return -1;
+
+    uint64_t tsStart    = pspShmTimeNs();
+    uint64_t cNsTimeout = cMillies == UINT32_MAX ? UINT64_MAX / 2 : (uint64_t)cMillies * 1000000;
+    uint64_t cNsSpin    = MIN(pThis->cNsSpin, cNsTimeout);
+    uint64_t tsNow      = tsStart;
+
+    /* Busy wait first, the response to a short request arrives faster than blocking takes. */
+    while (tsNow - tsStart < cNsSpin)
+    {
+        if (pspShmRxAvail(pThis))
+            return 0;
+        if (   pThis->fIntr
+            || pThis->fRxCorrupt)
+            break;
+
+        pspShmCpuRelax();
+        tsNow = pspShmTimeNs();
+    }
+
+    for (;;)
+    {
+        __atomic_store_n(&pRing->fDataWaiter, 1, __ATOMIC_SEQ_CST);
+        uint32_t u32Seq = __atomic_load_n(&pRing->u32DataSeq, __ATOMIC_SEQ_CST);
+        int rc = 0;
+
+        if (pspShmRxAvail(pThis))
+        {
+            /* Spin long enough to catch a response like this one next time, unless it took too long anyway. */
+            uint64_t cNsWaited = pspShmTimeNs() - tsStart;
+            if (2 * cNsWaited <= pThis->cNsSpinMax)
+                pspShmSpinAdjust(pThis, 2 * cNsWaited);
+            else
+                pspShmSpinAdjust(pThis, pThis->cNsSpin / 2);
+        }
+        else if (__atomic_exchange_n(&pThis->fIntr, 0, __ATOMIC_SEQ_CST))
+            rc = STS_ERR_PSP_PROXY_INTERRUPTED;
+        else if (   (pThis->pHdr->fFlags & PSP_SHM_F_PSP_CLOSED)
+                 || pThis->fRxCorrupt)
+            rc = -1;
+        else
+        {
+            tsNow = pspShmTimeNs();
+            if (tsNow - tsStart >= cNsTimeout)
+            {
+                /* Nothing came in for a long time, stop burning the CPU on the next requests. */
+                pspShmSpinAdjust(pThis, pThis->cNsSpin / 2);
+                rc = STS_ERR_PSP_PROXY_TIMEOUT;
+            }
+            else
+            {
+                rc = pspShmFutexWait(pThis, &pRing->u32DataSeq, u32Seq, cNsTimeout - (tsNow - tsStart));
+                if (!rc || rc == STS_ERR_PSP_PROXY_TIMEOUT)
+                    continue;
+            }
+        }
+
+        __atomic_store_n(&pRing->fDataWaiter, 0, __ATOMIC_SEQ_CST);
+        return rc;
+    }
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int shmProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Changing the sequence counter makes a blocked poll return, the stub treats it as a spurious wakeup. */
+    __atomic_store_n(&pThis->fIntr, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&pThis->pRingRx->u32DataSeq, 1, __ATOMIC_SEQ_CST);
+    if (syscall(SYS_futex, &pThis->pRingRx->u32DataSeq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0) == -1)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int shmProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pStats->cSyscalls = pThis->cSyscalls;
+    return 0;
+}
+
+
+/**
+ * Provider registration structure.
+ */
+const PSPPROXYPROV g_PspProxyProvShm =
+{
+    /** pszId */
+    "shm",
+    /** pszDesc */
+    "Shared memory rings for co-located stubs, device schema looks like shm://[spin=<us>,]<name>|/<path>|fd=<descriptor>",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    PSPPROXY_CAPS_F_ZERO_COPY,
+    /** pfnCtxInit */
+    shmProvCtxInit,
+    /** pfnCtxDestroy */
+    shmProvCtxDestroy,
+    /** pfnCtxPeek */
+    shmProvCtxPeek,
+    /** pfnCtxRead */
+    shmProvCtxRead,
+    /** pfnCtxWrite */
+    shmProvCtxWrite,
+    /** pfnCtxPoll */
+    shmProvCtxPoll,
+    /** pfnCtxInterrupt */
+    shmProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    shmProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    shmProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    NULL
+};
+
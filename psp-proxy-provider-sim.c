@@ -0,0 +1,1573 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - in process simulation of the serial stub
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <common/cdefs.h>
+#include <common/types.h>
+#include <common/status.h>
+#include <psp-stub/psp-serial-stub.h>
+
+#include "psp-proxy-provider.h"
+
+
+/** Default number of sockets simulated. */
+#define PSP_SIM_SOCKETS_DEF             1
+/** Default number of CCDs per socket simulated. */
+#define PSP_SIM_CCDS_PER_SOCKET_DEF     1
+/** Default maximum PDU size in bytes. */
+#define PSP_SIM_PDU_MAX_DEF             _4K
+/** Minimum PDU size accepted from the configuration. */
+#define PSP_SIM_PDU_MAX_MIN             256
+/** Default size of the SRAM per CCD in bytes. */
+#define PSP_SIM_SRAM_SZ_DEF             (256 * 1024)
+/** Size of the scratch space area at the end of the SRAM in bytes. */
+#define PSP_SIM_SCRATCH_SZ              (16 * 1024)
+/** Default size of the simulated x86 memory in bytes. */
+#define PSP_SIM_X86_MEM_SZ_DEF          (1024 * 1024)
+/** Interval between two beacons while nobody is connected in milliseconds. */
+#define PSP_SIM_BEACON_INTERVAL_MS      100
+/** Initial number of register file entries. */
+#define PSP_SIM_REGS_DEF                256
+
+
+/**
+ * Register file address spaces.
+ */
+typedef enum PSPSIMREGSPACE
+{
+    /** Invalid space. */
+    PSPSIMREGSPACE_INVALID = 0,
+    /** PSP MMIO. */
+    PSPSIMREGSPACE_PSP_MMIO,
+    /** SMN. */
+    PSPSIMREGSPACE_SMN,
+    /** x86 MMIO. */
+    PSPSIMREGSPACE_X86_MMIO,
+    /** Co-processor registers. */
+    PSPSIMREGSPACE_COPROC,
+    /** 32bit hack. */
+    PSPSIMREGSPACE_32BIT_HACK = 0x7fffffff
+} PSPSIMREGSPACE;
+
+
+/**
+ * A register file entry, covering a naturally aligned 32bit register.
+ */
+typedef struct PSPSIMREG
+{
+    /** The key (address space, CCD and aligned address), 0 if the entry is free. */
+    uint64_t                        uKey;
+    /** The register value. */
+    uint32_t                        u32Val;
+} PSPSIMREG;
+/** Pointer to a register file entry. */
+typedef PSPSIMREG *PPSPSIMREG;
+
+
+/**
+ * A PDU queued for the host on a link.
+ */
+typedef struct PSPSIMPDU
+{
+    /** Next PDU in the queue. */
+    struct PSPSIMPDU                *pNext;
+    /** Point in time (nanoseconds, monotonic clock) the PDU is completely received by the host. */
+    uint64_t                        tsReadyNs;
+    /** Size of the PDU in bytes. */
+    size_t                          cbPdu;
+    /** Number of bytes already read by the host. */
+    size_t                          offRead;
+    /** The PDU data, variable in size. */
+    uint8_t                         abPdu[1];
+} PSPSIMPDU;
+/** Pointer to a queued PDU. */
+typedef PSPSIMPDU *PPSPSIMPDU;
+
+
+/** Forward declaration of a link. */
+typedef struct PSPSIMLINK *PPSPSIMLINK;
+
+
+/**
+ * The simulated stub, the target side state.
+ */
+typedef struct PSPSIMSTUB
+{
+    /** Number of sockets. */
+    uint32_t                        cSockets;
+    /** Number of CCDs per socket. */
+    uint32_t                        cCcdsPerSocket;
+    /** Total number of CCDs. */
+    uint32_t                        cCcds;
+    /** Maximum PDU size. */
+    uint32_t                        cbPduMax;
+    /** Size of the SRAM per CCD. */
+    uint32_t                        cbSram;
+    /** The SRAM of all CCDs. */
+    uint8_t                         *pbSram;
+    /** Start of the scratch space area. */
+    PSPADDR                         PspAddrScratch;
+    /** Size of the scratch space area. */
+    uint32_t                        cbScratch;
+    /** Size of the x86 memory. */
+    size_t                          cbX86Mem;
+    /** The x86 memory. */
+    uint8_t                         *pbX86Mem;
+    /** The register file (hash table with linear probing). */
+    PPSPSIMREG                      paRegs;
+    /** Number of entries in the register file, power of two. */
+    uint32_t                        cRegsMax;
+    /** Number of used register file entries. */
+    uint32_t                        cRegs;
+    /** Start of the simulation (monotonic clock in nanoseconds), the target timestamps are relative to this. */
+    uint64_t                        tsStartNs;
+    /** Flag whether a host is connected. */
+    bool                            fConnected;
+    /** Number of PDUs sent since the last reset/connect. */
+    uint32_t                        cPdusSent;
+    /** Number of beacons sent since the last reset. */
+    uint32_t                        cBeaconsSent;
+    /** Point in time the next beacon is due. */
+    uint64_t                        tsNextBeaconNs;
+    /** Number of bytes of the code module loaded. */
+    size_t                          cbCm;
+    /** The ID the stub is shared under, 0 if private to a single link. */
+    uint64_t                        idShared;
+    /** Number of links attached to the stub. */
+    uint32_t                        cRefs;
+    /** Next shared stub in the list. */
+    struct PSPSIMSTUB               *pNext;
+    /** Point in time the last request was processed, for shared stubs. */
+    uint64_t                        tsReqLastNs;
+} PSPSIMSTUB;
+/** Pointer to the simulated stub. */
+typedef PSPSIMSTUB *PPSPSIMSTUB;
+
+
+/**
+ * A link between the host and the simulated stub.
+ */
+typedef struct PSPSIMLINK
+{
+    /** The stub this link is attached to. */
+    PPSPSIMSTUB                     pStub;
+    /** One way latency in nanoseconds. */
+    uint64_t                        cNsLatency;
+    /** Bandwidth in bytes per second, 0 for unlimited. */
+    uint64_t                        cbPerSec;
+    /** Point in time the host to target direction becomes idle. */
+    uint64_t                        tsTxIdleNs;
+    /** Point in time the target to host direction becomes idle. */
+    uint64_t                        tsRxIdleNs;
+    /** Buffer for assembling the PDUs written by the host. */
+    uint8_t                         *pbTx;
+    /** Size of the assembly buffer. */
+    size_t                          cbTxMax;
+    /** Number of bytes in the assembly buffer. */
+    size_t                          cbTx;
+    /** Head of the PDU queue to the host. */
+    PPSPSIMPDU                      pPduHead;
+    /** Tail of the PDU queue to the host. */
+    PPSPSIMPDU                      pPduTail;
+} PSPSIMLINK;
+
+
+/**
+ * Internal PSP proxy provider context.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** The simulated stub. */
+    PPSPSIMSTUB                     pStub;
+    /** The link to the stub. */
+    PSPSIMLINK                      Link;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+/**
+ * Simulation configuration parsed from the device URI.
+ */
+typedef struct PSPSIMCFG
+{
+    /** Number of sockets. */
+    uint32_t                        cSockets;
+    /** Number of CCDs per socket. */
+    uint32_t                        cCcdsPerSocket;
+    /** One way latency in microseconds. */
+    uint64_t                        cUsLatency;
+    /** Bandwidth in bytes per second, 0 for unlimited. */
+    uint64_t                        cbPerSec;
+    /** Maximum PDU size. */
+    uint32_t                        cbPduMax;
+    /** SRAM size per CCD. */
+    uint32_t                        cbSram;
+    /** x86 memory size. */
+    size_t                          cbX86Mem;
+    /** ID of the stub shared with other links, 0 for a private stub. */
+    uint64_t                        idStub;
+} PSPSIMCFG;
+/** Pointer to a simulation configuration. */
+typedef PSPSIMCFG *PPSPSIMCFG;
+
+
+/**
+ * List of stubs shared between multiple links (bonding).
+ */
+static PPSPSIMSTUB g_pSimStubsShared = NULL;
+/** Protects g_pSimStubsShared and the reference counts of the shared stubs, contexts might get
+ * created and destroyed on different threads. */
+static pthread_mutex_t g_SimStubsSharedMtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ */
+static uint64_t pspSimTimeNs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Sleeps until the given point in time or until the provider gets interrupted.
+ *
+ * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_INTERRUPTED if the provider was interrupted.
+ * @param   pThis                   The provider context.
+ * @param   tsNs                    The point in time to sleep until.
+ */
+static int pspSimSleepUntil(PPSPPROXYPROVCTXINT pThis, uint64_t tsNs)
+{
+    uint64_t tsNowNs = pspSimTimeNs();
+    uint64_t cNsWait = tsNs > tsNowNs ? tsNs - tsNowNs : 0;
+    struct pollfd PollFd;
+    struct timespec Ts;
+
+    Ts.tv_sec       = cNsWait / 1000000000ULL;
+    Ts.tv_nsec      = cNsWait % 1000000000ULL;
+    PollFd.fd       = pThis->iFdEvtIntr;
+    PollFd.events   = POLLIN;
+    PollFd.revents  = 0;
+    if (ppoll(&PollFd, 1, &Ts, NULL) == 1)
+    {
+        uint64_t uCnt = 0;
+        if (read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt)) == sizeof(uCnt))
+            return STS_ERR_PSP_PROXY_INTERRUPTED;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Returns the time required to transfer the given amount of bytes over the link.
+ *
+ * @returns Time in nanoseconds.
+ * @param   pLink                   The link.
+ * @param   cb                      Number of bytes.
+ */
+static uint64_t pspSimLinkXferTimeNs(PPSPSIMLINK pLink, size_t cb)
+{
+    if (!pLink->cbPerSec)
+        return 0;
+
+    return (uint64_t)cb * 1000000000ULL / pLink->cbPerSec;
+}
+
+
+/**
+ * Creates the register file key for the given address.
+ *
+ * @returns Key.
+ * @param   enmSpace                The address space.
+ * @param   idCcd                   The CCD ID.
+ * @param   uAddr                   The address, aligned to 4 bytes.
+ */
+static inline uint64_t pspSimStubRegKey(PSPSIMREGSPACE enmSpace, uint32_t idCcd, uint64_t uAddr)
+{
+    return ((uint64_t)enmSpace << 56) | ((uint64_t)(idCcd & 0xff) << 48) | (uAddr & 0xffffffffffffULL);
+}
+
+
+/**
+ * Looks up the register file entry for the given key.
+ *
+ * @returns Pointer to the entry, either the matching one or the free one the key would be inserted at.
+ * @param   paRegs                  The register file.
+ * @param   cRegsMax                Number of entries in the register file.
+ * @param   uKey                    The key to look for.
+ */
+static PPSPSIMREG pspSimStubRegLookup(PPSPSIMREG paRegs, uint32_t cRegsMax, uint64_t uKey)
+{
+    uint64_t uHash = uKey * 0x9e3779b97f4a7c15ULL;
+    uint32_t idx = (uint32_t)(uHash >> 32) & (cRegsMax - 1);
+
+    while (   paRegs[idx].uKey
+           && paRegs[idx].uKey != uKey)
+        idx = (idx + 1) & (cRegsMax - 1);
+
+    return &paRegs[idx];
+}
+
+
+/**
+ * Returns the register file entry for the given key, creating it if it doesn't exist.
+ *
+ * @returns Pointer to the entry or NULL if out of memory.
+ * @param   pStub                   The simulated stub.
+ * @param   uKey                    The key.
+ */
+static PPSPSIMREG pspSimStubRegGet(PPSPSIMSTUB pStub, uint64_t uKey)
+{
+    PPSPSIMREG pReg = pspSimStubRegLookup(pStub->paRegs, pStub->cRegsMax, uKey);
+    if (pReg->uKey)
+        return pReg;
+
+    /* Grow the table when it is half full to keep the probe sequences short. */
+    if ((pStub->cRegs + 1) * 2 > pStub->cRegsMax)
+    {
+        uint32_t cRegsMaxNew = pStub->cRegsMax * 2;
+        PPSPSIMREG paRegsNew = (PPSPSIMREG)calloc(cRegsMaxNew, sizeof(*paRegsNew));
+        if (!paRegsNew)
+            return NULL;
+
+        for (uint32_t i = 0; i < pStub->cRegsMax; i++)
+        {
+            if (pStub->paRegs[i].uKey)
+                *pspSimStubRegLookup(paRegsNew, cRegsMaxNew, pStub->paRegs[i].uKey) = pStub->paRegs[i];
+        }
+
+        free(pStub->paRegs);
+        pStub->paRegs   = paRegsNew;
+        pStub->cRegsMax = cRegsMaxNew;
+        pReg = pspSimStubRegLookup(pStub->paRegs, pStub->cRegsMax, uKey);
+    }
+
+    pReg->uKey   = uKey;
+    pReg->u32Val = 0;
+    pStub->cRegs++;
+    return pReg;
+}
+
+
+/**
+ * Accesses the register file, registers never written read as 0.
+ *
+ * @returns Status code.
+ * @param   pStub                   The simulated stub.
+ * @param   enmSpace                The address space.
+ * @param   idCcd                   The CCD ID.
+ * @param   uAddr                   The start address.
+ * @param   pvBuf                   The data buffer.
+ * @param   cb                      Number of bytes to access.
+ * @param   fWrite                  Flag whether this is a write.
+ */
+static int pspSimStubRegAccess(PPSPSIMSTUB pStub, PSPSIMREGSPACE enmSpace, uint32_t idCcd, uint64_t uAddr,
+                               void *pvBuf, size_t cb, bool fWrite)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+
+    for (size_t i = 0; i < cb; i++)
+    {
+        uint64_t uKey = pspSimStubRegKey(enmSpace, idCcd, (uAddr + i) & ~(uint64_t)3);
+        uint32_t cShift = ((uAddr + i) & 3) * 8;
+
+        if (fWrite)
+        {
+            PPSPSIMREG pReg = pspSimStubRegGet(pStub, uKey);
+            if (!pReg)
+                return -1;
+
+            pReg->u32Val = (pReg->u32Val & ~(0xffU << cShift)) | ((uint32_t)pbBuf[i] << cShift);
+        }
+        else
+        {
+            PPSPSIMREG pReg = pspSimStubRegLookup(pStub->paRegs, pStub->cRegsMax, uKey);
+            pbBuf[i] = pReg->uKey ? (uint8_t)(pReg->u32Val >> cShift) : 0;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Accesses a flat memory area.
+ *
+ * @returns Status code.
+ * @param   pbMem                   The memory area.
+ * @param   cbMem                   Size of the memory area.
+ * @param   uAddr                   The start address.
+ * @param   pvBuf                   The data buffer.
+ * @param   cb                      Number of bytes to access.
+ * @param   fWrite                  Flag whether this is a write.
+ */
+static int pspSimStubMemAccess(uint8_t *pbMem, size_t cbMem, uint64_t uAddr, void *pvBuf, size_t cb, bool fWrite)
+{
+    if (   uAddr >= cbMem
+        || cb > cbMem - uAddr)
+        return STS_ERR_INVALID_PARAMETER;
+
+    if (fWrite)
+        memcpy(pbMem + uAddr, pvBuf, cb);
+    else
+        memcpy(pvBuf, pbMem + uAddr, cb);
+    return 0;
+}
+
+
+/**
+ * Accesses the given address space of the simulated stub.
+ *
+ * @returns Status code.
+ * @param   pStub                   The simulated stub.
+ * @param   idCcd                   The CCD ID.
+ * @param   enmAddrSpace            The address space.
+ * @param   uAddr                   The start address.
+ * @param   pvBuf                   The data buffer.
+ * @param   cb                      Number of bytes to access.
+ * @param   fWrite                  Flag whether this is a write.
+ */
+static int pspSimStubAddrSpaceAccess(PPSPSIMSTUB pStub, uint32_t idCcd, PSPADDRSPACE enmAddrSpace, uint64_t uAddr,
+                                     void *pvBuf, size_t cb, bool fWrite)
+{
+    switch (enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+            return pspSimStubMemAccess(pStub->pbSram + (size_t)idCcd * pStub->cbSram, pStub->cbSram, uAddr, pvBuf, cb, fWrite);
+        case PSPADDRSPACE_PSP_MMIO:
+            return pspSimStubRegAccess(pStub, PSPSIMREGSPACE_PSP_MMIO, idCcd, uAddr, pvBuf, cb, fWrite);
+        case PSPADDRSPACE_SMN:
+            return pspSimStubRegAccess(pStub, PSPSIMREGSPACE_SMN, idCcd, uAddr, pvBuf, cb, fWrite);
+        case PSPADDRSPACE_X86_MEM:
+            return pspSimStubMemAccess(pStub->pbX86Mem, pStub->cbX86Mem, uAddr, pvBuf, cb, fWrite);
+        case PSPADDRSPACE_X86_MMIO:
+            return pspSimStubRegAccess(pStub, PSPSIMREGSPACE_X86_MMIO, idCcd, uAddr, pvBuf, cb, fWrite);
+        default:
+            break;
+    }
+
+    return STS_ERR_INVALID_PARAMETER;
+}
+
+
+/**
+ * Queues a PDU from the stub to the host on the given link.
+ *
+ * @returns Status code.
+ * @param   pStub                   The simulated stub.
+ * @param   pLink                   The link to send the PDU on.
+ * @param   tsNs                    Point in time the PDU is sent by the stub.
+ * @param   idCcd                   The CCD ID the PDU originates from.
+ * @param   enmRrnId                The Response/Notification ID.
+ * @param   rcReq                   The request status for responses.
+ * @param   pvPayload1              First part of the payload, optional.
+ * @param   cbPayload1              Size of the first part in bytes.
+ * @param   pvPayload2              Second part of the payload, optional.
+ * @param   cbPayload2              Size of the second part in bytes.
+ */
+static int pspSimStubPduSend(PPSPSIMSTUB pStub, PPSPSIMLINK pLink, uint64_t tsNs, uint32_t idCcd,
+                             PSPSERIALPDURRNID enmRrnId, PSPSTS rcReq,
+                             const void *pvPayload1, size_t cbPayload1,
+                             const void *pvPayload2, size_t cbPayload2)
+{
+    size_t cbPayload = cbPayload1 + cbPayload2;
+    size_t cbPad = ((cbPayload + 7) & ~(size_t)7) - cbPayload;
+    size_t cbPdu = sizeof(PSPSERIALPDUHDR) + cbPayload + cbPad + sizeof(PSPSERIALPDUFOOTER);
+    PPSPSIMPDU pPdu = (PPSPSIMPDU)calloc(1, sizeof(*pPdu) + cbPdu);
+    if (!pPdu)
+        return -1;
+
+    PPSPSERIALPDUHDR pHdr = (PPSPSERIALPDUHDR)&pPdu->abPdu[0];
+    uint8_t *pbPayload = (uint8_t *)(pHdr + 1);
+    PPSPSERIALPDUFOOTER pFooter = (PPSPSERIALPDUFOOTER)(pbPayload + cbPayload + cbPad);
+
+    pHdr->u32Magic           = PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC;
+    pHdr->u.Fields.cbPdu     = cbPayload;
+    pHdr->u.Fields.cPdus     = ++pStub->cPdusSent;
+    pHdr->u.Fields.enmRrnId  = enmRrnId;
+    pHdr->u.Fields.idCcd     = idCcd;
+    pHdr->u.Fields.rcReq     = rcReq;
+    pHdr->u.Fields.tsMillies = (uint32_t)((tsNs - pStub->tsStartNs) / 1000000ULL);
+    if (cbPayload1)
+        memcpy(pbPayload, pvPayload1, cbPayload1);
+    if (cbPayload2)
+        memcpy(pbPayload + cbPayload1, pvPayload2, cbPayload2);
+
+    uint32_t uChkSum = 0;
+    for (uint32_t i = 0; i < sizeof(pHdr->u.ab); i++)
+        uChkSum += pHdr->u.ab[i];
+    for (size_t i = 0; i < cbPayload; i++)
+        uChkSum += pbPayload[i];
+
+    pFooter->u32ChkSum = (0xffffffff - uChkSum) + 1;
+    pFooter->u32Magic  = PSP_SERIAL_PSP_2_EXT_PDU_END_MAGIC;
+
+    /* The PDU can't be sent before the link is idle and is ready once the last byte travelled to the host. */
+    uint64_t tsStartNs = MAX(tsNs, pLink->tsRxIdleNs);
+    pLink->tsRxIdleNs = tsStartNs + pspSimLinkXferTimeNs(pLink, cbPdu);
+
+    pPdu->pNext     = NULL;
+    pPdu->tsReadyNs = pLink->tsRxIdleNs + pLink->cNsLatency;
+    pPdu->cbPdu     = cbPdu;
+    pPdu->offRead   = 0;
+    if (pLink->pPduTail)
+        pLink->pPduTail->pNext = pPdu;
+    else
+        pLink->pPduHead = pPdu;
+    pLink->pPduTail = pPdu;
+    return 0;
+}
+
+
+/**
+ * Resets the simulated stub, as if it was restarted.
+ *
+ * @returns nothing.
+ * @param   pStub                   The simulated stub.
+ * @param   tsNs                    Point in time of the reset.
+ */
+static void pspSimStubReset(PPSPSIMSTUB pStub, uint64_t tsNs)
+{
+    pStub->fConnected     = false;
+    pStub->cPdusSent      = 0;
+    pStub->cBeaconsSent   = 0;
+    pStub->tsNextBeaconNs = tsNs;
+    pStub->cbCm           = 0;
+}
+
+
+/**
+ * Returns the response ID for the given request ID.
+ *
+ * @returns Response ID or PSPSERIALPDURRNID_INVALID if the request is unknown.
+ * @param   enmReq                  The request ID.
+ */
+static PSPSERIALPDURRNID pspSimStubReqToResp(PSPSERIALPDURRNID enmReq)
+{
+    switch (enmReq)
+    {
+        case PSPSERIALPDURRNID_REQUEST_CONNECT:             return PSPSERIALPDURRNID_RESPONSE_CONNECT;
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ:        return PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE:       return PSPSERIALPDURRNID_RESPONSE_PSP_SMN_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ:        return PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE:       return PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_READ:       return PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE:      return PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ:    return PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE:   return PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_READ:   return PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE:  return PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER:       return PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER;
+        case PSPSERIALPDURRNID_REQUEST_COPROC_READ:         return PSPSERIALPDURRNID_RESPONSE_COPROC_READ;
+        case PSPSERIALPDURRNID_REQUEST_COPROC_WRITE:        return PSPSERIALPDURRNID_RESPONSE_COPROC_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_LOAD_CODE_MOD:       return PSPSERIALPDURRNID_RESPONSE_LOAD_CODE_MOD;
+        case PSPSERIALPDURRNID_REQUEST_EXEC_CODE_MOD:       return PSPSERIALPDURRNID_RESPONSE_EXEC_CODE_MOD;
+        case PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE:     return PSPSERIALPDURRNID_RESPONSE_INPUT_BUF_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_BRANCH_TO:           return PSPSERIALPDURRNID_RESPONSE_BRANCH_TO;
+        default:
+            break;
+    }
+
+    return PSPSERIALPDURRNID_INVALID;
+}
+
+
+/**
+ * Handles a data transfer request.
+ *
+ * @returns Status code for the response.
+ * @param   pStub                   The simulated stub.
+ * @param   idCcd                   The CCD ID.
+ * @param   pReq                    The request.
+ * @param   pbData                  The data following the request.
+ * @param   cbData                  Size of the data in bytes.
+ * @param   pbResp                  Where to store the read data.
+ * @param   pcbResp                 Where to store the amount of read data.
+ */
+static PSPSTS pspSimStubDataXfer(PPSPSIMSTUB pStub, uint32_t idCcd, const PSPSERIALDATAXFERREQ *pReq,
+                                 const uint8_t *pbData, size_t cbData, uint8_t *pbResp, size_t *pcbResp)
+{
+    bool fRead = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_READ) ? true : false;
+    bool fWrite = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_WRITE) ? true : false;
+    uint64_t uAddr;
+
+    if (   fRead == fWrite
+        || !pReq->cbStride
+        || pReq->cbStride > 8
+        || pReq->cbXfer % pReq->cbStride)
+        return STS_ERR_INVALID_PARAMETER;
+
+    switch (pReq->enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            uAddr = pReq->u.PspAddrStart;
+            break;
+        case PSPADDRSPACE_SMN:
+            uAddr = pReq->u.SmnAddrStart;
+            break;
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            uAddr = pReq->u.X86.PhysX86AddrStart;
+            break;
+        default:
+            return STS_ERR_INVALID_PARAMETER;
+    }
+
+    if (fWrite)
+    {
+        size_t cbNeeded = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET) ? pReq->cbStride : pReq->cbXfer;
+        if (cbData < cbNeeded)
+            return STS_ERR_INVALID_PARAMETER;
+    }
+
+    *pcbResp = 0;
+    for (uint32_t off = 0; off < pReq->cbXfer; off += pReq->cbStride)
+    {
+        int rc;
+        if (fWrite)
+        {
+            const uint8_t *pbSrc = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET) ? pbData : pbData + off;
+            rc = pspSimStubAddrSpaceAccess(pStub, idCcd, pReq->enmAddrSpace, uAddr, (void *)pbSrc,
+                                           pReq->cbStride, true /*fWrite*/);
+        }
+        else
+        {
+            rc = pspSimStubAddrSpaceAccess(pStub, idCcd, pReq->enmAddrSpace, uAddr, pbResp + off,
+                                           pReq->cbStride, false /*fWrite*/);
+            *pcbResp += pReq->cbStride;
+        }
+        if (rc)
+            return STS_ERR_INVALID_PARAMETER;
+
+        if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR)
+            uAddr += pReq->cbStride;
+    }
+
+    return STS_INF_SUCCESS;
+}
+
+
+/**
+ * Processes a complete and valid request PDU received by the stub.
+ *
+ * @returns Status code.
+ * @param   pStub                   The simulated stub.
+ * @param   pLink                   The link the request was received on.
+ * @param   tsNs                    Point in time the request arrived at the stub.
+ * @param   pHdr                    The request PDU header, followed by the payload.
+ */
+static int pspSimStubReqProcess(PPSPSIMSTUB pStub, PPSPSIMLINK pLink, uint64_t tsNs, PCPSPSERIALPDUHDR pHdr)
+{
+    PSPSERIALPDURRNID enmResp = pspSimStubReqToResp(pHdr->u.Fields.enmRrnId);
+    const uint8_t *pbReq = (const uint8_t *)(pHdr + 1);
+    size_t cbReq = pHdr->u.Fields.cbPdu;
+    uint32_t idCcd = pHdr->u.Fields.idCcd;
+    size_t cbRespMax = pStub->cbPduMax - sizeof(PSPSERIALPDUHDR) - sizeof(PSPSERIALPDUFOOTER);
+    uint8_t abResp[_4K];
+    size_t cbResp = 0;
+    PSPSTS rcReq = STS_INF_SUCCESS;
+
+    /* Unknown requests are dropped, everything except a connect request is ignored until a host connects. */
+    if (   enmResp == PSPSERIALPDURRNID_INVALID
+        || (   !pStub->fConnected
+            && pHdr->u.Fields.enmRrnId != PSPSERIALPDURRNID_REQUEST_CONNECT))
+        return 0;
+
+    cbRespMax = MIN(cbRespMax, sizeof(abResp));
+    if (idCcd >= pStub->cCcds)
+        return pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, STS_ERR_INVALID_PARAMETER, NULL, 0, NULL, 0);
+
+    switch (pHdr->u.Fields.enmRrnId)
+    {
+        case PSPSERIALPDURRNID_REQUEST_CONNECT:
+        {
+            PSPSERIALCONNECTRESP ConResp;
+
+            memset(&ConResp, 0, sizeof(ConResp));
+            ConResp.cbPduMax       = pStub->cbPduMax;
+            ConResp.PspAddrScratch = pStub->PspAddrScratch;
+            ConResp.cbScratch      = pStub->cbScratch;
+            ConResp.cSysSockets    = pStub->cSockets;
+            ConResp.cCcdsPerSocket = pStub->cCcdsPerSocket;
+
+            /* The PDU counter starts over with the connect response. */
+            pStub->fConnected = true;
+            pStub->cPdusSent  = 0;
+            return pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, STS_INF_SUCCESS,
+                                     &ConResp, sizeof(ConResp), NULL, 0);
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE:
+        {
+            const PSPSERIALSMNMEMXFERREQ *pReq = (const PSPSERIALSMNMEMXFERREQ *)pbReq;
+            bool fWrite = pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE;
+
+            if (   cbReq < sizeof(*pReq)
+                || pReq->cbXfer > cbRespMax
+                || (fWrite && cbReq - sizeof(*pReq) != pReq->cbXfer))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else if (fWrite)
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, PSPADDRSPACE_SMN, pReq->SmnAddrStart,
+                                                  (void *)(pReq + 1), pReq->cbXfer, true /*fWrite*/);
+            else
+            {
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, PSPADDRSPACE_SMN, pReq->SmnAddrStart,
+                                                  &abResp[0], pReq->cbXfer, false /*fWrite*/);
+                cbResp = pReq->cbXfer;
+            }
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE:
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE:
+        {
+            const PSPSERIALPSPMEMXFERREQ *pReq = (const PSPSERIALPSPMEMXFERREQ *)pbReq;
+            bool fWrite =    pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE
+                          || pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE;
+            PSPADDRSPACE enmAddrSpace =    pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ
+                                        || pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE
+                                      ? PSPADDRSPACE_PSP_MEM
+                                      : PSPADDRSPACE_PSP_MMIO;
+
+            if (   cbReq < sizeof(*pReq)
+                || pReq->cbXfer > cbRespMax
+                || (fWrite && cbReq - sizeof(*pReq) != pReq->cbXfer))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else if (fWrite)
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, enmAddrSpace, pReq->PspAddrStart,
+                                                  (void *)(pReq + 1), pReq->cbXfer, true /*fWrite*/);
+            else
+            {
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, enmAddrSpace, pReq->PspAddrStart,
+                                                  &abResp[0], pReq->cbXfer, false /*fWrite*/);
+                cbResp = pReq->cbXfer;
+            }
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE:
+        {
+            const PSPSERIALX86MEMXFERREQ *pReq = (const PSPSERIALX86MEMXFERREQ *)pbReq;
+            bool fWrite =    pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE
+                          || pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE;
+            PSPADDRSPACE enmAddrSpace =    pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ
+                                        || pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE
+                                      ? PSPADDRSPACE_X86_MEM
+                                      : PSPADDRSPACE_X86_MMIO;
+
+            if (   cbReq < sizeof(*pReq)
+                || pReq->cbXfer > cbRespMax
+                || (fWrite && cbReq - sizeof(*pReq) != pReq->cbXfer))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else if (fWrite)
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, enmAddrSpace, pReq->PhysX86Start,
+                                                  (void *)(pReq + 1), pReq->cbXfer, true /*fWrite*/);
+            else
+            {
+                rcReq = pspSimStubAddrSpaceAccess(pStub, idCcd, enmAddrSpace, pReq->PhysX86Start,
+                                                  &abResp[0], pReq->cbXfer, false /*fWrite*/);
+                cbResp = pReq->cbXfer;
+            }
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER:
+        {
+            const PSPSERIALDATAXFERREQ *pReq = (const PSPSERIALDATAXFERREQ *)pbReq;
+
+            if (   cbReq < sizeof(*pReq)
+                || pReq->cbXfer > cbRespMax)
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else
+                rcReq = pspSimStubDataXfer(pStub, idCcd, pReq, (const uint8_t *)(pReq + 1), cbReq - sizeof(*pReq),
+                                           &abResp[0], &cbResp);
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_COPROC_READ:
+        case PSPSERIALPDURRNID_REQUEST_COPROC_WRITE:
+        {
+            const PSPSERIALCOPROCRWREQ *pReq = (const PSPSERIALCOPROCRWREQ *)pbReq;
+            bool fWrite = pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_COPROC_WRITE;
+
+            if (   cbReq != sizeof(*pReq) + (fWrite ? sizeof(uint32_t) : 0))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else
+            {
+                /* The register is identified by the coprocessor and the encoding, stored 4 bytes apart. */
+                uint64_t uAddr = (  ((uint64_t)pReq->u8CoProc << 32)
+                                  | ((uint64_t)pReq->u8Crn    << 24)
+                                  | ((uint64_t)pReq->u8Crm    << 16)
+                                  | ((uint64_t)pReq->u8Opc1   << 8)
+                                  |  (uint64_t)pReq->u8Opc2) << 2;
+                if (fWrite)
+                    rcReq = pspSimStubRegAccess(pStub, PSPSIMREGSPACE_COPROC, idCcd, uAddr,
+                                                (void *)(pReq + 1), sizeof(uint32_t), true /*fWrite*/);
+                else
+                {
+                    rcReq = pspSimStubRegAccess(pStub, PSPSIMREGSPACE_COPROC, idCcd, uAddr,
+                                                &abResp[0], sizeof(uint32_t), false /*fWrite*/);
+                    cbResp = sizeof(uint32_t);
+                }
+            }
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_LOAD_CODE_MOD:
+        {
+            const PSPSERIALLOADCODEMODREQ *pReq = (const PSPSERIALLOADCODEMODREQ *)pbReq;
+
+            if (   cbReq != sizeof(*pReq)
+                || pReq->enmCmType != PSPSERIALCMTYPE_FLAT_BINARY)
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else
+                pStub->cbCm = 0;
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE:
+        {
+            if (cbReq < sizeof(PSPSERIALINBUFWRREQ))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else
+                pStub->cbCm += cbReq - sizeof(PSPSERIALINBUFWRREQ);
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_EXEC_CODE_MOD:
+        {
+            const PSPSERIALEXECCODEMODREQ *pReq = (const PSPSERIALEXECCODEMODREQ *)pbReq;
+
+            if (cbReq != sizeof(*pReq))
+                return pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, STS_ERR_INVALID_PARAMETER, NULL, 0, NULL, 0);
+
+            int rc = pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, STS_INF_SUCCESS, NULL, 0, NULL, 0);
+            if (!rc)
+            {
+                /* The module announces itself, echoes the arguments to the output buffer and returns its size. */
+                char szLog[128];
+                int cchLog = snprintf(&szLog[0], sizeof(szLog), "sim: executing code module (%zu bytes)\n", pStub->cbCm);
+                rc = pspSimStubPduSend(pStub, pLink, tsNs, idCcd, PSPSERIALPDURRNID_NOTIFICATION_LOG_MSG,
+                                       STS_INF_SUCCESS, &szLog[0], cchLog, NULL, 0);
+                if (!rc)
+                {
+                    PSPSERIALOUTBUFNOT OutBufNot;
+
+                    memset(&OutBufNot, 0, sizeof(OutBufNot));
+                    OutBufNot.idOutBuf = 0;
+                    rc = pspSimStubPduSend(pStub, pLink, tsNs, idCcd, PSPSERIALPDURRNID_NOTIFICATION_OUT_BUF,
+                                           STS_INF_SUCCESS, &OutBufNot, sizeof(OutBufNot), pReq, sizeof(*pReq));
+                }
+                if (!rc)
+                {
+                    PSPSERIALEXECCMFINISHEDNOT ExecNot;
+
+                    memset(&ExecNot, 0, sizeof(ExecNot));
+                    ExecNot.u32CmRet = (uint32_t)pStub->cbCm;
+                    rc = pspSimStubPduSend(pStub, pLink, tsNs, idCcd, PSPSERIALPDURRNID_NOTIFICATION_CODE_MOD_EXEC_FINISHED,
+                                           STS_INF_SUCCESS, &ExecNot, sizeof(ExecNot), NULL, 0);
+                }
+            }
+            return rc;
+        }
+        case PSPSERIALPDURRNID_REQUEST_BRANCH_TO:
+        {
+            if (cbReq != sizeof(PSPSERIALBRANCHTOREQ))
+                rcReq = STS_ERR_INVALID_PARAMETER;
+            else
+            {
+                /* Branching away from the stub is modelled as the target resetting right after the response. */
+                int rc = pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, STS_INF_SUCCESS, NULL, 0, NULL, 0);
+                pspSimStubReset(pStub, tsNs + PSP_SIM_BEACON_INTERVAL_MS * 1000000ULL);
+                return rc;
+            }
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    if (rcReq != STS_INF_SUCCESS)
+        cbResp = 0;
+    return pspSimStubPduSend(pStub, pLink, tsNs, idCcd, enmResp, rcReq, &abResp[0], cbResp, NULL, 0);
+}
+
+
+/**
+ * Parses the data written by the host so far and processes all complete request PDUs.
+ *
+ * @returns Status code.
+ * @param   pLink                   The link.
+ * @param   tsNs                    Point in time the data arrived at the stub.
+ */
+static int pspSimLinkTxProcess(PPSPSIMLINK pLink, uint64_t tsNs)
+{
+    PPSPSIMSTUB pStub = pLink->pStub;
+    int rc = 0;
+
+    while (   !rc
+           && pLink->cbTx >= sizeof(uint32_t))
+    {
+        PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)pLink->pbTx;
+        size_t cbDrop = 0;
+
+        if (pHdr->u32Magic != PSP_SERIAL_EXT_2_PSP_PDU_START_MAGIC)
+            cbDrop = 1; /* Resync. */
+        else if (pLink->cbTx < sizeof(*pHdr))
+            break;
+        else if (pHdr->u.Fields.cbPdu > pStub->cbPduMax - sizeof(PSPSERIALPDUHDR) - sizeof(PSPSERIALPDUFOOTER))
+            cbDrop = 1;
+        else
+        {
+            size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~(size_t)7) - pHdr->u.Fields.cbPdu;
+            size_t cbPdu = sizeof(*pHdr) + pHdr->u.Fields.cbPdu + cbPad + sizeof(PSPSERIALPDUFOOTER);
+            if (pLink->cbTx < cbPdu)
+                break;
+
+            /* The padding is included in the checksum, it must be all 0. */
+            uint32_t uChkSum = 0;
+            for (uint32_t i = 0; i < sizeof(pHdr->u.ab); i++)
+                uChkSum += pHdr->u.ab[i];
+            const uint8_t *pbPayload = (const uint8_t *)(pHdr + 1);
+            for (size_t i = 0; i < pHdr->u.Fields.cbPdu + cbPad; i++)
+                uChkSum += pbPayload[i];
+
+            PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)(pbPayload + pHdr->u.Fields.cbPdu + cbPad);
+            if (   uChkSum + pFooter->u32ChkSum == 0
+                && pFooter->u32Magic == PSP_SERIAL_EXT_2_PSP_PDU_END_MAGIC)
+            {
+                uint64_t tsReqNs = tsNs;
+
+                /*
+                 * A stub shared by multiple links processes the requests in order, so a request can't
+                 * be answered before all preceding ones arrived over the other links.
+                 */
+                if (pStub->idShared)
+                {
+                    tsReqNs = MAX(tsReqNs, pStub->tsReqLastNs);
+                    pStub->tsReqLastNs = tsReqNs;
+                }
+
+                rc = pspSimStubReqProcess(pStub, pLink, tsReqNs, pHdr);
+                cbDrop = cbPdu;
+            }
+            else
+                cbDrop = 1;
+        }
+
+        memmove(pLink->pbTx, pLink->pbTx + cbDrop, pLink->cbTx - cbDrop);
+        pLink->cbTx -= cbDrop;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Lets the stub send anything which became due until now without host interaction (beacons).
+ *
+ * @returns Status code.
+ * @param   pLink                   The link.
+ * @param   tsNs                    The current point in time.
+ */
+static int pspSimLinkPump(PPSPSIMLINK pLink, uint64_t tsNs)
+{
+    PPSPSIMSTUB pStub = pLink->pStub;
+    int rc = 0;
+
+    while (   !rc
+           && !pStub->fConnected
+           && pStub->tsNextBeaconNs <= tsNs)
+    {
+        PSPSERIALBEACONNOT Beacon;
+
+        memset(&Beacon, 0, sizeof(Beacon));
+        Beacon.cBeaconsSent = ++pStub->cBeaconsSent;
+        rc = pspSimStubPduSend(pStub, pLink, pStub->tsNextBeaconNs, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_BEACON,
+                               STS_INF_SUCCESS, &Beacon, sizeof(Beacon), NULL, 0);
+        pStub->tsNextBeaconNs += PSP_SIM_BEACON_INTERVAL_MS * 1000000ULL;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Returns the number of bytes the host can read at the given point in time.
+ *
+ * @returns Number of bytes available.
+ * @param   pLink                   The link.
+ * @param   tsNs                    The current point in time.
+ */
+static size_t pspSimLinkRxAvail(PPSPSIMLINK pLink, uint64_t tsNs)
+{
+    size_t cbAvail = 0;
+    PPSPSIMPDU pPdu = pLink->pPduHead;
+
+    while (   pPdu
+           && pPdu->tsReadyNs <= tsNs)
+    {
+        cbAvail += pPdu->cbPdu - pPdu->offRead;
+        pPdu = pPdu->pNext;
+    }
+
+    return cbAvail;
+}
+
+
+/**
+ * Parses a size or count option value.
+ *
+ * @returns Status code.
+ * @param   pszVal                  The value string.
+ * @param   pu64Val                 Where to store the value.
+ */
+static int pspSimCfgParseU64(const char *pszVal, uint64_t *pu64Val)
+{
+    char *pszEnd = NULL;
+
+    errno = 0;
+    unsigned long long u64 = strtoull(pszVal, &pszEnd, 0);
+    if (   errno
+        || pszEnd == pszVal
+        || *pszEnd != '\0')
+        return -1;
+
+    *pu64Val = u64;
+    return 0;
+}
+
+
+/**
+ * Parses the device configuration of the form "opt=val,opt=val,...".
+ *
+ * @returns Status code.
+ * @param   pCfg                    Where to store the configuration.
+ * @param   pszDevice               The device configuration string.
+ */
+static int pspSimCfgParse(PPSPSIMCFG pCfg, const char *pszDevice)
+{
+    char szDev[256];
+    char *pszOpt = &szDev[0];
+
+    pCfg->cSockets       = PSP_SIM_SOCKETS_DEF;
+    pCfg->cCcdsPerSocket = PSP_SIM_CCDS_PER_SOCKET_DEF;
+    pCfg->cUsLatency     = 0;
+    pCfg->cbPerSec       = 0;
+    pCfg->cbPduMax       = PSP_SIM_PDU_MAX_DEF;
+    pCfg->cbSram         = PSP_SIM_SRAM_SZ_DEF;
+    pCfg->cbX86Mem       = PSP_SIM_X86_MEM_SZ_DEF;
+    pCfg->idStub         = 0;
+
+    if (strlen(pszDevice) >= sizeof(szDev))
+        return -1;
+    strcpy(&szDev[0], pszDevice);
+
+    while (*pszOpt)
+    {
+        char *pszNext = strchr(pszOpt, ',');
+        if (pszNext)
+            *pszNext++ = '\0';
+        else
+            pszNext = pszOpt + strlen(pszOpt);
+
+        char *pszVal = strchr(pszOpt, '=');
+        uint64_t u64Val = 0;
+        if (   !pszVal
+            || pspSimCfgParseU64(pszVal + 1, &u64Val))
+            return -1;
+        *pszVal = '\0';
+
+        if (!strcmp(pszOpt, "sockets"))
+            pCfg->cSockets = (uint32_t)u64Val;
+        else if (!strcmp(pszOpt, "ccds"))
+            pCfg->cCcdsPerSocket = (uint32_t)u64Val;
+        else if (!strcmp(pszOpt, "latency"))
+            pCfg->cUsLatency = u64Val;
+        else if (!strcmp(pszOpt, "bandwidth"))
+            pCfg->cbPerSec = u64Val;
+        else if (!strcmp(pszOpt, "pdu-max"))
+            pCfg->cbPduMax = (uint32_t)u64Val;
+        else if (!strcmp(pszOpt, "sram"))
+            pCfg->cbSram = (uint32_t)u64Val;
+        else if (!strcmp(pszOpt, "x86"))
+            pCfg->cbX86Mem = (size_t)u64Val;
+        else if (!strcmp(pszOpt, "stub"))
+            pCfg->idStub = u64Val;
+        else
+            return -1;
+
+        pszOpt = pszNext;
+    }
+
+    /* The CCD ID is part of the register file key. */
+    if (   !pCfg->cSockets
+        || !pCfg->cCcdsPerSocket
+        || pCfg->cSockets * pCfg->cCcdsPerSocket > 256
+        || pCfg->cbPduMax < PSP_SIM_PDU_MAX_MIN
+        || pCfg->cbPduMax > _4K
+        || pCfg->cbSram <= PSP_SIM_SCRATCH_SZ)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * Creates a new simulated stub.
+ *
+ * @returns Status code.
+ * @param   ppStub                  Where to store the stub on success.
+ * @param   pCfg                    The configuration to use.
+ */
+static int pspSimStubCreate(PPSPSIMSTUB *ppStub, PPSPSIMCFG pCfg)
+{
+    if (pCfg->idStub)
+    {
+        /* Attach to an existing shared stub, the configuration of the first link wins. */
+        pthread_mutex_lock(&g_SimStubsSharedMtx);
+        for (PPSPSIMSTUB pStub = g_pSimStubsShared; pStub; pStub = pStub->pNext)
+            if (pStub->idShared == pCfg->idStub)
+            {
+                pStub->cRefs++;
+                pthread_mutex_unlock(&g_SimStubsSharedMtx);
+                *ppStub = pStub;
+                return 0;
+            }
+        /* Keep the lock so no one else creates a stub with the same ID in the meantime. */
+    }
+
+    PPSPSIMSTUB pStub = (PPSPSIMSTUB)calloc(1, sizeof(*pStub));
+    if (!pStub)
+    {
+        if (pCfg->idStub)
+            pthread_mutex_unlock(&g_SimStubsSharedMtx);
+        return -1;
+    }
+
+    pStub->cSockets       = pCfg->cSockets;
+    pStub->cCcdsPerSocket = pCfg->cCcdsPerSocket;
+    pStub->cCcds          = pCfg->cSockets * pCfg->cCcdsPerSocket;
+    pStub->cbPduMax       = pCfg->cbPduMax;
+    pStub->cbSram         = pCfg->cbSram;
+    pStub->cbScratch      = PSP_SIM_SCRATCH_SZ;
+    pStub->PspAddrScratch = pCfg->cbSram - PSP_SIM_SCRATCH_SZ;
+    pStub->cbX86Mem       = pCfg->cbX86Mem;
+    pStub->cRegsMax       = PSP_SIM_REGS_DEF;
+    pStub->cRegs          = 0;
+    pStub->idShared       = pCfg->idStub;
+    pStub->cRefs          = 1;
+    pStub->tsReqLastNs    = 0;
+    pStub->tsStartNs      = pspSimTimeNs();
+    pStub->pbSram         = (uint8_t *)calloc(pStub->cCcds, pStub->cbSram);
+    pStub->pbX86Mem       = (uint8_t *)calloc(1, pStub->cbX86Mem ? pStub->cbX86Mem : 1);
+    pStub->paRegs         = (PPSPSIMREG)calloc(pStub->cRegsMax, sizeof(*pStub->paRegs));
+    if (   pStub->pbSram
+        && pStub->pbX86Mem
+        && pStub->paRegs)
+    {
+        pspSimStubReset(pStub, pStub->tsStartNs);
+        if (pStub->idShared)
+        {
+            pStub->pNext      = g_pSimStubsShared;
+            g_pSimStubsShared = pStub;
+            pthread_mutex_unlock(&g_SimStubsSharedMtx);
+        }
+        *ppStub = pStub;
+        return 0;
+    }
+
+    if (pCfg->idStub)
+        pthread_mutex_unlock(&g_SimStubsSharedMtx);
+    free(pStub->pbSram);
+    free(pStub->pbX86Mem);
+    free(pStub->paRegs);
+    free(pStub);
+    return -1;
+}
+
+
+/**
+ * Releases a reference to the given simulated stub, destroying it when the last link goes away.
+ *
+ * @returns nothing.
+ * @param   pStub                   The stub to release.
+ */
+static void pspSimStubDestroy(PPSPSIMSTUB pStub)
+{
+    if (pStub->idShared)
+    {
+        pthread_mutex_lock(&g_SimStubsSharedMtx);
+        if (--pStub->cRefs)
+        {
+            pthread_mutex_unlock(&g_SimStubsSharedMtx);
+            return;
+        }
+
+        PPSPSIMSTUB *ppStub = &g_pSimStubsShared;
+        while (*ppStub != pStub)
+            ppStub = &(*ppStub)->pNext;
+        *ppStub = pStub->pNext;
+        pthread_mutex_unlock(&g_SimStubsSharedMtx);
+    }
+    else if (--pStub->cRefs)
+        return;
+
+    free(pStub->pbSram);
+    free(pStub->pbX86Mem);
+    free(pStub->paRegs);
+    free(pStub);
+}
+
+
+/**
+ * Initializes a link to the given stub.
+ *
+ * @returns Status code.
+ * @param   pLink                   The link to initialize.
+ * @param   pStub                   The stub to attach to.
+ * @param   pCfg                    The configuration to use.
+ */
+static int pspSimLinkInit(PPSPSIMLINK pLink, PPSPSIMSTUB pStub, PPSPSIMCFG pCfg)
+{
+    pLink->pStub      = pStub;
+    pLink->cNsLatency = pCfg->cUsLatency * 1000;
+    pLink->cbPerSec   = pCfg->cbPerSec;
+    pLink->tsTxIdleNs = 0;
+    pLink->tsRxIdleNs = 0;
+    pLink->cbTxMax    = 2 * pStub->cbPduMax;
+    pLink->cbTx       = 0;
+    pLink->pPduHead   = NULL;
+    pLink->pPduTail   = NULL;
+    pLink->pbTx       = (uint8_t *)malloc(pLink->cbTxMax);
+    if (!pLink->pbTx)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * Frees all resources of the given link.
+ *
+ * @returns nothing.
+ * @param   pLink                   The link.
+ */
+static void pspSimLinkTerm(PPSPSIMLINK pLink)
+{
+    PPSPSIMPDU pPdu = pLink->pPduHead;
+    while (pPdu)
+    {
+        PPSPSIMPDU pNext = pPdu->pNext;
+        free(pPdu);
+        pPdu = pNext;
+    }
+
+    free(pLink->pbTx);
+    pLink->pbTx     = NULL;
+    pLink->pPduHead = NULL;
+    pLink->pPduTail = NULL;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int simProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PSPSIMCFG Cfg;
+
+    int rc = pspSimCfgParse(&Cfg, pszDevice);
+    if (!rc)
+    {
+        rc = pspSimStubCreate(&pThis->pStub, &Cfg);
+        if (!rc)
+        {
+            rc = pspSimLinkInit(&pThis->Link, pThis->pStub, &Cfg);
+            if (!rc)
+            {
+                pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (pThis->iFdEvtIntr > -1)
+                    return 0;
+
+                rc = -1;
+                pspSimLinkTerm(&pThis->Link);
+            }
+
+            pspSimStubDestroy(pThis->pStub);
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void simProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pspSimLinkTerm(&pThis->Link);
+    pspSimStubDestroy(pThis->pStub);
+    close(pThis->iFdEvtIntr);
+    pThis->pStub      = NULL;
+    pThis->iFdEvtIntr = -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t simProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t tsNs = pspSimTimeNs();
+
+    pspSimLinkPump(&pThis->Link, tsNs);
+    return pspSimLinkRxAvail(&pThis->Link, tsNs);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int simProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSIMLINK pLink = &pThis->Link;
+    uint64_t tsNs = pspSimTimeNs();
+    uint8_t *pbDst = (uint8_t *)pvDst;
+    size_t cbReadTotal = 0;
+
+    pspSimLinkPump(pLink, tsNs);
+    while (   cbRead
+           && pLink->pPduHead
+           && pLink->pPduHead->tsReadyNs <= tsNs)
+    {
+        PPSPSIMPDU pPdu = pLink->pPduHead;
+        size_t cbThisRead = MIN(cbRead, pPdu->cbPdu - pPdu->offRead);
+
+        memcpy(pbDst, &pPdu->abPdu[pPdu->offRead], cbThisRead);
+        pbDst          += cbThisRead;
+        cbRead         -= cbThisRead;
+        cbReadTotal    += cbThisRead;
+        pPdu->offRead  += cbThisRead;
+
+        if (pPdu->offRead == pPdu->cbPdu)
+        {
+            pLink->pPduHead = pPdu->pNext;
+            if (!pLink->pPduHead)
+                pLink->pPduTail = NULL;
+            free(pPdu);
+        }
+    }
+
+    *pcbRead = cbReadTotal;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int simProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSIMLINK pLink = &pThis->Link;
+    const uint8_t *pbPkt = (const uint8_t *)pvPkt;
+    uint64_t tsNs = pspSimTimeNs();
+    int rc = 0;
+
+    /* The data arrives at the stub after it was serialized onto the link and travelled across. */
+    uint64_t tsStartNs = MAX(tsNs, pLink->tsTxIdleNs);
+    pLink->tsTxIdleNs = tsStartNs + pspSimLinkXferTimeNs(pLink, cbPkt);
+
+    while (   !rc
+           && cbPkt)
+    {
+        size_t cbThisWrite = MIN(cbPkt, pLink->cbTxMax - pLink->cbTx);
+
+        memcpy(pLink->pbTx + pLink->cbTx, pbPkt, cbThisWrite);
+        pLink->cbTx += cbThisWrite;
+        pbPkt       += cbThisWrite;
+        cbPkt       -= cbThisWrite;
+
+        rc = pspSimLinkTxProcess(pLink, pLink->tsTxIdleNs + pLink->cNsLatency);
+    }
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int simProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PPSPSIMLINK pLink = &pThis->Link;
+    uint64_t tsNs = pspSimTimeNs();
+    uint64_t tsDeadlineNs = tsNs + (uint64_t)cMillies * 1000000ULL;
+
+    for (;;)
+    {
+        int rc = pspSimLinkPump(pLink, tsNs);
+        if (rc)
+            return rc;
+
+        if (pspSimLinkRxAvail(pLink, tsNs))
+            return 0;
+        if (tsNs >= tsDeadlineNs)
+            return STS_ERR_PSP_PROXY_TIMEOUT;
+
+        /* Sleep until the next PDU or beacon is due or the timeout elapsed. */
+        uint64_t tsWakeupNs = tsDeadlineNs;
+        if (pLink->pPduHead)
+            tsWakeupNs = MIN(tsWakeupNs, pLink->pPduHead->tsReadyNs);
+        if (!pLink->pStub->fConnected)
+            tsWakeupNs = MIN(tsWakeupNs, pLink->pStub->tsNextBeaconNs);
+
+        rc = pspSimSleepUntil(pThis, tsWakeupNs);
+        if (rc)
+            return rc;
+        tsNs = pspSimTimeNs();
+    }
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int simProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * Provider registration structure.
+ */
+const PSPPROXYPROV g_PspProxyProvSim =
+{
+    /** pszId */
+    "sim",
+    /** pszDesc */
+    "In process simulation of the PSP serial stub, device schema looks like sim://[sockets=<n>,ccds=<n per socket>,"
+    "latency=<one way latency in us>,bandwidth=<bytes per second>,pdu-max=<bytes>,sram=<bytes>,x86=<bytes>,"
+    "stub=<id shared between links>]",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    PSPPROXY_CAPS_F_SIMULATED,
+    /** pfnCtxInit */
+    simProvCtxInit,
+    /** pfnCtxDestroy */
+    simProvCtxDestroy,
+    /** pfnCtxPeek */
+    simProvCtxPeek,
+    /** pfnCtxRead */
+    simProvCtxRead,
+    /** pfnCtxWrite */
+    simProvCtxWrite,
+    /** pfnCtxPoll */
+    simProvCtxPoll,
+    /** pfnCtxInterrupt */
+    simProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    NULL,
+    /** pfnCtxWriteV */
+    NULL,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    NULL
+};
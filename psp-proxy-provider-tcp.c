@@ -33,11 +33,16 @@
 #include <netdb.h>
 
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 
 #include "psp-proxy-provider.h"
 
 
+/** Size of the userspace receive buffer. */
+#define PSP_TCP_RX_BUF_SZ               (64 * 1024)
+
+
 /**
  * Internal PSP proxy provider context.
  */
@@ -45,11 +50,50 @@ typedef struct PSPPROXYPROVCTXINT
 {
     /** The socket descriptor for the connection. */
     int                             iFdCon;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+    /** Offset of the first unconsumed byte in the receive buffer. */
+    size_t                          offRx;
+    /** Number of valid bytes in the receive buffer. */
+    size_t                          cbRx;
+    /** The receive buffer, peek and read are served from it. */
+    uint8_t                         abRx[PSP_TCP_RX_BUF_SZ];
 } PSPPROXYPROVCTXINT;
 /** Pointer to an internal PSP proxy context. */
 typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
 
 
+/**
+ * Fills the receive buffer with whatever the socket has available without blocking.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ *
+ * @note Must only be called when the receive buffer is empty.
+ */
+static int tcpProvCtxRxFill(PPSPPROXYPROVCTXINT pThis)
+{
+    ssize_t cbRet = recv(pThis->iFdCon, &pThis->abRx[0], sizeof(pThis->abRx), MSG_DONTWAIT);
+    pThis->cSyscalls++;
+    if (cbRet > 0)
+    {
+        pThis->offRx = 0;
+        pThis->cbRx  = cbRet;
+        return 0;
+    }
+
+    if (!cbRet)
+        return -1;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+
+    return -1;
+}
+
+
 /**
  * @copydoc{PSPPROXYPROV,pfnCtxInit}
  */
@@ -87,9 +131,15 @@ static int tcpProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
                     {
                         int rcPsx = connect(pThis->iFdCon,(struct sockaddr *)&SrvAddr,sizeof(SrvAddr));
                         if (!rcPsx)
-                            return 0;
-                        else
-                            rc = -1;
+                        {
+                            pThis->offRx      = 0;
+                            pThis->cbRx       = 0;
+                            pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                            if (pThis->iFdEvtIntr > -1)
+                                return 0;
+                        }
+
+                        rc = -1;
                     }
                     else
                         rc = -1;
@@ -121,7 +171,9 @@ static void tcpProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
 
     shutdown(pThis->iFdCon, SHUT_RDWR);
     close(pThis->iFdCon);
-    pThis->iFdCon = 0;
+    close(pThis->iFdEvtIntr);
+    pThis->iFdCon     = 0;
+    pThis->iFdEvtIntr = -1;
 }
 
 
@@ -132,12 +184,12 @@ static size_t tcpProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    int cbAvail = 0;
-    int rc = ioctl(pThis->iFdCon, FIONREAD, &cbAvail);
-    if (rc)
+    /* Reading right away instead of asking for the amount available saves a syscall on the following read. */
+    if (   pThis->offRx == pThis->cbRx
+        && tcpProvCtxRxFill(pThis))
         return 0;
 
-    return cbAvail;
+    return pThis->cbRx - pThis->offRx;
 }
 
 
@@ -148,20 +200,19 @@ static int tcpProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead,
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
-    ssize_t cbRet = recv(pThis->iFdCon, pvDst, cbRead, MSG_DONTWAIT);
-    if (cbRet > 0)
+    *pcbRead = 0;
+    if (pThis->offRx == pThis->cbRx)
     {
-        *pcbRead = cbRead;
-        return 0;
+        int rc = tcpProvCtxRxFill(pThis);
+        if (rc)
+            return rc;
     }
 
-    if (!cbRet)
-        return -1;
-
-    if (errno == EAGAIN || errno == EWOULDBLOCK)
-        return 0;
-
-    return -1;
+    size_t cbThisRead = MIN(cbRead, pThis->cbRx - pThis->offRx);
+    memcpy(pvDst, &pThis->abRx[pThis->offRx], cbThisRead);
+    pThis->offRx += cbThisRead;
+    *pcbRead      = cbThisRead;
+    return 0;
 }
 
 
@@ -173,6 +224,7 @@ static int tcpProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t c
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
 
     ssize_t cbRet = send(pThis->iFdCon, pvPkt, cbPkt, 0);
+    pThis->cSyscalls++;
     if (cbRet == cbPkt)
         return 0;
 
@@ -186,18 +238,34 @@ static int tcpProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t c
 static int tcpProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
 {
     PPSPPROXYPROVCTXINT pThis = hProvCtx;
-    struct pollfd PollFd;
+    struct pollfd aPollFds[2];
+
+    /* Data still buffered is available right away. */
+    if (pThis->offRx < pThis->cbRx)
+        return 0;
 
-    PollFd.fd      = pThis->iFdCon;
-    PollFd.events  = POLLIN | POLLHUP | POLLERR;
-    PollFd.revents = 0;
+    aPollFds[0].fd      = pThis->iFdCon;
+    aPollFds[0].events  = POLLIN | POLLHUP | POLLERR;
+    aPollFds[0].revents = 0;
+    aPollFds[1].fd      = pThis->iFdEvtIntr;
+    aPollFds[1].events  = POLLIN;
+    aPollFds[1].revents = 0;
 
     int rc = 0;
-    int rcPsx = poll(&PollFd, 1, cMillies);
+    int rcPsx = poll(&aPollFds[0], ELEMENTS(aPollFds), cMillies);
+    pThis->cSyscalls++;
     if (rcPsx == 0)
         rc = STS_ERR_PSP_PROXY_TIMEOUT;
     else if (rcPsx == -1)
         rc = -1; /** @todo Better status codes for the individual errors. */
+    else if (aPollFds[1].revents)
+    {
+        /* Consume the interrupt. */
+        uint64_t uCnt = 0;
+        ssize_t cbRead = read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+        pThis->cSyscalls++;
+        rc = cbRead == sizeof(uCnt) || errno == EAGAIN ? STS_ERR_PSP_PROXY_INTERRUPTED : -1;
+    }
 
     return rc;
 }
@@ -208,7 +276,90 @@ static int tcpProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
  */
 static int tcpProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
 {
-    return -1; /** @todo */
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    /* Saturating the counter is fine, the poll is interrupted anyway. */
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int tcpProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct iovec aIov[8];
+    struct msghdr Msg;
+
+    if (cIov > ELEMENTS(aIov))
+        return -1;
+
+    /* Local copy as partial sends require adjusting the buffers. */
+    memcpy(&aIov[0], paIov, cIov * sizeof(*paIov));
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov    = &aIov[0];
+    Msg.msg_iovlen = cIov;
+
+    /* Sending all fragments of a PDU with a single call results in a single segment for small PDUs. */
+    while (Msg.msg_iovlen)
+    {
+        ssize_t cbRet = sendmsg(pThis->iFdCon, &Msg, MSG_NOSIGNAL);
+        pThis->cSyscalls++;
+        if (cbRet == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        size_t cbLeft = cbRet;
+        while (   Msg.msg_iovlen
+               && cbLeft >= Msg.msg_iov->iov_len)
+        {
+            cbLeft -= Msg.msg_iov->iov_len;
+            Msg.msg_iov++;
+            Msg.msg_iovlen--;
+        }
+
+        if (cbLeft)
+        {
+            Msg.msg_iov->iov_base = (uint8_t *)Msg.msg_iov->iov_base + cbLeft;
+            Msg.msg_iov->iov_len -= cbLeft;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int tcpProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pStats->cSyscalls = pThis->cSyscalls;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryFd}
+ */
+static int tcpProvCtxQueryFd(PSPPROXYPROVCTX hProvCtx, int *piFd)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Data already buffered would get lost when somebody else reads from the socket. */
+    if (pThis->offRx < pThis->cbRx)
+        return -1;
+
+    *piFd = pThis->iFdCon;
+    return 0;
 }
 
 
@@ -258,6 +409,38 @@ const PSPPROXYPROV g_PspProxyProvTcp =
     /** pfnCtxEmuWaitForWork */
     NULL,
     /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    tcpProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    tcpProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    tcpProvCtxQueryFd,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
     NULL
 };
 
@@ -0,0 +1,1069 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - transport recording and replay
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Trace file format (all values in host byte order):
+ *
+ *     PSPTRACEHDR
+ *     { u8Type, cbData (LEB128), cNsDelta (LEB128), abData[cbData] } ...
+ *
+ * cNsDelta is the time in nanoseconds since the previous record (or the start of the recording
+ * for the first one). Only the bytes exchanged through pfnCtxRead/pfnCtxWrite are recorded,
+ * the optional x86 side channel callbacks are forwarded to the recorded provider unrecorded.
+ *
+ * A clock sync record is written at the start and the end of the recording, pairing the monotonic
+ * clock the PDU layer stamps the tsMillies header field with against the wall clock. This allows
+ * correlating the PDU timestamps in the trace with external logs and seeing the drift between both.
+ * Replay ignores record types it doesn't know.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <common/cdefs.h>
+#include <common/types.h>
+#include <common/status.h>
+
+#include "psp-proxy-provider.h"
+
+
+/** Trace file magic. */
+#define PSP_TRACE_MAGIC                 "PSPTRACE"
+/** Current trace file version. */
+#define PSP_TRACE_VERSION               1
+/** Buffer size used for the trace file stream. */
+#define PSP_TRACE_STREAM_BUF_SZ         (64 * 1024)
+
+
+/**
+ * Trace file header.
+ */
+typedef struct PSPTRACEHDR
+{
+    /** Magic identifying the file (PSP_TRACE_MAGIC without terminator). */
+    char                            achMagic[8];
+    /** Format version. */
+    uint32_t                        u32Version;
+    /** Reserved, 0. */
+    uint32_t                        u32Rsvd0;
+    /** Start of the recording, wall clock time in nanoseconds since the epoch. */
+    uint64_t                        tsStartNs;
+} PSPTRACEHDR;
+
+
+/**
+ * Trace record types.
+ */
+typedef enum PSPTRACERECTYPE
+{
+    /** Invalid record type. */
+    PSPTRACERECTYPE_INVALID = 0,
+    /** Data written to the target. */
+    PSPTRACERECTYPE_WRITE,
+    /** Data read from the target. */
+    PSPTRACERECTYPE_READ,
+    /** Clock sync, PSPTRACECLOCKSYNC as data. */
+    PSPTRACERECTYPE_CLOCK_SYNC,
+    /** 32bit hack. */
+    PSPTRACERECTYPE_32BIT_HACK = 0x7fffffff
+} PSPTRACERECTYPE;
+
+
+/**
+ * Clock sync record payload.
+ */
+typedef struct PSPTRACECLOCKSYNC
+{
+    /** Monotonic clock in nanoseconds. */
+    uint64_t                        tsMonotonicNs;
+    /** Wall clock time in nanoseconds since the epoch. */
+    uint64_t                        tsRealtimeNs;
+} PSPTRACECLOCKSYNC;
+
+
+/**
+ * Internal PSP proxy provider context, shared by the record and replay providers.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** The trace file. */
+    FILE                            *pFile;
+    /** Point in time of the last recorded record (monotonic clock in nanoseconds). */
+    uint64_t                        tsLastNs;
+    /** Record: The provider being recorded. */
+    PCPSPPROXYPROV                  pProvInner;
+    /** Record: The context of the provider being recorded. */
+    PSPPROXYPROVCTX                 hProvCtxInner;
+    /** Replay: Flag whether to replay as fast as possible instead of with the original timing. */
+    bool                            fFast;
+    /** Replay: Flag whether the end of the trace was reached. */
+    bool                            fEof;
+    /** Replay: Flag whether the read record in the buffer is loaded. */
+    bool                            fReadLoaded;
+    /** Replay: Buffer holding the data of the current read record. */
+    uint8_t                         *pbRead;
+    /** Replay: Size of the read record buffer. */
+    size_t                          cbReadMax;
+    /** Replay: Size of the current read record. */
+    size_t                          cbRead;
+    /** Replay: Number of bytes of the current read record handed out already. */
+    size_t                          offRead;
+    /** Replay: Recorded time between the last write and the current read record. */
+    uint64_t                        cNsSinceWrite;
+    /** Replay: Number of bytes written according to the trace so far. */
+    uint64_t                        cbWrittenTrace;
+    /** Replay: Number of bytes written by the host so far. */
+    uint64_t                        cbWrittenHost;
+    /** Replay: Point in time of the last write by the host. */
+    uint64_t                        tsLastWriteNs;
+    /** Replay: The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+
+/**
+ * Returns the current time of the given clock in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ * @param   idClock                 The clock to query.
+ */
+static uint64_t pspTraceTimeNs(clockid_t idClock)
+{
+    struct timespec Ts;
+
+    clock_gettime(idClock, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Writes the given value as an unsigned LEB128 number.
+ *
+ * @returns nothing.
+ * @param   pFile                   The file to write to.
+ * @param   u64Val                  The value to write.
+ */
+static void pspTraceLeb128Write(FILE *pFile, uint64_t u64Val)
+{
+    do
+    {
+        uint8_t bVal = u64Val & 0x7f;
+        u64Val >>= 7;
+        if (u64Val)
+            bVal |= 0x80;
+        putc(bVal, pFile);
+    } while (u64Val);
+}
+
+
+/**
+ * Reads an unsigned LEB128 number.
+ *
+ * @returns Status code.
+ * @param   pFile                   The file to read from.
+ * @param   pu64Val                 Where to store the value.
+ */
+static int pspTraceLeb128Read(FILE *pFile, uint64_t *pu64Val)
+{
+    uint64_t u64Val = 0;
+
+    for (uint32_t cShift = 0; cShift < 64; cShift += 7)
+    {
+        int iCh = getc(pFile);
+        if (iCh == EOF)
+            return -1;
+
+        u64Val |= (uint64_t)(iCh & 0x7f) << cShift;
+        if (!(iCh & 0x80))
+        {
+            *pu64Val = u64Val;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Appends a record to the trace.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   enmType                 The record type.
+ * @param   pvData                  The record data.
+ * @param   cbData                  Size of the record data in bytes.
+ */
+static void pspTraceRecAppend(PPSPPROXYPROVCTXINT pThis, PSPTRACERECTYPE enmType, const void *pvData, size_t cbData)
+{
+    uint64_t tsNs = pspTraceTimeNs(CLOCK_MONOTONIC);
+
+    putc((uint8_t)enmType, pThis->pFile);
+    pspTraceLeb128Write(pThis->pFile, cbData);
+    pspTraceLeb128Write(pThis->pFile, tsNs - pThis->tsLastNs);
+    fwrite(pvData, cbData, 1, pThis->pFile);
+    pThis->tsLastNs = tsNs;
+}
+
+
+/**
+ * Appends a clock sync record to the trace.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ */
+static void pspTraceRecClockSync(PPSPPROXYPROVCTXINT pThis)
+{
+    PSPTRACECLOCKSYNC ClockSync;
+
+    ClockSync.tsMonotonicNs = pspTraceTimeNs(CLOCK_MONOTONIC);
+    ClockSync.tsRealtimeNs  = pspTraceTimeNs(CLOCK_REALTIME);
+    pspTraceRecAppend(pThis, PSPTRACERECTYPE_CLOCK_SYNC, &ClockSync, sizeof(ClockSync));
+}
+
+
+/**
+ * Splits the given device string at the first comma.
+ *
+ * @returns Pointer to the remainder after the comma or NULL if there is none.
+ * @param   pszDevice               The device string.
+ * @param   pszFile                 Where to store the file path.
+ * @param   cbFile                  Size of the file path buffer.
+ */
+static const char *pspTraceDevSplit(const char *pszDevice, char *pszFile, size_t cbFile)
+{
+    const char *pszSep = strchr(pszDevice, ',');
+    size_t cchFile = pszSep ? (size_t)(pszSep - pszDevice) : strlen(pszDevice);
+
+    if (   !cchFile
+        || cchFile >= cbFile)
+        return NULL;
+
+    memcpy(pszFile, pszDevice, cchFile);
+    pszFile[cchFile] = '\0';
+    return pszSep ? pszSep + 1 : "";
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int recordProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    char szFile[256];
+    int rc = 0;
+
+    const char *pszDevInner = pspTraceDevSplit(pszDevice, &szFile[0], sizeof(szFile));
+    if (pszDevInner)
+    {
+        const char *pszDevRem = NULL;
+        pThis->pProvInner = pspProxyProvFind(pszDevInner, &pszDevRem);
+        if (   pThis->pProvInner
+            && pThis->pProvInner->pfnCtxRead) /* Nothing to record for native providers. */
+        {
+            pThis->hProvCtxInner = (PSPPROXYPROVCTX)calloc(1, pThis->pProvInner->cbCtx);
+            if (pThis->hProvCtxInner)
+            {
+                pThis->pFile = fopen(&szFile[0], "wb");
+                if (pThis->pFile)
+                {
+                    PSPTRACEHDR Hdr;
+
+                    setvbuf(pThis->pFile, NULL, _IOFBF, PSP_TRACE_STREAM_BUF_SZ);
+                    memset(&Hdr, 0, sizeof(Hdr));
+                    memcpy(&Hdr.achMagic[0], PSP_TRACE_MAGIC, sizeof(Hdr.achMagic));
+                    Hdr.u32Version = PSP_TRACE_VERSION;
+                    Hdr.tsStartNs  = pspTraceTimeNs(CLOCK_REALTIME);
+                    if (fwrite(&Hdr, sizeof(Hdr), 1, pThis->pFile) == 1)
+                    {
+                        /* Start the clock before the inner provider so the initial traffic is covered. */
+                        pThis->tsLastNs = pspTraceTimeNs(CLOCK_MONOTONIC);
+                        pspTraceRecClockSync(pThis);
+                        rc = pThis->pProvInner->pfnCtxInit(pThis->hProvCtxInner, pszDevRem);
+                        if (!rc)
+                            return 0;
+                    }
+                    else
+                        rc = -1;
+
+                    fclose(pThis->pFile);
+                    remove(&szFile[0]);
+                }
+                else
+                    rc = -1;
+
+                free(pThis->hProvCtxInner);
+            }
+            else
+                rc = -1;
+        }
+        else
+            rc = -1;
+    }
+    else
+        rc = -1;
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void recordProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pThis->pProvInner->pfnCtxDestroy(pThis->hProvCtxInner);
+    free(pThis->hProvCtxInner);
+    pspTraceRecClockSync(pThis);
+    fclose(pThis->pFile);
+    pThis->hProvCtxInner = NULL;
+    pThis->pFile         = NULL;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t recordProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    return pThis->pProvInner->pfnCtxPeek(pThis->hProvCtxInner);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int recordProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    int rc = pThis->pProvInner->pfnCtxRead(pThis->hProvCtxInner, pvDst, cbRead, pcbRead);
+    if (   !rc
+        && *pcbRead)
+        pspTraceRecAppend(pThis, PSPTRACERECTYPE_READ, pvDst, *pcbRead);
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int recordProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    int rc = pThis->pProvInner->pfnCtxWrite(pThis->hProvCtxInner, pvPkt, cbPkt);
+    if (!rc)
+        pspTraceRecAppend(pThis, PSPTRACERECTYPE_WRITE, pvPkt, cbPkt);
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int recordProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (!pThis->pProvInner->pfnCtxWriteV)
+    {
+        for (unsigned i = 0; i < cIov; i++)
+        {
+            int rc = recordProvCtxWrite(hProvCtx, paIov[i].iov_base, paIov[i].iov_len);
+            if (rc)
+                return rc;
+        }
+
+        return 0;
+    }
+
+    int rc = pThis->pProvInner->pfnCtxWriteV(pThis->hProvCtxInner, paIov, cIov);
+    if (!rc)
+    {
+        for (unsigned i = 0; i < cIov; i++)
+            pspTraceRecAppend(pThis, PSPTRACERECTYPE_WRITE, paIov[i].iov_base, paIov[i].iov_len);
+    }
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int recordProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    return pThis->pProvInner->pfnCtxPoll(pThis->hProvCtxInner, cMillies);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int recordProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (!pThis->pProvInner->pfnCtxInterrupt)
+        return -1;
+
+    return pThis->pProvInner->pfnCtxInterrupt(pThis->hProvCtxInner);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86SmnRead}
+ */
+static int recordProvCtxX86SmnRead(PSPPROXYPROVCTX hProvCtx, uint16_t idNode, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86SmnRead)
+        return pThis->pProvInner->pfnCtxX86SmnRead(pThis->hProvCtxInner, idNode, uSmnAddr, cbVal, pvVal);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86SmnWrite}
+ */
+static int recordProvCtxX86SmnWrite(PSPPROXYPROVCTX hProvCtx, uint16_t idNode, SMNADDR uSmnAddr, uint32_t cbVal, const void *pvVal)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86SmnWrite)
+        return pThis->pProvInner->pfnCtxX86SmnWrite(pThis->hProvCtxInner, idNode, uSmnAddr, cbVal, pvVal);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86MemAlloc}
+ */
+static int recordProvCtxX86MemAlloc(PSPPROXYPROVCTX hProvCtx, uint32_t cbMem, R0PTR *pR0KernVirtual, X86PADDR *pPhysX86Addr)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86MemAlloc)
+        return pThis->pProvInner->pfnCtxX86MemAlloc(pThis->hProvCtxInner, cbMem, pR0KernVirtual, pPhysX86Addr);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86MemFree}
+ */
+static int recordProvCtxX86MemFree(PSPPROXYPROVCTX hProvCtx, R0PTR R0KernVirtual)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86MemFree)
+        return pThis->pProvInner->pfnCtxX86MemFree(pThis->hProvCtxInner, R0KernVirtual);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86MemRead}
+ */
+static int recordProvCtxX86MemRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, R0PTR R0KernVirtualSrc, uint32_t cbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86MemRead)
+        return pThis->pProvInner->pfnCtxX86MemRead(pThis->hProvCtxInner, pvDst, R0KernVirtualSrc, cbRead);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86MemWrite}
+ */
+static int recordProvCtxX86MemWrite(PSPPROXYPROVCTX hProvCtx, R0PTR R0KernVirtualDst, const void *pvSrc, uint32_t cbWrite)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86MemWrite)
+        return pThis->pProvInner->pfnCtxX86MemWrite(pThis->hProvCtxInner, R0KernVirtualDst, pvSrc, cbWrite);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86PhysMemRead}
+ */
+static int recordProvCtxX86PhysMemRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, X86PADDR PhysX86AddrSrc, uint32_t cbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86PhysMemRead)
+        return pThis->pProvInner->pfnCtxX86PhysMemRead(pThis->hProvCtxInner, pvDst, PhysX86AddrSrc, cbRead);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxX86PhysMemWrite}
+ */
+static int recordProvCtxX86PhysMemWrite(PSPPROXYPROVCTX hProvCtx, X86PADDR PhysX86AddrDst, const void *pvSrc, uint32_t cbWrite)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxX86PhysMemWrite)
+        return pThis->pProvInner->pfnCtxX86PhysMemWrite(pThis->hProvCtxInner, PhysX86AddrDst, pvSrc, cbWrite);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxEmuWaitForWork}
+ */
+static int recordProvCtxEmuWaitForWork(PSPPROXYPROVCTX hProvCtx, uint32_t *pidCmd, X86PADDR *pPhysX86AddrCmdBuf, uint32_t msWait)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxEmuWaitForWork)
+        return pThis->pProvInner->pfnCtxEmuWaitForWork(pThis->hProvCtxInner, pidCmd, pPhysX86AddrCmdBuf, msWait);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxEmuSetResult}
+ */
+static int recordProvCtxEmuSetResult(PSPPROXYPROVCTX hProvCtx, uint32_t uResult)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxEmuSetResult)
+        return pThis->pProvInner->pfnCtxEmuSetResult(pThis->hProvCtxInner, uResult);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int recordProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->pProvInner->pfnCtxQueryStats)
+        return pThis->pProvInner->pfnCtxQueryStats(pThis->hProvCtxInner, pStats);
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryCaps}
+ */
+static int recordProvCtxQueryCaps(PSPPROXYPROVCTX hProvCtx, uint32_t *pfCaps)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* All callbacks are forwarded, so whatever the recorded provider can do is available. */
+    *pfCaps = pspProxyProvCapsQuery(pThis->pProvInner, pThis->hProvCtxInner);
+    return 0;
+}
+
+
+/**
+ * Makes sure the next read record of the trace is loaded, skipping over write records.
+ *
+ * The read data of a recording only depends on what was written before, so a read record is released
+ * only after the host wrote at least as many bytes as the trace up to that point. The bytes written
+ * are not compared as host generated fields (timestamps for example) legitimately differ between runs.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ */
+static int pspTraceReplayLoad(PPSPPROXYPROVCTXINT pThis)
+{
+    while (   !pThis->fReadLoaded
+           && !pThis->fEof)
+    {
+        uint64_t cbData = 0;
+        uint64_t cNsDelta = 0;
+        int iType = getc(pThis->pFile);
+
+        if (iType == EOF)
+        {
+            pThis->fEof = true;
+            break;
+        }
+
+        if (   pspTraceLeb128Read(pThis->pFile, &cbData)
+            || pspTraceLeb128Read(pThis->pFile, &cNsDelta))
+            return -1;
+
+        switch (iType)
+        {
+            case PSPTRACERECTYPE_WRITE:
+            {
+                if (fseeko(pThis->pFile, (off_t)cbData, SEEK_CUR))
+                    return -1;
+                pThis->cbWrittenTrace += cbData;
+                pThis->cNsSinceWrite   = 0;
+                break;
+            }
+            case PSPTRACERECTYPE_READ:
+            {
+                if (cbData > pThis->cbReadMax)
+                {
+                    uint8_t *pbRead = (uint8_t *)realloc(pThis->pbRead, cbData);
+                    if (!pbRead)
+                        return -1;
+                    pThis->pbRead    = pbRead;
+                    pThis->cbReadMax = cbData;
+                }
+
+                if (   cbData
+                    && fread(pThis->pbRead, cbData, 1, pThis->pFile) != 1)
+                    return -1;
+
+                pThis->cbRead        = cbData;
+                pThis->offRead       = 0;
+                pThis->cNsSinceWrite += cNsDelta;
+                pThis->fReadLoaded   = true;
+                break;
+            }
+            default:
+                /* Skip unknown records so newer traces remain replayable. */
+                if (fseeko(pThis->pFile, (off_t)cbData, SEEK_CUR))
+                    return -1;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Returns whether the loaded read record is released at the given point in time.
+ *
+ * @returns Flag whether the host can read the data.
+ * @param   pThis                   The provider context.
+ * @param   tsNs                    The current point in time.
+ * @param   ptsDueNs                Where to store the point in time the record becomes readable if waiting
+ *                                  for time to pass, UINT64_MAX if waiting for the host to write something.
+ */
+static bool pspTraceReplayIsReleased(PPSPPROXYPROVCTXINT pThis, uint64_t tsNs, uint64_t *ptsDueNs)
+{
+    *ptsDueNs = UINT64_MAX;
+    if (   !pThis->fReadLoaded
+        || pThis->cbWrittenHost < pThis->cbWrittenTrace)
+        return false;
+
+    if (pThis->fFast)
+        return true;
+
+    *ptsDueNs = pThis->tsLastWriteNs + pThis->cNsSinceWrite;
+    return *ptsDueNs <= tsNs;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int replayProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    char szFile[256];
+    int rc = 0;
+
+    const char *pszOpts = pspTraceDevSplit(pszDevice, &szFile[0], sizeof(szFile));
+    if (   pszOpts
+        && (   !*pszOpts
+            || !strcmp(pszOpts, "fast")))
+    {
+        pThis->fFast = *pszOpts != '\0';
+        pThis->pFile = fopen(&szFile[0], "rb");
+        if (pThis->pFile)
+        {
+            PSPTRACEHDR Hdr;
+
+            setvbuf(pThis->pFile, NULL, _IOFBF, PSP_TRACE_STREAM_BUF_SZ);
+            if (   fread(&Hdr, sizeof(Hdr), 1, pThis->pFile) == 1
+                && !memcmp(&Hdr.achMagic[0], PSP_TRACE_MAGIC, sizeof(Hdr.achMagic))
+                && Hdr.u32Version == PSP_TRACE_VERSION)
+            {
+                pThis->fEof           = false;
+                pThis->fReadLoaded    = false;
+                pThis->pbRead         = NULL;
+                pThis->cbReadMax      = 0;
+                pThis->cbWrittenTrace = 0;
+                pThis->cbWrittenHost  = 0;
+                pThis->cNsSinceWrite  = 0;
+                pThis->tsLastWriteNs  = pspTraceTimeNs(CLOCK_MONOTONIC);
+                pThis->iFdEvtIntr     = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (pThis->iFdEvtIntr > -1)
+                    return 0;
+
+                rc = -1;
+            }
+            else
+                rc = -1;
+
+            fclose(pThis->pFile);
+        }
+        else
+            rc = -1;
+    }
+    else
+        rc = -1;
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void replayProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    fclose(pThis->pFile);
+    free(pThis->pbRead);
+    close(pThis->iFdEvtIntr);
+    pThis->pFile      = NULL;
+    pThis->pbRead     = NULL;
+    pThis->iFdEvtIntr = -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t replayProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t tsDueNs;
+
+    if (   pspTraceReplayLoad(pThis)
+        || !pspTraceReplayIsReleased(pThis, pspTraceTimeNs(CLOCK_MONOTONIC), &tsDueNs))
+        return 0;
+
+    return pThis->cbRead - pThis->offRead;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int replayProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t tsDueNs;
+
+    *pcbRead = 0;
+    int rc = pspTraceReplayLoad(pThis);
+    if (   !rc
+        && pspTraceReplayIsReleased(pThis, pspTraceTimeNs(CLOCK_MONOTONIC), &tsDueNs))
+    {
+        size_t cbThisRead = MIN(cbRead, pThis->cbRead - pThis->offRead);
+
+        memcpy(pvDst, pThis->pbRead + pThis->offRead, cbThisRead);
+        pThis->offRead += cbThisRead;
+        *pcbRead = cbThisRead;
+
+        /* The timing of the next read record is relative to this one. */
+        if (pThis->offRead == pThis->cbRead)
+        {
+            pThis->fReadLoaded = false;
+            if (!pThis->fFast)
+            {
+                pThis->tsLastWriteNs = tsDueNs;
+                pThis->cNsSinceWrite = 0;
+            }
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int replayProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pThis->cbWrittenHost += cbPkt;
+    pThis->tsLastWriteNs  = pspTraceTimeNs(CLOCK_MONOTONIC);
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int replayProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t tsNs = pspTraceTimeNs(CLOCK_MONOTONIC);
+    uint64_t tsDeadlineNs = tsNs + (uint64_t)cMillies * 1000000ULL;
+
+    int rc = pspTraceReplayLoad(pThis);
+    if (rc)
+        return rc;
+
+    for (;;)
+    {
+        uint64_t tsDueNs;
+        if (pspTraceReplayIsReleased(pThis, tsNs, &tsDueNs))
+            return 0;
+
+        /* Nothing will change when replaying as fast as possible, same if the host has to write something first. */
+        if (   pThis->fFast
+            || tsNs >= tsDeadlineNs)
+            return STS_ERR_PSP_PROXY_TIMEOUT;
+
+        /* Sleep until the next read is due or the timeout elapsed, waking up early when interrupted. */
+        uint64_t cNsWait = MIN(tsDueNs, tsDeadlineNs) - tsNs;
+        struct pollfd PollFd;
+        struct timespec Ts;
+
+        Ts.tv_sec      = cNsWait / 1000000000ULL;
+        Ts.tv_nsec     = cNsWait % 1000000000ULL;
+        PollFd.fd      = pThis->iFdEvtIntr;
+        PollFd.events  = POLLIN;
+        PollFd.revents = 0;
+        if (ppoll(&PollFd, 1, &Ts, NULL) == 1)
+        {
+            uint64_t uCnt = 0;
+            if (read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt)) == sizeof(uCnt))
+                return STS_ERR_PSP_PROXY_INTERRUPTED;
+        }
+        tsNs = pspTraceTimeNs(CLOCK_MONOTONIC);
+    }
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int replayProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * Provider registration structure for the recorder.
+ */
+const PSPPROXYPROV g_PspProxyProvRecord =
+{
+    /** pszId */
+    "record",
+    /** pszDesc */
+    "Records the transport traffic of another provider, device schema looks like record://<trace file>,<device>",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    0,
+    /** pfnCtxInit */
+    recordProvCtxInit,
+    /** pfnCtxDestroy */
+    recordProvCtxDestroy,
+    /** pfnCtxPeek */
+    recordProvCtxPeek,
+    /** pfnCtxRead */
+    recordProvCtxRead,
+    /** pfnCtxWrite */
+    recordProvCtxWrite,
+    /** pfnCtxPoll */
+    recordProvCtxPoll,
+    /** pfnCtxInterrupt */
+    recordProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    recordProvCtxX86SmnRead,
+    /** pfnCtxX86SmnWrite */
+    recordProvCtxX86SmnWrite,
+    /** pfnCtxX86MemAlloc */
+    recordProvCtxX86MemAlloc,
+    /** pfnCtxX86MemFree */
+    recordProvCtxX86MemFree,
+    /** pfnCtxX86MemRead */
+    recordProvCtxX86MemRead,
+    /** pfnCtxX86MemWrite */
+    recordProvCtxX86MemWrite,
+    /** pfnCtxX86PhysMemRead */
+    recordProvCtxX86PhysMemRead,
+    /** pfnCtxX86PhysMemWrite */
+    recordProvCtxX86PhysMemWrite,
+    /** pfnCtxEmuWaitForWork */
+    recordProvCtxEmuWaitForWork,
+    /** pfnCtxEmuSetResult */
+    recordProvCtxEmuSetResult,
+    /** pfnCtxQueryStats */
+    recordProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    recordProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    recordProvCtxQueryCaps
+};
+
+
+/**
+ * Provider registration structure for the replayer.
+ */
+const PSPPROXYPROV g_PspProxyProvReplay =
+{
+    /** pszId */
+    "replay",
+    /** pszDesc */
+    "Replays a trace created with the record provider, device schema looks like replay://<trace file>[,fast]",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    PSPPROXY_CAPS_F_SIMULATED,
+    /** pfnCtxInit */
+    replayProvCtxInit,
+    /** pfnCtxDestroy */
+    replayProvCtxDestroy,
+    /** pfnCtxPeek */
+    replayProvCtxPeek,
+    /** pfnCtxRead */
+    replayProvCtxRead,
+    /** pfnCtxWrite */
+    replayProvCtxWrite,
+    /** pfnCtxPoll */
+    replayProvCtxPoll,
+    /** pfnCtxInterrupt */
+    replayProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    NULL,
+    /** pfnCtxWriteV */
+    NULL,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    NULL
+};
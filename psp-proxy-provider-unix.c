@@ -0,0 +1,534 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - access over a unix domain socket
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Device schema looks like unix://[seqpacket,][recvfd,]<path>|fd=<descriptor>:
+ *     - <path> is the socket to connect to, a leading @ selects the abstract namespace.
+ *     - seqpacket connects with SOCK_SEQPACKET instead of SOCK_STREAM, every PDU is a single message then.
+ *     - recvfd doesn't use the connection to <path> as the transport but receives a connected socket
+ *       from the peer with SCM_RIGHTS, so a bridge process can hand over a transport it set up.
+ *     - fd=<descriptor> takes over an already connected socket, for example one end of a socketpair()
+ *       inherited from the parent process. The descriptor is closed when the context is destroyed.
+ */
+
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "psp-proxy-provider.h"
+
+
+/** Size of the userspace receive buffer, also the maximum message size in seqpacket mode. */
+#define PSP_UNIX_RX_BUF_SZ              (64 * 1024)
+
+
+/**
+ * Internal PSP proxy provider context.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** The socket descriptor for the connection. */
+    int                             iFdCon;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+    /** Offset of the first unconsumed byte in the receive buffer. */
+    size_t                          offRx;
+    /** Number of valid bytes in the receive buffer. */
+    size_t                          cbRx;
+    /** The receive buffer, peek and read are served from it. */
+    uint8_t                         abRx[PSP_UNIX_RX_BUF_SZ];
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+/**
+ * Connects to the given socket path.
+ *
+ * @returns Socket descriptor on success, -1 on failure.
+ * @param   pszPath                 The path to connect to, a leading @ selects the abstract namespace.
+ * @param   iSockType               The socket type.
+ */
+static int unixProvConnect(const char *pszPath, int iSockType)
+{
+    struct sockaddr_un SrvAddr;
+    size_t cchPath = strlen(pszPath);
+
+    if (!cchPath || cchPath >= sizeof(SrvAddr.sun_path))
+        return -1;
+
+    memset(&SrvAddr, 0, sizeof(SrvAddr));
+    SrvAddr.sun_family = AF_UNIX;
+    memcpy(&SrvAddr.sun_path[0], pszPath, cchPath);
+    if (SrvAddr.sun_path[0] == '@')
+        SrvAddr.sun_path[0] = '\0';
+
+    int iFd = socket(AF_UNIX, iSockType | SOCK_CLOEXEC, 0);
+    if (iFd > -1)
+    {
+        int rcPsx = connect(iFd, (struct sockaddr *)&SrvAddr, offsetof(struct sockaddr_un, sun_path) + cchPath);
+        if (!rcPsx)
+            return iFd;
+
+        close(iFd);
+    }
+
+    return -1;
+}
+
+
+/**
+ * Receives a single descriptor passed by the peer.
+ *
+ * @returns Received descriptor on success, -1 on failure.
+ * @param   iFdCon                  The connection to receive the descriptor from.
+ */
+static int unixProvRecvFd(int iFdCon)
+{
+    union
+    {
+        struct cmsghdr              Hdr;
+        uint8_t                     ab[CMSG_SPACE(sizeof(int))];
+    } uCtrl;
+    struct msghdr Msg;
+    struct iovec Iov;
+    uint8_t bDummy = 0;
+
+    /* At least one byte of data is required to carry the control message. */
+    Iov.iov_base = &bDummy;
+    Iov.iov_len  = sizeof(bDummy);
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov        = &Iov;
+    Msg.msg_iovlen     = 1;
+    Msg.msg_control    = &uCtrl;
+    Msg.msg_controllen = sizeof(uCtrl);
+
+    ssize_t cbRet;
+    do
+        cbRet = recvmsg(iFdCon, &Msg, MSG_CMSG_CLOEXEC);
+    while (cbRet == -1 && errno == EINTR);
+    if (cbRet <= 0)
+        return -1;
+
+    struct cmsghdr *pCMsg = CMSG_FIRSTHDR(&Msg);
+    if (   pCMsg
+        && pCMsg->cmsg_level == SOL_SOCKET
+        && pCMsg->cmsg_type == SCM_RIGHTS
+        && pCMsg->cmsg_len == CMSG_LEN(sizeof(int)))
+    {
+        int iFd;
+        memcpy(&iFd, CMSG_DATA(pCMsg), sizeof(iFd));
+        return iFd;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Fills the receive buffer with whatever the socket has available without blocking.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ *
+ * @note Must only be called when the receive buffer is empty.
+ */
+static int unixProvCtxRxFill(PPSPPROXYPROVCTXINT pThis)
+{
+    ssize_t cbRet = recv(pThis->iFdCon, &pThis->abRx[0], sizeof(pThis->abRx), MSG_DONTWAIT);
+    pThis->cSyscalls++;
+    if (cbRet > 0)
+    {
+        pThis->offRx = 0;
+        pThis->cbRx  = cbRet;
+        return 0;
+    }
+
+    if (!cbRet)
+        return -1;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int unixProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    int iSockType = SOCK_STREAM;
+    bool fRecvFd = false;
+
+    for (;;)
+    {
+        if (!strncmp(pszDevice, "seqpacket,", sizeof("seqpacket,") - 1))
+        {
+            iSockType = SOCK_SEQPACKET;
+            pszDevice += sizeof("seqpacket,") - 1;
+        }
+        else if (!strncmp(pszDevice, "recvfd,", sizeof("recvfd,") - 1))
+        {
+            fRecvFd = true;
+            pszDevice += sizeof("recvfd,") - 1;
+        }
+        else
+            break;
+    }
+
+    pThis->iFdCon = -1;
+    if (!strncmp(pszDevice, "fd=", sizeof("fd=") - 1))
+    {
+        char *pszEnd = NULL;
+        long iFd = strtol(pszDevice + sizeof("fd=") - 1, &pszEnd, 10);
+        int iSockTypeFd = 0;
+        socklen_t cbSockType = sizeof(iSockTypeFd);
+
+        /* Only connected stream and seqpacket sockets make sense as a transport. */
+        if (   pszEnd
+            && *pszEnd == '\0'
+            && iFd >= 0
+            && iFd <= INT32_MAX
+            && !getsockopt((int)iFd, SOL_SOCKET, SO_TYPE, &iSockTypeFd, &cbSockType)
+            && (iSockTypeFd == SOCK_STREAM || iSockTypeFd == SOCK_SEQPACKET))
+            pThis->iFdCon = (int)iFd;
+    }
+    else
+    {
+        int iFd = unixProvConnect(pszDevice, iSockType);
+        if (iFd > -1 && fRecvFd)
+        {
+            /* The connection to the bridge is only used to get at the transport. */
+            pThis->iFdCon = unixProvRecvFd(iFd);
+            close(iFd);
+        }
+        else
+            pThis->iFdCon = iFd;
+    }
+
+    if (pThis->iFdCon > -1)
+    {
+        pThis->offRx      = 0;
+        pThis->cbRx       = 0;
+        pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (pThis->iFdEvtIntr > -1)
+            return 0;
+
+        close(pThis->iFdCon);
+        pThis->iFdCon = -1;
+    }
+
+    return -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void unixProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    shutdown(pThis->iFdCon, SHUT_RDWR);
+    close(pThis->iFdCon);
+    close(pThis->iFdEvtIntr);
+    pThis->iFdCon     = -1;
+    pThis->iFdEvtIntr = -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t unixProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (   pThis->offRx == pThis->cbRx
+        && unixProvCtxRxFill(pThis))
+        return 0;
+
+    return pThis->cbRx - pThis->offRx;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int unixProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    *pcbRead = 0;
+    if (pThis->offRx == pThis->cbRx)
+    {
+        int rc = unixProvCtxRxFill(pThis);
+        if (rc)
+            return rc;
+    }
+
+    size_t cbThisRead = MIN(cbRead, pThis->cbRx - pThis->offRx);
+    memcpy(pvDst, &pThis->abRx[pThis->offRx], cbThisRead);
+    pThis->offRx += cbThisRead;
+    *pcbRead      = cbThisRead;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int unixProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct iovec aIov[8];
+    struct msghdr Msg;
+
+    if (cIov > ELEMENTS(aIov))
+        return -1;
+
+    /* Local copy as partial sends require adjusting the buffers (stream sockets only, messages are sent atomically). */
+    memcpy(&aIov[0], paIov, cIov * sizeof(*paIov));
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov    = &aIov[0];
+    Msg.msg_iovlen = cIov;
+
+    while (Msg.msg_iovlen)
+    {
+        ssize_t cbRet = sendmsg(pThis->iFdCon, &Msg, MSG_NOSIGNAL);
+        pThis->cSyscalls++;
+        if (cbRet == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        size_t cbLeft = cbRet;
+        while (   Msg.msg_iovlen
+               && cbLeft >= Msg.msg_iov->iov_len)
+        {
+            cbLeft -= Msg.msg_iov->iov_len;
+            Msg.msg_iov++;
+            Msg.msg_iovlen--;
+        }
+
+        if (cbLeft)
+        {
+            Msg.msg_iov->iov_base = (uint8_t *)Msg.msg_iov->iov_base + cbLeft;
+            Msg.msg_iov->iov_len -= cbLeft;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int unixProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    struct iovec Iov = { (void *)pvPkt, cbPkt };
+
+    return unixProvCtxWriteV(hProvCtx, &Iov, 1);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int unixProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    struct pollfd aPollFds[2];
+
+    /* Data still buffered is available right away. */
+    if (pThis->offRx < pThis->cbRx)
+        return 0;
+
+    aPollFds[0].fd      = pThis->iFdCon;
+    aPollFds[0].events  = POLLIN | POLLHUP | POLLERR;
+    aPollFds[0].revents = 0;
+    aPollFds[1].fd      = pThis->iFdEvtIntr;
+    aPollFds[1].events  = POLLIN;
+    aPollFds[1].revents = 0;
+
+    int rc = 0;
+    int rcPsx = poll(&aPollFds[0], ELEMENTS(aPollFds), cMillies);
+    pThis->cSyscalls++;
+    if (rcPsx == 0)
+        rc = STS_ERR_PSP_PROXY_TIMEOUT;
+    else if (rcPsx == -1)
+        rc = -1;
+    else if (aPollFds[1].revents)
+    {
+        /* Consume the interrupt. */
+        uint64_t uCnt = 0;
+        ssize_t cbRead = read(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+        pThis->cSyscalls++;
+        rc = cbRead == sizeof(uCnt) || errno == EAGAIN ? STS_ERR_PSP_PROXY_INTERRUPTED : -1;
+    }
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int unixProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint64_t uCnt = 1;
+
+    /* Saturating the counter is fine, the poll is interrupted anyway. */
+    ssize_t cbWritten = write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt));
+    return cbWritten == sizeof(uCnt) || errno == EAGAIN ? 0 : -1;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int unixProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    pStats->cSyscalls = pThis->cSyscalls;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryFd}
+ */
+static int unixProvCtxQueryFd(PSPPROXYPROVCTX hProvCtx, int *piFd)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Data already buffered would get lost when somebody else reads from the socket. */
+    if (pThis->cbRx)
+        return -1;
+
+    *piFd = pThis->iFdCon;
+    return 0;
+}
+
+
+/**
+ * Provider registration structure.
+ */
+const PSPPROXYPROV g_PspProxyProvUnix =
+{
+    /** pszId */
+    "unix",
+    /** pszDesc */
+    "Unix domain socket, device schema looks like unix://[seqpacket,][recvfd,]<path>|fd=<descriptor>",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    0,
+    /** pfnCtxInit */
+    unixProvCtxInit,
+    /** pfnCtxDestroy */
+    unixProvCtxDestroy,
+    /** pfnCtxPeek */
+    unixProvCtxPeek,
+    /** pfnCtxRead */
+    unixProvCtxRead,
+    /** pfnCtxWrite */
+    unixProvCtxWrite,
+    /** pfnCtxPoll */
+    unixProvCtxPoll,
+    /** pfnCtxInterrupt */
+    unixProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    unixProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    unixProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    unixProvCtxQueryFd,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    NULL
+};
+
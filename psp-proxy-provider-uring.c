@@ -0,0 +1,1006 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - io_uring based transport for stream sockets and ttys.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The provider stacks on top of a stream provider (tcp or serial) which sets up the connection,
+ * device schema looks like uring://[sqpoll,]<device>, for example uring://tcp://127.0.0.1:1234.
+ * Afterwards all I/O on the descriptor goes through an io_uring instance:
+ *     - Receiving is done into a ring of provided buffers, for sockets with a single multishot
+ *       receive which stays armed as long as there are buffers available, ttys get a buffer selecting
+ *       read re-armed after each completion.
+ *     - Each packet is gathered into a registered buffer and written with a single fixed buffer write
+ *       instead of one write per fragment.
+ *     - Waiting for data is a single io_uring_enter() which also submits anything queued.
+ *     - With the sqpoll option a kernel thread polls the submission queue.
+ * The raw system call interface is used, so there is no dependency on liburing. If the kernel lacks
+ * any of the required features the provider silently forwards everything to the inner provider.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <common/cdefs.h>
+#include <common/types.h>
+#include <common/status.h>
+
+#include "psp-proxy-provider.h"
+
+
+/** Number of submission queue entries. */
+#define PSP_URING_SQ_ENTRIES            16
+/** Number of receive buffers in the provided buffer ring, must be a power of two. */
+#define PSP_URING_RX_BUF_COUNT          16
+/** Size of a single receive buffer. */
+#define PSP_URING_RX_BUF_SZ             (4 * 1024)
+/** Size of the registered transmit buffer. */
+#define PSP_URING_TX_BUF_SZ             (64 * 1024)
+/** The buffer group ID used for the provided receive buffers. */
+#define PSP_URING_RX_BGID               0
+/** Idle time of the submission queue polling thread before it goes to sleep in milliseconds. */
+#define PSP_URING_SQPOLL_IDLE_MS        100
+
+
+/**
+ * Operation tags stored in the user data of the submission entries.
+ */
+typedef enum PSPURINGOP
+{
+    /** Invalid operation. */
+    PSPURINGOP_INVALID = 0,
+    /** Receive into a provided buffer. */
+    PSPURINGOP_RECV,
+    /** Write from the registered transmit buffer. */
+    PSPURINGOP_WRITE,
+    /** Read of the interrupt eventfd. */
+    PSPURINGOP_INTR,
+    /** 32bit hack. */
+    PSPURINGOP_32BIT_HACK = 0x7fffffff
+} PSPURINGOP;
+
+
+/**
+ * A completed receive buffer.
+ */
+typedef struct PSPURINGRXBUF
+{
+    /** The buffer ID. */
+    uint16_t                        idBuf;
+    /** Offset of the first unconsumed byte. */
+    uint32_t                        offData;
+    /** Number of valid bytes. */
+    uint32_t                        cbData;
+} PSPURINGRXBUF;
+/** Pointer to a completed receive buffer. */
+typedef PSPURINGRXBUF *PPSPURINGRXBUF;
+
+
+/**
+ * Internal PSP proxy provider context.
+ */
+typedef struct PSPPROXYPROVCTXINT
+{
+    /** The inner provider setting up the connection. */
+    PCPSPPROXYPROV                  pProvInner;
+    /** The inner provider context. */
+    PSPPROXYPROVCTX                 hProvCtxInner;
+    /** Flag whether everything is forwarded to the inner provider because io_uring is not usable. */
+    bool                            fFallback;
+    /** Flag whether the kernel polls the submission queue. */
+    bool                            fSqPoll;
+    /** Flag whether the descriptor is a socket (multishot receive) or something else (ttys). */
+    bool                            fSocket;
+    /** The stream descriptor, owned by the inner provider. */
+    int                             iFd;
+    /** The original file status flags of the descriptor, -1 if they were not changed. */
+    int                             fFlFdOrig;
+    /** The io_uring descriptor. */
+    int                             iFdRing;
+    /** Number of system calls done so far. */
+    uint64_t                        cSyscalls;
+    /** The eventfd used to interrupt polling. */
+    int                             iFdEvtIntr;
+    /** Where the interrupt eventfd read stores the counter. */
+    uint64_t                        u64IntrCnt;
+
+    /** The mapping of the submission and completion rings. */
+    void                            *pvRings;
+    /** Size of the ring mapping. */
+    size_t                          cbRings;
+    /** The submission queue entries mapping. */
+    struct io_uring_sqe             *paSqes;
+    /** Size of the submission queue entries mapping. */
+    size_t                          cbSqes;
+    /** Submission queue head (kernel). */
+    uint32_t                        *pu32SqHead;
+    /** Submission queue tail. */
+    uint32_t                        *pu32SqTail;
+    /** Submission queue flags (kernel). */
+    uint32_t                        *pfSqFlags;
+    /** Submission queue index array. */
+    uint32_t                        *pau32SqArray;
+    /** Submission queue ring mask. */
+    uint32_t                        fSqMask;
+    /** Number of submission queue entries. */
+    uint32_t                        cSqEntries;
+    /** Local submission queue tail, published when submitting. */
+    uint32_t                        idxSqTail;
+    /** Number of submission entries queued but not handed to the kernel yet. */
+    uint32_t                        cSqesPending;
+    /** Completion queue head. */
+    uint32_t                        *pu32CqHead;
+    /** Completion queue tail (kernel). */
+    uint32_t                        *pu32CqTail;
+    /** Completion queue ring mask. */
+    uint32_t                        fCqMask;
+    /** The completion queue entries. */
+    struct io_uring_cqe             *paCqes;
+
+    /** The provided buffer ring. */
+    struct io_uring_buf_ring        *pBufRing;
+    /** Size of the provided buffer ring mapping. */
+    size_t                          cbBufRing;
+    /** Local tail of the provided buffer ring. */
+    uint16_t                        idxBufRingTail;
+    /** The receive buffers. */
+    uint8_t                         *pbRx;
+    /** The registered transmit buffer. */
+    uint8_t                         *pbTx;
+
+    /** Flag whether a receive is in flight. */
+    bool                            fRecvArmed;
+    /** Flag whether the kernel lacks multishot receive support and single shot receives are used. */
+    bool                            fRecvSingleShot;
+    /** Flag whether the interrupt eventfd read is in flight. */
+    bool                            fIntrArmed;
+    /** Flag whether an interrupt was received and not reported yet. */
+    bool                            fIntrPending;
+    /** Sticky receive status, set on errors and when the peer closed the connection. */
+    int                             rcRecv;
+    /** Flag whether a write is in flight. */
+    bool                            fWritePending;
+    /** Status of the write in flight. */
+    int                             rcWrite;
+    /** Number of bytes written by the write in flight. */
+    size_t                          cbWritten;
+    /** Index of the oldest completed receive buffer. */
+    uint32_t                        idxRxHead;
+    /** Number of completed receive buffers. */
+    uint32_t                        cRxBufs;
+    /** Number of bytes available in the completed receive buffers. */
+    size_t                          cbRxAvail;
+    /** The completed receive buffers in order of arrival. */
+    PSPURINGRXBUF                   aRxBufs[PSP_URING_RX_BUF_COUNT];
+} PSPPROXYPROVCTXINT;
+/** Pointer to an internal PSP proxy context. */
+typedef PSPPROXYPROVCTXINT *PPSPPROXYPROVCTXINT;
+
+
+/**
+ * Returns the current monotonic time in milliseconds.
+ */
+static uint64_t pspUringTimeMs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000 + Ts.tv_nsec / 1000000;
+}
+
+
+/**
+ * Enters the kernel to submit queued entries and optionally wait for completions.
+ *
+ * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_TIMEOUT if nothing completed before the timeout elapsed.
+ * @param   pThis                   The provider context.
+ * @param   fWait                   Flag whether to wait for at least one completion.
+ * @param   cMillies                How long to wait at most.
+ */
+static int pspUringEnter(PPSPPROXYPROVCTXINT pThis, bool fWait, uint32_t cMillies)
+{
+    struct __kernel_timespec Ts;
+    struct io_uring_getevents_arg Arg;
+    uint32_t cToSubmit = pThis->cSqesPending;
+    uint32_t fFlags = 0;
+
+    /* Publish the queued entries, the kernel thread picks them up without a system call. */
+    __atomic_store_n(pThis->pu32SqTail, pThis->idxSqTail, __ATOMIC_RELEASE);
+    pThis->cSqesPending = 0;
+
+    if (pThis->fSqPoll)
+    {
+        cToSubmit = 0;
+        if (__atomic_load_n(pThis->pfSqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)
+            fFlags |= IORING_ENTER_SQ_WAKEUP;
+        else if (!fWait)
+            return 0;
+    }
+    else if (!cToSubmit && !fWait)
+        return 0;
+
+    memset(&Arg, 0, sizeof(Arg));
+    if (fWait)
+    {
+        Ts.tv_sec  = cMillies / 1000;
+        Ts.tv_nsec = (cMillies % 1000) * 1000000;
+        Arg.sigmask_sz = _NSIG / 8;
+        Arg.ts         = (uint64_t)(uintptr_t)&Ts;
+        fFlags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    long rcSys = syscall(__NR_io_uring_enter, pThis->iFdRing, cToSubmit, fWait ? 1 : 0, fFlags,
+                         fWait ? &Arg : NULL, fWait ? sizeof(Arg) : 0);
+    pThis->cSyscalls++;
+    if (rcSys >= 0)
+        return 0;
+
+    if (errno == ETIME)
+        return STS_ERR_PSP_PROXY_TIMEOUT;
+    if (errno == EINTR)
+        return 0;
+
+    return -1;
+}
+
+
+/**
+ * Returns a free submission queue entry, submitting queued ones if the queue is full.
+ *
+ * @returns Pointer to the zeroed entry or NULL if the queue is full.
+ * @param   pThis                   The provider context.
+ * @param   enmOp                   The operation to tag the entry with.
+ */
+static struct io_uring_sqe *pspUringSqeGet(PPSPPROXYPROVCTXINT pThis, PSPURINGOP enmOp)
+{
+    uint32_t idxSqHead = __atomic_load_n(pThis->pu32SqHead, __ATOMIC_ACQUIRE);
+    if (pThis->idxSqTail - idxSqHead >= pThis->cSqEntries)
+    {
+        pspUringEnter(pThis, false /*fWait*/, 0);
+        idxSqHead = __atomic_load_n(pThis->pu32SqHead, __ATOMIC_ACQUIRE);
+        if (pThis->idxSqTail - idxSqHead >= pThis->cSqEntries)
+            return NULL;
+    }
+
+    struct io_uring_sqe *pSqe = &pThis->paSqes[pThis->idxSqTail & pThis->fSqMask];
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->user_data = enmOp;
+    pThis->idxSqTail++;
+    pThis->cSqesPending++;
+    return pSqe;
+}
+
+
+/**
+ * Hands a consumed receive buffer back to the kernel.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ * @param   idBuf                   The buffer ID.
+ */
+static void pspUringRxBufReturn(PPSPPROXYPROVCTXINT pThis, uint16_t idBuf)
+{
+    struct io_uring_buf *pBuf = &pThis->pBufRing->bufs[pThis->idxBufRingTail & (PSP_URING_RX_BUF_COUNT - 1)];
+
+    pBuf->addr = (uint64_t)(uintptr_t)&pThis->pbRx[idBuf * PSP_URING_RX_BUF_SZ];
+    pBuf->len  = PSP_URING_RX_BUF_SZ;
+    pBuf->bid  = idBuf;
+    pThis->idxBufRingTail++;
+    __atomic_store_n(&pThis->pBufRing->tail, pThis->idxBufRingTail, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Processes all available completions.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ */
+static void pspUringCqReap(PPSPPROXYPROVCTXINT pThis)
+{
+    uint32_t idxCqHead = *pThis->pu32CqHead;
+    uint32_t idxCqTail = __atomic_load_n(pThis->pu32CqTail, __ATOMIC_ACQUIRE);
+
+    while (idxCqHead != idxCqTail)
+    {
+        struct io_uring_cqe *pCqe = &pThis->paCqes[idxCqHead & pThis->fCqMask];
+
+        switch (pCqe->user_data)
+        {
+            case PSPURINGOP_RECV:
+            {
+                if (pCqe->res > 0 && (pCqe->flags & IORING_CQE_F_BUFFER))
+                {
+                    PPSPURINGRXBUF pRxBuf = &pThis->aRxBufs[(pThis->idxRxHead + pThis->cRxBufs) % ELEMENTS(pThis->aRxBufs)];
+
+                    pRxBuf->idBuf   = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    pRxBuf->offData = 0;
+                    pRxBuf->cbData  = pCqe->res;
+                    pThis->cRxBufs++;
+                    pThis->cbRxAvail += pCqe->res;
+                }
+                else if (!pCqe->res)
+                    pThis->rcRecv = -1; /* Connection closed. */
+                else if (   pCqe->res == -EINVAL
+                         && pThis->fSocket
+                         && !pThis->fRecvSingleShot)
+                    pThis->fRecvSingleShot = true; /* Kernel without multishot receives, re-armed as a single shot one. */
+                else if (pCqe->res != -ENOBUFS && pCqe->res != -EINTR && pCqe->res != -EAGAIN)
+                    pThis->rcRecv = -1;
+
+                /* Out of buffers, errors or a plain read terminate the request, re-armed once buffers are available again. */
+                if (!(pCqe->flags & IORING_CQE_F_MORE))
+                    pThis->fRecvArmed = false;
+                break;
+            }
+            case PSPURINGOP_WRITE:
+            {
+                if (pCqe->res >= 0)
+                    pThis->cbWritten = pCqe->res;
+                else
+                    pThis->rcWrite = -1;
+                pThis->fWritePending = false;
+                break;
+            }
+            case PSPURINGOP_INTR:
+            {
+                if (pCqe->res == sizeof(uint64_t))
+                    pThis->fIntrPending = true;
+                pThis->fIntrArmed = false;
+                break;
+            }
+            default:
+                break;
+        }
+
+        idxCqHead++;
+    }
+
+    __atomic_store_n(pThis->pu32CqHead, idxCqHead, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Queues the receive and interrupt requests if they are not in flight.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ */
+static void pspUringArm(PPSPPROXYPROVCTXINT pThis)
+{
+    if (   !pThis->fRecvArmed
+        && !pThis->rcRecv
+        && pThis->cRxBufs < PSP_URING_RX_BUF_COUNT)
+    {
+        struct io_uring_sqe *pSqe = pspUringSqeGet(pThis, PSPURINGOP_RECV);
+        if (pSqe)
+        {
+            if (pThis->fSocket)
+            {
+                pSqe->opcode = IORING_OP_RECV;
+                pSqe->ioprio = pThis->fRecvSingleShot ? 0 : IORING_RECV_MULTISHOT;
+                pSqe->len    = 0;
+            }
+            else
+            {
+                pSqe->opcode = IORING_OP_READ;
+                pSqe->len    = PSP_URING_RX_BUF_SZ;
+                pSqe->off    = (uint64_t)-1;
+            }
+            pSqe->fd        = pThis->iFd;
+            pSqe->flags     = IOSQE_BUFFER_SELECT;
+            pSqe->buf_group = PSP_URING_RX_BGID;
+            pThis->fRecvArmed = true;
+        }
+    }
+
+    if (!pThis->fIntrArmed)
+    {
+        struct io_uring_sqe *pSqe = pspUringSqeGet(pThis, PSPURINGOP_INTR);
+        if (pSqe)
+        {
+            pSqe->opcode = IORING_OP_READ;
+            pSqe->fd     = pThis->iFdEvtIntr;
+            pSqe->addr   = (uint64_t)(uintptr_t)&pThis->u64IntrCnt;
+            pSqe->len    = sizeof(pThis->u64IntrCnt);
+            pSqe->off    = (uint64_t)-1;
+            pThis->fIntrArmed = true;
+        }
+    }
+}
+
+
+/**
+ * Sets up the io_uring instance for the given descriptor.
+ *
+ * @returns Status code.
+ * @param   pThis                   The provider context.
+ */
+static int pspUringSetup(PPSPPROXYPROVCTXINT pThis)
+{
+    struct io_uring_params Params;
+    struct stat StatFd;
+
+    if (fstat(pThis->iFd, &StatFd))
+        return -1;
+    pThis->fSocket = S_ISSOCK(StatFd.st_mode);
+
+    memset(&Params, 0, sizeof(Params));
+    if (pThis->fSqPoll)
+    {
+        Params.flags          = IORING_SETUP_SQPOLL;
+        Params.sq_thread_idle = PSP_URING_SQPOLL_IDLE_MS;
+    }
+
+    pThis->iFdRing = syscall(__NR_io_uring_setup, PSP_URING_SQ_ENTRIES, &Params);
+    if (pThis->iFdRing < 0)
+        return -1;
+
+    if (   (Params.features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG))
+        != (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG))
+        return -1;
+
+    size_t cbSq = Params.sq_off.array + Params.sq_entries * sizeof(uint32_t);
+    size_t cbCq = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+    pThis->cbRings = cbSq > cbCq ? cbSq : cbCq;
+    pThis->pvRings = mmap(NULL, pThis->cbRings, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          pThis->iFdRing, IORING_OFF_SQ_RING);
+    if (pThis->pvRings == MAP_FAILED)
+    {
+        pThis->pvRings = NULL;
+        return -1;
+    }
+
+    pThis->cbSqes = Params.sq_entries * sizeof(struct io_uring_sqe);
+    pThis->paSqes = mmap(NULL, pThis->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         pThis->iFdRing, IORING_OFF_SQES);
+    if (pThis->paSqes == MAP_FAILED)
+    {
+        pThis->paSqes = NULL;
+        return -1;
+    }
+
+    uint8_t *pbRings = (uint8_t *)pThis->pvRings;
+    pThis->pu32SqHead   = (uint32_t *)(pbRings + Params.sq_off.head);
+    pThis->pu32SqTail   = (uint32_t *)(pbRings + Params.sq_off.tail);
+    pThis->pfSqFlags    = (uint32_t *)(pbRings + Params.sq_off.flags);
+    pThis->pau32SqArray = (uint32_t *)(pbRings + Params.sq_off.array);
+    pThis->fSqMask      = *(uint32_t *)(pbRings + Params.sq_off.ring_mask);
+    pThis->cSqEntries   = Params.sq_entries;
+    pThis->idxSqTail    = *pThis->pu32SqTail;
+    pThis->pu32CqHead   = (uint32_t *)(pbRings + Params.cq_off.head);
+    pThis->pu32CqTail   = (uint32_t *)(pbRings + Params.cq_off.tail);
+    pThis->fCqMask      = *(uint32_t *)(pbRings + Params.cq_off.ring_mask);
+    pThis->paCqes       = (struct io_uring_cqe *)(pbRings + Params.cq_off.cqes);
+
+    /* Entries are always used in ring order, so the index array is an identity mapping. */
+    for (uint32_t i = 0; i < pThis->cSqEntries; i++)
+        pThis->pau32SqArray[i] = i;
+
+    /* Register the transmit buffer. */
+    pThis->pbTx = mmap(NULL, PSP_URING_TX_BUF_SZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pThis->pbTx == MAP_FAILED)
+    {
+        pThis->pbTx = NULL;
+        return -1;
+    }
+
+    struct iovec IovTx = { pThis->pbTx, PSP_URING_TX_BUF_SZ };
+    if (syscall(__NR_io_uring_register, pThis->iFdRing, IORING_REGISTER_BUFFERS, &IovTx, 1))
+        return -1;
+
+    /* Set up the provided buffer ring for receiving and fill it with all buffers. */
+    pThis->pbRx = mmap(NULL, PSP_URING_RX_BUF_COUNT * PSP_URING_RX_BUF_SZ, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pThis->pbRx == MAP_FAILED)
+    {
+        pThis->pbRx = NULL;
+        return -1;
+    }
+
+    pThis->cbBufRing = PSP_URING_RX_BUF_COUNT * sizeof(struct io_uring_buf);
+    pThis->pBufRing  = mmap(NULL, pThis->cbBufRing, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pThis->pBufRing == MAP_FAILED)
+    {
+        pThis->pBufRing = NULL;
+        return -1;
+    }
+
+    struct io_uring_buf_reg BufReg;
+    memset(&BufReg, 0, sizeof(BufReg));
+    BufReg.ring_addr    = (uint64_t)(uintptr_t)pThis->pBufRing;
+    BufReg.ring_entries = PSP_URING_RX_BUF_COUNT;
+    BufReg.bgid         = PSP_URING_RX_BGID;
+    if (syscall(__NR_io_uring_register, pThis->iFdRing, IORING_REGISTER_PBUF_RING, &BufReg, 1))
+        return -1;
+
+    pThis->idxBufRingTail = 0;
+    for (uint16_t i = 0; i < PSP_URING_RX_BUF_COUNT; i++)
+        pspUringRxBufReturn(pThis, i);
+
+    /*
+     * The reads must block in the kernel instead of failing with EAGAIN. Only changed now that nothing
+     * can fail anymore, the inner provider relies on a non-blocking descriptor when falling back.
+     */
+    int fFlFd = fcntl(pThis->iFd, F_GETFL);
+    if (fFlFd == -1)
+        return -1;
+    if (   (fFlFd & O_NONBLOCK)
+        && fcntl(pThis->iFd, F_SETFL, fFlFd & ~O_NONBLOCK))
+        return -1;
+    pThis->fFlFdOrig = fFlFd;
+
+    pspUringArm(pThis);
+    return pspUringEnter(pThis, false /*fWait*/, 0);
+}
+
+
+/**
+ * Frees all io_uring related resources.
+ *
+ * @returns nothing.
+ * @param   pThis                   The provider context.
+ */
+static void pspUringTeardown(PPSPPROXYPROVCTXINT pThis)
+{
+    /* Closing the ring cancels everything in flight. */
+    if (pThis->iFdRing > -1)
+        close(pThis->iFdRing);
+    if (pThis->pBufRing)
+        munmap(pThis->pBufRing, pThis->cbBufRing);
+    if (pThis->pbRx)
+        munmap(pThis->pbRx, PSP_URING_RX_BUF_COUNT * PSP_URING_RX_BUF_SZ);
+    if (pThis->pbTx)
+        munmap(pThis->pbTx, PSP_URING_TX_BUF_SZ);
+    if (pThis->paSqes)
+        munmap(pThis->paSqes, pThis->cbSqes);
+    if (pThis->pvRings)
+        munmap(pThis->pvRings, pThis->cbRings);
+    if (pThis->fFlFdOrig != -1)
+        fcntl(pThis->iFd, F_SETFL, pThis->fFlFdOrig);
+
+    pThis->fFlFdOrig = -1;
+    pThis->iFdRing   = -1;
+    pThis->pBufRing  = NULL;
+    pThis->pbRx      = NULL;
+    pThis->pbTx      = NULL;
+    pThis->paSqes    = NULL;
+    pThis->pvRings   = NULL;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInit}
+ */
+static int uringProvCtxInit(PSPPROXYPROVCTX hProvCtx, const char *pszDevice)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    const char *pszDevRem = NULL;
+
+    pThis->iFdRing    = -1;
+    pThis->iFdEvtIntr = -1;
+    pThis->fFlFdOrig  = -1;
+    if (!strncmp(pszDevice, "sqpoll,", sizeof("sqpoll,") - 1))
+    {
+        pThis->fSqPoll = true;
+        pszDevice += sizeof("sqpoll,") - 1;
+    }
+
+    pThis->pProvInner = pspProxyProvFind(pszDevice, &pszDevRem);
+    if (   !pThis->pProvInner
+        || !pThis->pProvInner->pfnCtxRead)
+        return -1;
+
+    pThis->hProvCtxInner = (PSPPROXYPROVCTX)calloc(1, pThis->pProvInner->cbCtx);
+    if (!pThis->hProvCtxInner)
+        return -1;
+
+    int rc = pThis->pProvInner->pfnCtxInit(pThis->hProvCtxInner, pszDevRem);
+    if (!rc)
+    {
+        if (   pThis->pProvInner->pfnCtxQueryFd
+            && !pThis->pProvInner->pfnCtxQueryFd(pThis->hProvCtxInner, &pThis->iFd))
+        {
+            pThis->iFdEvtIntr = eventfd(0, EFD_CLOEXEC); /* Blocking, the ring waits for it to become readable. */
+            if (   pThis->iFdEvtIntr > -1
+                && !pspUringSetup(pThis))
+                return 0;
+
+            pspUringTeardown(pThis);
+            if (pThis->iFdEvtIntr > -1)
+                close(pThis->iFdEvtIntr);
+            pThis->iFdEvtIntr = -1;
+        }
+
+        /* io_uring is not available or the inner provider doesn't expose a descriptor. */
+        pThis->fFallback = true;
+        return 0;
+    }
+
+    free(pThis->hProvCtxInner);
+    pThis->hProvCtxInner = NULL;
+    return rc;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxDestroy}
+ */
+static void uringProvCtxDestroy(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (!pThis->fFallback)
+    {
+        pspUringTeardown(pThis);
+        close(pThis->iFdEvtIntr);
+        pThis->iFdEvtIntr = -1;
+    }
+
+    pThis->pProvInner->pfnCtxDestroy(pThis->hProvCtxInner);
+    free(pThis->hProvCtxInner);
+    pThis->hProvCtxInner = NULL;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPeek}
+ */
+static size_t uringProvCtxPeek(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->fFallback)
+        return pThis->pProvInner->pfnCtxPeek(pThis->hProvCtxInner);
+
+    pspUringCqReap(pThis);
+    return pThis->cbRxAvail;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxRead}
+ */
+static int uringProvCtxRead(PSPPROXYPROVCTX hProvCtx, void *pvDst, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    uint8_t *pbDst = (uint8_t *)pvDst;
+    size_t cbThisRead = 0;
+
+    if (pThis->fFallback)
+        return pThis->pProvInner->pfnCtxRead(pThis->hProvCtxInner, pvDst, cbRead, pcbRead);
+
+    pspUringCqReap(pThis);
+    while (cbRead && pThis->cRxBufs)
+    {
+        PPSPURINGRXBUF pRxBuf = &pThis->aRxBufs[pThis->idxRxHead];
+        size_t cbCopy = MIN(cbRead, pRxBuf->cbData - pRxBuf->offData);
+
+        memcpy(pbDst, &pThis->pbRx[pRxBuf->idBuf * PSP_URING_RX_BUF_SZ + pRxBuf->offData], cbCopy);
+        pbDst            += cbCopy;
+        cbRead           -= cbCopy;
+        cbThisRead       += cbCopy;
+        pRxBuf->offData  += cbCopy;
+        pThis->cbRxAvail -= cbCopy;
+        if (pRxBuf->offData == pRxBuf->cbData)
+        {
+            pspUringRxBufReturn(pThis, pRxBuf->idBuf);
+            pThis->idxRxHead = (pThis->idxRxHead + 1) % ELEMENTS(pThis->aRxBufs);
+            pThis->cRxBufs--;
+        }
+    }
+
+    if (pcbRead)
+    {
+        *pcbRead = cbThisRead;
+        return 0;
+    }
+
+    return cbRead ? -1 : 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWriteV}
+ */
+static int uringProvCtxWriteV(PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    unsigned idxIov = 0;
+    size_t offIov = 0;
+
+    if (pThis->fFallback)
+    {
+        if (pThis->pProvInner->pfnCtxWriteV)
+            return pThis->pProvInner->pfnCtxWriteV(pThis->hProvCtxInner, paIov, cIov);
+
+        for (unsigned i = 0; i < cIov; i++)
+        {
+            int rc = pThis->pProvInner->pfnCtxWrite(pThis->hProvCtxInner, paIov[i].iov_base, paIov[i].iov_len);
+            if (rc)
+                return rc;
+        }
+
+        return 0;
+    }
+
+    while (idxIov < cIov)
+    {
+        /* Gather as much as fits into the transmit buffer. */
+        size_t cbTx = 0;
+        while (idxIov < cIov && cbTx < PSP_URING_TX_BUF_SZ)
+        {
+            size_t cbCopy = MIN(paIov[idxIov].iov_len - offIov, PSP_URING_TX_BUF_SZ - cbTx);
+
+            memcpy(&pThis->pbTx[cbTx], (const uint8_t *)paIov[idxIov].iov_base + offIov, cbCopy);
+            cbTx   += cbCopy;
+            offIov += cbCopy;
+            if (offIov == paIov[idxIov].iov_len)
+            {
+                idxIov++;
+                offIov = 0;
+            }
+        }
+
+        /* Write the gathered data, resubmitting the rest after short writes. */
+        size_t offTx = 0;
+        while (offTx < cbTx)
+        {
+            struct io_uring_sqe *pSqe = pspUringSqeGet(pThis, PSPURINGOP_WRITE);
+            if (!pSqe)
+                return -1;
+
+            pSqe->opcode    = IORING_OP_WRITE_FIXED;
+            pSqe->fd        = pThis->iFd;
+            pSqe->addr      = (uint64_t)(uintptr_t)&pThis->pbTx[offTx];
+            pSqe->len       = cbTx - offTx;
+            pSqe->off       = (uint64_t)-1;
+            pSqe->buf_index = 0;
+            pThis->fWritePending = true;
+            pThis->rcWrite       = 0;
+            pThis->cbWritten     = 0;
+
+            /* The buffer can't be reused before the write finished, the receive side is picked up on the way. */
+            pspUringArm(pThis);
+            while (pThis->fWritePending)
+            {
+                int rc = pspUringEnter(pThis, true /*fWait*/, UINT32_MAX);
+                if (rc && rc != STS_ERR_PSP_PROXY_TIMEOUT)
+                    return rc;
+                pspUringCqReap(pThis);
+            }
+
+            if (pThis->rcWrite || !pThis->cbWritten)
+                return -1;
+            offTx += pThis->cbWritten;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxWrite}
+ */
+static int uringProvCtxWrite(PSPPROXYPROVCTX hProvCtx, const void *pvPkt, size_t cbPkt)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->fFallback)
+        return pThis->pProvInner->pfnCtxWrite(pThis->hProvCtxInner, pvPkt, cbPkt);
+
+    struct iovec Iov = { (void *)pvPkt, cbPkt };
+    return uringProvCtxWriteV(hProvCtx, &Iov, 1);
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxPoll}
+ */
+static int uringProvCtxPoll(PSPPROXYPROVCTX hProvCtx, uint32_t cMillies)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->fFallback)
+        return pThis->pProvInner->pfnCtxPoll(pThis->hProvCtxInner, cMillies);
+
+    uint64_t tsDeadline = cMillies == UINT32_MAX ? UINT64_MAX : pspUringTimeMs() + cMillies;
+    bool fWaited = false;
+    for (;;)
+    {
+        pspUringCqReap(pThis);
+        if (pThis->cbRxAvail)
+            return 0;
+        if (pThis->fIntrPending)
+        {
+            pThis->fIntrPending = false;
+            return STS_ERR_PSP_PROXY_INTERRUPTED;
+        }
+        if (pThis->rcRecv)
+            return pThis->rcRecv;
+
+        uint64_t tsNow = pspUringTimeMs();
+        if (fWaited && tsNow >= tsDeadline)
+            return STS_ERR_PSP_PROXY_TIMEOUT;
+
+        pspUringArm(pThis);
+        uint64_t cMsLeft = tsDeadline > tsNow ? tsDeadline - tsNow : 0;
+        int rc = pspUringEnter(pThis, true /*fWait*/, (uint32_t)MIN(cMsLeft, UINT32_MAX));
+        if (rc && rc != STS_ERR_PSP_PROXY_TIMEOUT)
+            return rc;
+        fWaited = true;
+    }
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxInterrupt}
+ */
+static int uringProvCtxInterrupt(PSPPROXYPROVCTX hProvCtx)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    if (pThis->fFallback)
+    {
+        if (!pThis->pProvInner->pfnCtxInterrupt)
+            return -1;
+
+        return pThis->pProvInner->pfnCtxInterrupt(pThis->hProvCtxInner);
+    }
+
+    uint64_t uCnt = 1;
+    if (write(pThis->iFdEvtIntr, &uCnt, sizeof(uCnt)) != sizeof(uCnt))
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryStats}
+ */
+static int uringProvCtxQueryStats(PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+    PSPPROXYPROVSTATS StatsInner;
+
+    memset(&StatsInner, 0, sizeof(StatsInner));
+    if (pThis->pProvInner->pfnCtxQueryStats)
+        pThis->pProvInner->pfnCtxQueryStats(pThis->hProvCtxInner, &StatsInner);
+
+    pStats->cSyscalls = pThis->cSyscalls + StatsInner.cSyscalls;
+    return 0;
+}
+
+
+/**
+ * @copydoc{PSPPROXYPROV,pfnCtxQueryCaps}
+ */
+static int uringProvCtxQueryCaps(PSPPROXYPROVCTX hProvCtx, uint32_t *pfCaps)
+{
+    PPSPPROXYPROVCTXINT pThis = hProvCtx;
+
+    /* Without a ring everything is forwarded, only the statistics are always kept. */
+    if (pThis->fFallback)
+    {
+        *pfCaps = pspProxyProvCapsQuery(pThis->pProvInner, pThis->hProvCtxInner) | PSPPROXY_CAPS_F_PROV_STATS;
+        return 0;
+    }
+
+    return -1; /* Derive from the callbacks. */
+}
+
+
+/**
+ * Provider registration structure.
+ */
+const PSPPROXYPROV g_PspProxyProvUring =
+{
+    /** pszId */
+    "uring",
+    /** pszDesc */
+    "io_uring based transport for stream sockets and ttys, device schema looks like uring://[sqpoll,]<device>",
+    /** cbCtx */
+    sizeof(PSPPROXYPROVCTXINT),
+    /** fFeatures */
+    PSPPROXY_CAPS_F_ASYNC,
+    /** pfnCtxInit */
+    uringProvCtxInit,
+    /** pfnCtxDestroy */
+    uringProvCtxDestroy,
+    /** pfnCtxPeek */
+    uringProvCtxPeek,
+    /** pfnCtxRead */
+    uringProvCtxRead,
+    /** pfnCtxWrite */
+    uringProvCtxWrite,
+    /** pfnCtxPoll */
+    uringProvCtxPoll,
+    /** pfnCtxInterrupt */
+    uringProvCtxInterrupt,
+    /** pfnCtxX86SmnRead */
+    NULL,
+    /** pfnCtxX86SmnWrite */
+    NULL,
+    /** pfnCtxX86MemAlloc */
+    NULL,
+    /** pfnCtxX86MemFree */
+    NULL,
+    /** pfnCtxX86MemRead */
+    NULL,
+    /** pfnCtxX86MemWrite */
+    NULL,
+    /** pfnCtxX86PhysMemRead */
+    NULL,
+    /** pfnCtxX86PhysMemWrite */
+    NULL,
+    /** pfnCtxEmuWaitForWork */
+    NULL,
+    /** pfnCtxEmuSetResult */
+    NULL,
+    /** pfnCtxQueryStats */
+    uringProvCtxQueryStats,
+    /** pfnCtxWriteV */
+    uringProvCtxWriteV,
+    /** pfnCtxQueryFd */
+    NULL,
+    /** pfnCtxQueryInfo */
+    NULL,
+    /** pfnCtxPspSmnRead */
+    NULL,
+    /** pfnCtxPspSmnWrite */
+    NULL,
+    /** pfnCtxPspMemRead */
+    NULL,
+    /** pfnCtxPspMemWrite */
+    NULL,
+    /** pfnCtxPspMmioRead */
+    NULL,
+    /** pfnCtxPspMmioWrite */
+    NULL,
+    /** pfnCtxPspX86MemRead */
+    NULL,
+    /** pfnCtxPspX86MemWrite */
+    NULL,
+    /** pfnCtxPspX86MmioRead */
+    NULL,
+    /** pfnCtxPspX86MmioWrite */
+    NULL,
+    /** pfnCtxPspSvcCall */
+    NULL,
+    /** pfnCtxQueryCaps */
+    uringProvCtxQueryCaps
+};
+
@@ -22,12 +22,30 @@
 #ifndef __psp_proxy_provider_h
 #define __psp_proxy_provider_h
 
+#include <sys/uio.h>
+
 #include "libpspproxy.h"
 
 
 /** Opaque proxy provider context. */
 typedef struct PSPPROXYPROVCTXINT *PSPPROXYPROVCTX;
 
+
+/**
+ * Provider statistics.
+ */
+typedef struct PSPPROXYPROVSTATS
+{
+    /** Number of system calls done by the provider so far. */
+    uint64_t                    cSyscalls;
+    /** Number of times the remote side was checked for new data so far, only for transports without any
+     * notification mechanism. Preset to UINT64_MAX by the caller and left alone by other providers. */
+    uint64_t                    cRemotePolls;
+} PSPPROXYPROVSTATS;
+/** Pointer to provider statistics. */
+typedef PSPPROXYPROVSTATS *PPSPPROXYPROVSTATS;
+
+
 /**
  * The proxy provider struct.
  */
@@ -39,7 +57,8 @@ typedef struct PSPPROXYPROV
     const char                  *pszDesc;
     /** Size of the provider context structure passed around in bytes. */
     size_t                      cbCtx;
-    /** Feature flags. */
+    /** Feature flags, the PSPPROXY_CAPS_F_TRANSPORT_MASK part of PSPPROXY_CAPS_F_XXX. The other capabilities
+     * are derived from the callbacks implemented. */
     uint32_t                    fFeatures;
 
     /**
@@ -97,16 +116,20 @@ typedef struct PSPPROXYPROV
      * Blocks until data is available for reading.
      *
      * @returns Status code.
+     * @retval  STS_ERR_PSP_PROXY_TIMEOUT if no data arrived in time.
+     * @retval  STS_ERR_PSP_PROXY_INTERRUPTED if interrupted with pfnCtxInterrupt.
      * @param   hProvCtx                Provider context instance data.
      * @param   cMillies                Number of milliseconds to wait before returning a timeout error.
      */
     int    (*pfnCtxPoll) (PSPPROXYPROVCTX hProvCtx, uint32_t cMillies);
 
     /**
-     * Interrupt any polling.
+     * Interrupt any polling, if nobody is polling right now the next pfnCtxPoll call is interrupted.
      *
      * @returns Status code.
      * @param   hProvCtx                Provider context instance data.
+     *
+     * @note This is called from a different thread than the other callbacks.
      */
     int    (*pfnCtxInterrupt) (PSPPROXYPROVCTX hProvCtx);
 
@@ -218,6 +241,210 @@ typedef struct PSPPROXYPROV
      */
     int (*pfnCtxEmuSetResult) (PSPPROXYPROVCTX hProvCtx, uint32_t uResult);
 
+    /**
+     * Queries the provider statistics - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   pStats                  Where to store the statistics.
+     */
+    int (*pfnCtxQueryStats) (PSPPROXYPROVCTX hProvCtx, PPSPPROXYPROVSTATS pStats);
+
+    /**
+     * Writes a packet scattered over multiple buffers to the underlying transport layer in one go - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   paIov                   The buffers making up the packet.
+     * @param   cIov                    Number of buffers.
+     *
+     * @note Like pfnCtxWrite this should only return when the whole packet has been written or an unrecoverable
+     *       error occurred. If not implemented pfnCtxWrite is called for each buffer.
+     */
+    int (*pfnCtxWriteV) (PSPPROXYPROVCTX hProvCtx, const struct iovec *paIov, unsigned cIov);
+
+    /**
+     * Queries the file descriptor of the underlying byte stream - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   piFd                    Where to store the file descriptor.
+     *
+     * @note This is used by providers stacking on top of another one which take over the I/O
+     *       on the descriptor after the inner provider set up the connection. The descriptor
+     *       stays owned by the inner provider.
+     */
+    int (*pfnCtxQueryFd) (PSPPROXYPROVCTX hProvCtx, int *piFd);
+
+    /*
+     * The following callbacks are for providers having direct access to the PSP which don't go through
+     * the stub PDU protocol. If set they are called instead of sending the respective request to the stub.
+     * A provider without pfnCtxRead doesn't get a stub PDU context at all and must implement
+     * every PSP callback it wants to support natively.
+     */
+
+    /**
+     * Queries information about the given CCD - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to query.
+     * @param   pPspAddrScratchStart    Where to store the start of the scratch space area on success.
+     * @param   pcbScratch              Where to store the size of the scratch space area on success.
+     */
+    int (*pfnCtxQueryInfo) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR *pPspAddrScratchStart, size_t *pcbScratch);
+
+    /**
+     * Reads the register at the given SMN address, the access is initiated from the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID doing the access.
+     * @param   idCcdTgt                The CCD ID to target.
+     * @param   uSmnAddr                The SMN address/offset to access.
+     * @param   cbVal                   Size of the register, valid are 1, 2, 4 or 8 byte.
+     * @param   pvVal                   Where to store the value on success.
+     */
+    int (*pfnCtxPspSmnRead) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal);
+
+    /**
+     * Writes the register at the given SMN address, the access is initiated from the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID doing the access.
+     * @param   idCcdTgt                The CCD ID to target.
+     * @param   uSmnAddr                The SMN address/offset to access.
+     * @param   cbVal                   Size of the register, valid are 1, 2, 4 or 8 byte.
+     * @param   pvVal                   The value to write.
+     */
+    int (*pfnCtxPspSmnWrite) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, const void *pvVal);
+
+    /**
+     * Reads from the PSP SRAM - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   uPspAddr                The PSP address to read from.
+     * @param   pvBuf                   Where to store the read data.
+     * @param   cbRead                  How much to read.
+     */
+    int (*pfnCtxPspMemRead) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, void *pvBuf, uint32_t cbRead);
+
+    /**
+     * Writes to the PSP SRAM - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   uPspAddr                The PSP address to write to.
+     * @param   pvBuf                   The data to write.
+     * @param   cbWrite                 How much to write.
+     */
+    int (*pfnCtxPspMemWrite) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, const void *pvBuf, uint32_t cbWrite);
+
+    /**
+     * Reads a PSP MMIO register - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   uPspAddr                The PSP address of the register.
+     * @param   cbVal                   Size of the register.
+     * @param   pvVal                   Where to store the value on success.
+     */
+    int (*pfnCtxPspMmioRead) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, uint32_t cbVal, void *pvVal);
+
+    /**
+     * Writes a PSP MMIO register - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   uPspAddr                The PSP address of the register.
+     * @param   cbVal                   Size of the register.
+     * @param   pvVal                   The value to write.
+     */
+    int (*pfnCtxPspMmioWrite) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, PSPADDR uPspAddr, uint32_t cbVal, const void *pvVal);
+
+    /**
+     * Reads x86 memory through the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   PhysX86Addr             The physical x86 address to read from.
+     * @param   pvBuf                   Where to store the read data.
+     * @param   cbRead                  How much to read.
+     */
+    int (*pfnCtxPspX86MemRead) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, void *pvBuf, uint32_t cbRead);
+
+    /**
+     * Writes x86 memory through the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   PhysX86Addr             The physical x86 address to write to.
+     * @param   pvBuf                   The data to write.
+     * @param   cbWrite                 How much to write.
+     */
+    int (*pfnCtxPspX86MemWrite) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, const void *pvBuf, uint32_t cbWrite);
+
+    /**
+     * Reads a x86 MMIO register through the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   PhysX86Addr             The physical x86 address of the register.
+     * @param   cbVal                   Size of the register.
+     * @param   pvVal                   Where to store the value on success.
+     */
+    int (*pfnCtxPspX86MmioRead) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, uint32_t cbVal, void *pvVal);
+
+    /**
+     * Writes a x86 MMIO register through the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to access.
+     * @param   PhysX86Addr             The physical x86 address of the register.
+     * @param   cbVal                   Size of the register.
+     * @param   pvVal                   The value to write.
+     */
+    int (*pfnCtxPspX86MmioWrite) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, X86PADDR PhysX86Addr, uint32_t cbVal, const void *pvVal);
+
+    /**
+     * Executes a syscall on the PSP - optional.
+     *
+     * @returns Status code.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   idCcd                   The CCD ID to execute the syscall on.
+     * @param   idxSyscall              The syscall number.
+     * @param   u32R0                   Value for R0.
+     * @param   u32R1                   Value for R1.
+     * @param   u32R2                   Value for R2.
+     * @param   u32R3                   Value for R3.
+     * @param   pu32R0Return            Where to store the value of R0 after the syscall returned.
+     */
+    int (*pfnCtxPspSvcCall) (PSPPROXYPROVCTX hProvCtx, uint32_t idCcd, uint32_t idxSyscall, uint32_t u32R0, uint32_t u32R1,
+                             uint32_t u32R2, uint32_t u32R3, uint32_t *pu32R0Return);
+
+    /**
+     * Queries the capabilities of the given provider context - optional.
+     *
+     * Without it the capabilities are derived from fFeatures and the callbacks present, providers stacking on
+     * top of others have to implement it as their forwarding callbacks are present regardless of the inner provider.
+     *
+     * @returns Status code, on failure the capabilities are derived as if the callback wasn't implemented.
+     * @param   hProvCtx                Provider context instance data.
+     * @param   pfCaps                  Where to store the PSPPROXY_CAPS_F_XXX flags, excluding PSPPROXY_CAPS_F_STUB
+     *                                  which is determined by the library.
+     */
+    int (*pfnCtxQueryCaps) (PSPPROXYPROVCTX hProvCtx, uint32_t *pfCaps);
+
 } PSPPROXYPROV;
 /** Pointer to a proxy provider. */
 typedef PSPPROXYPROV *PPSPPROXYPROV;
@@ -225,4 +452,53 @@ typedef PSPPROXYPROV *PPSPPROXYPROV;
 typedef const PSPPROXYPROV *PCPSPPROXYPROV;
 
 
+/** Version of the provider plugin interface, plugins with a different major version (upper 16 bits) are rejected. */
+#define PSPPROXY_PROV_PLUGIN_VERSION    UINT32_C(0x00010001)
+/** Name of the PSPPROXYPROVPLUGIN symbol a provider plugin has to export. */
+#define PSPPROXY_PROV_PLUGIN_SYMBOL     "g_PspProxyProvPlugin"
+
+
+/**
+ * Provider plugin descriptor, exported by shared objects providing additional transports.
+ *
+ * Plugins are looked up by the scheme of the device URI when no built-in provider matches, as
+ * libpspproxy-prov-<scheme>.so in the directories listed in the PSPPROXY_PLUGIN_PATH environment
+ * variable (colon separated) and then in the plugin directory of the installation. The pszId
+ * of the provider must be equal to the scheme.
+ */
+typedef struct PSPPROXYPROVPLUGIN
+{
+    /** PSPPROXY_PROV_PLUGIN_VERSION the plugin was built against. */
+    uint32_t                    u32Version;
+    /** sizeof(PSPPROXYPROV) the plugin was built against, optional callbacks appended later are
+     * treated as not implemented for older plugins. */
+    uint32_t                    cbProv;
+    /** The provider. */
+    PCPSPPROXYPROV              pProv;
+} PSPPROXYPROVPLUGIN;
+/** Pointer to a const provider plugin descriptor. */
+typedef const PSPPROXYPROVPLUGIN *PCPSPPROXYPROVPLUGIN;
+
+
+/**
+ * Finds the appropriate proxy provider from the given device URI, for use by providers stacking on top of others.
+ *
+ * @returns Pointer to the matching provider or NULL if none was found.
+ * @param   pszDevice               The device URI to match.
+ * @param   ppszDevRem              Where to store the pointer to remainder of the device string passed to the provider
+ *                                  during initialization.
+ */
+PCPSPPROXYPROV pspProxyProvFind(const char *pszDevice, const char **ppszDevRem);
+
+
+/**
+ * Returns the capabilities of the given provider context, for use by providers stacking on top of others.
+ *
+ * @returns PSPPROXY_CAPS_F_XXX flags, see PSPPROXYPROV::pfnCtxQueryCaps.
+ * @param   pProv                   The provider.
+ * @param   hProvCtx                The provider context.
+ */
+uint32_t pspProxyProvCapsQuery(PCPSPPROXYPROV pProv, PSPPROXYPROVCTX hProvCtx);
+
+
 #endif /* !__psp_proxy_provider_h */
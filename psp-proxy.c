@@ -22,9 +22,15 @@
 
 #define _DEFAULT_SOURCE
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <assert.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <common/cdefs.h>
 
 #include "psp-proxy-provider.h"
 #include "psp-stub-pdu.h"
@@ -48,6 +54,70 @@ typedef struct PSPSCRATCHCHUNKFREE
 typedef PSPSCRATCHCHUNKFREE *PPSPSCRATCHCHUNKFREE;
 
 
+/** Shift of the smallest x86 memory pool block size. */
+#define PSP_X86_POOL_BLK_SHIFT_MIN      6
+/** Shift of the largest x86 memory pool block size, larger allocations go to the provider directly. */
+#define PSP_X86_POOL_BLK_SHIFT_MAX      16
+/** Number of x86 memory pool size classes. */
+#define PSP_X86_POOL_CLASSES            (PSP_X86_POOL_BLK_SHIFT_MAX - PSP_X86_POOL_BLK_SHIFT_MIN + 1)
+/** Number of hash buckets for looking up allocated x86 memory pool blocks. */
+#define PSP_X86_POOL_HASH_BUCKETS       256
+
+
+/**
+ * A contiguous region of x86 memory allocated from the provider for the pool.
+ */
+typedef struct PSPX86POOLREGION
+{
+    /** Pointer to the next region or NULL if end of list. */
+    struct PSPX86POOLREGION        *pNext;
+    /** R0 virtual address of the region. */
+    R0PTR                          R0KernVirtual;
+    /** Physical address of the region. */
+    X86PADDR                       PhysX86Addr;
+    /** Size of the region. */
+    size_t                         cbRegion;
+    /** Offset of the first byte not handed out yet. */
+    size_t                         offFree;
+} PSPX86POOLREGION;
+/** Pointer to an x86 memory pool region. */
+typedef PSPX86POOLREGION *PPSPX86POOLREGION;
+
+
+/**
+ * A block carved from an x86 memory pool region.
+ */
+typedef struct PSPX86POOLBLK
+{
+    /** Pointer to the next block in the free or hash bucket list. */
+    struct PSPX86POOLBLK           *pNext;
+    /** R0 virtual address of the block. */
+    R0PTR                          R0KernVirtual;
+    /** Physical address of the block. */
+    X86PADDR                       PhysX86Addr;
+    /** The size class of the block. */
+    uint32_t                       idxClass;
+} PSPX86POOLBLK;
+/** Pointer to an x86 memory pool block. */
+typedef PSPX86POOLBLK *PPSPX86POOLBLK;
+
+
+/**
+ * A loaded provider plugin.
+ */
+typedef struct PSPPROXYPLUGIN
+{
+    /** Pointer to the next plugin or NULL if end of list. */
+    struct PSPPROXYPLUGIN          *pNext;
+    /** The dlopen() handle, never closed as contexts might still use the provider. */
+    void                           *hLib;
+    /** Copy of the provider table, callbacks the plugin doesn't know about are NULL. */
+    PSPPROXYPROV                   Prov;
+} PSPPROXYPLUGIN;
+/** Pointer to a loaded provider plugin. */
+typedef PSPPROXYPLUGIN *PPSPPROXYPLUGIN;
+
+
 /**
  * Internal PSP proxy context.
  */
@@ -65,8 +135,18 @@ typedef struct PSPPROXYCTXINT
     PPSPSCRATCHCHUNKFREE            pScratchFreeHead;
     /** The provider used. */
     PCPSPPROXYPROV                  pProv;
-    /** The stub PDU context. */
+    /** The stub PDU context, NULL if the provider accesses the PSP natively. */
     PSPSTUBPDUCTX                   hPduCtx;
+    /** Provider system call counter value when the statistics were reset, native providers only. */
+    uint64_t                        cProvSyscallsStatsBase;
+    /** Size of new x86 memory pool regions, 0 if pooling is disabled. */
+    size_t                          cbX86PoolRegion;
+    /** List of x86 memory pool regions, most recently allocated is head. */
+    PPSPX86POOLREGION               pX86PoolRegions;
+    /** Free x86 memory pool blocks for each size class. */
+    PPSPX86POOLBLK                  apX86PoolFree[PSP_X86_POOL_CLASSES];
+    /** Allocated x86 memory pool blocks hashed by their R0 address. */
+    PPSPX86POOLBLK                  apX86PoolUsed[PSP_X86_POOL_HASH_BUCKETS];
     /** The provider specific context data, variable in size. */
     uint8_t                         abProvCtx[1];
 } PSPPROXYCTXINT;
@@ -74,23 +154,46 @@ typedef struct PSPPROXYCTXINT
 typedef PSPPROXYCTXINT *PPSPPROXYCTXINT;
 
 
-//extern const PSPPROXYPROV g_PspProxyProvSev;
+extern const PSPPROXYPROV g_PspProxyProvSev;
 extern const PSPPROXYPROV g_PspProxyProvSerial;
 extern const PSPPROXYPROV g_PspProxyProvTcp;
-//extern const PSPPROXYPROV g_PspProxyProvEm100Tcp;
+extern const PSPPROXYPROV g_PspProxyProvEm100Tcp;
+extern const PSPPROXYPROV g_PspProxyProvUnix;
+extern const PSPPROXYPROV g_PspProxyProvShm;
+extern const PSPPROXYPROV g_PspProxyProvSim;
+extern const PSPPROXYPROV g_PspProxyProvRecord;
+extern const PSPPROXYPROV g_PspProxyProvReplay;
+extern const PSPPROXYPROV g_PspProxyProvBond;
+#ifdef PSPPROXY_WITH_IO_URING
+extern const PSPPROXYPROV g_PspProxyProvUring;
+#endif
 
 /**
  * Array of known PSP proxy providers.
  */
 static PCPSPPROXYPROV g_apPspProxyProv[] =
 {
-//    &g_PspProxyProvSev,
+    &g_PspProxyProvSev,
     &g_PspProxyProvSerial,
     &g_PspProxyProvTcp,
-//    &g_PspProxyProvEm100Tcp,
+    &g_PspProxyProvEm100Tcp,
+    &g_PspProxyProvUnix,
+    &g_PspProxyProvShm,
+    &g_PspProxyProvSim,
+    &g_PspProxyProvRecord,
+    &g_PspProxyProvReplay,
+    &g_PspProxyProvBond,
+#ifdef PSPPROXY_WITH_IO_URING
+    &g_PspProxyProvUring,
+#endif
     NULL
 };
 
+/** List of loaded provider plugins, entries are never removed. */
+static PPSPPROXYPLUGIN g_pPspProxyPlugins = NULL;
+/** Protects g_pPspProxyPlugins and serializes loading plugins. */
+static pthread_mutex_t g_PspProxyPluginsMtx = PTHREAD_MUTEX_INITIALIZER;
+
 
 /**
  * Initializes the scratch space manager.
@@ -103,7 +206,12 @@ static int pspProxyCtxScratchSpaceMgrInit(PPSPPROXYCTXINT pThis)
     PSPADDR PspAddrScratchStart = 0;
     size_t cbScratch = 0;
 
-    int rc = pspStubPduCtxQueryInfo(pThis->hPduCtx, pThis->idCcd, &PspAddrScratchStart, &cbScratch);
+    int rc;
+    if (pThis->pProv->pfnCtxQueryInfo)
+        rc = pThis->pProv->pfnCtxQueryInfo((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd,
+                                           &PspAddrScratchStart, &cbScratch);
+    else
+        rc = pspStubPduCtxQueryInfo(pThis->hPduCtx, pThis->idCcd, &PspAddrScratchStart, &cbScratch);
     if (!rc)
     {
         /* Set up the first chunk covering the whole scratch space area. */
@@ -127,14 +235,417 @@ static int pspProxyCtxScratchSpaceMgrInit(PPSPPROXYCTXINT pThis)
 
 
 /**
- * Finds the appropriate proxy provider from the given device URI.
+ * Returns the hash bucket for the given R0 address of a pool block.
+ *
+ * @returns Bucket index.
+ * @param   R0KernVirtual           The R0 address.
+ */
+static inline uint32_t pspProxyCtxX86PoolHash(R0PTR R0KernVirtual)
+{
+    return (uint32_t)((R0KernVirtual >> PSP_X86_POOL_BLK_SHIFT_MIN) ^ (R0KernVirtual >> 16)) % PSP_X86_POOL_HASH_BUCKETS;
+}
+
+
+/**
+ * Puts the given unused range of a pool region onto the free lists, split into naturally aligned blocks.
+ *
+ * @returns nothing.
+ * @param   pThis                   The context instance.
+ * @param   pRegion                 The region the range belongs to.
+ * @param   offStart                Start offset of the range.
+ * @param   offEnd                  End offset (exclusive) of the range.
+ */
+static void pspProxyCtxX86PoolGapReclaim(PPSPPROXYCTXINT pThis, PPSPX86POOLREGION pRegion, size_t offStart, size_t offEnd)
+{
+    size_t cbBlkMin = (size_t)1 << PSP_X86_POOL_BLK_SHIFT_MIN;
+
+    offStart = ((pRegion->PhysX86Addr + offStart + cbBlkMin - 1) & ~((X86PADDR)cbBlkMin - 1)) - pRegion->PhysX86Addr;
+    while (offStart + cbBlkMin <= offEnd)
+    {
+        X86PADDR PhysX86Addr = pRegion->PhysX86Addr + offStart;
+        uint32_t idxClass = 0;
+        while (   idxClass + 1 < PSP_X86_POOL_CLASSES
+               && !(PhysX86Addr & (((X86PADDR)cbBlkMin << (idxClass + 1)) - 1))
+               && offStart + (cbBlkMin << (idxClass + 1)) <= offEnd)
+            idxClass++;
+
+        PPSPX86POOLBLK pBlk = (PPSPX86POOLBLK)malloc(sizeof(*pBlk));
+        if (!pBlk)
+            break; /* The range is lost, not a big deal. */
+
+        pBlk->R0KernVirtual = pRegion->R0KernVirtual + offStart;
+        pBlk->PhysX86Addr   = PhysX86Addr;
+        pBlk->idxClass      = idxClass;
+        pBlk->pNext         = pThis->apX86PoolFree[idxClass];
+        pThis->apX86PoolFree[idxClass] = pBlk;
+
+        offStart += cbBlkMin << idxClass;
+    }
+}
+
+
+/**
+ * Carves a new block of the given size class from the pool regions, allocating a new region if required.
+ *
+ * @returns Status code.
+ * @param   pThis                   The context instance.
+ * @param   idxClass                The size class.
+ * @param   pBlk                    The block descriptor to fill in.
+ */
+static int pspProxyCtxX86PoolCarve(PPSPPROXYCTXINT pThis, uint32_t idxClass, PPSPX86POOLBLK pBlk)
+{
+    size_t cbBlk = (size_t)1 << (idxClass + PSP_X86_POOL_BLK_SHIFT_MIN);
+    PPSPX86POOLREGION pRegion = pThis->pX86PoolRegions;
+
+    /* Blocks are naturally aligned by their physical address, so the tail of a region might not fit. */
+    for (; pRegion; pRegion = pRegion->pNext)
+    {
+        size_t offBlk = ((pRegion->PhysX86Addr + pRegion->offFree + cbBlk - 1) & ~((X86PADDR)cbBlk - 1)) - pRegion->PhysX86Addr;
+        if (offBlk + cbBlk <= pRegion->cbRegion)
+        {
+            pspProxyCtxX86PoolGapReclaim(pThis, pRegion, pRegion->offFree, offBlk);
+            pRegion->offFree = offBlk;
+            break;
+        }
+    }
+
+    if (!pRegion)
+    {
+        pRegion = (PPSPX86POOLREGION)malloc(sizeof(*pRegion));
+        if (!pRegion)
+            return -1;
+
+        /* Try smaller regions if the provider can't come up with that much contiguous memory. */
+        int rc = -1;
+        size_t cbRegion = MAX(pThis->cbX86PoolRegion, cbBlk);
+        for (; cbRegion >= cbBlk; cbRegion /= 2)
+        {
+            rc = pThis->pProv->pfnCtxX86MemAlloc((PSPPROXYPROVCTX)&pThis->abProvCtx[0], (uint32_t)cbRegion,
+                                                 &pRegion->R0KernVirtual, &pRegion->PhysX86Addr);
+            if (!rc)
+                break;
+        }
+        if (rc)
+        {
+            free(pRegion);
+            return rc;
+        }
+
+        pRegion->cbRegion = cbRegion;
+        pRegion->offFree  = ((pRegion->PhysX86Addr + cbBlk - 1) & ~((X86PADDR)cbBlk - 1)) - pRegion->PhysX86Addr;
+        if (pRegion->offFree + cbBlk > cbRegion)
+            pRegion->offFree = 0; /* Provider memory not aligned to the block size, better than nothing. */
+        pspProxyCtxX86PoolGapReclaim(pThis, pRegion, 0, pRegion->offFree);
+        pRegion->pNext = pThis->pX86PoolRegions;
+        pThis->pX86PoolRegions = pRegion;
+    }
+
+    pBlk->R0KernVirtual = pRegion->R0KernVirtual + pRegion->offFree;
+    pBlk->PhysX86Addr   = pRegion->PhysX86Addr + pRegion->offFree;
+    pBlk->idxClass      = idxClass;
+    pRegion->offFree   += cbBlk;
+    return 0;
+}
+
+
+/**
+ * Allocates a block from the x86 memory pool.
+ *
+ * @returns Status code.
+ * @param   pThis                   The context instance.
+ * @param   cbMem                   Number of bytes to allocate, at most the largest block size.
+ * @param   pR0KernVirtual          Where to store the R0 virtual address of the block on success.
+ * @param   pPhysX86Addr            Where to store the X86 physical address of the block on success.
+ */
+static int pspProxyCtxX86PoolAlloc(PPSPPROXYCTXINT pThis, uint32_t cbMem, R0PTR *pR0KernVirtual, X86PADDR *pPhysX86Addr)
+{
+    uint32_t idxClass = 0;
+    while (((uint32_t)1 << (idxClass + PSP_X86_POOL_BLK_SHIFT_MIN)) < cbMem)
+        idxClass++;
+
+    PPSPX86POOLBLK pBlk = pThis->apX86PoolFree[idxClass];
+    if (pBlk)
+    {
+        /* Don't leak whatever the previous user left in the block. */
+        static const uint8_t s_abZero[(size_t)1 << PSP_X86_POOL_BLK_SHIFT_MAX] = { 0 };
+        int rc = pThis->pProv->pfnCtxX86MemWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pBlk->R0KernVirtual,
+                                                 &s_abZero[0], (uint32_t)1 << (idxClass + PSP_X86_POOL_BLK_SHIFT_MIN));
+        if (rc)
+            return rc;
+
+        pThis->apX86PoolFree[idxClass] = pBlk->pNext;
+    }
+    else
+    {
+        pBlk = (PPSPX86POOLBLK)malloc(sizeof(*pBlk));
+        if (!pBlk)
+            return -1;
+
+        int rc = pspProxyCtxX86PoolCarve(pThis, idxClass, pBlk);
+        if (rc)
+        {
+            free(pBlk);
+            return rc;
+        }
+    }
+
+    uint32_t idxBucket = pspProxyCtxX86PoolHash(pBlk->R0KernVirtual);
+    pBlk->pNext = pThis->apX86PoolUsed[idxBucket];
+    pThis->apX86PoolUsed[idxBucket] = pBlk;
+
+    *pR0KernVirtual = pBlk->R0KernVirtual;
+    *pPhysX86Addr   = pBlk->PhysX86Addr;
+    return 0;
+}
+
+
+/**
+ * Returns the given block to the x86 memory pool.
+ *
+ * @returns Flag whether the address belonged to a pool block.
+ * @param   pThis                   The context instance.
+ * @param   R0KernVirtual           The R0 virtual address to free.
+ */
+static bool pspProxyCtxX86PoolFree(PPSPPROXYCTXINT pThis, R0PTR R0KernVirtual)
+{
+    PPSPX86POOLBLK *ppBlk = &pThis->apX86PoolUsed[pspProxyCtxX86PoolHash(R0KernVirtual)];
+
+    for (PPSPX86POOLBLK pBlk = *ppBlk; pBlk; ppBlk = &pBlk->pNext, pBlk = pBlk->pNext)
+    {
+        if (pBlk->R0KernVirtual == R0KernVirtual)
+        {
+            *ppBlk = pBlk->pNext;
+            pBlk->pNext = pThis->apX86PoolFree[pBlk->idxClass];
+            pThis->apX86PoolFree[pBlk->idxClass] = pBlk;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * Destroys the x86 memory pool, returning all regions to the provider.
+ *
+ * @returns nothing.
+ * @param   pThis                   The context instance.
+ */
+static void pspProxyCtxX86PoolDestroy(PPSPPROXYCTXINT pThis)
+{
+    for (uint32_t i = 0; i < PSP_X86_POOL_CLASSES; i++)
+    {
+        while (pThis->apX86PoolFree[i])
+        {
+            PPSPX86POOLBLK pBlk = pThis->apX86PoolFree[i];
+            pThis->apX86PoolFree[i] = pBlk->pNext;
+            free(pBlk);
+        }
+    }
+
+    for (uint32_t i = 0; i < PSP_X86_POOL_HASH_BUCKETS; i++)
+    {
+        while (pThis->apX86PoolUsed[i])
+        {
+            PPSPX86POOLBLK pBlk = pThis->apX86PoolUsed[i];
+            pThis->apX86PoolUsed[i] = pBlk->pNext;
+            free(pBlk);
+        }
+    }
+
+    while (pThis->pX86PoolRegions)
+    {
+        PPSPX86POOLREGION pRegion = pThis->pX86PoolRegions;
+        pThis->pX86PoolRegions = pRegion->pNext;
+        pThis->pProv->pfnCtxX86MemFree((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pRegion->R0KernVirtual);
+        free(pRegion);
+    }
+}
+
+
+/**
+ * Returns the built-in provider or already loaded plugin with the given ID.
+ *
+ * @returns Pointer to the provider or NULL if not found.
+ * @note Must be called with g_PspProxyPluginsMtx held.
+ * @param   pszId                   The provider ID.
+ * @param   cchId                   Length of the ID.
+ */
+static PCPSPPROXYPROV pspProxyProvFindById(const char *pszId, size_t cchId)
+{
+    for (PCPSPPROXYPROV *ppProv = &g_apPspProxyProv[0]; *ppProv; ppProv++)
+    {
+        if (   strlen((*ppProv)->pszId) == cchId
+            && !strncmp((*ppProv)->pszId, pszId, cchId))
+            return *ppProv;
+    }
+
+    for (PPSPPROXYPLUGIN pPlugin = g_pPspProxyPlugins; pPlugin; pPlugin = pPlugin->pNext)
+    {
+        if (   strlen(pPlugin->Prov.pszId) == cchId
+            && !strncmp(pPlugin->Prov.pszId, pszId, cchId))
+            return &pPlugin->Prov;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Loads the given provider plugin.
+ *
+ * @returns Pointer to the provider on success, NULL on failure.
+ * @param   pszPath                 Path of the shared object.
+ * @param   pszId                   The provider ID the plugin must have, NULL to accept any.
  *
- * @returns Pointer to the matching provider or NULL if none was found.
- * @param   pszDevice               The device URI to match.
- * @param   ppszDevRem              Where to store the pointer to remainder of the device string passed to the provider
- *                                  during initialization.
+ * @note Must be called with g_PspProxyPluginsMtx held.
  */
-static PCPSPPROXYPROV pspProxyCtxProvFind(const char *pszDevice, const char **ppszDevRem)
+static PCPSPPROXYPROV pspProxyPluginLoad(const char *pszPath, const char *pszId)
+{
+    void *hLib = dlopen(pszPath, RTLD_NOW | RTLD_LOCAL);
+    if (!hLib)
+        return NULL;
+
+    PCPSPPROXYPROVPLUGIN pDesc = (PCPSPPROXYPROVPLUGIN)dlsym(hLib, PSPPROXY_PROV_PLUGIN_SYMBOL);
+    if (   pDesc
+        && (pDesc->u32Version >> 16) == (PSPPROXY_PROV_PLUGIN_VERSION >> 16)
+        && pDesc->cbProv >= offsetof(PSPPROXYPROV, pfnCtxX86SmnRead) /* Everything mandatory. */
+        && pDesc->pProv
+        && pDesc->pProv->pszId
+        && pDesc->pProv->pfnCtxInit
+        && pDesc->pProv->pfnCtxDestroy
+        && (   !pDesc->pProv->pfnCtxRead /* The stub PDU layer needs the complete transport. */
+            || (   pDesc->pProv->pfnCtxPeek
+                && pDesc->pProv->pfnCtxWrite
+                && pDesc->pProv->pfnCtxPoll
+                && pDesc->pProv->pfnCtxInterrupt))
+        && (!pszId || !strcmp(pDesc->pProv->pszId, pszId))
+        && !pspProxyProvFindById(pDesc->pProv->pszId, strlen(pDesc->pProv->pszId)))
+    {
+        PPSPPROXYPLUGIN pPlugin = (PPSPPROXYPLUGIN)calloc(1, sizeof(*pPlugin));
+        if (pPlugin)
+        {
+            memcpy(&pPlugin->Prov, pDesc->pProv, MIN(pDesc->cbProv, sizeof(pPlugin->Prov)));
+            pPlugin->hLib  = hLib;
+            pPlugin->pNext = g_pPspProxyPlugins;
+            g_pPspProxyPlugins = pPlugin;
+            return &pPlugin->Prov;
+        }
+    }
+
+    dlclose(hLib);
+    return NULL;
+}
+
+
+/**
+ * Tries to find a plugin for the given URI scheme in the plugin search path.
+ *
+ * @returns Pointer to the provider or NULL if not found.
+ * @param   pszScheme               The scheme.
+ * @param   cchScheme               Length of the scheme.
+ *
+ * @note Must be called with g_PspProxyPluginsMtx held.
+ */
+static PCPSPPROXYPROV pspProxyPluginFind(const char *pszScheme, size_t cchScheme)
+{
+    char szId[64];
+    char szPath[4096];
+
+    /* Don't let the scheme escape the plugin directory. */
+    if (   !cchScheme
+        || cchScheme >= sizeof(szId))
+        return NULL;
+    for (size_t i = 0; i < cchScheme; i++)
+    {
+        char ch = pszScheme[i];
+        if (!(   (ch >= 'a' && ch <= 'z')
+              || (ch >= '0' && ch <= '9')
+              || ch == '-'
+              || ch == '_'))
+            return NULL;
+    }
+    memcpy(&szId[0], pszScheme, cchScheme);
+    szId[cchScheme] = '\0';
+
+    const char *pszPath = getenv("PSPPROXY_PLUGIN_PATH");
+    while (pszPath && *pszPath)
+    {
+        const char *pszSep = strchr(pszPath, ':');
+        size_t cchDir = pszSep ? (size_t)(pszSep - pszPath) : strlen(pszPath);
+
+        if (   cchDir
+            && cchDir < sizeof(szPath) / 2)
+        {
+            snprintf(&szPath[0], sizeof(szPath), "%.*s/libpspproxy-prov-%s.so", (int)cchDir, pszPath, &szId[0]);
+            if (!access(&szPath[0], F_OK))
+            {
+                PCPSPPROXYPROV pProv = pspProxyPluginLoad(&szPath[0], &szId[0]);
+                if (pProv)
+                    return pProv;
+            }
+        }
+
+        pszPath = pszSep ? pszSep + 1 : NULL;
+    }
+
+#ifdef PSPPROXY_PLUGIN_DIR
+    snprintf(&szPath[0], sizeof(szPath), PSPPROXY_PLUGIN_DIR "/libpspproxy-prov-%s.so", &szId[0]);
+    if (!access(&szPath[0], F_OK))
+        return pspProxyPluginLoad(&szPath[0], &szId[0]);
+#endif
+
+    return NULL;
+}
+
+
+int PSPProxyProvPluginLoad(const char *pszPath)
+{
+    pthread_mutex_lock(&g_PspProxyPluginsMtx);
+    PCPSPPROXYPROV pProv = pspProxyPluginLoad(pszPath, NULL);
+    pthread_mutex_unlock(&g_PspProxyPluginsMtx);
+
+    return pProv ? 0 : -1;
+}
+
+
+uint32_t pspProxyProvCapsQuery(PCPSPPROXYPROV pProv, PSPPROXYPROVCTX hProvCtx)
+{
+    uint32_t fCaps = 0;
+
+    if (   pProv->pfnCtxQueryCaps
+        && !pProv->pfnCtxQueryCaps(hProvCtx, &fCaps))
+        return fCaps & ~PSPPROXY_CAPS_F_STUB;
+
+    fCaps = pProv->fFeatures & PSPPROXY_CAPS_F_TRANSPORT_MASK;
+    if (   pProv->pfnCtxPspMemRead
+        && pProv->pfnCtxPspMmioRead
+        && pProv->pfnCtxPspSmnRead)
+        fCaps |= PSPPROXY_CAPS_F_PSP_NATIVE;
+    if (pProv->pfnCtxPspSvcCall)
+        fCaps |= PSPPROXY_CAPS_F_PSP_SVC_CALL;
+    if (pProv->pfnCtxX86SmnRead)
+        fCaps |= PSPPROXY_CAPS_F_X86_SMN;
+    if (   pProv->pfnCtxX86MemAlloc
+        && pProv->pfnCtxX86MemRead
+        && pProv->pfnCtxX86MemWrite)
+        fCaps |= PSPPROXY_CAPS_F_X86_MEM;
+    if (pProv->pfnCtxX86PhysMemRead)
+        fCaps |= PSPPROXY_CAPS_F_X86_PHYS_MEM;
+    if (pProv->pfnCtxEmuWaitForWork)
+        fCaps |= PSPPROXY_CAPS_F_EMU;
+    if (pProv->pfnCtxInterrupt)
+        fCaps |= PSPPROXY_CAPS_F_INTERRUPT;
+    if (pProv->pfnCtxWriteV)
+        fCaps |= PSPPROXY_CAPS_F_WRITEV;
+    if (pProv->pfnCtxQueryStats)
+        fCaps |= PSPPROXY_CAPS_F_PROV_STATS;
+
+    return fCaps;
+}
+
+
+PCPSPPROXYPROV pspProxyProvFind(const char *pszDevice, const char **ppszDevRem)
 {
     size_t cchDevice = strlen(pszDevice);
     const char *pszSep = strchr(pszDevice, ':');
@@ -145,17 +656,17 @@ static PCPSPPROXYPROV pspProxyCtxProvFind(const char *pszDevice, const char **pp
         && pszSep[2] == '/')
     {
         size_t cchProv = pszSep - pszDevice;
-        PCPSPPROXYPROV *ppProv = &g_apPspProxyProv[0];
 
-        while (*ppProv)
+        /* The lock is held while loading so concurrent lookups don't load the same plugin twice. */
+        pthread_mutex_lock(&g_PspProxyPluginsMtx);
+        PCPSPPROXYPROV pProv = pspProxyProvFindById(pszDevice, cchProv);
+        if (!pProv)
+            pProv = pspProxyPluginFind(pszDevice, cchProv);
+        pthread_mutex_unlock(&g_PspProxyPluginsMtx);
+        if (pProv)
         {
-            if (!strncmp(pszDevice, (*ppProv)->pszId, cchProv))
-            {
-                *ppszDevRem = pszSep + 3;
-                return *ppProv; /* Found */
-            }
-
-            ppProv++;
+            *ppszDevRem = pszSep + 3;
+            return pProv;
         }
     }
 
@@ -169,7 +680,7 @@ int PSPProxyCtxCreate(PPSPPROXYCTX phCtx, const char *pszDevice, PCPSPPROXYIOIF
     int rc = 0;
 
     const char *pszDevRem = NULL;
-    PCPSPPROXYPROV pProv = pspProxyCtxProvFind(pszDevice, &pszDevRem);
+    PCPSPPROXYPROV pProv = pspProxyProvFind(pszDevice, &pszDevRem);
     if (pProv)
     {
         PPSPPROXYCTXINT pThis = (PPSPPROXYCTXINT)calloc(1, sizeof(*pThis) + pProv->cbCtx);
@@ -180,8 +691,16 @@ int PSPProxyCtxCreate(PPSPPROXYCTX phCtx, const char *pszDevice, PCPSPPROXYIOIF
             pThis->pvUser               = pvUser;
             pThis->fScratchSpaceMgrInit = 0;
             pThis->pProv                = pProv;
+            pThis->cbX86PoolRegion      = 0; /* Pooling is opt-in. */
             rc = pProv->pfnCtxInit((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pszDevRem);
-            if (!rc)
+            if (!rc && !pProv->pfnCtxRead)
+            {
+                /* The provider talks to the PSP directly, no stub to connect to. */
+                pThis->hPduCtx = NULL;
+                *phCtx = pThis;
+                return 0;
+            }
+            else if (!rc)
             {
                 /* Create the PDU context. */
                 rc = pspStubPduCtxCreate(&pThis->hPduCtx, pProv, (PSPPROXYPROVCTX)&pThis->abProvCtx[0],
@@ -217,7 +736,10 @@ void PSPProxyCtxDestroy(PSPPROXYCTX hCtx)
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
-    pspStubPduCtxDestroy(pThis->hPduCtx);
+    if (pThis->hPduCtx)
+        pspStubPduCtxDestroy(pThis->hPduCtx);
+    if (pThis->pX86PoolRegions)
+        pspProxyCtxX86PoolDestroy(pThis);
     pThis->pProv->pfnCtxDestroy((PSPPROXYPROVCTX)&pThis->abProvCtx[0]);
     free(pThis);
 }
@@ -236,13 +758,196 @@ int PSPProxyCtxQueryLastReqRc(PSPPROXYCTX hCtx, PSPSTS *pReqRcLast)
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxQueryLastReqRc(pThis->hPduCtx, pReqRcLast);
 }
 
+int PSPProxyCtxLogMsgBufSizeSet(PSPPROXYCTX hCtx, size_t cbLogMsgBuf)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxLogMsgBufSizeSet(pThis->hPduCtx, cbLogMsgBuf);
+}
+
+int PSPProxyCtxLogMsgQueryDropped(PSPPROXYCTX hCtx, uint64_t *pcbDropped)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxLogMsgQueryDropped(pThis->hPduCtx, pcbDropped);
+}
+
+int PSPProxyCtxQueryStats(PSPPROXYCTX hCtx, PPSPPROXYSTATS pStats)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+    {
+        PSPPROXYPROVSTATS ProvStats;
+
+        /* Only the provider counters are available without a stub connection. */
+        memset(pStats, 0, sizeof(*pStats));
+        ProvStats.cRemotePolls = UINT64_MAX;
+        if (   pThis->pProv->pfnCtxQueryStats
+            && !pThis->pProv->pfnCtxQueryStats((PSPPROXYPROVCTX)&pThis->abProvCtx[0], &ProvStats))
+            pStats->cProvSyscalls = ProvStats.cSyscalls - pThis->cProvSyscallsStatsBase;
+        else
+            pStats->cProvSyscalls = UINT64_MAX;
+        pStats->cProvRemotePolls = UINT64_MAX;
+        pStats->i32MsFwdMin      = INT32_MAX; /* No timestamped PDUs, so no delay samples. */
+        pStats->i32MsRevMin      = INT32_MAX;
+        return 0;
+    }
+
+    return pspStubPduCtxQueryStats(pThis->hPduCtx, pStats);
+}
+
+int PSPProxyCtxQueryCaps(PSPPROXYCTX hCtx, PPSPPROXYCAPS pCaps)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+    PCPSPPROXYPROV pProv = pThis->pProv;
+
+    memset(pCaps, 0, sizeof(*pCaps));
+    pCaps->pszProvId = pProv->pszId;
+    pCaps->fCaps     = pspProxyProvCapsQuery(pProv, (PSPPROXYPROVCTX)&pThis->abProvCtx[0]);
+    if (!pThis->hPduCtx)
+        pCaps->fCaps &= ~PSPPROXY_CAPS_F_INTERRUPT; /* Only interrupts waiting for stub PDUs. */
+
+    if (pThis->hPduCtx)
+        return pspStubPduCtxQueryCaps(pThis->hPduCtx, pCaps);
+
+    return 0;
+}
+
+int PSPProxyCtxQueryLastReqTiming(PSPPROXYCTX hCtx, PPSPPROXYREQTIMING pTiming)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxQueryLastReqTiming(pThis->hPduCtx, pTiming);
+}
+
+int PSPProxyCtxInterrupt(PSPPROXYCTX hCtx)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxInterrupt(pThis->hPduCtx);
+}
+
+int PSPProxyCtxReqTimeoutSet(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t cMillies)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxReqTimeoutSet(pThis->hPduCtx, enmReq, cMillies);
+}
+
+int PSPProxyCtxReqTimeoutQuery(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t *pcMillies)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxReqTimeoutQuery(pThis->hPduCtx, enmReq, pcMillies);
+}
+
+int PSPProxyCtxReqTimeoutAdaptiveSet(PSPPROXYCTX hCtx, uint32_t cMilliesMin)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxReqTimeoutAdaptiveSet(pThis->hPduCtx, cMilliesMin);
+}
+
+int PSPProxyCtxAutoResumeSet(PSPPROXYCTX hCtx, bool fAutoResume)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxAutoResumeSet(pThis->hPduCtx, fAutoResume);
+}
+
+int PSPProxyCtxResetStats(PSPPROXYCTX hCtx)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+    {
+        PSPPROXYPROVSTATS ProvStats;
+
+        if (   pThis->pProv->pfnCtxQueryStats
+            && !pThis->pProv->pfnCtxQueryStats((PSPPROXYPROVCTX)&pThis->abProvCtx[0], &ProvStats))
+            pThis->cProvSyscallsStatsBase = ProvStats.cSyscalls;
+        return 0;
+    }
+
+    return pspStubPduCtxResetStats(pThis->hPduCtx);
+}
+
+uint64_t PSPProxyStatsHistPercentileNs(PCPSPPROXYSTATSHIST pHist, double dPercentile)
+{
+    uint64_t cSamples = 0;
+
+    for (uint32_t i = 0; i < PSPPROXY_STATS_HIST_BUCKETS; i++)
+        cSamples += pHist->acSamples[i];
+
+    if (!cSamples)
+        return 0;
+
+    /* Nearest rank. */
+    double dRank = (double)cSamples * dPercentile / 100.0;
+    uint64_t cRank = (uint64_t)dRank;
+    if ((double)cRank < dRank)
+        cRank++;
+    if (!cRank)
+        cRank = 1;
+
+    uint64_t cSamplesSeen = 0;
+    uint32_t idxBucket = 0;
+    for (; idxBucket < PSPPROXY_STATS_HIST_BUCKETS - 1; idxBucket++)
+    {
+        cSamplesSeen += pHist->acSamples[idxBucket];
+        if (cSamplesSeen >= cRank)
+            break;
+    }
+
+    if (idxBucket < 16)
+        return idxBucket;
+
+    /* Upper bound of the bucket. */
+    uint32_t cShift = (idxBucket - 16) / 8 + 1;
+    uint64_t uSub = (idxBucket - 16) % 8;
+    return ((8 + uSub + 1) << cShift) - 1;
+}
+
 int PSPProxyCtxPspSmnRead(PSPPROXYCTX hCtx, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal)
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspSmnRead)
+        return pThis->pProv->pfnCtxPspSmnRead((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspSmnRead(pThis->hPduCtx, pThis->idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
 }
 
@@ -251,6 +956,11 @@ int PSPProxyCtxPspSmnWrite(PSPPROXYCTX hCtx, uint32_t idCcdTgt, SMNADDR uSmnAddr
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspSmnWrite)
+        return pThis->pProv->pfnCtxPspSmnWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspSmnWrite(pThis->hPduCtx, pThis->idCcd, idCcdTgt, uSmnAddr, cbVal, pvVal);
 }
 
@@ -259,6 +969,11 @@ int PSPProxyCtxPspMemRead(PSPPROXYCTX hCtx, PSPADDR uPspAddr, void *pvBuf, uint3
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspMemRead)
+        return pThis->pProv->pfnCtxPspMemRead((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, uPspAddr, pvBuf, cbRead);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspMemRead(pThis->hPduCtx, pThis->idCcd, uPspAddr, pvBuf, cbRead);
 }
 
@@ -267,6 +982,11 @@ int PSPProxyCtxPspMemWrite(PSPPROXYCTX hCtx, PSPADDR uPspAddr, const void *pvBuf
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspMemWrite)
+        return pThis->pProv->pfnCtxPspMemWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, uPspAddr, pvBuf, cbWrite);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspMemWrite(pThis->hPduCtx, pThis->idCcd, uPspAddr, pvBuf, cbWrite);
 }
 
@@ -275,6 +995,11 @@ int PSPProxyCtxPspMmioRead(PSPPROXYCTX hCtx, PSPADDR uPspAddr, uint32_t cbVal, v
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspMmioRead)
+        return pThis->pProv->pfnCtxPspMmioRead((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, uPspAddr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspMmioRead(pThis->hPduCtx, pThis->idCcd, uPspAddr, pvVal, cbVal);
 }
 
@@ -283,6 +1008,11 @@ int PSPProxyCtxPspMmioWrite(PSPPROXYCTX hCtx, PSPADDR uPspAddr, uint32_t cbVal,
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspMmioWrite)
+        return pThis->pProv->pfnCtxPspMmioWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, uPspAddr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspMmioWrite(pThis->hPduCtx, pThis->idCcd, uPspAddr, pvVal, cbVal);
 }
 
@@ -291,6 +1021,11 @@ int PSPProxyCtxPspX86MemRead(PSPPROXYCTX hCtx, X86PADDR PhysX86Addr, void *pvBuf
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspX86MemRead)
+        return pThis->pProv->pfnCtxPspX86MemRead((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, PhysX86Addr, pvBuf, cbRead);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspX86MemRead(pThis->hPduCtx, pThis->idCcd, PhysX86Addr, pvBuf, cbRead);
 }
 
@@ -299,6 +1034,11 @@ int PSPProxyCtxPspX86MemWrite(PSPPROXYCTX hCtx, X86PADDR PhysX86Addr, const void
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspX86MemWrite)
+        return pThis->pProv->pfnCtxPspX86MemWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, PhysX86Addr, pvBuf, cbWrite);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspX86MemWrite(pThis->hPduCtx, pThis->idCcd, PhysX86Addr, pvBuf, cbWrite);
 }
 
@@ -307,6 +1047,11 @@ int PSPProxyCtxPspX86MmioRead(PSPPROXYCTX hCtx, X86PADDR PhysX86Addr, uint32_t c
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspX86MmioRead)
+        return pThis->pProv->pfnCtxPspX86MmioRead((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, PhysX86Addr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspX86MmioRead(pThis->hPduCtx, pThis->idCcd, PhysX86Addr, pvVal, cbVal);
 }
 
@@ -315,6 +1060,11 @@ int PSPProxyCtxPspX86MmioWrite(PSPPROXYCTX hCtx, X86PADDR PhysX86Addr, uint32_t
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (pThis->pProv->pfnCtxPspX86MmioWrite)
+        return pThis->pProv->pfnCtxPspX86MmioWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd, PhysX86Addr, cbVal, pvVal);
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspX86MmioWrite(pThis->hPduCtx, pThis->idCcd, PhysX86Addr, pvVal, cbVal);
 }
 
@@ -323,11 +1073,9 @@ int PSPProxyCtxPspSvcCall(PSPPROXYCTX hCtx, uint32_t idxSyscall, uint32_t u32R0,
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
-#if 0 /** @todo Reintroduce again. */
     if (pThis->pProv->pfnCtxPspSvcCall)
         return pThis->pProv->pfnCtxPspSvcCall((PSPPROXYPROVCTX)&pThis->abProvCtx[0], pThis->idCcd,
                                               idxSyscall, u32R0, u32R1, u32R2, u32R3, pu32R0Return);
-#endif
 
     return -1;
 }
@@ -337,6 +1085,9 @@ int PSPProxyCtxPspAddrXfer(PSPPROXYCTX hCtx, PCPSPPROXYADDR pPspAddr, uint32_t f
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     if (   cbStride != 1
         && cbStride != 2
         && cbStride != 4)
@@ -358,6 +1109,9 @@ int PSPProxyCtxPspCoProcWrite(PSPPROXYCTX hCtx, uint8_t idCoProc, uint8_t idCrn,
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspCoProcWrite(pThis->hPduCtx, pThis->idCcd, idCoProc, idCrn, idCrm, idOpc1, idOpc2, u32Val);
 }
 
@@ -367,6 +1121,9 @@ int PSPProxyCtxPspCoProcRead(PSPPROXYCTX hCtx, uint8_t idCoProc, uint8_t idCrn,
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspCoProcRead(pThis->hPduCtx, pThis->idCcd, idCoProc, idCrn, idCrm, idOpc1, idOpc2, pu32Val);
 }
 
@@ -375,10 +1132,46 @@ int PSPProxyCtxPspWaitForIrq(PSPPROXYCTX hCtx, uint32_t *pidCcd, bool *pfIrq, bo
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspWaitForIrq(pThis->hPduCtx, pidCcd, pfIrq, pfFirq, cWaitMs);
 }
 
 
+int PSPProxyCtxIrqEvtCallbackSet(PSPPROXYCTX hCtx, PFNPSPPROXYIRQEVT pfnIrqEvt, void *pvUser)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxIrqEvtCallbackSet(pThis->hPduCtx, pfnIrqEvt, pvUser);
+}
+
+
+int PSPProxyCtxIrqEvtQueryFd(PSPPROXYCTX hCtx, int *piFd)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxIrqEvtQueryFd(pThis->hPduCtx, piFd);
+}
+
+
+int PSPProxyCtxIrqEvtQueryDropped(PSPPROXYCTX hCtx, uint64_t *pcEvtsDropped)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (!pThis->hPduCtx)
+        return -1;
+
+    return pspStubPduCtxIrqEvtQueryDropped(pThis->hPduCtx, pcEvtsDropped);
+}
+
+
 int PSPProxyCtxX86SmnRead(PSPPROXYCTX hCtx, uint16_t idNode, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal)
 {
     PPSPPROXYCTXINT pThis = hCtx;
@@ -414,7 +1207,28 @@ int PSPProxyCtxX86MemAlloc(PSPPROXYCTX hCtx, uint32_t cbMem, R0PTR *pR0KernVirtu
         return -1;
 
     if (pThis->pProv->pfnCtxX86MemAlloc)
-        return pThis->pProv->pfnCtxX86MemAlloc((PSPPROXYPROVCTX)&pThis->abProvCtx[0], cbMem, pR0KernVirtual, pPhysX86Addr);
+    {
+        R0PTR R0KernVirtual = 0;
+        X86PADDR PhysX86Addr = 0;
+        int rc;
+
+        if (   pThis->cbX86PoolRegion
+            && pThis->pProv->pfnCtxX86MemFree
+            && pThis->pProv->pfnCtxX86MemWrite
+            && cbMem <= ((uint32_t)1 << PSP_X86_POOL_BLK_SHIFT_MAX))
+            rc = pspProxyCtxX86PoolAlloc(pThis, cbMem, &R0KernVirtual, &PhysX86Addr);
+        else
+            rc = pThis->pProv->pfnCtxX86MemAlloc((PSPPROXYPROVCTX)&pThis->abProvCtx[0], cbMem, &R0KernVirtual, &PhysX86Addr);
+        if (!rc)
+        {
+            if (pR0KernVirtual)
+                *pR0KernVirtual = R0KernVirtual;
+            if (pPhysX86Addr)
+                *pPhysX86Addr = PhysX86Addr;
+        }
+
+        return rc;
+    }
 
     return -1;
 }
@@ -424,11 +1238,28 @@ int PSPProxyCtxX86MemFree(PSPPROXYCTX hCtx, R0PTR R0KernVirtual)
     PPSPPROXYCTXINT pThis = hCtx;
 
     if (pThis->pProv->pfnCtxX86MemFree)
+    {
+        if (pspProxyCtxX86PoolFree(pThis, R0KernVirtual))
+            return 0;
+
         return pThis->pProv->pfnCtxX86MemFree((PSPPROXYPROVCTX)&pThis->abProvCtx[0], R0KernVirtual);
+    }
 
     return -1;
 }
 
+int PSPProxyCtxX86MemPoolRegionSizeSet(PSPPROXYCTX hCtx, size_t cbRegion)
+{
+    PPSPPROXYCTXINT pThis = hCtx;
+
+    if (   cbRegion
+        && cbRegion < ((size_t)1 << PSP_X86_POOL_BLK_SHIFT_MAX))
+        return -1;
+
+    pThis->cbX86PoolRegion = cbRegion;
+    return 0;
+}
+
 int PSPProxyCtxX86MemRead(PSPPROXYCTX hCtx, void *pvDst, R0PTR R0KernVirtualSrc, uint32_t cbRead)
 {
     PPSPPROXYCTXINT pThis = hCtx;
@@ -443,10 +1274,8 @@ int PSPProxyCtxX86MemWrite(PSPPROXYCTX hCtx, R0PTR R0KernVirtualDst, const void
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
-#if 0 /** @todo Reintroduce again. */
     if (pThis->pProv->pfnCtxX86MemWrite)
         return pThis->pProv->pfnCtxX86MemWrite((PSPPROXYPROVCTX)&pThis->abProvCtx[0], R0KernVirtualDst, pvSrc, cbWrite);
-#endif
 
     return -1;
 }
@@ -663,6 +1492,9 @@ int PSPProxyCtxCodeModLoad(PSPPROXYCTX hCtx, const void *pvCm, size_t cbCm)
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspCodeModLoad(pThis->hPduCtx, pThis->idCcd, pvCm, cbCm);
 }
 
@@ -671,6 +1503,9 @@ int PSPProxyCtxCodeModExec(PSPPROXYCTX hCtx, uint32_t u32Arg0, uint32_t u32Arg1,
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxPspCodeModExec(pThis->hPduCtx, pThis->idCcd, u32Arg0, u32Arg1, u32Arg2, u32Arg3,
                                        pu32CmRet, cMillies);
 }
@@ -679,6 +1514,9 @@ int PSPProxyCtxBranchTo(PSPPROXYCTX hCtx, PSPPADDR PspAddrPc, bool fThumb, uint3
 {
     PPSPPROXYCTXINT pThis = hCtx;
 
+    if (!pThis->hPduCtx)
+        return -1;
+
     return pspStubPduCtxBranchTo(pThis->hPduCtx, pThis->idCcd, PspAddrPc, fThumb, pau32Gprs);
 }
 
@@ -0,0 +1,63 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - static tracepoints.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __psp_sdt_h
+#define __psp_sdt_h
+
+/*
+ * USDT probes under the "libpspproxy" provider, compiled in with -DPSPPROXY_WITH_SDT
+ * (CMake option PSPPROXY_SDT). An enabled but unattached probe is a single nop, when
+ * disabled the arguments are not evaluated at all. Usage example:
+ *
+ *     bpftrace -e 'usdt:libpspproxy.so:libpspproxy:req_done { @[arg0] = hist(arg3); }'
+ *
+ * Probes:
+ *     pdu_send(idCcd, enmRrnId, cbPayload, rc)            PDU handed to the provider.
+ *     pdu_recv(idCcd, enmRrnId, cbPayload, tsMillies)     Valid PDU received.
+ *     pdu_hdr_error(cbResyncSkipped)                      Received header failed validation.
+ *     pdu_chksum_error(idCcd, enmRrnId, cbPayload)        Received PDU failed checksum validation.
+ *     req_start(idCcd, enmReq, cbPayload)                 Request is about to be sent.
+ *     req_match(enmRrnId, cbPayload)                      Response matched the pending request.
+ *     req_done(enmReq, rc, rcReq, cNsRtt)                 Request completed (rcReq is 0 without response).
+ *     session_resume(cBeaconsSent, rc)                    Session resume after a target reset finished.
+ *     prov_poll(cMillies, rc)                             Provider poll returned.
+ *     prov_read(cbRequested, cbRead, rc)                  Provider read returned.
+ *     prov_write(cbWrite, rc)                             Provider write returned.
+ */
+#ifdef PSPPROXY_WITH_SDT
+# include <sys/sdt.h>
+
+# define PSPPROXY_PROBE1(a_Name, a_Arg1) \
+    DTRACE_PROBE1(libpspproxy, a_Name, a_Arg1)
+# define PSPPROXY_PROBE2(a_Name, a_Arg1, a_Arg2) \
+    DTRACE_PROBE2(libpspproxy, a_Name, a_Arg1, a_Arg2)
+# define PSPPROXY_PROBE3(a_Name, a_Arg1, a_Arg2, a_Arg3) \
+    DTRACE_PROBE3(libpspproxy, a_Name, a_Arg1, a_Arg2, a_Arg3)
+# define PSPPROXY_PROBE4(a_Name, a_Arg1, a_Arg2, a_Arg3, a_Arg4) \
+    DTRACE_PROBE4(libpspproxy, a_Name, a_Arg1, a_Arg2, a_Arg3, a_Arg4)
+#else
+# define PSPPROXY_PROBE1(a_Name, a_Arg1)                            do { } while (0)
+# define PSPPROXY_PROBE2(a_Name, a_Arg1, a_Arg2)                    do { } while (0)
+# define PSPPROXY_PROBE3(a_Name, a_Arg1, a_Arg2, a_Arg3)            do { } while (0)
+# define PSPPROXY_PROBE4(a_Name, a_Arg1, a_Arg2, a_Arg3, a_Arg4)    do { } while (0)
+#endif
+
+#endif /* !__psp_sdt_h */
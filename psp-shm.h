@@ -0,0 +1,108 @@
+/** @file
+ * PSP proxy library to interface with the hardware of the PSP - shared memory transport layout.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __psp_shm_h
+#define __psp_shm_h
+
+#include <stdint.h>
+
+/*
+ * The shared memory region starts with a PSPSHMHDR followed by the ring data areas. It is created
+ * and initialized by the side running the stub (bridge or emulator), the library attaches to it.
+ * Each direction is a single producer single consumer byte ring:
+ *     - offHead and offTail are free running byte counters, the ring size is a power of two.
+ *     - The producer copies the data in and publishes it with a release store to offHead. Afterwards
+ *       it increments u32DataSeq and does a FUTEX_WAKE on it if fDataWaiter is set.
+ *     - The consumer about to block sets fDataWaiter, reads u32DataSeq, re-checks offHead and waits
+ *       with FUTEX_WAIT on u32DataSeq for the read value. All of this has to be sequentially consistent.
+ *     - The space in the other direction works the same with offTail, u32SpaceSeq and fSpaceWaiter.
+ * The futexes are shared between processes, so the non private operations have to be used. A side
+ * going away sets its closed flag in fFlags and wakes up the data waiter of the ring it produces.
+ */
+
+/** The magic value of the shared memory header ('PSHM'). */
+#define PSP_SHM_MAGIC                   0x4d485350
+/** Current shared memory layout version. */
+#define PSP_SHM_VERSION                 1
+
+/** The library side closed the transport. */
+#define PSP_SHM_F_EXT_CLOSED            (1 << 0)
+/** The stub side closed the transport. */
+#define PSP_SHM_F_PSP_CLOSED            (1 << 1)
+
+
+/**
+ * A single direction ring header, the producer and consumer fields live in separate cache lines.
+ */
+typedef struct PSPSHMRING
+{
+    /** Size of the ring data area in bytes, must be a power of two. */
+    uint32_t                        cbRing;
+    /** Offset of the ring data area from the start of the region. */
+    uint32_t                        offData;
+    /** Reserved. */
+    uint32_t                        au32Rsvd0[14];
+    /** Producer: number of bytes written so far. */
+    volatile uint32_t               offHead;
+    /** Producer: incremented after new data was published. */
+    volatile uint32_t               u32DataSeq;
+    /** Consumer: set while blocked waiting for data. */
+    volatile uint32_t               fDataWaiter;
+    /** Reserved. */
+    uint32_t                        au32Rsvd1[13];
+    /** Consumer: number of bytes read so far. */
+    volatile uint32_t               offTail;
+    /** Consumer: incremented after space was freed. */
+    volatile uint32_t               u32SpaceSeq;
+    /** Producer: set while blocked waiting for space. */
+    volatile uint32_t               fSpaceWaiter;
+    /** Reserved. */
+    uint32_t                        au32Rsvd2[13];
+} PSPSHMRING;
+/** Pointer to a ring header. */
+typedef PSPSHMRING *PPSPSHMRING;
+
+
+/**
+ * The shared memory region header.
+ */
+typedef struct PSPSHMHDR
+{
+    /** Magic value (PSP_SHM_MAGIC), written last by the creator. */
+    volatile uint32_t               u32Magic;
+    /** Layout version (PSP_SHM_VERSION). */
+    uint32_t                        u32Version;
+    /** Size of the whole region in bytes. */
+    uint32_t                        cbRegion;
+    /** PSP_SHM_F_XXX flags. */
+    volatile uint32_t               fFlags;
+    /** Reserved. */
+    uint32_t                        au32Rsvd[12];
+    /** The library to stub ring. */
+    PSPSHMRING                      Ext2Psp;
+    /** The stub to library ring. */
+    PSPSHMRING                      Psp2Ext;
+} PSPSHMHDR;
+/** Pointer to a shared memory region header. */
+typedef PSPSHMHDR *PPSPSHMHDR;
+
+#endif /* !__psp_shm_h */
+
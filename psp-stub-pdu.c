@@ -23,16 +23,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include <common/status.h>
 #include <common/cdefs.h>
 #include <psp-stub/psp-serial-stub.h>
 
 #include "psp-stub-pdu.h"
+#include "psp-sdt.h"
 
 
-/** Maximum number of CCDs supported at the moment. */
-#define PSP_CCDS_MAX 16
+/** Number of IRQ events queued per CCD before the oldest ones get dropped. */
+#define PSP_STUB_PDU_IRQ_EVTS_PER_CCD           16
+/** Default size of the log message line assembly buffer (maximum length of a single log line). */
+#define PSP_STUB_PDU_LOG_MSG_LINE_SZ_DEFAULT    _4K
+/** Maximum number of log lines collected before they are handed to the callback. */
+#define PSP_STUB_PDU_LOG_MSG_BATCH_MAX          32
+/** Default request timeout in milliseconds. */
+#define PSP_STUB_PDU_REQ_TIMEOUT_MS_DEFAULT     10000
+/** Number of round trip time samples required before adaptive timeouts are used for a request type. */
+#define PSP_STUB_PDU_RTO_SAMPLES_MIN            8
+/** Maximum number of PDUs of abandoned requests which are remembered for discarding. */
+#define PSP_STUB_PDU_ABANDONED_MAX              8
+/** Minimum time in milliseconds a PDU of an abandoned request is waited for. */
+#define PSP_STUB_PDU_ABANDONED_EXPIRE_MS_MIN    10000
 
 
 /**
@@ -55,6 +71,36 @@ typedef enum PSPSERIALPDURECVSTATE
 } PSPSERIALPDURECVSTATE;
 
 
+/**
+ * Adaptive timeout state for a request type (RFC 6298 style estimator).
+ */
+typedef struct PSPSTUBPDURTO
+{
+    /** Smoothed round trip time in nanoseconds. */
+    uint64_t                    cNsSrtt;
+    /** Round trip time variation in nanoseconds. */
+    uint64_t                    cNsRttVar;
+    /** Number of samples taken since the last reset. */
+    uint32_t                    cSamples;
+} PSPSTUBPDURTO;
+/** Pointer to an adaptive timeout state. */
+typedef PSPSTUBPDURTO *PPSPSTUBPDURTO;
+
+
+/**
+ * PDU still outstanding for a request which was abandoned because it timed out or got interrupted.
+ */
+typedef struct PSPSTUBPDUABANDONED
+{
+    /** The Request/Response/Notification ID of the PDU. */
+    PSPSERIALPDURRNID           enmRrnId;
+    /** PDU sequence counter of the request the PDU is the response to, 0 for notifications. */
+    uint32_t                    cPdusReq;
+    /** Point in time after which the PDU is not expected anymore. */
+    uint64_t                    tsExpireNs;
+} PSPSTUBPDUABANDONED;
+
+
 /**
  * Internal PSP PDU context.
  */
@@ -86,6 +132,10 @@ typedef struct PSPSTUBPDUCTXINT
     uint8_t                     abPdu[4096];
     /** Flag whether a connection was established. */
     bool                        fConnect;
+    /** Flag whether the session is resumed automatically when the target resets. */
+    bool                        fAutoResume;
+    /** Flag whether the session was lost because resuming it after a target reset failed. */
+    bool                        fSessionLost;
     /** Maximum PDU length supported. */
     uint32_t                    cbPduMax;
     /** Status code of the last request. */
@@ -100,24 +150,537 @@ typedef struct PSPSTUBPDUCTXINT
     uint32_t                    cCcdsPerSocket;
     /** Total number of CCDs in the remote system. */
     uint32_t                    cCcds;
-    /** Log message buffer. */
-    char                        achLogMsg[1024];
-    /** Number of bytes valid in the log message buffer. */
-    size_t                      cchLogMsgAvail;
-    /** Number of CCDs for which we received a IRQ status change notification. */
-    uint32_t                    cCcdsIrqChange;
-    /** Array of per CCD IRQ notification received since last time flag. */
-    bool                        afPerCcdIrqNotRcvd[PSP_CCDS_MAX];
-    /** Array of per CCD IRQ flags. */
-    bool                        afPerCcdIrq[PSP_CCDS_MAX];
-    /** Array of per CCD FIRQ flags. */
-    bool                        afPerCcdFirq[PSP_CCDS_MAX];
+    /** Log message line assembly buffer holding the incomplete line received so far. */
+    char                        *pachLogMsgLine;
+    /** Size of the line assembly buffer in bytes. */
+    size_t                      cbLogMsgLine;
+    /** Number of characters of the incomplete line in the assembly buffer. */
+    size_t                      cchLogMsgLine;
+    /** CCD ID the incomplete line originated from. */
+    uint32_t                    idCcdLogMsgLine;
+    /** Target timestamp of the PDU which started the incomplete line. */
+    uint32_t                    tsLogMsgLine;
+    /** Flag whether the current line overflowed and is discarded up to the next newline. */
+    bool                        fLogMsgLineTrunc;
+    /** Number of log message bytes dropped so far. */
+    uint64_t                    cbLogMsgDropped;
+    /** String buffer holding the complete lines of the current batch. */
+    char                        *pachLogMsgBatch;
+    /** Size of the batch string buffer in bytes. */
+    size_t                      cbLogMsgBatch;
+    /** Offset of the next free byte in the batch string buffer. */
+    size_t                      offLogMsgBatch;
+    /** Number of lines in the current batch. */
+    uint32_t                    cLogMsgBatch;
+    /** The log lines of the current batch. */
+    PSPPROXYLOGMSG              aLogMsgBatch[PSP_STUB_PDU_LOG_MSG_BATCH_MAX];
+    /** IRQ event queue (ring buffer), sized according to the number of CCDs during connect. */
+    PPSPPROXYIRQEVT             paIrqEvts;
+    /** Number of entries in the IRQ event queue. */
+    uint32_t                    cIrqEvtsMax;
+    /** Index of the oldest queued IRQ event. */
+    uint32_t                    idxIrqEvtHead;
+    /** Number of IRQ events queued. */
+    uint32_t                    cIrqEvts;
+    /** Number of IRQ events dropped because the queue was full. */
+    uint64_t                    cIrqEvtsDropped;
+    /** IRQ event callback, NULL if events are queued. */
+    PFNPSPPROXYIRQEVT           pfnIrqEvt;
+    /** Opaque user data for the IRQ event callback. */
+    void                        *pvIrqEvtUser;
+    /** eventfd signalled when IRQ events are queued, -1 if not created yet. */
+    int                         iFdIrqEvt;
+    /** Statistics collected so far. */
+    PSPPROXYSTATS               Stats;
+    /** Number of log message bytes dropped when the statistics were reset. */
+    uint64_t                    cbLogMsgDroppedStatsBase;
+    /** Number of IRQ events dropped when the statistics were reset. */
+    uint64_t                    cIrqEvtsDroppedStatsBase;
+    /** Number of provider system calls when the statistics were reset. */
+    uint64_t                    cProvSyscallsStatsBase;
+    /** Number of provider remote polls when the statistics were reset. */
+    uint64_t                    cProvRemotePollsStatsBase;
+    /** Host timestamp in milliseconds of the last PDU sent. */
+    uint32_t                    tsHostMilliesSent;
+    /** Minimum forward delay observed since connecting in milliseconds (includes the clock offset). */
+    int32_t                     i32MsFwdMin;
+    /** Minimum reverse delay observed since connecting in milliseconds (includes the negated clock offset). */
+    int32_t                     i32MsRevMin;
+    /** Timing information of the last request which received a response. */
+    PSPPROXYREQTIMING           LastReqTiming;
+    /** Timeout in milliseconds for each request type. */
+    uint32_t                    acMsReqTimeout[PSPPROXYREQ_COUNT];
+    /** Lower bound of the adaptive timeouts in milliseconds, 0 if adaptive timeouts are disabled. */
+    uint32_t                    cMsReqTimeoutAdaptiveMin;
+    /** Adaptive timeout state for each request type. */
+    PSPSTUBPDURTO               aRto[PSPPROXYREQ_COUNT];
+    /** Number of valid entries in aAbandoned. */
+    uint32_t                    cAbandoned;
+    /** PDUs of abandoned requests which are discarded when they arrive late, oldest first. */
+    PSPSTUBPDUABANDONED         aAbandoned[PSP_STUB_PDU_ABANDONED_MAX];
+    /** Flag whether abPduLate holds a response discarded while waiting for a response of the same type. */
+    bool                        fPduLate;
+    /** Copy of the last response discarded as a late one which might have been the awaited response after all. */
+    uint8_t                     abPduLate[4096];
 } PSPSTUBPDUCTXINT;
 /** Pointer to an internal PSP proxy context. */
 typedef PSPSTUBPDUCTXINT *PPSPSTUBPDUCTXINT;
 
 
 
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ */
+static uint64_t pspStubPduCtxTimeNs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Converts the given monotonic timestamp to the millisecond timestamp used in the PDU header.
+ *
+ * @returns Timestamp in milliseconds (wraps around after ~49 days).
+ * @param   tsNs                    The timestamp in nanoseconds.
+ */
+static inline uint32_t pspStubPduCtxTsNsToMillies(uint64_t tsNs)
+{
+    return (uint32_t)(tsNs / 1000000ULL);
+}
+
+
+/**
+ * Returns the absolute deadline for the given timeout starting now.
+ *
+ * @returns Deadline in nanoseconds (monotonic clock).
+ * @param   cMillies                The timeout in milliseconds.
+ */
+static inline uint64_t pspStubPduCtxDeadlineFromMillies(uint32_t cMillies)
+{
+    return pspStubPduCtxTimeNs() + (uint64_t)cMillies * 1000000ULL;
+}
+
+
+/**
+ * Returns the number of milliseconds left until the given deadline.
+ *
+ * @returns Milliseconds left (rounded up), 0 if the deadline passed already.
+ * @param   tsDeadlineNs            The deadline in nanoseconds (monotonic clock).
+ */
+static uint32_t pspStubPduCtxDeadlineMsLeft(uint64_t tsDeadlineNs)
+{
+    uint64_t tsNowNs = pspStubPduCtxTimeNs();
+    if (tsNowNs >= tsDeadlineNs)
+        return 0;
+
+    uint64_t cMsLeft = (tsDeadlineNs - tsNowNs + 999999) / 1000000;
+    return cMsLeft < UINT32_MAX ? (uint32_t)cMsLeft : UINT32_MAX;
+}
+
+
+/**
+ * Returns the size of a PDU on the wire.
+ *
+ * @returns Size of the PDU in bytes, including header, padding and footer.
+ * @param   cbPayload               Size of the payload in bytes.
+ */
+static inline size_t pspStubPduCtxPduSz(size_t cbPayload)
+{
+    return sizeof(PSPSERIALPDUHDR) + ((cbPayload + 7) & ~(size_t)7) + sizeof(PSPSERIALPDUFOOTER);
+}
+
+
+/**
+ * Converts the given request ID to the request type used for the statistics and timeouts.
+ *
+ * @returns Request type or PSPPROXYREQ_COUNT if the given ID is not a request.
+ * @param   enmReq                  The request ID.
+ */
+static PSPPROXYREQ pspStubPduCtxStatsReqFromRrnId(PSPSERIALPDURRNID enmReq)
+{
+    switch (enmReq)
+    {
+        case PSPSERIALPDURRNID_REQUEST_CONNECT:             return PSPPROXYREQ_CONNECT;
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ:        return PSPPROXYREQ_PSP_SMN_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE:       return PSPPROXYREQ_PSP_SMN_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ:        return PSPPROXYREQ_PSP_MEM_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE:       return PSPPROXYREQ_PSP_MEM_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_READ:       return PSPPROXYREQ_PSP_MMIO_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE:      return PSPPROXYREQ_PSP_MMIO_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ:    return PSPPROXYREQ_PSP_X86_MEM_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE:   return PSPPROXYREQ_PSP_X86_MEM_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_READ:   return PSPPROXYREQ_PSP_X86_MMIO_READ;
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE:  return PSPPROXYREQ_PSP_X86_MMIO_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER:       return PSPPROXYREQ_PSP_DATA_XFER;
+        case PSPSERIALPDURRNID_REQUEST_COPROC_READ:         return PSPPROXYREQ_COPROC_READ;
+        case PSPSERIALPDURRNID_REQUEST_COPROC_WRITE:        return PSPPROXYREQ_COPROC_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_LOAD_CODE_MOD:       return PSPPROXYREQ_LOAD_CODE_MOD;
+        case PSPSERIALPDURRNID_REQUEST_EXEC_CODE_MOD:       return PSPPROXYREQ_EXEC_CODE_MOD;
+        case PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE:     return PSPPROXYREQ_INPUT_BUF_WRITE;
+        case PSPSERIALPDURRNID_REQUEST_BRANCH_TO:           return PSPPROXYREQ_BRANCH_TO;
+        default:
+            break;
+    }
+
+    return PSPPROXYREQ_COUNT;
+}
+
+
+/**
+ * Returns whether the given request can be issued again after the target reset without changing the outcome.
+ *
+ * Only plain memory accesses qualify, register and MMIO accesses might have side effects and
+ * everything executing code or feeding data to it must not be done twice.
+ *
+ * @returns Flag whether the request is idempotent.
+ * @param   enmReq                  The request ID.
+ */
+static bool pspStubPduCtxReqIsIdempotent(PSPSERIALPDURRNID enmReq)
+{
+    switch (enmReq)
+    {
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE:
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+
+/**
+ * Returns the latency histogram bucket for the given value, see PSPPROXY_STATS_HIST_BUCKETS for the layout.
+ *
+ * @returns Bucket index.
+ * @param   cNs                     The value in nanoseconds.
+ */
+static inline uint32_t pspStubPduCtxStatsHistIdx(uint64_t cNs)
+{
+    if (cNs < 16)
+        return (uint32_t)cNs;
+
+    uint32_t iMsb = 63 - __builtin_clzll(cNs);
+    if (iMsb > 36)
+        return PSPPROXY_STATS_HIST_BUCKETS - 1;
+
+    return 16 + (iMsb - 4) * 8 + ((cNs >> (iMsb - 3)) & 7);
+}
+
+
+/**
+ * Updates the per request type statistics after a request completed.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmReq                  The request ID.
+ * @param   pPduResp                The response PDU, NULL if no response was received.
+ * @param   rc                      Status code of the receive operation.
+ * @param   tsStartNs               Point in time the request was started.
+ * @param   tsSentNs                Point in time the request was handed to the provider completely.
+ */
+static void pspStubPduCtxStatsReqComplete(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmReq, PCPSPSERIALPDUHDR pPduResp,
+                                          int rc, uint64_t tsStartNs, uint64_t tsSentNs)
+{
+    PSPPROXYREQ enmStatsReq = pspStubPduCtxStatsReqFromRrnId(enmReq);
+    if (enmStatsReq == PSPPROXYREQ_COUNT)
+        return;
+
+    PPSPPROXYSTATSREQ pReq = &pThis->Stats.aReqs[enmStatsReq];
+    if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
+    {
+        pReq->cTimeouts++;
+        pThis->Stats.cTimeouts++;
+    }
+    else if (rc == STS_ERR_PSP_PROXY_INTERRUPTED)
+        pThis->Stats.cInterrupts++;
+
+    if (pPduResp)
+    {
+        uint64_t cNs = pspStubPduCtxTimeNs() - tsStartNs;
+        PPSPPROXYREQTIMING pTiming = &pThis->LastReqTiming;
+
+        /*
+         * The target timestamp is taken when the response is sent, so the difference to the host timestamp
+         * of the request consists of the clock offset, the link latency, any queuing and the processing time.
+         * The minimum serves as the baseline, the excess over it is mostly processing time.
+         */
+        int32_t i32MsFwd = (int32_t)(pPduResp->u.Fields.tsMillies - pThis->tsHostMilliesSent);
+        if (i32MsFwd < pThis->i32MsFwdMin)
+            pThis->i32MsFwdMin = i32MsFwd;
+
+        pTiming->enmReq          = enmStatsReq;
+        pTiming->tsHostMillies   = pThis->tsHostMilliesSent;
+        pTiming->tsTargetMillies = pPduResp->u.Fields.tsMillies;
+        pTiming->cMsFwdExcess    = (uint32_t)(i32MsFwd - pThis->i32MsFwdMin);
+        pTiming->tsHostStartNs   = tsStartNs;
+        pTiming->cNsHostTx       = tsSentNs - tsStartNs;
+        pTiming->cNsRtt          = cNs;
+
+        pReq->cNsHostTxTotal    += pTiming->cNsHostTx;
+        pReq->cMsFwdExcessTotal += pTiming->cMsFwdExcess;
+        pReq->Recv.cPdus++;
+        pReq->Recv.cbPdus += pspStubPduCtxPduSz(pPduResp->u.Fields.cbPdu);
+        if (pPduResp->u.Fields.rcReq != STS_INF_SUCCESS)
+            pReq->cErrors++;
+        pReq->cNsTotal += cNs;
+        if (cNs > pReq->cNsMax)
+            pReq->cNsMax = cNs;
+        pReq->HistNs.acSamples[pspStubPduCtxStatsHistIdx(cNs)]++;
+    }
+}
+
+
+/**
+ * Returns the timeout currently in effect for the given request type.
+ *
+ * @returns Timeout in milliseconds.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmReq                  The request type.
+ */
+static uint32_t pspStubPduCtxReqTimeoutEffective(PPSPSTUBPDUCTXINT pThis, PSPPROXYREQ enmReq)
+{
+    uint32_t cMsTimeout = pThis->acMsReqTimeout[enmReq];
+    PPSPSTUBPDURTO pRto = &pThis->aRto[enmReq];
+
+    if (   pThis->cMsReqTimeoutAdaptiveMin
+        && pRto->cSamples >= PSP_STUB_PDU_RTO_SAMPLES_MIN)
+    {
+        /* RTO = SRTT + 4 * RTTVAR, bounded by the configured minimum and the static timeout. */
+        uint64_t cMsRto = (pRto->cNsSrtt + 4 * pRto->cNsRttVar + 999999) / 1000000;
+        if (cMsRto < pThis->cMsReqTimeoutAdaptiveMin)
+            cMsRto = pThis->cMsReqTimeoutAdaptiveMin;
+        if (cMsRto < cMsTimeout)
+            cMsTimeout = (uint32_t)cMsRto;
+    }
+
+    return cMsTimeout;
+}
+
+
+/**
+ * Returns the timeout for the given request.
+ *
+ * @returns Timeout in milliseconds.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmReq                  The request ID.
+ */
+static uint32_t pspStubPduCtxReqTimeoutGet(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmReq)
+{
+    PSPPROXYREQ enmProxyReq = pspStubPduCtxStatsReqFromRrnId(enmReq);
+    if (enmProxyReq == PSPPROXYREQ_COUNT)
+        return PSP_STUB_PDU_REQ_TIMEOUT_MS_DEFAULT;
+
+    return pspStubPduCtxReqTimeoutEffective(pThis, enmProxyReq);
+}
+
+
+/**
+ * Updates the adaptive timeout estimator of the given request type.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmReq                  The request ID.
+ * @param   rc                      Status code of the receive operation.
+ * @param   tsStartNs               Point in time the request was started.
+ */
+static void pspStubPduCtxRtoUpdate(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmReq, int rc, uint64_t tsStartNs)
+{
+    PSPPROXYREQ enmProxyReq = pspStubPduCtxStatsReqFromRrnId(enmReq);
+    if (enmProxyReq == PSPPROXYREQ_COUNT)
+        return;
+
+    PPSPSTUBPDURTO pRto = &pThis->aRto[enmProxyReq];
+    if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
+    {
+        /* Fall back to the static timeout until enough samples were collected again. */
+        pRto->cSamples = 0;
+        return;
+    }
+    if (rc)
+        return;
+
+    uint64_t cNsRtt = pspStubPduCtxTimeNs() - tsStartNs;
+    if (!pRto->cSamples)
+    {
+        pRto->cNsSrtt   = cNsRtt;
+        pRto->cNsRttVar = cNsRtt / 2;
+    }
+    else
+    {
+        uint64_t cNsDelta = pRto->cNsSrtt > cNsRtt ? pRto->cNsSrtt - cNsRtt : cNsRtt - pRto->cNsSrtt;
+
+        pRto->cNsRttVar = (3 * pRto->cNsRttVar + cNsDelta) / 4;
+        pRto->cNsSrtt   = (7 * pRto->cNsSrtt + cNsRtt) / 8;
+    }
+
+    if (pRto->cSamples < UINT32_MAX)
+        pRto->cSamples++;
+}
+
+
+/**
+ * Remembers a PDU which is still outstanding for an abandoned request, so it gets discarded when it arrives late.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmRrnId                The Request/Response/Notification ID of the outstanding PDU.
+ * @param   cPdusReq                PDU sequence counter of the abandoned request, 0 for notifications.
+ * @param   cMillies                How long to wait for the PDU before forgetting about it, raised to
+ *                                  PSP_STUB_PDU_ABANDONED_EXPIRE_MS_MIN as short timeouts tend to be the cause.
+ */
+static void pspStubPduCtxAbandonedAdd(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrnId, uint32_t cPdusReq, uint32_t cMillies)
+{
+    if (cMillies < PSP_STUB_PDU_ABANDONED_EXPIRE_MS_MIN)
+        cMillies = PSP_STUB_PDU_ABANDONED_EXPIRE_MS_MIN;
+
+    /* Forget about the oldest one if there is no room. */
+    if (pThis->cAbandoned == ELEMENTS(pThis->aAbandoned))
+    {
+        memmove(&pThis->aAbandoned[0], &pThis->aAbandoned[1], (ELEMENTS(pThis->aAbandoned) - 1) * sizeof(pThis->aAbandoned[0]));
+        pThis->cAbandoned--;
+    }
+
+    pThis->aAbandoned[pThis->cAbandoned].enmRrnId   = enmRrnId;
+    pThis->aAbandoned[pThis->cAbandoned].cPdusReq   = cPdusReq;
+    pThis->aAbandoned[pThis->cAbandoned].tsExpireNs = pspStubPduCtxDeadlineFromMillies(cMillies);
+    pThis->cAbandoned++;
+}
+
+
+/**
+ * Forgets about the responses of all abandoned requests sent before the given one.
+ *
+ * The stub processes requests one after the other, so once the response to a request arrived
+ * any response to an earlier request either arrived already or got lost.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cPdusReq                PDU sequence counter of the request the response arrived for.
+ */
+static void pspStubPduCtxAbandonedPurge(PPSPSTUBPDUCTXINT pThis, uint32_t cPdusReq)
+{
+    uint32_t i = 0;
+
+    while (i < pThis->cAbandoned)
+    {
+        if (   pThis->aAbandoned[i].cPdusReq
+            && (int32_t)(cPdusReq - pThis->aAbandoned[i].cPdusReq) > 0)
+        {
+            memmove(&pThis->aAbandoned[i], &pThis->aAbandoned[i + 1], (pThis->cAbandoned - i - 1) * sizeof(pThis->aAbandoned[0]));
+            pThis->cAbandoned--;
+        }
+        else
+            i++;
+    }
+}
+
+
+/**
+ * Checks whether the given PDU belongs to an abandoned request, consuming the matching entry.
+ *
+ * If the PDU has the type of the response being waited for and the abandoned request was sent before
+ * the current one it can't be told apart from the awaited response. A copy is kept in that case, which is
+ * returned if no other response arrives because the response to the abandoned request got lost.
+ *
+ * @returns Flag whether the PDU should be discarded.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPdu                    The received PDU.
+ * @param   enmRrnIdWait            The Request/Response/Notification ID being waited for.
+ */
+static bool pspStubPduCtxAbandonedCheck(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR pPdu, PSPSERIALPDURRNID enmRrnIdWait)
+{
+    uint64_t tsNowNs = pspStubPduCtxTimeNs();
+    uint32_t i = 0;
+
+    while (i < pThis->cAbandoned)
+    {
+        bool fExpired = pThis->aAbandoned[i].tsExpireNs <= tsNowNs;
+        if (   fExpired
+            || pThis->aAbandoned[i].enmRrnId == pPdu->u.Fields.enmRrnId)
+        {
+            memmove(&pThis->aAbandoned[i], &pThis->aAbandoned[i + 1], (pThis->cAbandoned - i - 1) * sizeof(pThis->aAbandoned[0]));
+            pThis->cAbandoned--;
+
+            if (!fExpired)
+            {
+                if (   pPdu->u.Fields.enmRrnId == enmRrnIdWait
+                    && pThis->aAbandoned[i].cPdusReq
+                    && pThis->aAbandoned[i].cPdusReq != pThis->cPdusSent)
+                {
+                    memcpy(&pThis->abPduLate[0], pPdu, sizeof(*pPdu) + pPdu->u.Fields.cbPdu);
+                    pThis->fPduLate = true;
+                }
+
+                pThis->Stats.cLateRespsDropped++;
+                return true;
+            }
+        }
+        else
+            i++;
+    }
+
+    return false;
+}
+
+
+/**
+ * Updates the notification statistics for the given valid PDU.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPdu                    The PDU received.
+ */
+static void pspStubPduCtxStatsPduRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR pPdu)
+{
+    PSPPROXYSTATSPDUS *pPdus = NULL;
+    size_t cbPdu = pspStubPduCtxPduSz(pPdu->u.Fields.cbPdu);
+
+    /* Every PDU carries a target timestamp which is good for estimating the reverse delay. */
+    int32_t i32MsRev = (int32_t)(pspStubPduCtxTsNsToMillies(pspStubPduCtxTimeNs()) - pPdu->u.Fields.tsMillies);
+    if (i32MsRev < pThis->i32MsRevMin)
+        pThis->i32MsRevMin = i32MsRev;
+
+    pThis->Stats.Recv.cPdus++;
+    pThis->Stats.Recv.cbPdus += cbPdu;
+
+    switch (pPdu->u.Fields.enmRrnId)
+    {
+        case PSPSERIALPDURRNID_NOTIFICATION_BEACON:
+            pPdus = &pThis->Stats.NotBeacon;
+            break;
+        case PSPSERIALPDURRNID_NOTIFICATION_LOG_MSG:
+            pPdus = &pThis->Stats.NotLogMsg;
+            break;
+        case PSPSERIALPDURRNID_NOTIFICATION_OUT_BUF:
+            pPdus = &pThis->Stats.NotOutBuf;
+            break;
+        case PSPSERIALPDURRNID_NOTIFICATION_CODE_MOD_EXEC_FINISHED:
+            pPdus = &pThis->Stats.NotCodeModExecFinished;
+            break;
+        case PSPSERIALPDURRNID_NOTIFICATION_IRQ:
+            pPdus = &pThis->Stats.NotIrq;
+            break;
+        default: /* Responses are accounted for in pspStubPduCtxStatsReqComplete(). */
+            break;
+    }
+
+    if (pPdus)
+    {
+        pPdus->cPdus++;
+        pPdus->cbPdus += cbPdu;
+    }
+}
+
+
 /**
  * Resets the PDU receive state machine.
  *
@@ -150,7 +713,9 @@ static int pspStubPduCtxHdrValidate(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR p
           || (   pHdr->u.Fields.enmRrnId >= PSPSERIALPDURRNID_RESPONSE_FIRST
               && pHdr->u.Fields.enmRrnId < PSPSERIALPDURRNID_RESPONSE_INVALID_FIRST)))
         return -1;
+    /* Beacons are let through, a target which reset starts over with its PDU counter. */
     if (   pHdr->u.Fields.cPdus != pThis->cPduRecvNext + 1
+        && pHdr->u.Fields.enmRrnId != PSPSERIALPDURRNID_NOTIFICATION_BEACON
         && pThis->fConnect)
         return -1;
     if (pHdr->u.Fields.idCcd >= pThis->cCcds)
@@ -214,6 +779,8 @@ static int pspStubPduCtxRecvAdvance(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *
             }
             else
             {
+                pThis->Stats.cbResyncSkipped++;
+
                 /* Remove the first byte and teceive the next byte (the last 3 bytes could belong to the magic). */
                 pThis->abPdu[0] = pThis->abPdu[1];
                 pThis->abPdu[1] = pThis->abPdu[2];
@@ -247,6 +814,8 @@ static int pspStubPduCtxRecvAdvance(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *
             else
             {
                 /** @todo Send out of band error. */
+                pThis->Stats.cHdrErrors++;
+                PSPPROXY_PROBE1(pdu_hdr_error, pThis->Stats.cbResyncSkipped);
                 pspStubPduCtxRecvReset(pThis);
             }
             break;
@@ -266,9 +835,20 @@ static int pspStubPduCtxRecvAdvance(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *
             rc = pspStubPduCtxValidate(pThis, pHdr);
             if (!rc)
             {
-                pThis->cPduRecvNext++;
+                /* Out of sequence beacons don't advance the counter, see pspStubPduCtxHdrValidate(). */
+                if (   pHdr->u.Fields.cPdus == pThis->cPduRecvNext + 1
+                    || pHdr->u.Fields.enmRrnId != PSPSERIALPDURRNID_NOTIFICATION_BEACON)
+                    pThis->cPduRecvNext++;
+                pspStubPduCtxStatsPduRecv(pThis, pHdr);
+                PSPPROXY_PROBE4(pdu_recv, pHdr->u.Fields.idCcd, pHdr->u.Fields.enmRrnId, pHdr->u.Fields.cbPdu,
+                                pHdr->u.Fields.tsMillies);
                 *ppPduRcvd = pHdr;
             }
+            else
+            {
+                pThis->Stats.cChkSumErrors++;
+                PSPPROXY_PROBE3(pdu_chksum_error, pHdr->u.Fields.idCcd, pHdr->u.Fields.enmRrnId, pHdr->u.Fields.cbPdu);
+            }
             /** @todo Send out of band error. */
             /* Start receiving a new PDU in any case. */
             pspStubPduCtxRecvReset(pThis);
@@ -288,20 +868,30 @@ static int pspStubPduCtxRecvAdvance(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
  * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
- * @param   cMillies                Amount of milliseconds to wait until a timeout is returned.
+ * @param   tsDeadlineNs            Absolute deadline (monotonic clock) after which a timeout is returned.
+ *
+ * @note A partially received PDU is kept when the deadline passes and completed on the next call.
  */
-static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRcvd, uint32_t cMillies)
+static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRcvd, uint64_t tsDeadlineNs)
 {
     int rc = 0;
 
-    /** @todo Timeout handling. */
     do
     {
-        rc = pThis->pProvIf->pfnCtxPoll(pThis->hProvCtx, cMillies);
+        /*
+         * An expired deadline still results in a non blocking poll so data which is already there gets
+         * consumed, but we give up after that round instead of letting trickling data extend the wait.
+         */
+        uint32_t cMsLeft = pspStubPduCtxDeadlineMsLeft(tsDeadlineNs);
+
+        pThis->Stats.cProvPolls++;
+        rc = pThis->pProvIf->pfnCtxPoll(pThis->hProvCtx, cMsLeft);
+        PSPPROXY_PROBE2(prov_poll, cMsLeft, rc);
         if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
             break;
         if (!rc)
         {
+            pThis->Stats.cProvPeeks++;
             size_t cbAvail = pThis->pProvIf->pfnCtxPeek(pThis->hProvCtx);
             if (cbAvail)
             {
@@ -309,7 +899,9 @@ static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRc
                 /** @todo If the connection turns out to be unreliable we have to do a marker search first. */
                 size_t cbThisRecv = MIN(cbAvail, pThis->cbPduRecvLeft);
 
+                pThis->Stats.cProvReads++;
                 rc = pThis->pProvIf->pfnCtxRead(pThis->hProvCtx, &pThis->abPdu[pThis->offPduRecv], cbThisRecv, &cbThisRecv);
+                PSPPROXY_PROBE3(prov_read, MIN(cbAvail, pThis->cbPduRecvLeft), cbThisRecv, rc);
                 if (!rc)
                 {
                     pThis->offPduRecv    += cbThisRecv;
@@ -325,6 +917,10 @@ static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRc
                     }
                 }
             }
+
+            if (   !rc
+                && !cMsLeft)
+                rc = STS_ERR_PSP_PROXY_TIMEOUT;
         }
     } while (!rc);
 
@@ -333,7 +929,79 @@ static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRc
 
 
 /**
- * Waits for a PDU with the specific ID to be received.
+ * Hands all log lines collected in the current batch over to the I/O interface callbacks.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubPduCtxLogMsgBatchFlush(PPSPSTUBPDUCTXINT pThis)
+{
+    if (!pThis->cLogMsgBatch)
+        return;
+
+    if (pThis->pProxyIoIf->pfnLogMsgBatch)
+        pThis->pProxyIoIf->pfnLogMsgBatch(pThis->hProxyCtx, pThis->pvProxyIoUser, &pThis->aLogMsgBatch[0],
+                                          pThis->cLogMsgBatch);
+    else
+    {
+        for (uint32_t i = 0; i < pThis->cLogMsgBatch; i++)
+            pThis->pProxyIoIf->pfnLogMsg(pThis->hProxyCtx, pThis->pvProxyIoUser, pThis->aLogMsgBatch[i].pszMsg);
+    }
+
+    pThis->cLogMsgBatch   = 0;
+    pThis->offLogMsgBatch = 0;
+}
+
+
+/**
+ * Completes the line in the assembly buffer with the given tail and appends it to the current batch.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPdu                    The log message PDU the tail originates from, NULL if there is no tail.
+ * @param   pchTail                 The tail of the line (including the newline if any).
+ * @param   cchTail                 Number of characters in the tail.
+ */
+static void pspStubPduCtxLogMsgLineEmit(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR pPdu, const char *pchTail, size_t cchTail)
+{
+    if (!pThis->cchLogMsgLine)
+    {
+        pThis->idCcdLogMsgLine = pPdu->u.Fields.idCcd;
+        pThis->tsLogMsgLine    = pPdu->u.Fields.tsMillies;
+    }
+
+    /* Truncate the line to the maximum length, the remainder is lost. */
+    size_t cchTailCopy = MIN(cchTail, pThis->cbLogMsgLine - pThis->cchLogMsgLine);
+    size_t cchLine = pThis->cchLogMsgLine + cchTailCopy;
+    pThis->cbLogMsgDropped += cchTail - cchTailCopy;
+
+    if (   pThis->cLogMsgBatch == ELEMENTS(pThis->aLogMsgBatch)
+        || pThis->cbLogMsgBatch - pThis->offLogMsgBatch < cchLine + 1)
+        pspStubPduCtxLogMsgBatchFlush(pThis);
+
+    char *pszMsg = &pThis->pachLogMsgBatch[pThis->offLogMsgBatch];
+    memcpy(pszMsg, pThis->pachLogMsgLine, pThis->cchLogMsgLine);
+    if (cchTailCopy)
+        memcpy(pszMsg + pThis->cchLogMsgLine, pchTail, cchTailCopy);
+    pszMsg[cchLine] = '\0';
+
+    PPSPPROXYLOGMSG pLogMsg = &pThis->aLogMsgBatch[pThis->cLogMsgBatch++];
+    pLogMsg->idCcd     = pThis->idCcdLogMsgLine;
+    pLogMsg->tsMillies = pThis->tsLogMsgLine;
+    pLogMsg->cchMsg    = cchLine;
+    pLogMsg->pszMsg    = pszMsg;
+
+    pThis->offLogMsgBatch += cchLine + 1;
+    pThis->cchLogMsgLine   = 0;
+}
+
+
+/**
+ * Handles a log message notification, splitting the received data into lines.
+ *
+ * Each received byte is only looked at once, complete lines are appended to the current
+ * batch (see pspStubPduCtxLogMsgBatchFlush()) and only the trailing incomplete line is kept
+ * in the assembly buffer.
  *
  * @returns nothing.
  * @param   pThis                   The serial stub instance data.
@@ -342,43 +1010,172 @@ static int pspStubPduCtxRecv(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR *ppPduRc
 static void pspStubPduCtxLogMsgHandle(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR pPdu)
 {
     size_t cchMsg = pPdu->u.Fields.cbPdu;
-    const char *pbMsg = (const char *)(pPdu + 1);
+    const char *pchMsg = (const char *)(pPdu + 1);
+
+    /* Don't mix up lines from different CCDs, an incomplete line of another CCD is handed over as is. */
+    if (   pThis->cchLogMsgLine
+        && pThis->idCcdLogMsgLine != pPdu->u.Fields.idCcd)
+        pspStubPduCtxLogMsgLineEmit(pThis, NULL /*pPdu*/, NULL /*pchTail*/, 0 /*cchTail*/);
 
-    /* Drop any log message PDU which is too big to fit into the message buffer. */
-    if (sizeof(pThis->achLogMsg) - pThis->cchLogMsgAvail >= cchMsg)
+    while (cchMsg)
     {
-        memcpy(&pThis->achLogMsg[pThis->cchLogMsgAvail], pbMsg, cchMsg);
-        pThis->cchLogMsgAvail += cchMsg;
+        const char *pchNewLine = (const char *)memchr(pchMsg, '\n', cchMsg);
+        size_t cchChunk = pchNewLine ? (size_t)(pchNewLine - pchMsg) + 1 : cchMsg;
 
-        for (;;)
+        if (pThis->fLogMsgLineTrunc)
         {
-            /* Parse the buffer for newlines and hand them over to the callback. */
-            char *pszNewLine = strchr(&pThis->achLogMsg[0], '\n');
-            if (pszNewLine)
+            /* Discard the remainder of an overlong line. */
+            pThis->cbLogMsgDropped += cchChunk;
+            if (pchNewLine)
+                pThis->fLogMsgLineTrunc = false;
+        }
+        else if (pchNewLine)
+            pspStubPduCtxLogMsgLineEmit(pThis, pPdu, pchMsg, cchChunk);
+        else if (pThis->cbLogMsgLine - pThis->cchLogMsgLine >= cchChunk)
+        {
+            if (!pThis->cchLogMsgLine)
             {
-                /* Terminate the string after the newline. */
-                pszNewLine++;
-                char chOld = *pszNewLine;
-                *pszNewLine = '\0';
-
-                pThis->pProxyIoIf->pfnLogMsg(pThis->hProxyCtx, pThis->pvProxyIoUser, &pThis->achLogMsg[0]);
-                /* Restore old value and move everything remaining to the front, clearing out the remainder. */
-                *pszNewLine = chOld;
-                size_t cchMsg = pszNewLine - &pThis->achLogMsg[0];
-                /** @todo assert(cchMsg <= pThis->cchLogMsgAvail) */
-                memmove(&pThis->achLogMsg[0], pszNewLine, pThis->cchLogMsgAvail - cchMsg);
-                pThis->cchLogMsgAvail -= cchMsg;
-                memset(&pThis->achLogMsg[pThis->cchLogMsgAvail], 0, sizeof(pThis->achLogMsg) - pThis->cchLogMsgAvail);
-                if (!pThis->cchLogMsgAvail)
-                    break;
+                pThis->idCcdLogMsgLine = pPdu->u.Fields.idCcd;
+                pThis->tsLogMsgLine    = pPdu->u.Fields.tsMillies;
             }
-            else
-                break;
+
+            memcpy(&pThis->pachLogMsgLine[pThis->cchLogMsgLine], pchMsg, cchChunk);
+            pThis->cchLogMsgLine += cchChunk;
+        }
+        else
+        {
+            /* Line doesn't fit, hand over what we have and drop everything up to the next newline. */
+            pspStubPduCtxLogMsgLineEmit(pThis, pPdu, pchMsg, cchChunk);
+            pThis->fLogMsgLineTrunc = true;
         }
+
+        pchMsg += cchChunk;
+        cchMsg -= cchChunk;
     }
 }
 
 
+/**
+ * Allocates the log message line assembly and batch buffers.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cbLogMsgLine            Size of the line assembly buffer in bytes.
+ */
+static int pspStubPduCtxLogMsgBufAlloc(PPSPSTUBPDUCTXINT pThis, size_t cbLogMsgLine)
+{
+    /* The batch buffer can hold at least two lines of maximum length including terminators. */
+    size_t cbLogMsgBatch = 2 * (cbLogMsgLine + 1);
+    char *pachBuf = (char *)malloc(cbLogMsgLine + cbLogMsgBatch);
+    if (!pachBuf)
+        return -1;
+
+    free(pThis->pachLogMsgLine);
+    pThis->pachLogMsgLine   = pachBuf;
+    pThis->cbLogMsgLine     = cbLogMsgLine;
+    pThis->cchLogMsgLine    = 0;
+    pThis->fLogMsgLineTrunc = false;
+    pThis->pachLogMsgBatch  = pachBuf + cbLogMsgLine;
+    pThis->cbLogMsgBatch    = cbLogMsgBatch;
+    pThis->offLogMsgBatch   = 0;
+    pThis->cLogMsgBatch     = 0;
+    return 0;
+}
+
+
+/**
+ * Signals the IRQ event fd if it was created.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubPduCtxIrqEvtSignal(PPSPSTUBPDUCTXINT pThis)
+{
+    if (pThis->iFdIrqEvt != -1)
+    {
+        uint64_t uCnt = 1;
+        ssize_t cbWr = write(pThis->iFdIrqEvt, &uCnt, sizeof(uCnt));
+        (void)cbWr; /* Can only fail if the counter overflows, which means it is signalled anyway. */
+    }
+}
+
+
+/**
+ * Removes the oldest event from the IRQ event queue.
+ *
+ * @returns Flag whether an event was dequeued.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pIrqEvt                 Where to store the event.
+ */
+static bool pspStubPduCtxIrqEvtDequeue(PPSPSTUBPDUCTXINT pThis, PPSPPROXYIRQEVT pIrqEvt)
+{
+    if (!pThis->cIrqEvts)
+        return false;
+
+    *pIrqEvt = pThis->paIrqEvts[pThis->idxIrqEvtHead];
+    pThis->idxIrqEvtHead = (pThis->idxIrqEvtHead + 1) % pThis->cIrqEvtsMax;
+    pThis->cIrqEvts--;
+
+    /* Clear the eventfd once the queue is drained. */
+    if (   !pThis->cIrqEvts
+        && pThis->iFdIrqEvt != -1)
+    {
+        uint64_t uCnt;
+        ssize_t cbRd = read(pThis->iFdIrqEvt, &uCnt, sizeof(uCnt));
+        (void)cbRd; /* Non blocking, fails only if it wasn't signalled. */
+    }
+
+    return true;
+}
+
+
+/**
+ * Handles an IRQ state change notification.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPdu                    The IRQ notification PDU.
+ * @param   pIrqEvt                 Where to return the event instead of delivering it, optional.
+ */
+static int pspStubPduCtxIrqNotHandle(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALPDUHDR pPdu, PPSPPROXYIRQEVT pIrqEvt)
+{
+    PCPSPSERIALIRQNOT pIrqNot = (PCPSPSERIALIRQNOT)(pPdu + 1);
+    PSPPROXYIRQEVT IrqEvt;
+
+    if (   pPdu->u.Fields.idCcd >= pThis->cCcds
+        || pPdu->u.Fields.cbPdu != sizeof(*pIrqNot))
+        return STS_ERR_INVALID_PARAMETER;
+
+    IrqEvt.idCcd     = pPdu->u.Fields.idCcd;
+    IrqEvt.tsMillies = pPdu->u.Fields.tsMillies;
+    IrqEvt.fIrq      = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_IRQ) ? true : false;
+    IrqEvt.fFirq     = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_FIQ) ? true : false;
+
+    if (pIrqEvt)
+        *pIrqEvt = IrqEvt;
+    else if (pThis->pfnIrqEvt)
+        pThis->pfnIrqEvt(pThis->hProxyCtx, pThis->pvIrqEvtUser, &IrqEvt);
+    else if (pThis->cIrqEvtsMax)
+    {
+        /* Drop the oldest event if the queue is full. */
+        if (pThis->cIrqEvts == pThis->cIrqEvtsMax)
+        {
+            pThis->idxIrqEvtHead = (pThis->idxIrqEvtHead + 1) % pThis->cIrqEvtsMax;
+            pThis->cIrqEvts--;
+            pThis->cIrqEvtsDropped++;
+        }
+
+        pThis->paIrqEvts[(pThis->idxIrqEvtHead + pThis->cIrqEvts) % pThis->cIrqEvtsMax] = IrqEvt;
+        pThis->cIrqEvts++;
+        pspStubPduCtxIrqEvtSignal(pThis);
+    }
+    else /* Not connected yet. */
+        pThis->cIrqEvtsDropped++;
+
+    return STS_INF_SUCCESS;
+}
+
+
 /**
  * handles an output buffer write.
  *
@@ -397,36 +1194,63 @@ static void pspStubPduCtxOutBufWriteHandle(PPSPSTUBPDUCTXINT pThis, PCPSPSERIALP
 }
 
 
+/* Resuming a session after a target reset happens while waiting for a PDU and waits for the connect response itself. */
+static int pspStubPduCtxResume(PPSPSTUBPDUCTXINT pThis, uint32_t cBeaconsSent, uint64_t tsDeadlineNs);
+
+
 /**
  * Waits for a PDU with the specific ID to be received.
  *
  * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_TARGET_RESET if the target reset and the session was resumed, the PDU waited for
+ *          will never arrive.
  * @param   pThis                   The serial stub instance data.
  * @param   enmRrnId                The PDU ID to wait for.
  * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
  * @param   ppvPayload              Where to store the pointer to the payload data on success.
  * @param   pcbPayload              Where to store the size of the payload in bytes on success.
- * @param   cMillies                Amount of milliseconds to wait until a timeout is returned.
+ * @param   tsDeadlineNs            Absolute deadline (monotonic clock) after which a timeout is returned,
+ *                                  notifications received in the meantime don't extend it.
  */
 static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrnId, PCPSPSERIALPDUHDR *ppPduRcvd,
-                               void **ppvPayload, size_t *pcbPayload, uint32_t cMillies)
+                               void **ppvPayload, size_t *pcbPayload, uint64_t tsDeadlineNs)
 {
     int rc = 0;
 
+    pThis->fPduLate = false;
     while (!rc)
     {
         PCPSPSERIALPDUHDR pPdu = NULL;
-        rc = pspStubPduCtxRecv(pThis, &pPdu, cMillies);
+        rc = pspStubPduCtxRecv(pThis, &pPdu, tsDeadlineNs);
         if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
+        {
+            /* The response to the abandoned request got lost, so the one discarded was ours. */
+            if (pThis->fPduLate)
+            {
+                pThis->Stats.cLateRespsDropped--;
+                pPdu = (PCPSPSERIALPDUHDR)&pThis->abPduLate[0];
+                *ppPduRcvd = pPdu;
+                if (ppvPayload)
+                    *ppvPayload = (void *)(pPdu + 1);
+                if (pcbPayload)
+                    *pcbPayload = pPdu->u.Fields.cbPdu;
+                rc = 0;
+            }
             break;
+        }
         if (!rc)
         {
+            if (   pThis->cAbandoned
+                && pspStubPduCtxAbandonedCheck(pThis, pPdu, enmRrnId))
+                continue;
+
             if (pPdu->u.Fields.enmRrnId != enmRrnId)
             {
                 if (pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_NOTIFICATION_LOG_MSG)
                 {
                     if (   pThis->pProxyIoIf
-                        && pThis->pProxyIoIf->pfnLogMsg)
+                        && (   pThis->pProxyIoIf->pfnLogMsg
+                            || pThis->pProxyIoIf->pfnLogMsgBatch))
                         pspStubPduCtxLogMsgHandle(pThis, pPdu);
                     continue;
                 }
@@ -434,29 +1258,18 @@ static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrn
                 {
                     if (   pThis->pProxyIoIf
                         && pThis->pProxyIoIf->pfnOutBufWrite)
+                    {
+                        /* Keep the order of log messages and output buffer data. */
+                        pspStubPduCtxLogMsgBatchFlush(pThis);
                         pspStubPduCtxOutBufWriteHandle(pThis, pPdu);
+                    }
                     continue;
                 }
                 else if (pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_NOTIFICATION_IRQ)
                 {
-                    uint32_t idCcd = pPdu->u.Fields.idCcd;
-                    PCPSPSERIALIRQNOT pIrqNot = (PCPSPSERIALIRQNOT)(pPdu + 1);
-
-                    if (idCcd < PSP_CCDS_MAX)
-                    {
-                        if (!pThis->afPerCcdIrqNotRcvd[idCcd])
-                        {
-                            pThis->afPerCcdIrqNotRcvd[idCcd] = true;
-                            pThis->afPerCcdIrq[idCcd] = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_IRQ)  ? true : false;
-                            pThis->afPerCcdFirq[idCcd] = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_FIQ) ? true : false;
-                            pThis->cCcdsIrqChange++;
-                        }
-                    }
-                    else
-                    {
-                        rc = -1;
+                    rc = pspStubPduCtxIrqNotHandle(pThis, pPdu, NULL /*pIrqEvt*/);
+                    if (rc)
                         break;
-                    }
                     continue;
                 }
                 else if (pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_NOTIFICATION_BEACON)
@@ -475,6 +1288,13 @@ static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrn
                         pThis->cBeaconsSeen++;
                         continue;
                     }
+
+                    /* Reply to this very beacon instead of waiting for a new connect to keep the downtime short. */
+                    if (pThis->fAutoResume)
+                    {
+                        rc = pspStubPduCtxResume(pThis, pBeacon->cBeaconsSent, tsDeadlineNs);
+                        break;
+                    }
                 }
 
                 rc = -1; /* Unexpected PDU received or system resetted. */
@@ -483,6 +1303,10 @@ static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrn
             else
             {
                 /* Return the PDU. */
+                PSPPROXY_PROBE2(req_match, pPdu->u.Fields.enmRrnId, pPdu->u.Fields.cbPdu);
+                if (   pThis->cAbandoned
+                    && pPdu->u.Fields.enmRrnId < PSPSERIALPDURRNID_NOTIFICATION_FIRST)
+                    pspStubPduCtxAbandonedPurge(pThis, pThis->cPdusSent);
                 *ppPduRcvd = pPdu;
                 if (ppvPayload)
                     *ppvPayload = (void *)(pPdu + 1);
@@ -493,6 +1317,46 @@ static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrn
         }
     }
 
+    /* Hand over the log lines collected while waiting. */
+    if (pThis->cLogMsgBatch)
+        pspStubPduCtxLogMsgBatchFlush(pThis);
+
+    return rc;
+}
+
+
+/**
+ * Writes the given buffers through the provider, in one go if the provider supports it.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   paIov                   The buffers to write.
+ * @param   cIov                    Number of buffers.
+ */
+static int pspStubPduCtxProvWriteV(PPSPSTUBPDUCTXINT pThis, const struct iovec *paIov, unsigned cIov)
+{
+    int rc = 0;
+
+    if (pThis->pProvIf->pfnCtxWriteV)
+    {
+        size_t cbWrite = 0;
+        for (unsigned i = 0; i < cIov; i++)
+            cbWrite += paIov[i].iov_len;
+
+        pThis->Stats.cProvWrites++;
+        rc = pThis->pProvIf->pfnCtxWriteV(pThis->hProvCtx, paIov, cIov);
+        PSPPROXY_PROBE2(prov_write, cbWrite, rc);
+    }
+    else
+    {
+        for (unsigned i = 0; i < cIov && !rc; i++)
+        {
+            pThis->Stats.cProvWrites++;
+            rc = pThis->pProvIf->pfnCtxWrite(pThis->hProvCtx, paIov[i].iov_base, paIov[i].iov_len);
+            PSPPROXY_PROBE2(prov_write, paIov[i].iov_len, rc);
+        }
+    }
+
     return rc;
 }
 
@@ -509,6 +1373,11 @@ static int pspStubPduCtxRecvId(PPSPSTUBPDUCTXINT pThis, PSPSERIALPDURRNID enmRrn
  */
 static int pspStubPduCtxSend(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALPDURRNID enmPduRrnId, const void *pvPayload, size_t cbPayload)
 {
+    /* The target doesn't know about us anymore, only a new connect helps. */
+    if (   pThis->fSessionLost
+        && enmPduRrnId != PSPSERIALPDURRNID_REQUEST_CONNECT)
+        return -1;
+
     PSPSERIALPDUHDR PduHdr;
     PSPSERIALPDUFOOTER PduFooter;
     uint8_t abPad[7] = { 0 };
@@ -520,7 +1389,7 @@ static int pspStubPduCtxSend(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALP
     PduHdr.u.Fields.cPdus     = ++pThis->cPdusSent;
     PduHdr.u.Fields.enmRrnId  = enmPduRrnId;
     PduHdr.u.Fields.idCcd     = idCcd;
-    PduHdr.u.Fields.tsMillies = 0;
+    PduHdr.u.Fields.tsMillies = pspStubPduCtxTsNsToMillies(pspStubPduCtxTimeNs());
 
     uint32_t uChkSum = 0;
     for (uint32_t i = 0; i < sizeof(PduHdr.u.ab); i++)
@@ -536,13 +1405,42 @@ static int pspStubPduCtxSend(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALP
     PduFooter.u32Magic  = PSP_SERIAL_EXT_2_PSP_PDU_END_MAGIC;
 
     /* Send everything, header first, then payload and any padding and footer last. */
-    int rc = pThis->pProvIf->pfnCtxWrite(pThis->hProvCtx, &PduHdr, sizeof(PduHdr));
-    if (!rc && pvPayload && cbPayload)
-        rc = pThis->pProvIf->pfnCtxWrite(pThis->hProvCtx, pvPayload, cbPayload);
-    if (!rc && cbPad)
-        rc = pThis->pProvIf->pfnCtxWrite(pThis->hProvCtx, &abPad[0], cbPad);
+    struct iovec aIov[4];
+    unsigned cIov = 0;
+
+    aIov[cIov].iov_base = &PduHdr;
+    aIov[cIov++].iov_len = sizeof(PduHdr);
+    if (pvPayload && cbPayload)
+    {
+        aIov[cIov].iov_base = (void *)pvPayload;
+        aIov[cIov++].iov_len = cbPayload;
+    }
+    if (cbPad)
+    {
+        aIov[cIov].iov_base = &abPad[0];
+        aIov[cIov++].iov_len = cbPad;
+    }
+    aIov[cIov].iov_base = &PduFooter;
+    aIov[cIov++].iov_len = sizeof(PduFooter);
+
+    int rc = pspStubPduCtxProvWriteV(pThis, &aIov[0], cIov);
+
+    PSPPROXY_PROBE4(pdu_send, idCcd, enmPduRrnId, cbPayload, rc);
+
     if (!rc)
-        rc = pThis->pProvIf->pfnCtxWrite(pThis->hProvCtx, &PduFooter, sizeof(PduFooter));
+    {
+        size_t cbPdu = pspStubPduCtxPduSz(cbPayload);
+        PSPPROXYREQ enmStatsReq = pspStubPduCtxStatsReqFromRrnId(enmPduRrnId);
+
+        pThis->tsHostMilliesSent = PduHdr.u.Fields.tsMillies;
+        pThis->Stats.Sent.cPdus++;
+        pThis->Stats.Sent.cbPdus += cbPdu;
+        if (enmStatsReq != PSPPROXYREQ_COUNT)
+        {
+            pThis->Stats.aReqs[enmStatsReq].Sent.cPdus++;
+            pThis->Stats.aReqs[enmStatsReq].Sent.cbPdus += cbPdu;
+        }
+    }
 
     return rc;
 }
@@ -561,20 +1459,45 @@ static int pspStubPduCtxSend(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALP
  * @param   cbReqPayload            Size of the request payload data in bytes.
  * @param   pvResp                  Where to store the response data on success.
  * @param   cbResp                  Size of the response buffer.
- * @param   cMillies                Timeout in milliseconds.
+ *
+ * @note The timeout is taken from the request type configuration and covers sending the request as well.
+ *       Idempotent requests are issued once more if the target reset while waiting and the session was resumed.
  */
 static int pspStubPduCtxReqResp(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALPDURRNID enmReq,
                                 PSPSERIALPDURRNID enmResp,
-                                const void *pvReqPayload, size_t cbReqPayload, void *pvResp, size_t cbResp,
-                                uint32_t cMillies)
+                                const void *pvReqPayload, size_t cbReqPayload, void *pvResp, size_t cbResp)
 {
+    uint64_t tsStartNs = pspStubPduCtxTimeNs();
+    uint32_t cMsTimeout = pspStubPduCtxReqTimeoutGet(pThis, enmReq);
+    uint64_t tsDeadlineNs = tsStartNs + (uint64_t)cMsTimeout * 1000000ULL;
+    PSPPROXY_PROBE3(req_start, idCcd, enmReq, cbReqPayload);
     int rc = pspStubPduCtxSend(pThis, idCcd, enmReq, pvReqPayload, cbReqPayload);
     if (!rc)
     {
         PCPSPSERIALPDUHDR pPdu = NULL;
         void *pvPduResp = NULL;
         size_t cbPduResp = 0;
-        rc = pspStubPduCtxRecvId(pThis, enmResp, &pPdu, &pvPduResp, &cbPduResp, cMillies);
+        uint64_t tsSentNs = pspStubPduCtxTimeNs();
+        rc = pspStubPduCtxRecvId(pThis, enmResp, &pPdu, &pvPduResp, &cbPduResp, tsDeadlineNs);
+        if (   rc == STS_ERR_PSP_PROXY_TARGET_RESET
+            && pspStubPduCtxReqIsIdempotent(enmReq))
+        {
+            /* The request got lost with the reset, issue it again on the resumed session with the full timeout. */
+            pThis->Stats.cReqsReplayed++;
+            tsDeadlineNs = pspStubPduCtxTimeNs() + (uint64_t)cMsTimeout * 1000000ULL;
+            rc = pspStubPduCtxSend(pThis, idCcd, enmReq, pvReqPayload, cbReqPayload);
+            if (!rc)
+            {
+                tsSentNs = pspStubPduCtxTimeNs();
+                rc = pspStubPduCtxRecvId(pThis, enmResp, &pPdu, &pvPduResp, &cbPduResp, tsDeadlineNs);
+            }
+        }
+        pspStubPduCtxStatsReqComplete(pThis, enmReq, rc ? NULL : pPdu, rc, tsStartNs, tsSentNs);
+        pspStubPduCtxRtoUpdate(pThis, enmReq, rc, tsStartNs);
+        if (   rc == STS_ERR_PSP_PROXY_INTERRUPTED
+            || rc == STS_ERR_PSP_PROXY_TIMEOUT)
+            pspStubPduCtxAbandonedAdd(pThis, enmResp, pThis->cPdusSent, cMsTimeout);
+        PSPPROXY_PROBE4(req_done, enmReq, rc, rc ? 0 : pPdu->u.Fields.rcReq, pspStubPduCtxTimeNs() - tsStartNs);
         if (!rc)
         {
             pThis->rcReqLast = pPdu->u.Fields.rcReq;
@@ -611,13 +1534,11 @@ static int pspStubPduCtxReqResp(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERI
  * @param   cbReqPayload1           Size of the stage 1 request payload data in bytes.
  * @param   pvReqPayload2           Stage 2 request payload data.
  * @param   cbReqPayload2           Size of the stage 2 request payload data in bytes.
- * @param   cMillies                Timeout in milliseconds.
  */
 static int pspStubPduCtxReqRespWr(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSERIALPDURRNID enmReq,
                                   PSPSERIALPDURRNID enmResp,
                                   const void *pvReqPayload1, size_t cbReqPayload1,
-                                  const void *pvReqPayload2, size_t cbReqPayload2,
-                                  uint32_t cMillies)
+                                  const void *pvReqPayload2, size_t cbReqPayload2)
 {
     int rc = 0;
 
@@ -628,7 +1549,7 @@ static int pspStubPduCtxReqRespWr(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSE
         memcpy(pvTmp, pvReqPayload1, cbReqPayload1);
         memcpy((uint8_t *)pvTmp + cbReqPayload1, pvReqPayload2, cbReqPayload2);
         rc = pspStubPduCtxReqResp(pThis, idCcd, enmReq, enmResp, pvTmp, cbReqPayload1 + cbReqPayload2,
-                                  NULL /*pvRespPayload*/, 0 /*cbRespPayload*/, cMillies);
+                                  NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
         free(pvTmp);
     }
     else
@@ -638,6 +1559,130 @@ static int pspStubPduCtxReqRespWr(PPSPSTUBPDUCTXINT pThis, uint32_t idCcd, PSPSE
 }
 
 
+/**
+ * Resets the state tied to a connection before connecting to the target.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubPduCtxSessionReset(PPSPSTUBPDUCTXINT pThis)
+{
+    pThis->cchLogMsgLine    = 0;
+    pThis->fLogMsgLineTrunc = false;
+
+    /* The target clock might have been reset, start over with the delay and round trip time estimation. */
+    pThis->i32MsFwdMin = INT32_MAX;
+    pThis->i32MsRevMin = INT32_MAX;
+    memset(&pThis->aRto[0], 0, sizeof(pThis->aRto));
+    pThis->cAbandoned = 0;
+}
+
+
+/**
+ * Sends the connect request in reply to a beacon and processes the response.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cBeaconsSent            The beacon counter of the beacon replied to.
+ * @param   fResume                 Flag whether an established session is resumed after the target reset,
+ *                                  the session parameters have to match the ones of the initial connect.
+ * @param   tsDeadlineNs            Absolute deadline (monotonic clock) for the response.
+ */
+static int pspStubPduCtxConnectReq(PPSPSTUBPDUCTXINT pThis, uint32_t cBeaconsSent, bool fResume, uint64_t tsDeadlineNs)
+{
+    PCPSPSERIALPDUHDR pPdu = NULL;
+    uint64_t tsStartNs = pspStubPduCtxTimeNs();
+    int rc = pspStubPduCtxSend(pThis, 0 /*idCcd*/, PSPSERIALPDURRNID_REQUEST_CONNECT, NULL /*pvPayload*/, 0 /*cbPayload*/);
+    if (!rc)
+    {
+        PCPSPSERIALCONNECTRESP pConResp = NULL;
+        size_t cbConResp = 0;
+        uint64_t tsSentNs = pspStubPduCtxTimeNs();
+        rc = pspStubPduCtxRecvId(pThis, PSPSERIALPDURRNID_RESPONSE_CONNECT, &pPdu,
+                                 (void **)&pConResp, &cbConResp, tsDeadlineNs);
+        pspStubPduCtxStatsReqComplete(pThis, PSPSERIALPDURRNID_REQUEST_CONNECT, rc ? NULL : pPdu, rc,
+                                      tsStartNs, tsSentNs);
+        if (!rc && fResume)
+        {
+            /* Everything handed out so far (scratch space, CCD topology, transfer sizes) has to stay valid. */
+            if (   pConResp->cbPduMax       == pThis->cbPduMax
+                && pConResp->cbScratch      == pThis->cbScratch
+                && pConResp->PspAddrScratch == pThis->PspAddrScratch
+                && pConResp->cSysSockets    == pThis->cSysSockets
+                && pConResp->cCcdsPerSocket == pThis->cCcdsPerSocket)
+            {
+                pThis->fConnect     = true;
+                pThis->cBeaconsSeen = cBeaconsSent;
+                pThis->cPduRecvNext = 1;
+            }
+            else
+                rc = -1;
+        }
+        else if (!rc)
+        {
+            pThis->cbPduMax       = pConResp->cbPduMax;
+            pThis->cbScratch      = pConResp->cbScratch;
+            pThis->PspAddrScratch = pConResp->PspAddrScratch;
+            pThis->cSysSockets    = pConResp->cSysSockets;
+            pThis->cCcdsPerSocket = pConResp->cCcdsPerSocket;
+            pThis->cCcds          = pThis->cSysSockets * pThis->cCcdsPerSocket;
+
+            /* Size the IRQ event queue according to the number of CCDs. */
+            PPSPPROXYIRQEVT paIrqEvts = (PPSPPROXYIRQEVT)calloc(pThis->cCcds * PSP_STUB_PDU_IRQ_EVTS_PER_CCD,
+                                                                sizeof(*paIrqEvts));
+            if (paIrqEvts)
+            {
+                free(pThis->paIrqEvts);
+                pThis->paIrqEvts      = paIrqEvts;
+                pThis->cIrqEvtsMax    = pThis->cCcds * PSP_STUB_PDU_IRQ_EVTS_PER_CCD;
+                pThis->idxIrqEvtHead  = 0;
+                pThis->cIrqEvts       = 0;
+                pThis->fConnect       = true;
+                pThis->fSessionLost   = false;
+                pThis->cBeaconsSeen   = cBeaconsSent;
+                pThis->cPduRecvNext   = 1;
+            }
+            else
+                rc = -1;
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * Resumes the session after the target reset by replying to the given beacon right away.
+ *
+ * @returns Status code.
+ * @retval  STS_ERR_PSP_PROXY_TARGET_RESET if the session was resumed, any state on the target is gone nonetheless.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cBeaconsSent            The beacon counter of the beacon announcing the reset.
+ * @param   tsDeadlineNs            Absolute deadline (monotonic clock) for the connect response.
+ *
+ * @note If resuming fails the session is considered lost and every further request fails.
+ */
+static int pspStubPduCtxResume(PPSPSTUBPDUCTXINT pThis, uint32_t cBeaconsSent, uint64_t tsDeadlineNs)
+{
+    pThis->Stats.cTargetResets++;
+
+    /* Not connected while waiting for the response, so further beacons and the restarted PDU counter are accepted. */
+    pThis->fConnect = false;
+    pspStubPduCtxSessionReset(pThis);
+    int rc = pspStubPduCtxConnectReq(pThis, cBeaconsSent, true /*fResume*/, tsDeadlineNs);
+    if (!rc)
+    {
+        pThis->Stats.cSessionsResumed++;
+        rc = STS_ERR_PSP_PROXY_TARGET_RESET;
+    }
+    else
+        pThis->fSessionLost = true;
+
+    PSPPROXY_PROBE2(session_resume, cBeaconsSent, rc);
+    return rc;
+}
+
+
 int pspStubPduCtxCreate(PPSPSTUBPDUCTX phPduCtx, PCPSPPROXYPROV pProvIf, PSPPROXYPROVCTX hProvCtx,
                         PCPSPPROXYIOIF pProxyIoIf, PSPPROXYCTX hProxyCtx, void *pvUser)
 {
@@ -653,9 +1698,19 @@ int pspStubPduCtxCreate(PPSPSTUBPDUCTX phPduCtx, PCPSPPROXYPROV pProvIf, PSPPROX
         pThis->cBeaconsSeen  = 0;
         pThis->cCcds         = 1; /* To make validation succeed during the initial connect phase. */
         pThis->fConnect      = false;
+        pThis->fAutoResume   = true;
         pThis->rcReqLast     = STS_INF_SUCCESS;
+        pThis->iFdIrqEvt     = -1;
+        pThis->i32MsFwdMin   = INT32_MAX;
+        pThis->i32MsRevMin   = INT32_MAX;
+        for (uint32_t i = 0; i < ELEMENTS(pThis->acMsReqTimeout); i++)
+            pThis->acMsReqTimeout[i] = PSP_STUB_PDU_REQ_TIMEOUT_MS_DEFAULT;
         pspStubPduCtxRecvReset(pThis);
-        *phPduCtx = pThis;
+        rc = pspStubPduCtxLogMsgBufAlloc(pThis, PSP_STUB_PDU_LOG_MSG_LINE_SZ_DEFAULT);
+        if (!rc)
+            *phPduCtx = pThis;
+        else
+            free(pThis);
     }
     else
         rc = -1;
@@ -668,6 +1723,10 @@ void pspStubPduCtxDestroy(PSPSTUBPDUCTX hPduCtx)
 {
     PPSPSTUBPDUCTXINT pThis = hPduCtx;
 
+    if (pThis->iFdIrqEvt != -1)
+        close(pThis->iFdIrqEvt);
+    free(pThis->paIrqEvts);
+    free(pThis->pachLogMsgLine);
     free(pThis);
 }
 
@@ -676,45 +1735,19 @@ int pspStubPduCtxConnect(PSPSTUBPDUCTX hPduCtx, uint32_t cMillies)
 {
     PPSPSTUBPDUCTXINT pThis = hPduCtx;
 
-    pThis->cchLogMsgAvail = 0;
-    memset(&pThis->achLogMsg[0], 0, sizeof(pThis->achLogMsg));
+    pspStubPduCtxSessionReset(pThis);
 
-    /* Wait for a beacon PDU. */
-    /** @todo Timeout handling. */
+    /* Wait for a beacon PDU, the timeout covers the whole connection procedure. */
+    uint64_t tsDeadlineNs = pspStubPduCtxDeadlineFromMillies(cMillies);
     PCPSPSERIALPDUHDR pPdu = NULL;
     PCPSPSERIALBEACONNOT pBeacon = NULL;
     size_t cbBeacon = 0;
     int rc = pspStubPduCtxRecvId(pThis, PSPSERIALPDURRNID_NOTIFICATION_BEACON, &pPdu,
-                                 (void **)&pBeacon, &cbBeacon, cMillies);
+                                 (void **)&pBeacon, &cbBeacon, tsDeadlineNs);
     if (!rc)
     {
         if (cbBeacon == sizeof(PSPSERIALBEACONNOT))
-        {
-            /* Remember the beacon count for later when we successfully connected. */
-            uint32_t cBeaconsSeen = pBeacon->cBeaconsSent;
-
-            /* Send connect request. */
-            rc = pspStubPduCtxSend(pThis, 0 /*idCcd*/, PSPSERIALPDURRNID_REQUEST_CONNECT, NULL /*pvPayload*/, 0 /*cbPayload*/);
-            if (!rc)
-            {
-                PCPSPSERIALCONNECTRESP pConResp = NULL;
-                size_t cbConResp = 0;
-                rc = pspStubPduCtxRecvId(pThis, PSPSERIALPDURRNID_RESPONSE_CONNECT, &pPdu,
-                                         (void **)&pConResp, &cbConResp, cMillies);
-                if (!rc)
-                {
-                    pThis->cbPduMax       = pConResp->cbPduMax;
-                    pThis->cbScratch      = pConResp->cbScratch;
-                    pThis->PspAddrScratch = pConResp->PspAddrScratch;
-                    pThis->cSysSockets    = pConResp->cSysSockets;
-                    pThis->cCcdsPerSocket = pConResp->cCcdsPerSocket;
-                    pThis->cCcds          = pThis->cSysSockets * pThis->cCcdsPerSocket;
-                    pThis->fConnect       = true;
-                    pThis->cBeaconsSeen   = cBeaconsSeen;
-                    pThis->cPduRecvNext   = 1;
-                }
-            }
-        }
+            rc = pspStubPduCtxConnectReq(pThis, pBeacon->cBeaconsSent, false /*fResume*/, tsDeadlineNs);
         else
             rc = -1;
     }
@@ -742,6 +1775,162 @@ int pspStubPduCtxQueryLastReqRc(PSPSTUBPDUCTX hPduCtx, PSPSTS *pReqRcLast)
 }
 
 
+int pspStubPduCtxLogMsgBufSizeSet(PSPSTUBPDUCTX hPduCtx, size_t cbLogMsgBuf)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    if (!cbLogMsgBuf)
+        return STS_ERR_INVALID_PARAMETER;
+
+    /* Hand over anything pending before the buffers go away. */
+    if (pThis->cchLogMsgLine)
+        pspStubPduCtxLogMsgLineEmit(pThis, NULL /*pPdu*/, NULL /*pchTail*/, 0 /*cchTail*/);
+    pspStubPduCtxLogMsgBatchFlush(pThis);
+
+    return pspStubPduCtxLogMsgBufAlloc(pThis, cbLogMsgBuf);
+}
+
+
+int pspStubPduCtxLogMsgQueryDropped(PSPSTUBPDUCTX hPduCtx, uint64_t *pcbDropped)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    *pcbDropped = pThis->cbLogMsgDropped;
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxQueryCaps(PSPSTUBPDUCTX hPduCtx, PPSPPROXYCAPS pCaps)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    /* The provider derived capabilities stay valid while the session is down (waiting to be resumed for instance). */
+    if (!pThis->fConnect)
+        return 0;
+
+    pCaps->fCaps         |= PSPPROXY_CAPS_F_STUB;
+    pCaps->cbPduMax       = pThis->cbPduMax;
+    pCaps->cSysSockets    = pThis->cSysSockets;
+    pCaps->cCcdsPerSocket = pThis->cCcdsPerSocket;
+    return 0;
+}
+
+
+int pspStubPduCtxQueryStats(PSPSTUBPDUCTX hPduCtx, PPSPPROXYSTATS pStats)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+    PSPPROXYPROVSTATS ProvStats;
+
+    memcpy(pStats, &pThis->Stats, sizeof(*pStats));
+    pStats->cbLogMsgDropped = pThis->cbLogMsgDropped - pThis->cbLogMsgDroppedStatsBase;
+    pStats->cIrqEvtsDropped = pThis->cIrqEvtsDropped - pThis->cIrqEvtsDroppedStatsBase;
+    pStats->i32MsFwdMin     = pThis->i32MsFwdMin;
+    pStats->i32MsRevMin     = pThis->i32MsRevMin;
+    ProvStats.cRemotePolls  = UINT64_MAX;
+    if (   pThis->pProvIf->pfnCtxQueryStats
+        && !pThis->pProvIf->pfnCtxQueryStats(pThis->hProvCtx, &ProvStats))
+        pStats->cProvSyscalls = ProvStats.cSyscalls - pThis->cProvSyscallsStatsBase;
+    else
+        pStats->cProvSyscalls = UINT64_MAX;
+    if (ProvStats.cRemotePolls != UINT64_MAX)
+        pStats->cProvRemotePolls = ProvStats.cRemotePolls - pThis->cProvRemotePollsStatsBase;
+    else
+        pStats->cProvRemotePolls = UINT64_MAX;
+
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxQueryLastReqTiming(PSPSTUBPDUCTX hPduCtx, PPSPPROXYREQTIMING pTiming)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    *pTiming = pThis->LastReqTiming;
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxInterrupt(PSPSTUBPDUCTX hPduCtx)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    if (!pThis->pProvIf->pfnCtxInterrupt)
+        return -1;
+
+    return pThis->pProvIf->pfnCtxInterrupt(pThis->hProvCtx);
+}
+
+
+int pspStubPduCtxReqTimeoutSet(PSPSTUBPDUCTX hPduCtx, PSPPROXYREQ enmReq, uint32_t cMillies)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    if (   (uint32_t)enmReq > PSPPROXYREQ_COUNT
+        || !cMillies)
+        return STS_ERR_INVALID_PARAMETER;
+
+    if (enmReq == PSPPROXYREQ_COUNT)
+    {
+        for (uint32_t i = 0; i < ELEMENTS(pThis->acMsReqTimeout); i++)
+            pThis->acMsReqTimeout[i] = cMillies;
+    }
+    else
+        pThis->acMsReqTimeout[enmReq] = cMillies;
+
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxReqTimeoutQuery(PSPSTUBPDUCTX hPduCtx, PSPPROXYREQ enmReq, uint32_t *pcMillies)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    if ((uint32_t)enmReq >= PSPPROXYREQ_COUNT)
+        return STS_ERR_INVALID_PARAMETER;
+
+    *pcMillies = pspStubPduCtxReqTimeoutEffective(pThis, enmReq);
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxReqTimeoutAdaptiveSet(PSPSTUBPDUCTX hPduCtx, uint32_t cMilliesMin)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    pThis->cMsReqTimeoutAdaptiveMin = cMilliesMin;
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxAutoResumeSet(PSPSTUBPDUCTX hPduCtx, bool fAutoResume)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    pThis->fAutoResume = fAutoResume;
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxResetStats(PSPSTUBPDUCTX hPduCtx)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+    PSPPROXYPROVSTATS ProvStats;
+
+    memset(&pThis->Stats, 0, sizeof(pThis->Stats));
+    pThis->cbLogMsgDroppedStatsBase = pThis->cbLogMsgDropped;
+    pThis->cIrqEvtsDroppedStatsBase = pThis->cIrqEvtsDropped;
+    ProvStats.cRemotePolls          = UINT64_MAX;
+    if (   pThis->pProvIf->pfnCtxQueryStats
+        && !pThis->pProvIf->pfnCtxQueryStats(pThis->hProvCtx, &ProvStats))
+    {
+        pThis->cProvSyscallsStatsBase    = ProvStats.cSyscalls;
+        pThis->cProvRemotePollsStatsBase = ProvStats.cRemotePolls;
+    }
+
+    return STS_INF_SUCCESS;
+}
+
+
 int pspStubPduCtxPspSmnRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal)
 {
     PPSPSTUBPDUCTXINT pThis = hPduCtx;
@@ -758,7 +1947,7 @@ int pspStubPduCtxPspSmnRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t idCc
         Req.cbXfer       = cbVal;
         return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ,
-                                    &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                    &Req, sizeof(Req), pvVal, cbVal);
     }
 
     /* Slow path. */
@@ -773,7 +1962,7 @@ int pspStubPduCtxPspSmnRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t idCc
         Req.cbXfer       = cbThisRead;
         rc = pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ,
-                                    &Req, sizeof(Req), pbDst, cbThisRead, 10000);
+                                    &Req, sizeof(Req), pbDst, cbThisRead);
         if (!rc)
         {
             pbDst    += cbThisRead;
@@ -801,7 +1990,7 @@ int pspStubPduCtxPspSmnWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t idC
         Req.cbXfer       = cbVal;
         return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE,
                                       PSPSERIALPDURRNID_RESPONSE_PSP_SMN_WRITE,
-                                      &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                      &Req, sizeof(Req), pvVal, cbVal);
     }
 
     /* Slow path. */
@@ -816,7 +2005,7 @@ int pspStubPduCtxPspSmnWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t idC
         Req.cbXfer       = cbThisWrite;
         rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_SMN_WRITE,
-                                    &Req, sizeof(Req), pbSrc, cbThisWrite, 10000);
+                                    &Req, sizeof(Req), pbSrc, cbThisWrite);
         if (!rc)
         {
             pbSrc    += cbThisWrite;
@@ -844,7 +2033,7 @@ int pspStubPduCtxPspMemRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPspA
         Req.cbXfer       = cbRead;
         return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ,
-                                    &Req, sizeof(Req), pvBuf, cbRead, 10000);
+                                    &Req, sizeof(Req), pvBuf, cbRead);
     }
 
     /* Slow path. */
@@ -859,7 +2048,7 @@ int pspStubPduCtxPspMemRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPspA
         Req.cbXfer       = cbThisRead;
         rc = pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ,
                                   PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ,
-                                  &Req, sizeof(Req), pbBuf, cbThisRead, 10000);
+                                  &Req, sizeof(Req), pbBuf, cbThisRead);
         if (!rc)
         {
             pbBuf    += cbThisRead;
@@ -887,7 +2076,7 @@ int pspStubPduCtxPspMemWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPsp
         Req.cbXfer       = cbWrite;
         return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE,
                                       PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE,
-                                      &Req, sizeof(Req), pvBuf, cbWrite, 10000);
+                                      &Req, sizeof(Req), pvBuf, cbWrite);
     }
 
     /* Slow path. */
@@ -902,7 +2091,7 @@ int pspStubPduCtxPspMemWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPsp
         Req.cbXfer       = cbThisWrite;
         rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE,
-                                    &Req, sizeof(Req), pbBuf, cbThisWrite, 10000);
+                                    &Req, sizeof(Req), pbBuf, cbThisWrite);
         if (!rc)
         {
             pbBuf    += cbThisWrite;
@@ -924,7 +2113,7 @@ int pspStubPduCtxPspMmioRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPsp
     Req.cbXfer       = cbVal;
     return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MMIO_READ,
                                 PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_READ,
-                                &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                &Req, sizeof(Req), pvVal, cbVal);
 }
 
 
@@ -937,7 +2126,7 @@ int pspStubPduCtxPspMmioWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR uPs
     Req.cbXfer       = cbVal;
     return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE,
                                   PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_WRITE,
-                                  &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                  &Req, sizeof(Req), pvVal, cbVal);
 }
 
 
@@ -957,7 +2146,7 @@ int pspStubPduCtxPspX86MemRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR P
         Req.u32Pad0      = 0;
         return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ,
-                                    &Req, sizeof(Req), pvBuf, cbRead, 10000);
+                                    &Req, sizeof(Req), pvBuf, cbRead);
     }
 
     /* Slow path. */
@@ -972,7 +2161,7 @@ int pspStubPduCtxPspX86MemRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR P
         Req.cbXfer       = cbThisRead;
         rc = pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ,
                                   PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ,
-                                  &Req, sizeof(Req), pbBuf, cbThisRead, 10000);
+                                  &Req, sizeof(Req), pbBuf, cbThisRead);
         if (!rc)
         {
             pbBuf       += cbThisRead;
@@ -1001,7 +2190,7 @@ int pspStubPduCtxPspX86MemWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR
         Req.u32Pad0      = 0;
         return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE,
                                       PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE,
-                                      &Req, sizeof(Req), pvBuf, cbWrite, 10000);
+                                      &Req, sizeof(Req), pvBuf, cbWrite);
     }
 
     /* Slow path. */
@@ -1016,7 +2205,7 @@ int pspStubPduCtxPspX86MemWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR
         Req.cbXfer       = cbThisWrite;
         rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE,
-                                    &Req, sizeof(Req), pbBuf, cbThisWrite, 10000);
+                                    &Req, sizeof(Req), pbBuf, cbThisWrite);
         if (!rc)
         {
             pbBuf       += cbThisWrite;
@@ -1039,7 +2228,7 @@ int pspStubPduCtxPspX86MmioRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR
     Req.u32Pad0      = 0;
     return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_READ,
                                 PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_READ,
-                                &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                &Req, sizeof(Req), pvVal, cbVal);
 }
 
 
@@ -1053,7 +2242,7 @@ int pspStubPduCtxPspX86MmioWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, X86PADDR
     Req.u32Pad0      = 0;
     return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE,
                                   PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_WRITE,
-                                  &Req, sizeof(Req), pvVal, cbVal, 10000);
+                                  &Req, sizeof(Req), pvVal, cbVal);
 }
 
 
@@ -1116,7 +2305,7 @@ int pspStubPduCtxPspAddrXfer(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PCPSPPROXYAD
     if (cbData <= cbPduPayloadMax)
         return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER,
                                       PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER,
-                                      &Req, sizeof(Req), pvLocal, cbData, 10000);
+                                      &Req, sizeof(Req), pvLocal, cbData);
 
     const uint8_t *pbLocal = (const uint8_t *)pvLocal;
     int rc = 0;
@@ -1128,7 +2317,7 @@ int pspStubPduCtxPspAddrXfer(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PCPSPPROXYAD
         Req.cbXfer = cbThisXfer;
         rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER,
                                     PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER,
-                                    &Req, sizeof(Req), pbLocal, cbThisXfer, 10000);
+                                    &Req, sizeof(Req), pbLocal, cbThisXfer);
         if (!rc)
         {
             if (!(fFlags & PSPPROXY_CTX_ADDR_XFER_F_MEMSET))
@@ -1181,7 +2370,7 @@ int pspStubPduCtxPspCoProcWrite(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint8_t i
     Req.abPad[2] = 0;
     return pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_COPROC_WRITE,
                                   PSPSERIALPDURRNID_RESPONSE_COPROC_WRITE,
-                                  &Req, sizeof(Req), &u32Val, sizeof(u32Val), 10000);
+                                  &Req, sizeof(Req), &u32Val, sizeof(u32Val));
 }
 
 
@@ -1201,31 +2390,22 @@ int pspStubPduCtxPspCoProcRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint8_t id
     Req.abPad[2] = 0;
     return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_COPROC_READ,
                                 PSPSERIALPDURRNID_RESPONSE_COPROC_READ,
-                                &Req, sizeof(Req), pu32Val, sizeof(*pu32Val), 10000);
+                                &Req, sizeof(Req), pu32Val, sizeof(*pu32Val));
 }
 
 
 int pspStubPduCtxPspWaitForIrq(PSPSTUBPDUCTX hPduCtx, uint32_t *pidCcd, bool *pfIrq, bool *pfFirq, uint32_t cWaitMs)
 {
     PPSPSTUBPDUCTXINT pThis = hPduCtx;
+    PSPPROXYIRQEVT IrqEvt;
 
-    /* Check for a pending IRQ notification we received earlier. */
-    if (pThis->cCcdsIrqChange)
+    /* Check for a pending IRQ event we received earlier. */
+    if (pspStubPduCtxIrqEvtDequeue(pThis, &IrqEvt))
     {
-        for (uint32_t i = 0; i < PSP_CCDS_MAX; i++)
-        {
-            if (pThis->afPerCcdIrqNotRcvd[i])
-            {
-                *pidCcd = i;
-                *pfIrq = pThis->afPerCcdIrq[i];
-                *pfFirq = pThis->afPerCcdFirq[i];
-
-                /* Reset */
-                pThis->afPerCcdIrqNotRcvd[i] = false;
-                pThis->cCcdsIrqChange--;
-                return STS_INF_SUCCESS;
-            }
-        }
+        *pidCcd = IrqEvt.idCcd;
+        *pfIrq  = IrqEvt.fIrq;
+        *pfFirq = IrqEvt.fFirq;
+        return STS_INF_SUCCESS;
     }
 
     int rc = STS_INF_SUCCESS;
@@ -1233,20 +2413,18 @@ int pspStubPduCtxPspWaitForIrq(PSPSTUBPDUCTX hPduCtx, uint32_t *pidCcd, bool *pf
     {
         /* Nothing received, so wait for one. */
         PCPSPSERIALPDUHDR pPdu = NULL;
-        PCPSPSERIALIRQNOT pIrqNot;
-        size_t cbIrqNot;
         rc = pspStubPduCtxRecvId(pThis, PSPSERIALPDURRNID_NOTIFICATION_IRQ, &pPdu,
-                                 (void **)&pIrqNot, &cbIrqNot, cWaitMs);
+                                 NULL /*ppvPayload*/, NULL /*pcbPayload*/,
+                                 pspStubPduCtxDeadlineFromMillies(cWaitMs));
         if (!rc)
         {
-            if (cbIrqNot == sizeof(*pIrqNot))
+            rc = pspStubPduCtxIrqNotHandle(pThis, pPdu, &IrqEvt);
+            if (!rc)
             {
-                *pidCcd = pPdu->u.Fields.idCcd;
-                *pfIrq  = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_IRQ) ? true : false;
-                *pfFirq = (pIrqNot->fIrqCur & PSP_SERIAL_NOTIFICATION_IRQ_PENDING_FIQ) ? true : false;
+                *pidCcd = IrqEvt.idCcd;
+                *pfIrq  = IrqEvt.fIrq;
+                *pfFirq = IrqEvt.fFirq;
             }
-            else
-                rc = STS_ERR_INVALID_PARAMETER;
         }
         else if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
             rc = STS_ERR_PSP_PROXY_WFI_NO_CHANGE;
@@ -1258,6 +2436,54 @@ int pspStubPduCtxPspWaitForIrq(PSPSTUBPDUCTX hPduCtx, uint32_t *pidCcd, bool *pf
 }
 
 
+int pspStubPduCtxIrqEvtCallbackSet(PSPSTUBPDUCTX hPduCtx, PFNPSPPROXYIRQEVT pfnIrqEvt, void *pvUser)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    pThis->pfnIrqEvt    = pfnIrqEvt;
+    pThis->pvIrqEvtUser = pvUser;
+
+    /* Hand over everything which was queued so far. */
+    if (pfnIrqEvt)
+    {
+        PSPPROXYIRQEVT IrqEvt;
+        while (pspStubPduCtxIrqEvtDequeue(pThis, &IrqEvt))
+            pfnIrqEvt(pThis->hProxyCtx, pvUser, &IrqEvt);
+    }
+
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxIrqEvtQueryFd(PSPSTUBPDUCTX hPduCtx, int *piFd)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    if (pThis->iFdIrqEvt == -1)
+    {
+        pThis->iFdIrqEvt = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (pThis->iFdIrqEvt == -1)
+            return -1;
+
+        /* Make the fd reflect events queued before it was created. */
+        if (pThis->cIrqEvts)
+            pspStubPduCtxIrqEvtSignal(pThis);
+    }
+
+    *piFd = pThis->iFdIrqEvt;
+    return STS_INF_SUCCESS;
+}
+
+
+int pspStubPduCtxIrqEvtQueryDropped(PSPSTUBPDUCTX hPduCtx, uint64_t *pcEvtsDropped)
+{
+    PPSPSTUBPDUCTXINT pThis = hPduCtx;
+
+    *pcEvtsDropped = pThis->cIrqEvtsDropped;
+    return STS_INF_SUCCESS;
+}
+
+
 int pspStubPduCtxPspCodeModLoad(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, const void *pvCm, size_t cbCm)
 {
     PPSPSTUBPDUCTXINT pThis = hPduCtx;
@@ -1267,7 +2493,7 @@ int pspStubPduCtxPspCodeModLoad(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, const voi
     Req.u32Pad0   = 0; /* idInBuf */
     int rc = pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_LOAD_CODE_MOD,
                                   PSPSERIALPDURRNID_RESPONSE_LOAD_CODE_MOD,
-                                  &Req, sizeof(Req), NULL /*pvResp*/, 0 /*cbResp*/, 10000);
+                                  &Req, sizeof(Req), NULL /*pvResp*/, 0 /*cbResp*/);
     if (!rc)
     {
         /* Load the code module in chunks so we don't exceed the maximum PDU size. */
@@ -1288,7 +2514,7 @@ int pspStubPduCtxPspCodeModLoad(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, const voi
 
             rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE,
                                         PSPSERIALPDURRNID_RESPONSE_INPUT_BUF_WRITE,
-                                        &InBufWrReq, sizeof(InBufWrReq), pbCm, cbThisSend, 10000);
+                                        &InBufWrReq, sizeof(InBufWrReq), pbCm, cbThisSend);
 
             cbCm -= cbThisSend;
             pbCm += cbThisSend;
@@ -1309,9 +2535,10 @@ int pspStubPduCtxPspCodeModExec(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t
     Req.u32Arg1 = u32Arg1;
     Req.u32Arg2 = u32Arg2;
     Req.u32Arg3 = u32Arg3;
+    uint64_t tsDeadlineNs = cMillies == UINT32_MAX ? UINT64_MAX : pspStubPduCtxDeadlineFromMillies(cMillies);
     int rc = pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_EXEC_CODE_MOD,
                                   PSPSERIALPDURRNID_RESPONSE_EXEC_CODE_MOD,
-                                  &Req, sizeof(Req), NULL /*pvResp*/, 0 /*cbResp*/, 10000);
+                                  &Req, sizeof(Req), NULL /*pvResp*/, 0 /*cbResp*/);
     if (!rc)
     {
         /*
@@ -1324,7 +2551,7 @@ int pspStubPduCtxPspCodeModExec(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t
             PCPSPSERIALEXECCMFINISHEDNOT pExecNot = NULL;
             size_t cbExecNot = 0;
             rc = pspStubPduCtxRecvId(pThis, PSPSERIALPDURRNID_NOTIFICATION_CODE_MOD_EXEC_FINISHED, &pPdu,
-                                     (void **)&pExecNot, &cbExecNot, 1);
+                                     (void **)&pExecNot, &cbExecNot, pspStubPduCtxDeadlineFromMillies(1));
             if (!rc)
             {
                 if (pExecNot)
@@ -1335,7 +2562,14 @@ int pspStubPduCtxPspCodeModExec(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t
             }
             else if (rc == STS_ERR_PSP_PROXY_TIMEOUT)
             {
-                /* Nothing received for now, check input. */
+                /* Nothing received for now, give up if the code module exceeded its time or check input. */
+                if (pspStubPduCtxTimeNs() >= tsDeadlineNs)
+                {
+                    pspStubPduCtxAbandonedAdd(pThis, PSPSERIALPDURRNID_NOTIFICATION_CODE_MOD_EXEC_FINISHED,
+                                              0 /*cPdusReq*/, PSP_STUB_PDU_ABANDONED_EXPIRE_MS_MIN);
+                    break;
+                }
+
                 rc = 0;
                 if (   pThis->pProxyIoIf
                     && pThis->pProxyIoIf->pfnInBufPeek)
@@ -1355,7 +2589,7 @@ int pspStubPduCtxPspCodeModExec(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint32_t
                             InBufWrReq.u32Pad0 = 0;
                             rc = pspStubPduCtxReqRespWr(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE,
                                                         PSPSERIALPDURRNID_RESPONSE_INPUT_BUF_WRITE,
-                                                        &InBufWrReq, sizeof(InBufWrReq), &abBuf[0], cbThisRead, 10000);
+                                                        &InBufWrReq, sizeof(InBufWrReq), &abBuf[0], cbThisRead);
                         }
                     }
                 }
@@ -1379,7 +2613,6 @@ int pspStubPduCtxBranchTo(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPPADDR PspAdd
 
     return pspStubPduCtxReqResp(pThis, idCcd, PSPSERIALPDURRNID_REQUEST_BRANCH_TO,
                                 PSPSERIALPDURRNID_RESPONSE_BRANCH_TO,
-                                &Req, sizeof(Req), NULL /*pvRespPayload*/, 0 /*cbRespPayload*/,
-                                10000);
+                                &Req, sizeof(Req), NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
 }
 
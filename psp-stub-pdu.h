@@ -94,6 +94,117 @@ int pspStubPduCtxQueryInfo(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, PSPADDR *pPspA
 int pspStubPduCtxQueryLastReqRc(PSPSTUBPDUCTX hPduCtx, PSPSTS *pReqRcLast);
 
 
+/**
+ * Sets the size of the log message line assembly buffer.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   cbLogMsgBuf             Size of the line assembly buffer in bytes.
+ */
+int pspStubPduCtxLogMsgBufSizeSet(PSPSTUBPDUCTX hPduCtx, size_t cbLogMsgBuf);
+
+
+/**
+ * Queries the number of log message bytes dropped so far.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pcbDropped              Where to store the number of bytes dropped.
+ */
+int pspStubPduCtxLogMsgQueryDropped(PSPSTUBPDUCTX hPduCtx, uint64_t *pcbDropped);
+
+
+/**
+ * Queries the statistics collected so far.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pStats                  Where to store the statistics.
+ */
+int pspStubPduCtxQueryStats(PSPSTUBPDUCTX hPduCtx, PPSPPROXYSTATS pStats);
+
+
+/**
+ * Fills in the stub related capabilities, leaving the provider derived ones untouched
+ * if there is no connection to the stub.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pCaps                   The capabilities to update.
+ */
+int pspStubPduCtxQueryCaps(PSPSTUBPDUCTX hPduCtx, PPSPPROXYCAPS pCaps);
+
+
+/**
+ * Queries the timing information of the last request which received a response.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pTiming                 Where to store the timing information.
+ */
+int pspStubPduCtxQueryLastReqTiming(PSPSTUBPDUCTX hPduCtx, PPSPPROXYREQTIMING pTiming);
+
+
+/**
+ * Interrupts the request currently waiting for a response.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ */
+int pspStubPduCtxInterrupt(PSPSTUBPDUCTX hPduCtx);
+
+
+/**
+ * Sets the timeout for the given request type.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   enmReq                  The request type, PSPPROXYREQ_COUNT to set it for all request types.
+ * @param   cMillies                The timeout in milliseconds.
+ */
+int pspStubPduCtxReqTimeoutSet(PSPSTUBPDUCTX hPduCtx, PSPPROXYREQ enmReq, uint32_t cMillies);
+
+
+/**
+ * Queries the timeout currently in effect for the given request type.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   enmReq                  The request type.
+ * @param   pcMillies               Where to store the timeout in milliseconds.
+ */
+int pspStubPduCtxReqTimeoutQuery(PSPSTUBPDUCTX hPduCtx, PSPPROXYREQ enmReq, uint32_t *pcMillies);
+
+
+/**
+ * Enables or disables adaptive request timeouts.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   cMilliesMin             Lower bound of the adaptive timeouts in milliseconds, 0 to disable.
+ */
+int pspStubPduCtxReqTimeoutAdaptiveSet(PSPSTUBPDUCTX hPduCtx, uint32_t cMilliesMin);
+
+
+/**
+ * Enables or disables resuming the session automatically when the target resets.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   fAutoResume             Flag whether to resume the session automatically.
+ */
+int pspStubPduCtxAutoResumeSet(PSPSTUBPDUCTX hPduCtx, bool fAutoResume);
+
+
+/**
+ * Resets the statistics.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ */
+int pspStubPduCtxResetStats(PSPSTUBPDUCTX hPduCtx);
+
+
 /**
  * Reads the register at the given SMN address.
  *
@@ -291,6 +402,37 @@ int pspStubPduCtxPspCoProcRead(PSPSTUBPDUCTX hPduCtx, uint32_t idCcd, uint8_t id
 int pspStubPduCtxPspWaitForIrq(PSPSTUBPDUCTX hPduCtx, uint32_t *pidCcd, bool *pfIrq, bool *pfFirq, uint32_t cWaitMs);
 
 
+/**
+ * Registers a callback for IRQ events.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pfnIrqEvt               The callback to register, NULL to queue events.
+ * @param   pvUser                  Opaque user data to pass to the callback.
+ */
+int pspStubPduCtxIrqEvtCallbackSet(PSPSTUBPDUCTX hPduCtx, PFNPSPPROXYIRQEVT pfnIrqEvt, void *pvUser);
+
+
+/**
+ * Returns the eventfd signalled when IRQ events are queued, creating it on first use.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   piFd                    Where to store the file descriptor.
+ */
+int pspStubPduCtxIrqEvtQueryFd(PSPSTUBPDUCTX hPduCtx, int *piFd);
+
+
+/**
+ * Queries the number of IRQ events dropped so far.
+ *
+ * @returns Status code.
+ * @param   hPduCtx                 The PDU context handle.
+ * @param   pcEvtsDropped           Where to store the number of events dropped.
+ */
+int pspStubPduCtxIrqEvtQueryDropped(PSPSTUBPDUCTX hPduCtx, uint64_t *pcEvtsDropped);
+
+
 /**
  * Loads a code module on the given PSP.
  *
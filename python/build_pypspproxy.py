@@ -29,21 +29,164 @@ typedef struct PSPPROXYCTXINT *PSPPROXYCTX;
 typedef PSPPROXYCTX *PPSPPROXYCTX;
 typedef uint64_t R0PTR;
 
+typedef struct PSPPROXYLOGMSG
+{
+    uint32_t idCcd;
+    uint32_t tsMillies;
+    size_t cchMsg;
+    const char *pszMsg;
+} PSPPROXYLOGMSG;
+typedef const PSPPROXYLOGMSG *PCPSPPROXYLOGMSG;
+
 typedef struct PSPPROXYIOIF
 {
     void (*pfnLogMsg) (PSPPROXYCTX hCtx, void *pvUser, const char *pszMsg);
     int (*pfnOutBufWrite) (PSPPROXYCTX hCtx, void *pvUser, uint32_t idOutBuf, const void *pvBuf, size_t cbBuf);
     size_t (*pfnInBufPeek) (PSPPROXYCTX hCtx, void *pvUser, uint32_t idInBuf);
     int (*pfnInBufRead) (PSPPROXYCTX hCtx, void *pvUser, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead);
+    void (*pfnLogMsgBatch) (PSPPROXYCTX hCtx, void *pvUser, PCPSPPROXYLOGMSG paMsgs, uint32_t cMsgs);
 
 } PSPPROXYIOIF;
 typedef PSPPROXYIOIF *PPSPPROXYIOIF;
 typedef const PSPPROXYIOIF *PCPSPPROXYIOIF;
 
+typedef enum PSPPROXYREQ
+{
+    PSPPROXYREQ_CONNECT = 0,
+    PSPPROXYREQ_PSP_SMN_READ,
+    PSPPROXYREQ_PSP_SMN_WRITE,
+    PSPPROXYREQ_PSP_MEM_READ,
+    PSPPROXYREQ_PSP_MEM_WRITE,
+    PSPPROXYREQ_PSP_MMIO_READ,
+    PSPPROXYREQ_PSP_MMIO_WRITE,
+    PSPPROXYREQ_PSP_X86_MEM_READ,
+    PSPPROXYREQ_PSP_X86_MEM_WRITE,
+    PSPPROXYREQ_PSP_X86_MMIO_READ,
+    PSPPROXYREQ_PSP_X86_MMIO_WRITE,
+    PSPPROXYREQ_PSP_DATA_XFER,
+    PSPPROXYREQ_COPROC_READ,
+    PSPPROXYREQ_COPROC_WRITE,
+    PSPPROXYREQ_LOAD_CODE_MOD,
+    PSPPROXYREQ_EXEC_CODE_MOD,
+    PSPPROXYREQ_INPUT_BUF_WRITE,
+    PSPPROXYREQ_BRANCH_TO,
+    PSPPROXYREQ_COUNT,
+    PSPPROXYREQ_32BIT_HACK = 0x7fffffff
+} PSPPROXYREQ;
+
+#define PSPPROXY_STATS_HIST_BUCKETS 280
+
+typedef struct PSPPROXYSTATSHIST
+{
+    uint64_t acSamples[PSPPROXY_STATS_HIST_BUCKETS];
+} PSPPROXYSTATSHIST;
+typedef const PSPPROXYSTATSHIST *PCPSPPROXYSTATSHIST;
+
+typedef struct PSPPROXYSTATSPDUS
+{
+    uint64_t cPdus;
+    uint64_t cbPdus;
+} PSPPROXYSTATSPDUS;
+
+typedef struct PSPPROXYSTATSREQ
+{
+    PSPPROXYSTATSPDUS Sent;
+    PSPPROXYSTATSPDUS Recv;
+    uint64_t cErrors;
+    uint64_t cTimeouts;
+    uint64_t cNsTotal;
+    uint64_t cNsMax;
+    uint64_t cNsHostTxTotal;
+    uint64_t cMsFwdExcessTotal;
+    PSPPROXYSTATSHIST HistNs;
+} PSPPROXYSTATSREQ;
+
+typedef struct PSPPROXYSTATS
+{
+    PSPPROXYSTATSPDUS Sent;
+    PSPPROXYSTATSPDUS Recv;
+    PSPPROXYSTATSPDUS NotBeacon;
+    PSPPROXYSTATSPDUS NotLogMsg;
+    PSPPROXYSTATSPDUS NotOutBuf;
+    PSPPROXYSTATSPDUS NotCodeModExecFinished;
+    PSPPROXYSTATSPDUS NotIrq;
+    uint64_t cHdrErrors;
+    uint64_t cChkSumErrors;
+    uint64_t cbResyncSkipped;
+    uint64_t cbLogMsgDropped;
+    uint64_t cIrqEvtsDropped;
+    uint64_t cTimeouts;
+    uint64_t cInterrupts;
+    uint64_t cLateRespsDropped;
+    uint64_t cTargetResets;
+    uint64_t cSessionsResumed;
+    uint64_t cReqsReplayed;
+    uint64_t cProvPolls;
+    uint64_t cProvPeeks;
+    uint64_t cProvReads;
+    uint64_t cProvWrites;
+    uint64_t cProvSyscalls;
+    uint64_t cProvRemotePolls;
+    int32_t i32MsFwdMin;
+    int32_t i32MsRevMin;
+    PSPPROXYSTATSREQ aReqs[PSPPROXYREQ_COUNT];
+} PSPPROXYSTATS;
+typedef PSPPROXYSTATS *PPSPPROXYSTATS;
+
+typedef struct PSPPROXYREQTIMING
+{
+    PSPPROXYREQ enmReq;
+    uint32_t tsHostMillies;
+    uint32_t tsTargetMillies;
+    uint32_t cMsFwdExcess;
+    uint64_t tsHostStartNs;
+    uint64_t cNsHostTx;
+    uint64_t cNsRtt;
+} PSPPROXYREQTIMING;
+typedef PSPPROXYREQTIMING *PPSPPROXYREQTIMING;
+
+#define PSPPROXY_CAPS_F_STUB                    0x00000001
+#define PSPPROXY_CAPS_F_PSP_NATIVE              0x00000002
+#define PSPPROXY_CAPS_F_PSP_SVC_CALL            0x00000004
+#define PSPPROXY_CAPS_F_X86_SMN                 0x00000008
+#define PSPPROXY_CAPS_F_X86_MEM                 0x00000010
+#define PSPPROXY_CAPS_F_X86_PHYS_MEM            0x00000020
+#define PSPPROXY_CAPS_F_EMU                     0x00000040
+#define PSPPROXY_CAPS_F_INTERRUPT               0x00000080
+#define PSPPROXY_CAPS_F_WRITEV                  0x00000100
+#define PSPPROXY_CAPS_F_PROV_STATS              0x00000200
+#define PSPPROXY_CAPS_F_ZERO_COPY               0x00010000
+#define PSPPROXY_CAPS_F_ASYNC                   0x00020000
+#define PSPPROXY_CAPS_F_BATCHING                0x00040000
+#define PSPPROXY_CAPS_F_SIMULATED               0x00080000
+
+typedef struct PSPPROXYCAPS
+{
+    uint32_t fCaps;
+    uint32_t cbPduMax;
+    uint32_t cSysSockets;
+    uint32_t cCcdsPerSocket;
+    const char *pszProvId;
+} PSPPROXYCAPS;
+typedef PSPPROXYCAPS *PPSPPROXYCAPS;
+
+int PSPProxyProvPluginLoad(const char *pszPath);
 int PSPProxyCtxCreate(PPSPPROXYCTX phCtx, const char *pszDevice, PCPSPPROXYIOIF pIoIf, void *pvUser);
 void PSPProxyCtxDestroy(PSPPROXYCTX hCtx);
 int PSPProxyCtxPspCcdSet(PSPPROXYCTX hCtx, uint32_t idCcd);
 int PSPProxyCtxQueryLastReqRc(PSPPROXYCTX hCtx, PSPSTS *pReqRcLast);
+int PSPProxyCtxLogMsgBufSizeSet(PSPPROXYCTX hCtx, size_t cbLogMsgBuf);
+int PSPProxyCtxLogMsgQueryDropped(PSPPROXYCTX hCtx, uint64_t *pcbDropped);
+int PSPProxyCtxQueryStats(PSPPROXYCTX hCtx, PPSPPROXYSTATS pStats);
+int PSPProxyCtxQueryCaps(PSPPROXYCTX hCtx, PPSPPROXYCAPS pCaps);
+int PSPProxyCtxQueryLastReqTiming(PSPPROXYCTX hCtx, PPSPPROXYREQTIMING pTiming);
+int PSPProxyCtxInterrupt(PSPPROXYCTX hCtx);
+int PSPProxyCtxReqTimeoutSet(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t cMillies);
+int PSPProxyCtxReqTimeoutQuery(PSPPROXYCTX hCtx, PSPPROXYREQ enmReq, uint32_t *pcMillies);
+int PSPProxyCtxReqTimeoutAdaptiveSet(PSPPROXYCTX hCtx, uint32_t cMilliesMin);
+int PSPProxyCtxAutoResumeSet(PSPPROXYCTX hCtx, bool fAutoResume);
+int PSPProxyCtxResetStats(PSPPROXYCTX hCtx);
+uint64_t PSPProxyStatsHistPercentileNs(PCPSPPROXYSTATSHIST pHist, double dPercentile);
 int PSPProxyCtxPspSmnRead(PSPPROXYCTX hCtx, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, void *pvVal);
 int PSPProxyCtxPspSmnWrite(PSPPROXYCTX hCtx, uint32_t idCcdTgt, SMNADDR uSmnAddr, uint32_t cbVal, const void *pvVal);
 int PSPProxyCtxPspMemRead(PSPPROXYCTX hCtx, PSPADDR uPspAddr, void *pvBuf, uint32_t cbRead);
@@ -62,6 +205,7 @@ int PSPProxyCtxX86SmnRead(PSPPROXYCTX hCtx, uint16_t idNode, SMNADDR uSmnAddr, u
 int PSPProxyCtxX86SmnWrite(PSPPROXYCTX hCtx, uint16_t idNode, SMNADDR uSmnAddr, uint32_t cbVal, const void *pvVal);
 int PSPProxyCtxX86MemAlloc(PSPPROXYCTX hCtx, uint32_t cbMem, R0PTR *pR0KernVirtual, X86PADDR *pPhysX86Addr);
 int PSPProxyCtxX86MemFree(PSPPROXYCTX hCtx, R0PTR R0KernVirtual);
+int PSPProxyCtxX86MemPoolRegionSizeSet(PSPPROXYCTX hCtx, size_t cbRegion);
 int PSPProxyCtxX86MemRead(PSPPROXYCTX hCtx, void *pvDst, R0PTR R0KernVirtualSrc, uint32_t cbRead);
 int PSPProxyCtxX86MemWrite(PSPPROXYCTX hCtx, R0PTR R0KernVirtualDst, const void *pvSrc, uint32_t cbWrite);
 int PSPProxyCtxX86PhysMemRead(PSPPROXYCTX hCtx, void *pvDst, X86PADDR PhysX86AddrSrc, uint32_t cbRead);
@@ -31,6 +31,121 @@ class PSPProxy(object):
             return pVal[0];
         return self.rcLibLast;
 
+    def setLogMsgBufSize(self, cbLogMsgBuf):
+        self.rcLibLast = lib.PSPProxyCtxLogMsgBufSizeSet(self.hCtx, cbLogMsgBuf);
+        return self.rcLibLast;
+
+    def queryLogMsgDropped(self):
+        pVal = ffi.new("uint64_t *");
+        self.rcLibLast = lib.PSPProxyCtxLogMsgQueryDropped(self.hCtx, pVal);
+        if self.rcLibLast == 0:
+            return (0, pVal[0]);
+        else:
+            return (self.rcLibLast, 0);
+
+    def queryStats(self):
+        pStats = ffi.new("PPSPPROXYSTATS");
+        self.rcLibLast = lib.PSPProxyCtxQueryStats(self.hCtx, pStats);
+        if self.rcLibLast != 0:
+            return (self.rcLibLast, None);
+
+        dStats = { };
+        for sPdus in ('Sent', 'Recv', 'NotBeacon', 'NotLogMsg', 'NotOutBuf', 'NotCodeModExecFinished', 'NotIrq'):
+            oPdus = getattr(pStats, sPdus);
+            dStats[sPdus] = { 'cPdus': oPdus.cPdus, 'cbPdus': oPdus.cbPdus };
+        for sCnt in ('cHdrErrors', 'cChkSumErrors', 'cbResyncSkipped', 'cbLogMsgDropped', 'cIrqEvtsDropped',
+                     'cTimeouts', 'cInterrupts', 'cLateRespsDropped', 'cTargetResets', 'cSessionsResumed', 'cReqsReplayed',
+                     'cProvPolls', 'cProvPeeks', 'cProvReads', 'cProvWrites'):
+            dStats[sCnt] = getattr(pStats, sCnt);
+        dStats['cProvSyscalls'] = pStats.cProvSyscalls if pStats.cProvSyscalls != 0xffffffffffffffff else None;
+        dStats['cProvRemotePolls'] = pStats.cProvRemotePolls if pStats.cProvRemotePolls != 0xffffffffffffffff else None;
+        dStats['i32MsFwdMin']   = pStats.i32MsFwdMin if pStats.i32MsFwdMin != 0x7fffffff else None;
+        dStats['i32MsRevMin']   = pStats.i32MsRevMin if pStats.i32MsRevMin != 0x7fffffff else None;
+
+        dReqs = { };
+        for sReq in dir(lib):
+            if not sReq.startswith('PSPPROXYREQ_') or sReq in ('PSPPROXYREQ_COUNT', 'PSPPROXYREQ_32BIT_HACK'):
+                continue;
+            oReq = pStats.aReqs[getattr(lib, sReq)];
+            if oReq.Sent.cPdus == 0:
+                continue;
+            dReqs[sReq[len('PSPPROXYREQ_'):].lower()] = {
+                'cReqs':     oReq.Sent.cPdus,
+                'cbSent':    oReq.Sent.cbPdus,
+                'cbRecv':    oReq.Recv.cbPdus,
+                'cErrors':   oReq.cErrors,
+                'cTimeouts': oReq.cTimeouts,
+                'cNsTotal':  oReq.cNsTotal,
+                'cNsMax':    oReq.cNsMax,
+                'cNsHostTxTotal':    oReq.cNsHostTxTotal,
+                'cMsFwdExcessTotal': oReq.cMsFwdExcessTotal,
+                'cNsP50':    lib.PSPProxyStatsHistPercentileNs(ffi.addressof(oReq.HistNs), 50.0),
+                'cNsP99':    lib.PSPProxyStatsHistPercentileNs(ffi.addressof(oReq.HistNs), 99.0),
+                'cNsP999':   lib.PSPProxyStatsHistPercentileNs(ffi.addressof(oReq.HistNs), 99.9),
+            };
+        dStats['Reqs'] = dReqs;
+        return (0, dStats);
+
+    def queryCaps(self):
+        pCaps = ffi.new("PPSPPROXYCAPS");
+        self.rcLibLast = lib.PSPProxyCtxQueryCaps(self.hCtx, pCaps);
+        if self.rcLibLast != 0:
+            return (self.rcLibLast, None);
+
+        asCaps = [ ];
+        for sCap in dir(lib):
+            if sCap.startswith('PSPPROXY_CAPS_F_') and pCaps.fCaps & getattr(lib, sCap):
+                asCaps.append(sCap[len('PSPPROXY_CAPS_F_'):].lower());
+
+        return (0, { 'fCaps':          pCaps.fCaps,
+                     'asCaps':         asCaps,
+                     'cbPduMax':       pCaps.cbPduMax,
+                     'cSysSockets':    pCaps.cSysSockets,
+                     'cCcdsPerSocket': pCaps.cCcdsPerSocket,
+                     'sProvId':        ffi.string(pCaps.pszProvId).decode() });
+
+    def queryLastReqTiming(self):
+        pTiming = ffi.new("PPSPPROXYREQTIMING");
+        self.rcLibLast = lib.PSPProxyCtxQueryLastReqTiming(self.hCtx, pTiming);
+        if self.rcLibLast != 0:
+            return (self.rcLibLast, None);
+
+        return (0, { 'enmReq':          pTiming.enmReq,
+                     'tsHostMillies':   pTiming.tsHostMillies,
+                     'tsTargetMillies': pTiming.tsTargetMillies,
+                     'cMsFwdExcess':    pTiming.cMsFwdExcess,
+                     'tsHostStartNs':   pTiming.tsHostStartNs,
+                     'cNsHostTx':       pTiming.cNsHostTx,
+                     'cNsRtt':          pTiming.cNsRtt });
+
+    def interrupt(self):
+        self.rcLibLast = lib.PSPProxyCtxInterrupt(self.hCtx);
+        return self.rcLibLast;
+
+    def setReqTimeout(self, enmReq, cMillies):
+        self.rcLibLast = lib.PSPProxyCtxReqTimeoutSet(self.hCtx, enmReq, cMillies);
+        return self.rcLibLast;
+
+    def queryReqTimeout(self, enmReq):
+        pVal = ffi.new("uint32_t *");
+        self.rcLibLast = lib.PSPProxyCtxReqTimeoutQuery(self.hCtx, enmReq, pVal);
+        if self.rcLibLast == 0:
+            return (0, pVal[0]);
+        else:
+            return (self.rcLibLast, 0);
+
+    def setReqTimeoutAdaptive(self, cMilliesMin):
+        self.rcLibLast = lib.PSPProxyCtxReqTimeoutAdaptiveSet(self.hCtx, cMilliesMin);
+        return self.rcLibLast;
+
+    def setAutoResume(self, fAutoResume):
+        self.rcLibLast = lib.PSPProxyCtxAutoResumeSet(self.hCtx, fAutoResume);
+        return self.rcLibLast;
+
+    def resetStats(self):
+        self.rcLibLast = lib.PSPProxyCtxResetStats(self.hCtx);
+        return self.rcLibLast;
+
     def readSmn(self, idCcdTgt, uSmnAddr, cbVal):
         pVal = None;
         if cbVal == 1: